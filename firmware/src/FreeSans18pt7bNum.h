@@ -7,11 +7,13 @@
  * the original license file was retreived and put beside this file under the name
  * 'Copying-Adafruit-GFX-Library.txt'. The file was retreived from the above GitHub
  * repository on the 'master' branch, commit 91d916deeb75263582a2456cb211ebdaf06b840b.
+ * Unlike the original, the tables aren't PROGMEM: every gauge value is drawn with it, it's kept
+ * in the DTCM (see placement.h).
 */
 
 #include <gfxfont.h>
 
-const uint8_t FreeSans18pt7bBitmapsNum[] PROGMEM = {
+const uint8_t FreeSans18pt7bBitmapsNum[] = {
     0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xE9, 0x20, 0x3F, 0xFC, 0xE3, 0xF1,
     0xF8, 0xFC, 0x7E, 0x3F, 0x1F, 0x8E, 0x82, 0x41, 0x00, 0x01, 0xC3, 0x80,
     0x38, 0x70, 0x06, 0x0E, 0x00, 0xC1, 0x80, 0x38, 0x70, 0x07, 0x0E, 0x0F,
@@ -92,7 +94,7 @@ const uint8_t FreeSans18pt7bBitmapsNum[] PROGMEM = {
     0x70, 0x0E, 0x70, 0x1C, 0x78, 0x3C, 0x3F, 0xF8, 0x1F, 0xF0, 0x07, 0xC0,
 };
 
-const GFXglyph FreeSans18pt7bGlyphsNum[] PROGMEM = {
+const GFXglyph FreeSans18pt7bGlyphsNum[] = {
     {0, 0, 0, 9, 0, 1},         // 0x20 ' '
     {0, 3, 26, 12, 4, -25},     // 0x21 '!'
     {10, 9, 9, 12, 1, -24},     // 0x22 '"'
@@ -121,7 +123,7 @@ const GFXglyph FreeSans18pt7bGlyphsNum[] PROGMEM = {
     {886, 16, 25, 19, 1, -24},  // 0x39 '9'
 };
 
-const GFXfont FreeSans18pt7bNum PROGMEM = {(uint8_t *)FreeSans18pt7bBitmapsNum,
+const GFXfont FreeSans18pt7bNum = {(uint8_t *)FreeSans18pt7bBitmapsNum,
                                         (GFXglyph *)FreeSans18pt7bGlyphsNum, 0x20,
                                         0x7E, 42};
 
@@ -0,0 +1,206 @@
+/*
+ * Hardware threshold alarms for the RX-8 Ashtray Gauges project, see adc_compare.h.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#include <Arduino.h>
+#include "adc_compare.h"
+#include "adc_pair.h"
+#if !defined(__IMXRT1062__)
+#include "host_sim.h"
+#endif
+
+// No channel is being watched
+#define ADC_COMPARE_IDLE 0xFF
+
+// One watched channel
+typedef struct {
+    uint8_t pin;
+    AdcCompareConfig config;
+    uint32_t holdoff_until_ms;  // millis() before which the channel isn't watched, after an alarm
+} AdcCompareChannel;
+
+static AdcCompareChannel compareChannels[ADC_COMPARE_CHANNEL_COUNT];
+static uint8_t watchedChannel = ADC_COMPARE_IDLE;
+static uint8_t nextChannel = 0;
+static AdcCompareStats compareStats;
+static void (*alarmCallback)(uint8_t channel, uint16_t counts, uint32_t nowUs) = NULL;
+static IntervalTimer dwellTimer;
+
+void adcCompareEncode(uint16_t low, uint16_t high, AdcCompareConfig &config)
+{
+    config.gc = 0;
+    config.cv1 = 0;
+    config.cv2 = 0;
+
+    if (low != ADC_COMPARE_NO_LIMIT && high != ADC_COMPARE_NO_LIMIT && low < high) {
+        // Outside range, inclusive: result >= CV1 or result <= CV2, with CV1 > CV2
+        config.gc = ADC_COMPARE_GC_ACFE | ADC_COMPARE_GC_ACFGT | ADC_COMPARE_GC_ACREN;
+        config.cv1 = high;
+        config.cv2 = low;
+    } else if (low != ADC_COMPARE_NO_LIMIT && high != ADC_COMPARE_NO_LIMIT) {
+        // The limits overlap, every result is an alarm: result < 4096
+        config.gc = ADC_COMPARE_GC_ACFE;
+        config.cv1 = 0xFFF;
+    } else if (high != ADC_COMPARE_NO_LIMIT) {
+        // Greater than or equal: result >= CV1
+        config.gc = ADC_COMPARE_GC_ACFE | ADC_COMPARE_GC_ACFGT;
+        config.cv1 = high;
+    } else if (low != ADC_COMPARE_NO_LIMIT) {
+        // Less than: result < CV1
+        config.gc = ADC_COMPARE_GC_ACFE;
+        config.cv1 = low + 1;
+    }
+}
+
+bool adcCompareMatch(const AdcCompareConfig &config, uint16_t result)
+{
+    bool greater = config.gc & ADC_COMPARE_GC_ACFGT;
+
+    if (!(config.gc & ADC_COMPARE_GC_ACFE))
+        return true;
+
+    if (!(config.gc & ADC_COMPARE_GC_ACREN))
+        return greater ? result >= config.cv1 : result < config.cv1;
+
+    if (config.cv1 <= config.cv2) {
+        // Inside range inclusive, or outside range not inclusive
+        return greater ? result >= config.cv1 && result <= config.cv2 : result < config.cv1 || result > config.cv2;
+    }
+    // Outside range inclusive, or inside range not inclusive
+    return greater ? result >= config.cv1 || result <= config.cv2 : result < config.cv1 && result > config.cv2;
+}
+
+// A conversion of the watched channel is outside its window, called from an interrupt
+static void raiseAlarm(uint16_t counts, uint32_t nowUs)
+{
+    uint8_t channel = watchedChannel;
+
+    watchedChannel = ADC_COMPARE_IDLE;
+    if (channel == ADC_COMPARE_IDLE)
+        return;
+
+    compareChannels[channel].holdoff_until_ms = millis() + ADC_COMPARE_HOLDOFF_MS;
+    compareStats.alarms++;
+    if (alarmCallback)
+        alarmCallback(channel, counts, nowUs);
+}
+
+#if defined(__IMXRT1062__)
+
+// ADC input number that stops the conversions
+#define ADC_INPUT_DISABLED 31
+
+// Watch the specified channel: program its window and start the continuous conversions
+static void startWatching(uint8_t channel)
+{
+    if (channel == ADC_COMPARE_IDLE) {
+        ADC2_HC0 = ADC_HC_ADCH(ADC_INPUT_DISABLED);
+        return;
+    }
+
+    const AdcCompareChannel &watched = compareChannels[channel];
+
+    // The compare settings must be in place before HC0 is written, that starts the conversions
+    ADC2_GC = (ADC2_GC & ~(ADC_COMPARE_GC_ACFE | ADC_COMPARE_GC_ACFGT | ADC_COMPARE_GC_ACREN)) | watched.config.gc;
+    ADC2_CV = ADC_CV_CV1(watched.config.cv1) | ADC_CV_CV2(watched.config.cv2);
+    ADC2_HC0 = ADC_HC_AIEN | ADC_HC_ADCH(getAdcInput(watched.pin));
+}
+
+// Converter interrupt: only raised by a conversion outside the window
+FASTRUN static void onCompareInterrupt()
+{
+    uint32_t nowUs = micros();
+    // Reading the result clears the conversion complete flag
+    uint16_t counts = ADC2_R0;
+
+    ADC2_HC0 = ADC_HC_ADCH(ADC_INPUT_DISABLED);
+    raiseAlarm(counts, nowUs);
+}
+
+#else
+
+// On the host, the channel is converted once when it starts being watched, from the same input the
+// firmware reads, and the compare model decides whether the converter would have kept the result.
+static void startWatching(uint8_t channel)
+{
+    uint16_t counts;
+
+    if (channel == ADC_COMPARE_IDLE)
+        return;
+
+    counts = hostAnalogSample(compareChannels[channel].pin);
+    if (adcCompareMatch(compareChannels[channel].config, counts))
+        raiseAlarm(counts, micros());
+}
+
+#endif
+
+// Dwell timer interrupt: switch to the next channel to watch
+FASTRUN static void watchNextChannel()
+{
+    uint8_t channel = ADC_COMPARE_IDLE;
+    uint32_t nowMs = millis();
+
+    compareStats.dwells++;
+    for (uint8_t i = 0; i < ADC_COMPARE_CHANNEL_COUNT; i++) {
+        uint8_t candidate = (nextChannel + i) % ADC_COMPARE_CHANNEL_COUNT;
+        if (compareChannels[candidate].config.gc && (int32_t)(nowMs - compareChannels[candidate].holdoff_until_ms) >= 0) {
+            channel = candidate;
+            break;
+        }
+    }
+
+    if (channel == ADC_COMPARE_IDLE) {
+        compareStats.idle_dwells++;
+    } else {
+        nextChannel = (channel + 1) % ADC_COMPARE_CHANNEL_COUNT;
+    }
+    watchedChannel = channel;
+    startWatching(channel);
+}
+
+FLASHMEM void initAdcCompare(void (*onAlarm)(uint8_t channel, uint16_t counts, uint32_t nowUs), uint8_t priority)
+{
+    alarmCallback = onAlarm;
+
+    #if defined(__IMXRT1062__)
+    // The core has already clocked and calibrated ADC2 like ADC1, only the averaging and
+    // the continuous conversion mode are changed
+    ADC2_HC0 = ADC_HC_ADCH(ADC_INPUT_DISABLED);
+    ADC2_CFG = (ADC2_CFG & ~ADC_CFG_AVGS(3)) | ADC_CFG_AVGS(ADC_COMPARE_AVERAGING);
+    ADC2_GC = ADC_GC_ADCO | ADC_GC_AVGE;
+    attachInterruptVector(IRQ_ADC2, onCompareInterrupt);
+    NVIC_SET_PRIORITY(IRQ_ADC2, priority);
+    NVIC_ENABLE_IRQ(IRQ_ADC2);
+    #endif
+
+    dwellTimer.priority(priority);
+    dwellTimer.begin(watchNextChannel, ADC_COMPARE_DWELL_US);
+}
+
+void setAdcCompareWindow(uint8_t channel, uint8_t pin, uint16_t low, uint16_t high)
+{
+    AdcCompareConfig config;
+
+    if (channel >= ADC_COMPARE_CHANNEL_COUNT || pin < 14 || pin > 23)
+        return;
+
+    adcCompareEncode(low, high, config);
+    noInterrupts();
+    compareChannels[channel].pin = pin;
+    compareChannels[channel].config = config;
+    compareChannels[channel].holdoff_until_ms = millis() + ADC_COMPARE_SETTLE_MS;
+    if (watchedChannel == channel) {
+        watchedChannel = ADC_COMPARE_IDLE;
+        startWatching(ADC_COMPARE_IDLE);
+    }
+    interrupts();
+}
+
+void getAdcCompareStats(AdcCompareStats &stats)
+{
+    noInterrupts();
+    stats = compareStats;
+    interrupts();
+}
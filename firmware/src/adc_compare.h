@@ -0,0 +1,87 @@
+/*
+ * Hardware threshold alarms for the RX-8 Ashtray Gauges project.
+ * ADC2 isn't used by analogRead() for our inputs (they are all on ADC1 as well), so it is left
+ * converting continuously with its compare function enabled: a conversion inside the programmed
+ * window is thrown away by the converter itself, only one outside of it raises an interrupt.
+ * There is a single compare window per converter, so the channels take turns, ADC_COMPARE_DWELL_US
+ * each, switched by a timer interrupt. A violation is caught within one round of the channels.
+ *
+ * After an alarm the channel is left alone for ADC_COMPARE_HOLDOFF_MS, so a lasting violation
+ * costs one interrupt per hold off period; the software readings take over meanwhile.
+ *
+ * The compare logic of the converter is modelled by adcCompareMatch(). The host build uses it in
+ * place of the hardware, so the window encoding runs the same code on both.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#ifndef ADC_COMPARE_H
+#define ADC_COMPARE_H
+
+#include <stdint.h>
+
+// Number of channels watched in turn
+#define ADC_COMPARE_CHANNEL_COUNT 4
+
+// Time each channel is watched before switching to the next one, in microseconds
+#define ADC_COMPARE_DWELL_US 250
+
+// Time a channel isn't watched after an alarm, in milliseconds
+#define ADC_COMPARE_HOLDOFF_MS 200
+
+// Time a channel isn't watched after its window is changed, in milliseconds. Changing the window
+// usually goes with a change on the input (thermistor reference switch) that takes time to settle.
+#define ADC_COMPARE_SETTLE_MS 2
+
+// Hardware averaging of the compare conversions: 0 (4 samples) to 3 (32 samples), see ADC_CFG_AVGS
+#define ADC_COMPARE_AVERAGING 3
+
+// Limit value meaning no limit
+#define ADC_COMPARE_NO_LIMIT 0xFFFF
+
+// Compare function fields of the ADC registers (i.MX RT1060 reference manual, ADC chapter)
+#define ADC_COMPARE_GC_ACREN 0x04   // Range compare
+#define ADC_COMPARE_GC_ACFGT 0x08   // Greater than compare
+#define ADC_COMPARE_GC_ACFE 0x10    // Compare enabled
+
+// Compare configuration of the converter
+typedef struct {
+    uint32_t gc;                // ADC_COMPARE_GC_* bits of the GC register
+    uint16_t cv1;               // CV register, first compare value
+    uint16_t cv2;               // CV register, second compare value
+} AdcCompareConfig;
+
+// Alarm statistics
+typedef struct {
+    uint32_t alarms;            // Alarms raised
+    uint32_t dwells;            // Channel switches
+    uint32_t idle_dwells;       // Switches with no channel to watch
+} AdcCompareStats;
+
+// Encode an alarm window into the compare configuration
+// low: The counts at or below which the alarm is raised, ADC_COMPARE_NO_LIMIT for none
+// high: The counts at or above which the alarm is raised, ADC_COMPARE_NO_LIMIT for none
+// config: Receives the configuration. Without any limit, the compare function is left disabled.
+void adcCompareEncode(uint16_t low, uint16_t high, AdcCompareConfig &config);
+
+// Model of the converter compare logic
+// config: The compare configuration
+// result: The conversion result
+// Return: True if the result is kept by the converter (conversion complete flag set)
+bool adcCompareMatch(const AdcCompareConfig &config, uint16_t result);
+
+// Start the channel switching timer and the converter
+// onAlarm: Called from the interrupt when a conversion is outside its channel window
+//          (channel, the conversion result, micros() when the interrupt was entered)
+// priority: Priority of the timer and converter interrupts
+void initAdcCompare(void (*onAlarm)(uint8_t channel, uint16_t counts, uint32_t nowUs), uint8_t priority);
+
+// Set the window of a channel and start watching it, after ADC_COMPARE_SETTLE_MS
+// channel: The channel, below ADC_COMPARE_CHANNEL_COUNT
+// pin: The analogue pin
+// low, high: The alarm limits, as for adcCompareEncode(). A channel without limits isn't watched.
+void setAdcCompareWindow(uint8_t channel, uint8_t pin, uint16_t low, uint16_t high);
+
+// Get the alarm statistics
+void getAdcCompareStats(AdcCompareStats &stats);
+
+#endif
@@ -0,0 +1,45 @@
+/*
+ * Synchronised conversions on both ADCs for the RX-8 Ashtray Gauges project, see adc_pair.h.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#include <Arduino.h>
+#include "adc_pair.h"
+#if !defined(__IMXRT1062__)
+#include "host_sim.h"
+#endif
+
+// ADC input of the analogue pins 14 (A0) to 23 (A9)
+static const uint8_t adcInputs[] = {7, 8, 12, 11, 6, 5, 15, 0, 13, 14};
+
+uint8_t getAdcInput(uint8_t pin)
+{
+    return adcInputs[pin - 14];
+}
+
+#if defined(__IMXRT1062__)
+
+void analogReadPair(uint8_t pinA, uint8_t pinB, uint16_t &a, uint16_t &b)
+{
+    // Writing HC0 starts a conversion: both are started back to back, a few bus clocks apart
+    ADC1_HC0 = ADC_HC_ADCH(getAdcInput(pinA));
+    ADC2_HC0 = ADC_HC_ADCH(getAdcInput(pinB));
+    while (!(ADC1_HS & ADC_HS_COCO0) || !(ADC2_HS & ADC_HS_COCO0))
+        ;
+    // Reading the results clears the conversion complete flags
+    a = ADC1_R0;
+    b = ADC2_R0;
+}
+
+#else
+
+// On the host, both inputs are sampled at the same virtual time, then the clock moves on by the
+// time of one conversion
+void analogReadPair(uint8_t pinA, uint8_t pinB, uint16_t &a, uint16_t &b)
+{
+    a = hostAnalogSample(pinA);
+    b = hostAnalogSample(pinB);
+    delayMicroseconds(HOST_ANALOG_READ_US);
+}
+
+#endif
@@ -0,0 +1,28 @@
+/*
+ * Synchronised conversions on both ADCs for the RX-8 Ashtray Gauges project.
+ * The analogue inputs 14 (A0) to 23 (A9) are wired to ADC1 and ADC2 alike, so two of them can be
+ * converted at the same time, one on each converter. A pair of channels is sampled in the time of
+ * one, and both samples of a pair are taken at the same instant.
+ * ADC2 is left with the settings the core gave it, the same as ADC1 (resolution, averaging,
+ * sample time), so a paired sample reads the same as an analogRead() of the pin. It can't be
+ * shared with the compare alarms of adc_compare.h, that keep ADC2 converting on their own.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#ifndef ADC_PAIR_H
+#define ADC_PAIR_H
+
+#include <stdint.h>
+
+// Input number of an analogue pin on the converters, the same on ADC1 and ADC2
+// pin: The analogue pin, 14 (A0) to 23 (A9)
+// Return: The ADC_HC_ADCH input number
+uint8_t getAdcInput(uint8_t pin);
+
+// Convert two analogue pins at the same time, the first on ADC1 and the second on ADC2, and wait
+// for both results
+// pinA, pinB: The analogue pins, 14 (A0) to 23 (A9)
+// a, b: Receive the conversion results, in the analogRead() resolution
+void analogReadPair(uint8_t pinA, uint8_t pinB, uint16_t &a, uint16_t &b);
+
+#endif
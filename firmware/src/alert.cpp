@@ -0,0 +1,249 @@
+/*
+ * Alert handling for the RX-8 Ashtray Gauges project, see alert.h.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#include <string.h>
+#include <Arduino.h>
+#include "alert.h"
+#include "error_codes.h"
+#include "black_box.h"
+
+// State of one alert channel
+typedef struct {
+    float low;
+    float high;
+    float value;                // Last reading
+    uint8_t error;              // Error code of the last reading
+    uint32_t sampled_us;        // micros() at the end of the acquisition of the last reading
+    bool seeded;                // True once a reading was published
+    bool compare_alarm;         // True from a hardware compare alarm to the next reading
+    uint16_t compare_counts;    // Conversion result of the compare alarm
+    uint32_t compare_us;        // micros() of the compare alarm
+    uint8_t reason;             // ALERT_* reason the channel is in alert for, ALERT_NONE if it isn't
+    bool unrecorded;            // True from a reading to its black box record
+    uint8_t held;               // Reason until the first reading, from before a warm restart
+} AlertChannel;
+
+// Shared between the loop and the timer interrupt: the loop only writes with interrupts disabled
+static AlertChannel alertChannels[ALERT_CHANNEL_COUNT];
+static AlertEvent alertEvents[ALERT_EVENT_COUNT];
+static AlertStats alertStats;
+
+// Only used by the timer interrupt, once started
+static uint8_t alertLedPin = ALERT_NO_PIN;
+static uint8_t alertBuzzerPin = ALERT_NO_PIN;
+static bool alertActive = false;
+static bool buzzerOn = false;
+static uint32_t buzzerOffMs;
+
+static IntervalTimer alertTimer;
+
+// Get the reason a channel is in alert
+static uint8_t getAlertReason(const AlertChannel &channel, uint32_t nowUs)
+{
+    if (channel.compare_alarm)
+        return ALERT_COMPARE;
+    if (!channel.seeded)
+        return channel.held;
+    if (nowUs - channel.sampled_us > (uint32_t)ALERT_SAMPLE_TIMEOUT_MS * 1000)
+        return ALERT_STALE;
+    if (channel.error != ENOERR)
+        return ALERT_FAULT;
+    if (channel.value <= channel.low)
+        return ALERT_LOW;
+    if (channel.value >= channel.high)
+        return ALERT_HIGH;
+    return ALERT_NONE;
+}
+
+// Evaluate every channel and drive the outputs, from the alert interrupts
+static void evaluateAlerts()
+{
+    uint32_t nowUs = micros();
+    uint32_t writtenUs;
+    uint8_t started[ALERT_CHANNEL_COUNT];
+    uint8_t startedCount = 0;
+    bool active = false;
+    uint8_t reason;
+
+    for (uint8_t i = 0; i < ALERT_CHANNEL_COUNT; i++) {
+        AlertChannel &channel = alertChannels[i];
+
+        reason = getAlertReason(channel, nowUs);
+        if (reason != ALERT_NONE && channel.reason == ALERT_NONE)
+            started[startedCount++] = i;
+        // Every reading goes to the black box, and every change of the reason in between
+        if (channel.unrecorded || reason != channel.reason)
+            recordBlackBox(i, channel.value, channel.error, reason, channel.unrecorded ? channel.sampled_us : nowUs);
+        channel.unrecorded = false;
+        channel.reason = reason;
+        active |= reason != ALERT_NONE;
+    }
+
+    if (active != alertActive && alertLedPin != ALERT_NO_PIN)
+        digitalWrite(alertLedPin, active ? HIGH : LOW);
+    alertActive = active;
+
+    if (startedCount && alertBuzzerPin != ALERT_NO_PIN) {
+        digitalWrite(alertBuzzerPin, HIGH);
+        buzzerOn = true;
+        buzzerOffMs = millis() + ALERT_BUZZER_DURATION_MS;
+    } else if (buzzerOn && (int32_t)(millis() - buzzerOffMs) >= 0) {
+        digitalWrite(alertBuzzerPin, LOW);
+        buzzerOn = false;
+    }
+
+    // The latency runs up to here, the LED output is written
+    writtenUs = micros();
+    for (uint8_t i = 0; i < startedCount; i++) {
+        const AlertChannel &channel = alertChannels[started[i]];
+        AlertEvent &event = alertEvents[alertStats.events % ALERT_EVENT_COUNT];
+
+        event.channel = started[i];
+        event.reason = channel.reason;
+        event.error = channel.error;
+        event.value = channel.reason == ALERT_COMPARE ? channel.compare_counts : channel.value;
+        event.sampled_us = channel.reason == ALERT_COMPARE ? channel.compare_us : channel.sampled_us;
+        if (channel.reason == ALERT_STALE) {
+            event.latency_us = writtenUs - channel.sampled_us - (uint32_t)ALERT_SAMPLE_TIMEOUT_MS * 1000;
+        } else {
+            event.latency_us = writtenUs - event.sampled_us;
+            alertStats.latency_total_us += event.latency_us;
+            if (event.latency_us > alertStats.latency_max_us)
+                alertStats.latency_max_us = event.latency_us;
+        }
+        alertStats.events++;
+    }
+
+    // The black box keeps the time around the first alert to start
+    if (startedCount)
+        triggerBlackBox(started[0], alertChannels[started[0]].reason, writtenUs);
+}
+
+// Timer interrupt
+FASTRUN static void checkAlerts()
+{
+    #if defined(__IMXRT1062__)
+    uint32_t cycles = ARM_DWT_CYCCNT;
+    #endif
+
+    alertStats.ticks++;
+    evaluateAlerts();
+
+    #if defined(__IMXRT1062__)
+    cycles = ARM_DWT_CYCCNT - cycles;
+    alertStats.cycles_total += cycles;
+    if (cycles > alertStats.cycles_max)
+        alertStats.cycles_max = cycles;
+    #endif
+}
+
+FLASHMEM void initAlerts(uint8_t ledPin, uint8_t buzzerPin)
+{
+    alertLedPin = ledPin;
+    alertBuzzerPin = buzzerPin;
+    if (alertLedPin != ALERT_NO_PIN)
+        digitalWrite(alertLedPin, LOW);
+    if (alertBuzzerPin != ALERT_NO_PIN)
+        digitalWrite(alertBuzzerPin, LOW);
+    alertActive = false;
+    buzzerOn = false;
+
+    alertTimer.priority(ALERT_TIMER_PRIORITY);
+    alertTimer.begin(checkAlerts, ALERT_PERIOD_US);
+}
+
+void setAlertThresholds(uint8_t channel, float low, float high)
+{
+    if (channel >= ALERT_CHANNEL_COUNT)
+        return;
+    noInterrupts();
+    alertChannels[channel].low = low;
+    alertChannels[channel].high = high;
+    interrupts();
+}
+
+void publishAlertSample(uint8_t channel, float value, uint8_t error, uint32_t sampledUs)
+{
+    if (channel >= ALERT_CHANNEL_COUNT)
+        return;
+    noInterrupts();
+    alertChannels[channel].value = value;
+    alertChannels[channel].error = error;
+    alertChannels[channel].sampled_us = sampledUs;
+    alertChannels[channel].seeded = true;
+    alertChannels[channel].unrecorded = true;
+    // A reading acquired after a compare alarm takes over from it
+    if (alertChannels[channel].compare_alarm && (int32_t)(sampledUs - alertChannels[channel].compare_us) > 0)
+        alertChannels[channel].compare_alarm = false;
+    interrupts();
+}
+
+FASTRUN void raiseCompareAlert(uint8_t channel, uint16_t counts, uint32_t sampledUs)
+{
+    if (channel >= ALERT_CHANNEL_COUNT)
+        return;
+    alertChannels[channel].compare_alarm = true;
+    alertChannels[channel].compare_counts = counts;
+    alertChannels[channel].compare_us = sampledUs;
+    evaluateAlerts();
+}
+
+bool isAlertActive()
+{
+    return alertActive;
+}
+
+uint8_t getAlertChannelReason(uint8_t channel)
+{
+    return channel < ALERT_CHANNEL_COUNT ? alertChannels[channel].reason : ALERT_NONE;
+}
+
+bool getAlertEvent(uint32_t sequence, AlertEvent &event)
+{
+    bool available;
+
+    noInterrupts();
+    available = sequence < alertStats.events && alertStats.events - sequence <= ALERT_EVENT_COUNT;
+    if (available)
+        memcpy(&event, &alertEvents[sequence % ALERT_EVENT_COUNT], sizeof(AlertEvent));
+    interrupts();
+    return available;
+}
+
+void getAlertStats(AlertStats &stats)
+{
+    noInterrupts();
+    memcpy(&stats, &alertStats, sizeof(AlertStats));
+    interrupts();
+}
+
+void getAlertLatches(AlertLatches &latches)
+{
+    noInterrupts();
+    for (uint8_t i = 0; i < ALERT_CHANNEL_COUNT; i++)
+        latches.reasons[i] = alertChannels[i].reason;
+    memcpy(latches.events, alertEvents, sizeof(alertEvents));
+    memcpy(&latches.stats, &alertStats, sizeof(AlertStats));
+    interrupts();
+}
+
+FLASHMEM void restoreAlertLatches(const AlertLatches &latches)
+{
+    uint8_t reason;
+
+    noInterrupts();
+    for (uint8_t i = 0; i < ALERT_CHANNEL_COUNT; i++) {
+        // A stale or compare alert needs the loop or the alarm that raised it, the rest is held
+        reason = latches.reasons[i];
+        alertChannels[i].seeded = false;
+        alertChannels[i].compare_alarm = false;
+        alertChannels[i].unrecorded = false;
+        alertChannels[i].held = reason == ALERT_LOW || reason == ALERT_HIGH || reason == ALERT_FAULT ? reason : ALERT_NONE;
+        alertChannels[i].reason = alertChannels[i].held;
+    }
+    memcpy(alertEvents, latches.events, sizeof(alertEvents));
+    memcpy(&alertStats, &latches.stats, sizeof(AlertStats));
+    interrupts();
+}
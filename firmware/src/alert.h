@@ -0,0 +1,131 @@
+/*
+ * Alert handling for the RX-8 Ashtray Gauges project.
+ * The warning thresholds are evaluated, and the warning LED and buzzer driven, from a high priority
+ * timer interrupt instead of the main loop. The loop only hands over each reading as soon as it is
+ * acquired, with the time it was acquired; the display flushes and the waits that follow can no
+ * longer delay an alert.
+ *
+ * Worst case latency, from the end of the acquisition of a reading to the LED output changing:
+ *   the conversion of the reading to its value (tens of microseconds)
+ *   + ALERT_PERIOD_US (the reading waits at most one period for the next timer interrupt)
+ *   + the interrupt run time (a few microseconds, nothing else runs at a higher priority)
+ * i.e. just over 1ms with the default settings. Each alert records its actual latency, see AlertEvent.
+ * A channel whose readings stop coming (loop stalled) raises a fault after ALERT_SAMPLE_TIMEOUT_MS.
+ * The timer also hands every reading, and the start of each alert, to the black box recorder
+ * (black_box.h).
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#ifndef ALERT_H
+#define ALERT_H
+
+#include <stdint.h>
+
+// Period of the alert timer interrupt, in microseconds
+#define ALERT_PERIOD_US 1000
+
+// Priority of the alert timer interrupt, above the CAN interrupts (128) so they can't delay it
+#define ALERT_TIMER_PRIORITY 32
+
+// A channel that has had no reading for this long is in fault, in milliseconds
+#define ALERT_SAMPLE_TIMEOUT_MS 1000
+
+// Time the buzzer sounds when an alert starts, in milliseconds
+#define ALERT_BUZZER_DURATION_MS 2000
+
+// Number of alert channels, one per gauge channel (see GAUGE_CHANNEL_MAX)
+#define ALERT_CHANNEL_COUNT 8
+
+// Number of alert events kept, see getAlertEvent()
+#define ALERT_EVENT_COUNT 16
+
+// Output pin value meaning no output
+#define ALERT_NO_PIN 0xFF
+
+// Why a channel is in alert
+#define ALERT_NONE 0
+#define ALERT_LOW 1             // Reading at or below the low threshold
+#define ALERT_HIGH 2            // Reading at or above the high threshold
+#define ALERT_FAULT 3           // Reading failed, see the error code
+#define ALERT_STALE 4           // No reading for ALERT_SAMPLE_TIMEOUT_MS
+#define ALERT_COMPARE 5         // Hardware compare alarm, until the next reading, see adc_compare.h
+
+// An alert starting on a channel
+typedef struct {
+    uint8_t channel;
+    uint8_t reason;             // ALERT_* reason
+    uint8_t error;              // Error code of the reading, for ALERT_FAULT
+    float value;                // The reading that raised the alert, in raw ADC counts for ALERT_COMPARE
+    uint32_t sampled_us;        // micros() at the end of its acquisition (of the alarm for ALERT_COMPARE)
+    uint32_t latency_us;        // From sampled_us to the LED output written (to the check for ALERT_STALE)
+} AlertEvent;
+
+// Alert statistics
+typedef struct {
+    uint32_t events;            // Alerts started, all channels
+    uint32_t latency_max_us;    // Longest latency, ALERT_STALE alerts excluded
+    uint64_t latency_total_us;  // Sum of the latencies, for the average
+    uint32_t ticks;             // Timer interrupts run
+    uint32_t cycles_max;        // Longest run of the timer interrupt in CPU cycles, on the Teensy
+    uint64_t cycles_total;      // Sum of the runs, for the average
+} AlertStats;
+
+// What the alert timer carries over a warm restart, see warm_start.h
+typedef struct {
+    uint8_t reasons[ALERT_CHANNEL_COUNT];   // ALERT_* reason of each channel
+    AlertEvent events[ALERT_EVENT_COUNT];
+    AlertStats stats;
+} AlertLatches;
+
+// Start the alert timer
+// ledPin: The warning LED output, ALERT_NO_PIN for none
+// buzzerPin: The buzzer output, ALERT_NO_PIN for none
+void initAlerts(uint8_t ledPin, uint8_t buzzerPin);
+
+// Set the thresholds of a channel. A channel without thresholds only alerts on faults.
+// channel: The channel, below ALERT_CHANNEL_COUNT
+// low: The reading at or below which the channel is in alert, -__FLT_MAX__ for none
+// high: The reading at or above which the channel is in alert, __FLT_MAX__ for none
+void setAlertThresholds(uint8_t channel, float low, float high);
+
+// Hand a reading over to the alert timer. Call this as soon as the reading is converted.
+// channel: The channel
+// value: The reading
+// error: ENOERR, or the error code if the reading failed (the value is then ignored)
+// sampledUs: micros() at the end of the acquisition of the reading
+void publishAlertSample(uint8_t channel, float value, uint8_t error, uint32_t sampledUs);
+
+// Put a channel in alert straight away, following a hardware compare alarm. It stays in alert
+// until a reading acquired after the alarm is published. Same signature as the alarm callback of
+// initAdcCompare(), the alarm interrupts must have the ALERT_TIMER_PRIORITY priority.
+// channel: The channel
+// counts: The conversion result that raised the alarm
+// sampledUs: micros() when the alarm was raised
+void raiseCompareAlert(uint8_t channel, uint16_t counts, uint32_t sampledUs);
+
+// Return true if any channel is in alert
+bool isAlertActive();
+
+// Get the reason a channel is in alert, as of the last timer interrupt
+// channel: The channel
+// Return: The ALERT_* reason, ALERT_NONE if it isn't in alert
+uint8_t getAlertChannelReason(uint8_t channel);
+
+// Get one of the last ALERT_EVENT_COUNT alert events
+// sequence: The event number, counting from 0 since power up
+// event: Receives the event
+// Return: False if that event hasn't happened yet or was already overwritten
+bool getAlertEvent(uint32_t sequence, AlertEvent &event);
+
+// Get the alert statistics
+void getAlertStats(AlertStats &stats);
+
+// Get the latches of the alert timer: the reason of each channel, the last events and the statistics
+void getAlertLatches(AlertLatches &latches);
+
+// Put back the latches from before a warm restart. A channel in alert for a reading keeps its
+// reason until its next reading: the warning LED is back at the first timer interrupt, and an
+// alert that goes on isn't counted, sounded or recorded again. Call this before initAlerts().
+void restoreAlertLatches(const AlertLatches &latches);
+
+#endif
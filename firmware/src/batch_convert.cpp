@@ -0,0 +1,134 @@
+/*
+ * Batch conversion of raw samples for the RX-8 Ashtray Gauges project, see batch_convert.h.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#include <math.h>
+#include <string.h>
+#include <Arduino.h>
+#include "batch_convert.h"
+#include "error_codes.h"
+
+// Interpolation weights, in Q14
+#define CONVERSION_WEIGHT_SHIFT 14
+#define CONVERSION_WEIGHT_ONE (1 << CONVERSION_WEIGHT_SHIFT)
+
+void initConversionTable(ConversionTable &table, ConversionFunction convert, const void *context)
+{
+    float value;
+
+    table.convert = convert;
+    table.context = context;
+    for (uint16_t counts = 0; counts < CONVERSION_COUNTS; counts++) {
+        if (convert(value, counts, context) != ENOERR)
+            table.values[counts] = CONVERSION_INVALID;
+        else
+            table.values[counts] = (int16_t)lroundf(constrain(value * CONVERSION_SCALE, -INT16_MAX, INT16_MAX));
+    }
+}
+
+// Interpolate between two table values
+// low, high: The values
+// weight: The weight of high, in Q14
+// Return: The value, saturated to 16 bits
+static int32_t interpolate(int16_t low, int16_t high, uint16_t weight)
+{
+    #if defined(__IMXRT1062__)
+    uint32_t values = (uint16_t)low | ((uint32_t)(uint16_t)high << 16);
+    uint32_t weights = (CONVERSION_WEIGHT_ONE - weight) | ((uint32_t)weight << 16);
+    int32_t sum = CONVERSION_WEIGHT_ONE / 2;
+
+    // low * (1 - weight) + high * weight in one instruction, then back to 16 bits
+    asm("smlad %0, %1, %2, %0" : "+r" (sum) : "r" (values), "r" (weights));
+    sum >>= CONVERSION_WEIGHT_SHIFT;
+    asm("ssat %0, #16, %0" : "+r" (sum));
+    return sum;
+    #else
+    int32_t sum = (low * (CONVERSION_WEIGHT_ONE - weight) + high * weight + CONVERSION_WEIGHT_ONE / 2) >> CONVERSION_WEIGHT_SHIFT;
+
+    return constrain(sum, (int32_t)INT16_MIN, (int32_t)INT16_MAX);
+    #endif
+}
+
+int convertMeanCounts(const ConversionTable &table, float counts, float &value)
+{
+    uint16_t index, next;
+    uint16_t weight;
+
+    if (counts >= 0 && counts <= CONVERSION_COUNTS - 1) {
+        index = (uint16_t)counts;
+        next = min(index + 1, CONVERSION_COUNTS - 1);
+        weight = (uint16_t)lroundf((counts - index) * CONVERSION_WEIGHT_ONE);
+        if (table.values[index] != CONVERSION_INVALID && table.values[next] != CONVERSION_INVALID) {
+            value = (float)interpolate(table.values[index], table.values[next], weight) / CONVERSION_SCALE;
+            return ENOERR;
+        }
+    }
+    // Next to a result that doesn't convert, the scalar conversion gives the error
+    return table.convert(value, counts, table.context);
+}
+
+// Sum the samples of each channel of a block
+// samples, frames, channels: The block, see convertBlock()
+// sums: Receives the sum of each channel
+static void sumChannels(const uint16_t *samples, uint16_t frames, uint8_t channels, uint32_t *sums)
+{
+    memset(sums, 0, channels * sizeof(uint32_t));
+
+    #if defined(__IMXRT1062__)
+    // With an even number of channels, each word holds two samples of a pair of channels: a pair
+    // is summed in one instruction, in two 16 bit lanes
+    if (channels % 2 == 0) {
+        const uint32_t *words = (const uint32_t *)samples;
+        uint8_t pairs = channels / 2;
+        uint32_t lanes[CONVERSION_CHANNEL_MAX / 2];
+
+        for (uint16_t start = 0; start < frames; start += CONVERSION_LANE_FRAMES) {
+            uint16_t end = min(frames, start + CONVERSION_LANE_FRAMES);
+
+            memset(lanes, 0, sizeof(lanes));
+            for (uint16_t i = start; i < end; i++) {
+                for (uint8_t p = 0; p < pairs; p++)
+                    asm("uadd16 %0, %0, %1" : "+r" (lanes[p]) : "r" (words[i * pairs + p]));
+            }
+            // Carry the lanes before they can overflow
+            for (uint8_t p = 0; p < pairs; p++) {
+                sums[2 * p] += lanes[p] & 0xFFFF;
+                sums[2 * p + 1] += lanes[p] >> 16;
+            }
+        }
+        return;
+    }
+    #endif
+
+    for (uint16_t i = 0; i < frames; i++) {
+        for (uint8_t c = 0; c < channels; c++)
+            sums[c] += samples[i * channels + c];
+    }
+}
+
+void convertBlock(const uint16_t *samples, uint16_t frames, uint8_t channels, const ConversionTable *const *tables,
+    float *values, int *errors, int16_t *converted)
+{
+    uint32_t sums[CONVERSION_CHANNEL_MAX];
+
+    channels = min(channels, (uint8_t)CONVERSION_CHANNEL_MAX);
+    sumChannels(samples, frames, channels, sums);
+    for (uint8_t c = 0; c < channels; c++) {
+        if (frames == 0) {
+            errors[c] = EINVALID;
+            continue;
+        }
+        errors[c] = convertMeanCounts(*tables[c], (float)sums[c] / frames, values[c]);
+    }
+
+    if (converted) {
+        for (uint16_t i = 0; i < frames; i++) {
+            for (uint8_t c = 0; c < channels; c++) {
+                uint32_t n = i * channels + c;
+
+                converted[n] = tables[c]->values[samples[n] & (CONVERSION_COUNTS - 1)];
+            }
+        }
+    }
+}
@@ -0,0 +1,79 @@
+/*
+ * Batch conversion of raw samples for the RX-8 Ashtray Gauges project.
+ * The readings are converted one averaged value at a time, each through its own sensor policy
+ * (floats, a logarithm for the thermistors). That's fine for a few samples per reading; a block
+ * of samples taken at a high rate (a DMA scan of the inputs, bursts on the second ADC) is
+ * converted here in one pass instead:
+ *  - Each channel has a table of the value of every 10 bit result, built once from its scalar
+ *    conversion, in CONVERSION_SCALE fixed point.
+ *  - The samples of a block are summed per channel two at a time, in packed 16 bit lanes (UADD16
+ *    on the Cortex-M7), carried into 32 bits every CONVERSION_LANE_FRAMES frames.
+ *  - The mean of each channel is read from its table, interpolated between the two results
+ *    around it by one packed multiply-accumulate (SMLAD) and saturated to 16 bits (SSAT).
+ *  - Optionally, each sample is converted too, by a table lookup.
+ * A mean next to a result that doesn't convert (out of range, open sensor...) goes through the
+ * scalar conversion, so the error codes are the same. The host builds use portable C.
+ * See the convert-bench host tool for the speed against the scalar path.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#ifndef BATCH_CONVERT_H
+#define BATCH_CONVERT_H
+
+#include <stdint.h>
+
+// Fixed point of the table values: hundredths of the unit (0.01C, 0.01psi, 0.01V). The values
+// saturate at +/-327.67 units.
+#define CONVERSION_SCALE 100
+
+// Table value of a result that doesn't convert
+#define CONVERSION_INVALID INT16_MIN
+
+// Number of 10 bit results
+#define CONVERSION_COUNTS 1024
+
+// Frames summed in 16 bit lanes before they're carried: 64 results of 1023 fit in 16 bits
+#define CONVERSION_LANE_FRAMES 64
+
+// Most channels in a block
+#define CONVERSION_CHANNEL_MAX 8
+
+// Scalar conversion of a channel, to build its table and for the means its table can't take
+// value: Receives the value
+// counts: The mean result, 0 to 1023
+// context: The context given to initConversionTable()
+// Return: ENOERR if the value was converted, otherwise the error code
+typedef int (*ConversionFunction)(float &value, float counts, const void *context);
+
+// Conversion table of one channel
+typedef struct {
+    ConversionFunction convert;
+    const void *context;
+    int16_t values[CONVERSION_COUNTS]; // Value of each result, CONVERSION_INVALID if it doesn't convert
+} ConversionTable;
+
+// Build the table of a channel, it takes CONVERSION_COUNTS scalar conversions
+// table: The table
+// convert: The scalar conversion of the channel
+// context: Passed on to convert()
+void initConversionTable(ConversionTable &table, ConversionFunction convert, const void *context);
+
+// Convert a mean result through a table
+// table: The table of the channel
+// counts: The mean result, 0 to 1023
+// value: Receives the value
+// Return: ENOERR if the value was converted, otherwise the error code
+int convertMeanCounts(const ConversionTable &table, float counts, float &value);
+
+// Convert a block of samples of several channels in one pass
+// samples: The samples, frame by frame: sample i of channel c at i * channels + c. 4 byte aligned.
+// frames: The number of frames
+// channels: The number of channels, up to CONVERSION_CHANNEL_MAX
+// tables: The table of each channel
+// values: Receives the mean of each channel, converted
+// errors: Receives the error code of each channel, ENOERR if its value was converted
+// converted: NULL, or receives each sample converted, in CONVERSION_SCALE fixed point (laid out like samples)
+void convertBlock(const uint16_t *samples, uint16_t frames, uint8_t channels, const ConversionTable *const *tables,
+    float *values, int *errors, int16_t *converted);
+
+#endif
@@ -0,0 +1,607 @@
+/*
+ * Black box recorder for the RX-8 Ashtray Gauges project, see black_box.h.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <Arduino.h>
+#include "black_box.h"
+#include "alert.h"
+#include "record_codec.h"
+#include "clock_scaling.h"
+
+#if !defined(__IMXRT1062__)
+// On the host, the flash is an array that the replay tool can load and save
+uint8_t blackBoxFlash[BLACK_BOX_SLOT_COUNT * BLACK_BOX_SLOT_SIZE];
+#endif
+
+#if ENABLE_BLACK_BOX
+
+// Fewest records a flash page holds, each compressed page is a block of record_codec.h
+#define BLACK_BOX_PAGE_RECORDS (BLACK_BOX_PAGE_SIZE / RECORD_CODEC_MAX_BYTES)
+
+// Fewest records a slot holds: its first page holds the event, written once all its records are
+#define BLACK_BOX_SLOT_RECORDS ((BLACK_BOX_SLOT_SIZE / BLACK_BOX_PAGE_SIZE - 1) * BLACK_BOX_PAGE_RECORDS)
+
+// Marks a slot holding a complete event, with compressed records
+#define BLACK_BOX_MAGIC 0x58384243
+
+// Length of the longest serial command
+#define BLACK_BOX_COMMAND_LENGTH 32
+
+static_assert(BLACK_BOX_RECORDS <= BLACK_BOX_SLOT_RECORDS, "A slot must hold a whole ring of records");
+static_assert(BLACK_BOX_RECORDS <= 65535, "The record count of an event is 16 bits");
+
+// First page of a slot
+typedef struct {
+    uint32_t magic;
+    BlackBoxEvent event;
+} BlackBoxHeader;
+
+// The ring, in the DTCM like the rest: the alert timer interrupt writes a record per reading and
+// reads back the pre-trigger time, it mustn't wait on cache misses. Only the interrupt writes it.
+static BlackBoxRecord blackBoxRecords[BLACK_BOX_RECORDS];
+
+// Written by the interrupt only
+static volatile uint32_t ringHead;          // Records written since power up
+static volatile uint32_t eventsStarted;
+static BlackBoxEvent startedEvent;          // Last event started, read by the loop once counted
+static volatile uint32_t eventStart;        // Its first record
+static volatile uint32_t eventDropped;      // Records dropped before it started
+static bool pendingTrigger;                 // An alert waits for the held event to be saved
+static uint8_t pendingChannel;
+static uint8_t pendingReason;
+static uint32_t pendingUs;
+static uint32_t pendingMs;
+
+// Written by the loop only
+static volatile uint32_t ringSaved;         // Records of the held event saved up to there
+static volatile uint32_t eventsDone;
+
+// Each counter is only written by one side: the ring ones by the interrupt, the flash ones by the loop
+static BlackBoxStats blackBoxStats;
+
+// Only used by the loop
+static uint32_t nextSequence;               // Sequence number of the next event saved
+static uint8_t nextSlot;                    // Slot the next event goes to
+static uint8_t nextSector;                  // Sectors of the next slot known to be blank
+static bool eventFrozen;                    // The held event is complete, its end is eventEnd
+static uint32_t eventEnd;
+static uint16_t eventPages;                 // Record pages of the held event written
+static char command[BLACK_BOX_COMMAND_LENGTH + 1];
+static uint8_t commandLength;
+static bool dumping;                        // Printing the records of the events
+static uint32_t dumpSequence;               // Event being dumped
+static uint32_t dumpLast;                   // Last event to dump
+static uint32_t dumpRecord;                 // Next record to print, 0 prints the event line first
+static uint16_t dumpPage;                   // Page of the next record, and its decoder
+static RecordBlock dumpBlock;
+static BlackBoxCommand commandHandler;      // Runs the commands not known here
+static const char *commandHelp;
+
+#if defined(__IMXRT1062__)
+
+// Flash routines of the Teensy core (the EEPROM emulation), they run from RAM with the
+// interrupts disabled until the flash is done
+extern "C" void eepromemu_flash_write(void *addr, const void *data, uint32_t len);
+extern "C" void eepromemu_flash_erase_sector(void *addr);
+extern unsigned long _flashimagelen;
+
+// Get the address of a location of the black box flash
+static inline const uint8_t *getFlash(uint32_t offset)
+{
+    return (const uint8_t *)BLACK_BOX_FLASH_ADDRESS + offset;
+}
+
+static bool isFlashUsable()
+{
+    return 0x60000000 + (uint32_t)&_flashimagelen <= BLACK_BOX_FLASH_ADDRESS;
+}
+
+static void writeFlashPage(uint32_t offset, const void *data)
+{
+    eepromemu_flash_write((void *)getFlash(offset), data, BLACK_BOX_PAGE_SIZE);
+}
+
+static void eraseFlashSector(uint32_t offset)
+{
+    eepromemu_flash_erase_sector((void *)getFlash(offset));
+}
+
+#else
+
+// The host flash takes no virtual time
+static inline const uint8_t *getFlash(uint32_t offset)
+{
+    return blackBoxFlash + offset;
+}
+
+static bool isFlashUsable()
+{
+    return true;
+}
+
+// As the NOR flash, writing only clears bits
+static void writeFlashPage(uint32_t offset, const void *data)
+{
+    for (uint32_t i = 0; i < BLACK_BOX_PAGE_SIZE; i++)
+        blackBoxFlash[offset + i] &= ((const uint8_t *)data)[i];
+}
+
+static void eraseFlashSector(uint32_t offset)
+{
+    memset(blackBoxFlash + offset, 0xFF, BLACK_BOX_SECTOR_SIZE);
+}
+
+#endif
+
+// Get the event saved in a slot
+// Return: False if the slot doesn't hold a complete event
+static bool readSlot(uint8_t slot, BlackBoxEvent &event)
+{
+    BlackBoxHeader header;
+
+    memcpy(&header, getFlash((uint32_t)slot * BLACK_BOX_SLOT_SIZE), sizeof(BlackBoxHeader));
+    if (header.magic != BLACK_BOX_MAGIC)
+        return false;
+    memcpy(&event, &header.event, sizeof(BlackBoxEvent));
+    return true;
+}
+
+// Return true if a sector of the flash is blank
+static bool isSectorBlank(uint32_t offset)
+{
+    const uint32_t *words = (const uint32_t *)getFlash(offset);
+
+    for (uint32_t i = 0; i < BLACK_BOX_SECTOR_SIZE / 4; i++) {
+        if (words[i] != 0xFFFFFFFF)
+            return false;
+    }
+    return true;
+}
+
+// Pick the slot of the next event: one without an event, otherwise the oldest event's
+static void pickNextSlot()
+{
+    BlackBoxEvent event;
+    uint32_t oldest = 0xFFFFFFFF;
+
+    for (uint8_t slot = 0; slot < BLACK_BOX_SLOT_COUNT; slot++) {
+        if (!readSlot(slot, event)) {
+            nextSlot = slot;
+            break;
+        }
+        if (event.sequence < oldest) {
+            oldest = event.sequence;
+            nextSlot = slot;
+        }
+    }
+    nextSector = 0;
+}
+
+static bool isNextSlotBlank()
+{
+    return nextSector >= BLACK_BOX_SLOT_SIZE / BLACK_BOX_SECTOR_SIZE;
+}
+
+// Blank the next slot by one more sector: skip those already blank, erase one that isn't
+static void eraseNextSector()
+{
+    uint32_t offset;
+
+    while (!isNextSlotBlank()) {
+        offset = (uint32_t)nextSlot * BLACK_BOX_SLOT_SIZE + (uint32_t)nextSector * BLACK_BOX_SECTOR_SIZE;
+        nextSector++;
+        if (!isSectorBlank(offset)) {
+            eraseFlashSector(offset);
+            blackBoxStats.sectors++;
+            return;
+        }
+    }
+}
+
+FLASHMEM void initBlackBox()
+{
+    BlackBoxEvent event;
+
+    blackBoxStats.flash = isFlashUsable();
+    if (!blackBoxStats.flash)
+        return;
+
+    nextSequence = 0;
+    for (uint8_t slot = 0; slot < BLACK_BOX_SLOT_COUNT; slot++) {
+        if (readSlot(slot, event) && event.sequence >= nextSequence)
+            nextSequence = event.sequence + 1;
+    }
+
+    // Nothing is held up yet: the slot is made blank in one go
+    pickNextSlot();
+    while (!isNextSlotBlank())
+        eraseNextSector();
+}
+
+// Start an event, from the interrupt: it keeps the records of the pre-trigger time still in the ring
+static void startEvent(uint8_t channel, uint8_t reason, uint32_t triggerUs, uint32_t triggerMs)
+{
+    uint32_t head = ringHead;
+    uint32_t oldest = head > BLACK_BOX_RECORDS ? head - BLACK_BOX_RECORDS : 0;
+    uint32_t fromUs = triggerUs - (uint32_t)BLACK_BOX_PRE_TRIGGER_MS * 1000;
+    uint32_t start = head;
+
+    while (start > oldest && (int32_t)(blackBoxRecords[(start - 1) % BLACK_BOX_RECORDS].time_us - fromUs) >= 0)
+        start--;
+
+    startedEvent.trigger_ms = triggerMs;
+    startedEvent.trigger_us = triggerUs;
+    startedEvent.channel = channel;
+    startedEvent.reason = reason;
+    eventStart = start;
+    eventDropped = blackBoxStats.dropped;
+    blackBoxStats.triggers++;
+    // The loop takes the event once it's counted
+    eventsStarted = eventsStarted + 1;
+}
+
+// Start the pending event once the held one is saved, from the interrupt
+static void startPendingEvent()
+{
+    if (pendingTrigger && eventsStarted == eventsDone) {
+        pendingTrigger = false;
+        startEvent(pendingChannel, pendingReason, pendingUs, pendingMs);
+    }
+}
+
+FASTRUN void recordBlackBox(uint8_t channel, float value, uint8_t error, uint8_t reason, uint32_t timeUs)
+{
+    uint32_t head = ringHead;
+    uint32_t keep;
+    BlackBoxRecord *record;
+
+    startPendingEvent();
+
+    // While an event is held, the records from the first one not saved yet are kept
+    if (eventsStarted != eventsDone) {
+        keep = (int32_t)(ringSaved - eventStart) > 0 ? ringSaved : eventStart;
+        if (head - keep >= BLACK_BOX_RECORDS) {
+            blackBoxStats.dropped++;
+            return;
+        }
+    }
+
+    record = &blackBoxRecords[head % BLACK_BOX_RECORDS];
+    record->time_us = timeUs;
+    record->channel = channel;
+    record->error = error;
+    record->reason = reason;
+    record->reserved = 0;
+    record->value = value;
+    blackBoxStats.records++;
+    // The loop reads the record once it's counted
+    ringHead = head + 1;
+}
+
+FASTRUN void triggerBlackBox(uint8_t channel, uint8_t reason, uint32_t nowUs)
+{
+    startPendingEvent();
+
+    if (eventsStarted == eventsDone) {
+        startEvent(channel, reason, nowUs, millis());
+    } else if (!pendingTrigger) {
+        pendingTrigger = true;
+        pendingChannel = channel;
+        pendingReason = reason;
+        pendingUs = nowUs;
+        pendingMs = millis();
+    } else {
+        blackBoxStats.missed++;
+    }
+}
+
+// Save the held event a few pages at a time, once its post-trigger time is over
+// mayErase: True if the next slot may be erased, when it isn't blank
+static void saveEvent(bool mayErase)
+{
+    uint8_t page[BLACK_BOX_PAGE_SIZE];
+    BlackBoxHeader header;
+    RecordBlock block;
+    uint32_t slotOffset = (uint32_t)nextSlot * BLACK_BOX_SLOT_SIZE;
+    uint32_t saved = ringSaved;
+    uint32_t count;
+    #if defined(__IMXRT1062__)
+    uint32_t cycles;
+    #endif
+
+    if (!eventFrozen) {
+        if ((int32_t)(micros() - startedEvent.trigger_us) < (int32_t)BLACK_BOX_POST_TRIGGER_MS * 1000)
+            return;
+        eventFrozen = true;
+        eventEnd = ringHead;
+        // Dropped records count against the event until it's frozen
+        startedEvent.dropped = blackBoxStats.dropped - eventDropped;
+        saved = eventStart;
+        ringSaved = saved;
+        eventPages = 0;
+    }
+
+    // Without flash, the event is let go
+    if (!blackBoxStats.flash) {
+        eventFrozen = false;
+        eventsDone = eventsDone + 1;
+        return;
+    }
+
+    // The slot must be blank first: the event waits for the alert to be over, see black_box.h
+    if (!isNextSlotBlank()) {
+        if (mayErase)
+            eraseNextSector();
+        return;
+    }
+
+    for (uint8_t i = 0; i < BLACK_BOX_PAGES_PER_LOOP && saved != eventEnd; i++) {
+        // As many records as the page takes, compressed
+        #if defined(__IMXRT1062__)
+        cycles = ARM_DWT_CYCCNT;
+        #endif
+        memset(page, 0xFF, sizeof(page));
+        startRecordEncoding(block, page, sizeof(page));
+        for (count = 0; saved + count != eventEnd; count++) {
+            if (!encodeRecord(block, blackBoxRecords[(saved + count) % BLACK_BOX_RECORDS]))
+                break;
+        }
+        #if defined(__IMXRT1062__)
+        blackBoxStats.encode_cycles += ARM_DWT_CYCCNT - cycles;
+        #endif
+        blackBoxStats.encoded += count;
+        blackBoxStats.bytes += block.position;
+
+        writeFlashPage(slotOffset + (eventPages + 1) * BLACK_BOX_PAGE_SIZE, page);
+        blackBoxStats.pages++;
+        eventPages++;
+        saved += count;
+        // The interrupt may overwrite them from now on
+        ringSaved = saved;
+    }
+    if (saved != eventEnd)
+        return;
+
+    // The event is complete once its first page is written
+    memset(page, 0xFF, sizeof(page));
+    header.magic = BLACK_BOX_MAGIC;
+    header.event = startedEvent;
+    header.event.sequence = nextSequence++;
+    header.event.records = eventEnd - eventStart;
+    memcpy(page, &header, sizeof(header));
+    writeFlashPage(slotOffset, page);
+    blackBoxStats.pages++;
+    blackBoxStats.saved++;
+
+    eventFrozen = false;
+    eventsDone = eventsDone + 1;
+    pickNextSlot();
+}
+
+bool getBlackBoxEvent(uint32_t sequence, BlackBoxEvent &event)
+{
+    for (uint8_t slot = 0; slot < BLACK_BOX_SLOT_COUNT; slot++) {
+        if (readSlot(slot, event) && event.sequence == sequence)
+            return true;
+    }
+    return false;
+}
+
+// Find the slot of an event
+// Return: The slot, BLACK_BOX_SLOT_COUNT if the event isn't saved
+static uint8_t findSlot(uint32_t sequence)
+{
+    BlackBoxEvent event;
+
+    for (uint8_t slot = 0; slot < BLACK_BOX_SLOT_COUNT; slot++) {
+        if (readSlot(slot, event) && event.sequence == sequence)
+            return slot;
+    }
+    return BLACK_BOX_SLOT_COUNT;
+}
+
+// Get the range of the saved events
+// Return: False if there are none
+static bool getSavedRange(uint32_t &first, uint32_t &last)
+{
+    BlackBoxEvent event;
+    bool found = false;
+
+    for (uint8_t slot = 0; slot < BLACK_BOX_SLOT_COUNT; slot++) {
+        if (!readSlot(slot, event))
+            continue;
+        if (!found || event.sequence < first)
+            first = event.sequence;
+        if (!found || event.sequence > last)
+            last = event.sequence;
+        found = true;
+    }
+    return found;
+}
+
+// Print the saved events, one line each
+FLASHMEM static void listEvents()
+{
+    BlackBoxEvent event;
+    uint32_t first, last;
+
+    if (!getSavedRange(first, last)) {
+        Serial.println("no events");
+        return;
+    }
+    for (uint32_t sequence = first; sequence <= last; sequence++) {
+        if (getBlackBoxEvent(sequence, event))
+            Serial.printf("event %u: channel %u reason %u at %u ms, %u records, %u dropped\r\n", (unsigned)event.sequence,
+                event.channel, event.reason, (unsigned)event.trigger_ms, event.records, (unsigned)event.dropped);
+    }
+    if (blackBoxStats.encoded) {
+        Serial.printf("saved %u records in %u bytes, %.1f per record, %u cycles per record\r\n", (unsigned)blackBoxStats.encoded,
+            (unsigned)blackBoxStats.bytes, (float)blackBoxStats.bytes / blackBoxStats.encoded,
+            (unsigned)(blackBoxStats.encode_cycles / blackBoxStats.encoded));
+    }
+}
+
+// Print the next lines of the dump: the event line, then a line per record with its time from the trigger
+FLASHMEM static void dumpEvents()
+{
+    BlackBoxEvent event;
+    BlackBoxRecord record;
+    uint8_t slot;
+
+    // The dump runs at full clock, until it's done
+    if (dumping)
+        requestClockBoost(CLOCK_BOOST_MS);
+
+    for (uint16_t lines = 0; dumping && lines < BLACK_BOX_DUMP_LINES_PER_LOOP; lines++) {
+        slot = findSlot(dumpSequence);
+        if (slot == BLACK_BOX_SLOT_COUNT || !readSlot(slot, event) || dumpRecord > event.records) {
+            // Next event, the one just dumped was overwritten or is done
+            dumpRecord = 0;
+            dumping = dumpSequence++ != dumpLast;
+            continue;
+        }
+
+        if (dumpRecord == 0) {
+            Serial.printf("event,%u,%u,%u,%u,%u,%u\r\n", (unsigned)event.sequence, (unsigned)event.trigger_ms,
+                event.channel, event.reason, event.records, (unsigned)event.dropped);
+            dumpPage = 1;
+            startRecordDecoding(dumpBlock, getFlash((uint32_t)slot * BLACK_BOX_SLOT_SIZE + BLACK_BOX_PAGE_SIZE), BLACK_BOX_PAGE_SIZE);
+        } else {
+            // The records are decoded in order, a page after the other
+            if (!decodeRecord(dumpBlock, record)) {
+                dumpPage++;
+                startRecordDecoding(dumpBlock, getFlash((uint32_t)slot * BLACK_BOX_SLOT_SIZE + dumpPage * BLACK_BOX_PAGE_SIZE),
+                    BLACK_BOX_PAGE_SIZE);
+                if (dumpPage >= BLACK_BOX_SLOT_SIZE / BLACK_BOX_PAGE_SIZE || !decodeRecord(dumpBlock, record)) {
+                    // A corrupted page ends the event
+                    dumpRecord = event.records + 1;
+                    continue;
+                }
+            }
+            Serial.printf("record,%u,%.3f,%u,%.3f,%u,%u\r\n", (unsigned)event.sequence,
+                (int32_t)(record.time_us - event.trigger_us) / 1000.0, record.channel, record.value, record.error, record.reason);
+        }
+        dumpRecord++;
+    }
+}
+
+// Run a serial command
+FLASHMEM static void runCommand()
+{
+    uint32_t first, last;
+
+    if (strcmp(command, "events") == 0) {
+        listEvents();
+    } else if (strncmp(command, "dump", 4) == 0 && (command[4] == 0 || command[4] == ' ')) {
+        if (!getSavedRange(first, last)) {
+            Serial.println("no events");
+        } else {
+            if (command[4] == ' ')
+                first = last = strtoul(command + 5, NULL, 10);
+            dumping = true;
+            dumpSequence = first;
+            dumpLast = last;
+            dumpRecord = 0;
+        }
+    } else if (commandLength && !(commandHandler && commandHandler(command))) {
+        Serial.print("commands: events, dump [event]");
+        if (commandHelp) {
+            Serial.print(", ");
+            Serial.print(commandHelp);
+        }
+        Serial.println();
+    }
+}
+
+void setBlackBoxCommandHandler(BlackBoxCommand handler, const char *help)
+{
+    commandHandler = handler;
+    commandHelp = help;
+}
+
+void serviceBlackBox(bool engineOff)
+{
+    // An erase holds the interrupts: not during an alert, unless the ring would drop records
+    bool mayErase = !isAlertActive() || ringHead - eventStart >= BLACK_BOX_RECORDS * 3 / 4;
+    int c;
+
+    if (eventsStarted != eventsDone) {
+        saveEvent(mayErase);
+    } else if (blackBoxStats.flash && !isNextSlotBlank() && engineOff && !isAlertActive()) {
+        // Get the next slot ready while the timers have nothing to do
+        eraseNextSector();
+    }
+
+    while ((c = Serial.read()) >= 0) {
+        if (c == '\r' || c == '\n') {
+            command[commandLength] = 0;
+            runCommand();
+            commandLength = 0;
+        } else if (commandLength < BLACK_BOX_COMMAND_LENGTH) {
+            command[commandLength++] = c;
+        }
+    }
+    dumpEvents();
+}
+
+uint32_t readBlackBoxRecords(uint32_t &next, BlackBoxRecord *records, uint32_t count)
+{
+    uint32_t head = ringHead;
+    uint32_t copied = 0;
+
+    // The oldest records may be overwritten while they're copied, they are left out
+    if (head - next > BLACK_BOX_RECORDS / 2)
+        next = head - BLACK_BOX_RECORDS / 2;
+    for (; next != head && copied < count; next++)
+        records[copied++] = blackBoxRecords[next % BLACK_BOX_RECORDS];
+    return copied;
+}
+
+void getBlackBoxStats(BlackBoxStats &stats)
+{
+    noInterrupts();
+    memcpy(&stats, &blackBoxStats, sizeof(BlackBoxStats));
+    interrupts();
+}
+
+#else
+
+void initBlackBox()
+{
+}
+
+void recordBlackBox(uint8_t, float, uint8_t, uint8_t, uint32_t)
+{
+}
+
+void triggerBlackBox(uint8_t, uint8_t, uint32_t)
+{
+}
+
+void serviceBlackBox(bool)
+{
+}
+
+bool getBlackBoxEvent(uint32_t, BlackBoxEvent &)
+{
+    return false;
+}
+
+uint32_t readBlackBoxRecords(uint32_t &next, BlackBoxRecord *records, uint32_t count)
+{
+    return 0;
+}
+
+void setBlackBoxCommandHandler(BlackBoxCommand, const char *)
+{
+}
+
+void getBlackBoxStats(BlackBoxStats &stats)
+{
+    memset(&stats, 0, sizeof(BlackBoxStats));
+}
+
+#endif
@@ -0,0 +1,161 @@
+/*
+ * Black box recorder for the RX-8 Ashtray Gauges project.
+ * Every reading of every gauge channel, and every change of its alert state, is recorded as it
+ * reaches the alert timer, into a ring in RAM (the DTCM, see placement.h) holding the last minutes of
+ * driving. When an alert starts (a threshold or a sensor fault), the recorder keeps the
+ * BLACK_BOX_PRE_TRIGGER_MS before it and the BLACK_BOX_POST_TRIGGER_MS after it: those records
+ * can't be overwritten until they are saved in a slot of the program flash, so the event
+ * survives a power off. The last few events are kept, see BLACK_BOX_SLOT_COUNT.
+ *
+ * The readings are recorded at the rate the loop takes them, not as the ADC reads they're made
+ * of: a reading is the mean of ANALOG_SAMPLES_COUNT reads taken back to back, there's nothing
+ * more to see between them, and the alert timer only gets the readings. The highest rate is the
+ * cranking one (see power_state.h), the supply and the oil pressure every 20ms: the ring is
+ * sized for over 30 seconds of it, which is over 3 minutes at the running rate.
+ *
+ * The records are written by the alert timer interrupt and saved by the loop, without locks:
+ *  - The interrupt only writes the records past those the loop still has to save, then moves
+ *    the ring head. A full ring drops records, it never overwrites them.
+ *  - The loop only reads the records behind the head, and moves the saved mark.
+ * The interrupt starts an event and counts it started, the loop counts it done once saved: each
+ * side only writes its own counter. An alert starting while an event is held waits for it to be
+ * saved, then starts the next event with the records since.
+ *
+ * The records are saved compressed, 3 to 6 bytes each instead of 12, the values rounded to the
+ * hundredth (see record_codec.h).
+ * The flash is written a few pages per loop pass. The flash can't be read while it's written, so
+ * the interrupts wait for each page (under a millisecond). A slot is erased ahead of the next
+ * event, one 4kB sector per loop pass, and each erase holds the interrupts for tens of
+ * milliseconds (up to 400): the alert timer runs late, and the tach poll finds the capture
+ * timer may have wrapped (it starts its averaging again, see tach.h). So the next slot is
+ * readied at power up, before the timers start, and while the engine is off without an alert
+ * (see power_state.h). An event saved while the engine runs, its slot not blank yet, erases it
+ * then: once the alert is over, or once the held records take three quarters of the ring, as a
+ * lasting alert (a sensor fault) would otherwise have the ring drop the records past them.
+ *
+ * The events are read over the USB serial port: "events" lists them, "dump" prints the records
+ * of all of them, "dump <event>" of one. Other modules can add their own commands, see
+ * setBlackBoxCommandHandler().
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#ifndef BLACK_BOX_H
+#define BLACK_BOX_H
+
+#include <stdint.h>
+
+// Set this to 0 to not record the readings
+#define ENABLE_BLACK_BOX 1
+
+// Records kept in RAM: 12 bytes each, over 30 seconds of cranking (110 readings a second), over
+// 3 minutes of four gauges read 5 times a second
+#define BLACK_BOX_RECORDS 4096
+
+// Time kept before and after the start of an alert, in milliseconds
+#define BLACK_BOX_PRE_TRIGGER_MS 30000
+#define BLACK_BOX_POST_TRIGGER_MS 10000
+
+// Program flash used to keep the events: a few 64kB slots, just below the EEPROM emulation
+// area of the Teensy 4.0. They are only used if the program doesn't reach them.
+#define BLACK_BOX_FLASH_ADDRESS 0x601B0000
+#define BLACK_BOX_SLOT_COUNT 4
+#define BLACK_BOX_SLOT_SIZE 65536
+#define BLACK_BOX_SECTOR_SIZE 4096
+#define BLACK_BOX_PAGE_SIZE 256
+
+// Flash pages written per loop pass, while saving an event
+#define BLACK_BOX_PAGES_PER_LOOP 4
+
+// Records printed per loop pass, while dumping the events
+#define BLACK_BOX_DUMP_LINES_PER_LOOP 64
+
+// One record: a reading, or the alert state of its channel changing
+typedef struct {
+    uint32_t time_us;           // micros() at the end of the acquisition, or of the change
+    uint8_t channel;            // Gauge channel
+    uint8_t error;              // Error code of the reading
+    uint8_t reason;             // ALERT_* reason the channel is in alert for, after this record
+    uint8_t reserved;
+    float value;                // The reading
+} BlackBoxRecord;
+
+// An event, as saved in the flash
+typedef struct {
+    uint32_t sequence;          // Event number, counting from the first one ever saved
+    uint32_t trigger_ms;        // millis() when the alert started
+    uint32_t trigger_us;        // micros() then, the records are timed against it
+    uint8_t channel;            // Channel and reason of the alert
+    uint8_t reason;
+    uint16_t records;           // Number of records saved
+    uint32_t dropped;           // Records lost because the ring was full, during the event
+} BlackBoxEvent;
+
+// Recorder statistics
+typedef struct {
+    uint32_t records;           // Records written into the ring
+    uint32_t dropped;           // Records lost because the ring was full
+    uint32_t triggers;          // Alerts that started an event
+    uint32_t missed;            // Alerts that came while an event was being saved, after the pending one
+    uint32_t saved;             // Events saved in the flash
+    uint32_t pages;             // Flash pages written
+    uint32_t encoded;           // Records saved, and the flash bytes they took
+    uint32_t bytes;
+    uint32_t encode_cycles;     // CPU cycles spent compressing them, on the Teensy
+    uint32_t sectors;           // Flash sectors erased
+    bool flash;                 // True if the flash slots are used, false if the program reaches them
+} BlackBoxStats;
+
+// Find the events saved in the flash and get the next slot ready. Call this before the timers
+// start: erasing a slot then doesn't hold them.
+void initBlackBox();
+
+// Record a reading, or the change of the alert state of its channel. Call this from the alert
+// timer interrupt only.
+// channel: The gauge channel
+// value: The reading
+// error: Its error code
+// reason: The ALERT_* reason the channel is in alert for
+// timeUs: micros() at the end of the acquisition of the reading, or of the change
+void recordBlackBox(uint8_t channel, float value, uint8_t error, uint8_t reason, uint32_t timeUs);
+
+// Start an event, if none is being captured. Call this from the alert timer interrupt only,
+// when an alert starts.
+// channel: The channel of the alert
+// reason: Its ALERT_* reason
+// nowUs: micros() now
+void triggerBlackBox(uint8_t channel, uint8_t reason, uint32_t nowUs);
+
+// Save the frozen event, erase the next slot and run the serial commands, a few steps at a time.
+// Call this from the loop.
+// engineOff: True while the engine is off: the next slot is readied then, if there's no alert
+void serviceBlackBox(bool engineOff);
+
+// Get a saved event
+// sequence: The event number
+// event: Receives the event
+// Return: False if the event isn't in the flash (not saved yet, or overwritten)
+bool getBlackBoxEvent(uint32_t sequence, BlackBoxEvent &event);
+
+// Copy the records written into the ring since the last call, e.g. to keep a log of the whole
+// drive. Call this from the loop, often enough to keep up with the ring: the records already
+// overwritten are skipped.
+// next: The number of the next record to copy, 0 at first, moved past those copied
+// records: Receives the records
+// count: The most records to copy
+// Return: The number of records copied
+uint32_t readBlackBoxRecords(uint32_t &next, BlackBoxRecord *records, uint32_t count);
+
+// Handles a serial command not known to the black box
+// command: The command line, without its end of line
+// Return: False if the command isn't known either
+typedef bool (*BlackBoxCommand)(const char *command);
+
+// Set the handler of the other serial commands
+// handler: The handler, NULL for none
+// help: Its commands, added to the list printed for an unknown command
+void setBlackBoxCommandHandler(BlackBoxCommand handler, const char *help);
+
+// Get the recorder statistics
+void getBlackBoxStats(BlackBoxStats &stats);
+
+#endif
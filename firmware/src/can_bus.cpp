@@ -0,0 +1,267 @@
+/*
+ * This is the CAN bus source code for the RX-8 Ashtray Gauges project.
+ * The frame encoding and decoding is plain C++ so it can also be built and run on a Linux host
+ * against a SocketCAN (vcan) interface, see 'host/can_ingest.cpp' and 'host/can_gauges.cpp'.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#include <string.h>
+#include "can_bus.h"
+#include "error_codes.h"
+
+// Frame identifiers we let through the hardware filters
+const uint32_t canFilterIds[] = {
+    RX8_CAN_ID_PCM_STATUS,
+    RX8_CAN_ID_PCM_TEMPERATURE
+};
+const uint8_t canFilterCount = sizeof(canFilterIds) / sizeof(canFilterIds[0]);
+
+// The readings store, written by the receive interrupt
+static EcuReadings ecuReadings;
+
+// The latest gauge readings, read by the publish timer interrupt
+static GaugeReadings gaugeReadings;
+
+// Store a 16 bits value, big endian
+static inline void putUint16(uint8_t *buf, uint16_t value)
+{
+    buf[0] = (uint8_t)(value >> 8);
+    buf[1] = (uint8_t)value;
+}
+
+// Read a 16 bits value, big endian
+static inline uint16_t getUint16(const uint8_t *buf)
+{
+    return (uint16_t)((buf[0] << 8) | buf[1]);
+}
+
+// Scale a value to a 16 bits integer, clamped to the type range
+// value: The value to scale
+// scale: The number of steps per unit
+// isSigned: True for an int16 field, False for an uint16 field
+static uint16_t scaleUint16(float value, float scale, bool isSigned)
+{
+    float scaled = value * scale;
+    float min = isSigned ? -32768.0 : 0.0;
+    float max = isSigned ? 32767.0 : 65535.0;
+
+    if (scaled < min)
+        scaled = min;
+    if (scaled > max)
+        scaled = max;
+
+    // Round to the nearest step
+    scaled += scaled < 0 ? -0.5 : 0.5;
+    return isSigned ? (uint16_t)(int16_t)scaled : (uint16_t)scaled;
+}
+
+bool decodeEcuFrame(uint32_t id, const uint8_t *buf, uint8_t len, uint32_t nowMs, EcuReadings &store)
+{
+    int32_t speed;
+
+    switch (id) {
+        case RX8_CAN_ID_PCM_STATUS:
+            if (len < 7) {
+                store.frames_short++;
+                return false;
+            }
+            store.rpm = (uint16_t)((float)((buf[0] << 8) | buf[1]) / RX8_RPM_DIVIDER);
+            // The speed is offset so the car can report a (small) negative value, we don't.
+            speed = (int32_t)((buf[4] << 8) | buf[5]) - RX8_SPEED_OFFSET;
+            store.speed_kph_x100 = speed > 0 ? (uint16_t)speed : 0;
+            store.throttle_pct_x2 = buf[6];
+            // Never store a zero timestamp, zero means 'never seen'
+            store.pcm_status_ms = nowMs ? nowMs : 1;
+            break;
+        case RX8_CAN_ID_PCM_TEMPERATURE:
+            if (len < 1) {
+                store.frames_short++;
+                return false;
+            }
+            store.coolant_temp_celsius = (int16_t)buf[0] - RX8_COOLANT_TEMP_OFFSET;
+            store.pcm_temperature_ms = nowMs ? nowMs : 1;
+            break;
+        default:
+            // The hardware filters should never let this happen
+            store.frames_ignored++;
+            return false;
+    }
+
+    store.frames_decoded++;
+    return true;
+}
+
+void encodeGaugeFrames(const GaugeReadings &readings, uint8_t counter, CanFrame &values, CanFrame &status)
+{
+    uint8_t faults = 0;
+
+    values.id = CAN_ID_GAUGE_VALUES;
+    values.len = 8;
+    putUint16(&values.buf[0], scaleUint16(readings.oil_temp_celsius, 10.0, true));
+    putUint16(&values.buf[2], scaleUint16(readings.oil_psi, 10.0, false));
+    putUint16(&values.buf[4], scaleUint16(readings.coolant_temp_celsius, 10.0, true));
+    putUint16(&values.buf[6], scaleUint16(readings.supply_voltage, 100.0, false));
+
+    // Stuck, noisy or glitching channels still carry a valid value, only their error code tells
+    for (uint8_t i = 0; i < GAUGE_CHANNEL_COUNT; i++) {
+        if (readings.errors[i] != ENOERR && readings.errors[i] != ESENSORSTUCK && readings.errors[i] != ESENSORNOISY &&
+            readings.errors[i] != ESENSORGLITCH)
+            faults |= 1 << i;
+    }
+
+    status.id = CAN_ID_GAUGE_STATUS;
+    status.len = 5;
+    status.buf[0] = readings.alerts;
+    status.buf[1] = faults;
+    status.buf[2] = (uint8_t)((readings.errors[GAUGE_CHANNEL_OIL_TEMP] << 4) | (readings.errors[GAUGE_CHANNEL_OIL_PSI] & 0x0F));
+    status.buf[3] = (uint8_t)((readings.errors[GAUGE_CHANNEL_COOLANT_TEMP] << 4) | (readings.errors[GAUGE_CHANNEL_SUPPLY_VOLTAGE] & 0x0F));
+    status.buf[4] = counter;
+    memset(&status.buf[5], 0, 3);
+}
+
+bool decodeGaugeFrame(uint32_t id, const uint8_t *buf, uint8_t len, GaugeReadings &readings, uint8_t &counter)
+{
+    switch (id) {
+        case CAN_ID_GAUGE_VALUES:
+            if (len < 8)
+                return false;
+            readings.oil_temp_celsius = (int16_t)getUint16(&buf[0]) / 10.0;
+            readings.oil_psi = getUint16(&buf[2]) / 10.0;
+            readings.coolant_temp_celsius = (int16_t)getUint16(&buf[4]) / 10.0;
+            readings.supply_voltage = getUint16(&buf[6]) / 100.0;
+            return true;
+        case CAN_ID_GAUGE_STATUS:
+            if (len < 5)
+                return false;
+            readings.alerts = buf[0];
+            readings.errors[GAUGE_CHANNEL_OIL_TEMP] = buf[2] >> 4;
+            readings.errors[GAUGE_CHANNEL_OIL_PSI] = buf[2] & 0x0F;
+            readings.errors[GAUGE_CHANNEL_COOLANT_TEMP] = buf[3] >> 4;
+            readings.errors[GAUGE_CHANNEL_SUPPLY_VOLTAGE] = buf[3] & 0x0F;
+            counter = buf[4];
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool isEcuReadingFresh(uint32_t lastMs, uint32_t nowMs)
+{
+    return lastMs != 0 && (uint32_t)(nowMs - lastMs) < CAN_READING_TIMEOUT_MS;
+}
+
+#if defined(__IMXRT1062__)
+
+#include <Arduino.h>
+
+#if ENABLE_CAN_BUS
+#include <FlexCAN_T4.h>
+
+// CAN2 is the only controller available on pins we can reach on the Teensy 4.0 (0 and 1).
+// We never call events(), so the library calls our handler straight from the interrupt with a
+// reference to the mailbox copy: nothing is queued and the frame is decoded where it lands.
+static FlexCAN_T4<CAN2, RX_SIZE_16, TX_SIZE_16> canBus;
+
+// Called from the CAN interrupt for every frame matching one of the mailbox filters
+FASTRUN static void onCanFrame(const CAN_message_t &msg)
+{
+    if (msg.flags.overrun)
+        ecuReadings.frames_overrun++;
+
+    decodeEcuFrame(msg.id, msg.buf, msg.len, millis(), ecuReadings);
+}
+
+#if ENABLE_CAN_PUBLISH
+// This timer sends the gauge frames at CAN_PUBLISH_RATE_HZ
+static IntervalTimer canPublishTimer;
+
+// Copy a frame into a library message and queue it.
+// write() puts it straight into a free transmit mailbox, or in the library transmit queue that
+// is emptied from the CAN interrupt as mailboxes complete. Nothing here ever waits on the bus.
+static void queueFrame(const CanFrame &frame)
+{
+    CAN_message_t msg;
+
+    msg.id = frame.id;
+    msg.len = frame.len;
+    msg.flags.extended = 0;
+    msg.flags.remote = 0;
+    memcpy(msg.buf, frame.buf, sizeof(msg.buf));
+    canBus.write(msg);
+}
+
+// Called from the publish timer interrupt
+FASTRUN static void sendGaugeFrames()
+{
+    static uint8_t counter = 0;
+    CanFrame values;
+    CanFrame status;
+
+    encodeGaugeFrames(gaugeReadings, counter++, values, status);
+    queueFrame(values);
+    queueFrame(status);
+}
+#endif
+#endif
+
+FLASHMEM void initCanBus()
+{
+    #if ENABLE_CAN_BUS
+    canBus.begin();
+    canBus.setBaudRate(CAN_BAUD_RATE);
+    canBus.setMaxMB(16);
+
+    // One receive mailbox per identifier, everything else is left for transmission.
+    // The controller compares every frame on the bus against the mailbox filters in hardware,
+    // so the rest of the bus traffic costs no CPU time at all, even at full bus load.
+    for (uint8_t i = 0; i < 16; i++) {
+        canBus.setMB((FLEXCAN_MAILBOX)i, i < canFilterCount ? RX : TX, STD);
+    }
+    canBus.setMBFilter(REJECT_ALL);
+    canBus.enableMBInterrupts();
+    for (uint8_t i = 0; i < canFilterCount; i++) {
+        canBus.setMBFilter((FLEXCAN_MAILBOX)i, canFilterIds[i]);
+        canBus.onReceive((FLEXCAN_MAILBOX)i, onCanFrame);
+    }
+
+    #if ENABLE_CAN_PUBLISH
+    // Lower priority than the CAN interrupt (default 128), so receiving is never delayed by sending
+    canPublishTimer.priority(160);
+    canPublishTimer.begin(sendGaugeFrames, 1000000 / CAN_PUBLISH_RATE_HZ);
+    #endif
+    #endif
+}
+
+void publishGaugeReadings(const GaugeReadings &readings)
+{
+    noInterrupts();
+    memcpy(&gaugeReadings, &readings, sizeof(GaugeReadings));
+    interrupts();
+}
+
+void getEcuReadings(EcuReadings &readings)
+{
+    noInterrupts();
+    memcpy(&readings, &ecuReadings, sizeof(EcuReadings));
+    interrupts();
+}
+
+#else
+
+// On the host, frames are fed to decodeEcuFrame() directly by the caller
+
+void initCanBus()
+{
+}
+
+void publishGaugeReadings(const GaugeReadings &readings)
+{
+    memcpy(&gaugeReadings, &readings, sizeof(GaugeReadings));
+}
+
+void getEcuReadings(EcuReadings &readings)
+{
+    memcpy(&readings, &ecuReadings, sizeof(EcuReadings));
+}
+
+#endif
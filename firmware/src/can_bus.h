@@ -0,0 +1,156 @@
+/*
+ * This is the CAN bus header file for the RX-8 Ashtray Gauges project.
+ * It listens to the RX-8 HS-CAN bus for the few ECU frames the gauges care about,
+ * and publishes the gauge readings for data loggers and dashes on the same bus.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#ifndef CAN_BUS_H
+#define CAN_BUS_H
+
+#include <stdint.h>
+
+// Set this to 1 to listen to the car's HS-CAN bus.
+// This needs a 3.3V CAN transceiver (SN65HVD230 or similar) wired to pins 0 (CRX2) and 1 (CTX2)
+// of the Teensy, and to the CAN-H/CAN-L pins of the diagnostic port.
+#define ENABLE_CAN_BUS 0
+
+// The RX-8 HS-CAN bus runs at 500 kbit/s
+#define CAN_BAUD_RATE 500000
+
+// RX-8 ECU frame identifiers.
+// These come from the community reverse engineering of the RX-8 bus, not from a Mazda document.
+// 0x201: Engine RPM, vehicle speed and accelerator pedal position, sent every 10ms
+// 0x420: Engine coolant temperature and warning lamps, sent every 100ms
+#define RX8_CAN_ID_PCM_STATUS 0x201
+#define RX8_CAN_ID_PCM_TEMPERATURE 0x420
+
+// Scaling of the 0x201 and 0x420 payloads
+// RPM = ((B0 << 8) + B1) / 3.85
+// Speed (km/h) = (((B4 << 8) + B5) - 10000) / 100
+// Throttle (%) = B6 / 2
+// Coolant (C) = B0 - 40
+#define RX8_RPM_DIVIDER 3.85
+#define RX8_SPEED_OFFSET 10000
+#define RX8_COOLANT_TEMP_OFFSET 40
+
+// Set this to 1 to broadcast the gauge readings on the CAN bus (needs ENABLE_CAN_BUS)
+#define ENABLE_CAN_PUBLISH 1
+
+// How often the gauge frames are sent, in Hz
+#define CAN_PUBLISH_RATE_HZ 10
+
+// Identifiers of the frames we send. They must not be used by anything else on your bus,
+// these two are free on a stock RX-8.
+#define CAN_ID_GAUGE_VALUES 0x6A0
+#define CAN_ID_GAUGE_STATUS 0x6A1
+
+/* Gauge frames layout, all values are big endian (as the RX-8 ECU frames)
+ * CAN_ID_GAUGE_VALUES, DLC 8:
+ *   B0-B1: Oil temperature, int16, 0.1 C
+ *   B2-B3: Oil pressure, uint16, 0.1 PSI
+ *   B4-B5: Coolant temperature, int16, 0.1 C
+ *   B6-B7: Supply voltage, uint16, 0.01 V
+ * CAN_ID_GAUGE_STATUS, DLC 5:
+ *   B0: Alert bits, see GAUGE_ALERT_*
+ *   B1: Fault bits, one per channel, set when the value in the values frame is not valid
+ *   B2: Oil temperature error code (high nibble), oil pressure error code (low nibble), see error_codes.h
+ *   B3: Coolant temperature error code (high nibble), supply voltage error code (low nibble)
+ *   B4: Rolling counter, incremented for every pair of frames sent
+ */
+#define GAUGE_ALERT_OIL_TEMP_HIGH       0x01
+#define GAUGE_ALERT_OIL_PSI_LOW         0x02
+#define GAUGE_ALERT_OIL_PSI_HIGH        0x04
+#define GAUGE_ALERT_COOLANT_TEMP_HIGH   0x08
+#define GAUGE_ALERT_VOLTAGE_LOW         0x10
+#define GAUGE_ALERT_VOLTAGE_HIGH        0x20
+
+// Channels, in the order of the values frame. Also the bit number in the fault bits.
+#define GAUGE_CHANNEL_OIL_TEMP 0
+#define GAUGE_CHANNEL_OIL_PSI 1
+#define GAUGE_CHANNEL_COOLANT_TEMP 2
+#define GAUGE_CHANNEL_SUPPLY_VOLTAGE 3
+#define GAUGE_CHANNEL_COUNT 4
+
+// A reading is considered stale if its frame hasn't been seen for this long, in milliseconds
+#define CAN_READING_TIMEOUT_MS 500
+
+// Readings decoded from the ECU frames.
+// This is written from the CAN receive interrupt, use getEcuReadings() to get a consistent copy.
+typedef struct {
+    uint16_t rpm;                   // Engine speed, in RPM
+    uint16_t speed_kph_x100;        // Vehicle speed, in 1/100 km/h
+    uint8_t throttle_pct_x2;        // Accelerator pedal position, in 1/2 %
+    int16_t coolant_temp_celsius;   // ECU coolant temperature, in Celsius
+    uint32_t pcm_status_ms;         // millis() when 0x201 was last decoded
+    uint32_t pcm_temperature_ms;    // millis() when 0x420 was last decoded
+    uint32_t frames_decoded;        // Frames accepted and decoded
+    uint32_t frames_ignored;        // Frames that got through the filters but that we don't know
+    uint32_t frames_short;          // Frames with a DLC too short for their layout
+    uint32_t frames_overrun;        // Frames the controller reported as overrun (a frame was lost before it)
+} EcuReadings;
+
+// The converted gauge readings, as sent on the bus
+typedef struct {
+    float oil_temp_celsius;
+    float oil_psi;
+    float coolant_temp_celsius;
+    float supply_voltage;
+    uint8_t errors[GAUGE_CHANNEL_COUNT];    // ENOERR or the error code of each channel
+    uint8_t alerts;                         // GAUGE_ALERT_* bits
+} GaugeReadings;
+
+// A CAN frame, independent of the controller library
+typedef struct {
+    uint32_t id;
+    uint8_t len;
+    uint8_t buf[8];
+} CanFrame;
+
+// The identifiers accepted by the hardware filters, one receive mailbox each
+extern const uint32_t canFilterIds[];
+extern const uint8_t canFilterCount;
+
+// Decode one CAN frame straight from the receive buffer into the readings store
+// id: The standard (11 bits) frame identifier
+// buf: The frame payload, decoded in place
+// len: The frame DLC
+// nowMs: The timestamp to record against the decoded values
+// store: The readings store to update
+// Return: True if the frame was one of ours and has been decoded, otherwise false
+bool decodeEcuFrame(uint32_t id, const uint8_t *buf, uint8_t len, uint32_t nowMs, EcuReadings &store);
+
+// Return true if the specified frame timestamp is recent enough to be trusted
+// lastMs: The timestamp recorded when the frame was decoded (zero if never seen)
+// nowMs: The current timestamp
+bool isEcuReadingFresh(uint32_t lastMs, uint32_t nowMs);
+
+// Encode the gauge readings into the two gauge frames
+// readings: The readings to encode
+// counter: The rolling counter value to put in the status frame
+// values: The frame that will hold the values
+// status: The frame that will hold the alert and fault bits
+void encodeGaugeFrames(const GaugeReadings &readings, uint8_t counter, CanFrame &values, CanFrame &status);
+
+// Decode one of the gauge frames into the readings
+// Only the fields carried by that frame are updated.
+// id, buf, len: The received frame
+// readings: The readings to update
+// counter: The variable that will hold the rolling counter, if the frame is the status frame
+// Return: True if the frame was one of the gauge frames, otherwise false
+bool decodeGaugeFrame(uint32_t id, const uint8_t *buf, uint8_t len, GaugeReadings &readings, uint8_t &counter);
+
+// Configure the CAN controller, its receive mailboxes and hardware filters
+// Does nothing unless ENABLE_CAN_BUS is set
+void initCanBus();
+
+// Hand the latest gauge readings over to the publisher
+// They are sent from a timer interrupt at CAN_PUBLISH_RATE_HZ, so this only copies them.
+// readings: The readings to publish
+void publishGaugeReadings(const GaugeReadings &readings);
+
+// Copy the current ECU readings, with the receive interrupt masked for the copy
+// readings: The variable that will hold the copy
+void getEcuReadings(EcuReadings &readings);
+
+#endif
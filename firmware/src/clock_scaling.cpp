@@ -0,0 +1,164 @@
+/*
+ * CPU clock scaling for the RX-8 Ashtray Gauges project, see clock_scaling.h.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#include <string.h>
+#include <Arduino.h>
+#include "clock_scaling.h"
+
+static_assert(CLOCK_HIGH_HZ % 150000000 == 0 && CLOCK_LOW_HZ % 150000000 == 0,
+    "The clocks must be multiples of 150 MHz, to keep the peripheral bus at 150 MHz");
+static_assert(CLOCK_RESUME_CELSIUS < CLOCK_THROTTLE_CELSIUS, "The throttling needs some hysteresis");
+
+#if !defined(__IMXRT1062__)
+// On the host, the die temperature the replay tool sets
+float hostDieCelsius = 40;
+#endif
+
+static ClockStats clockStats = {CLOCK_HIGH_HZ};
+
+#if defined(__IMXRT1062__)
+
+// Teensy core, clockspeed.c: changes the PLL, the dividers and the core voltage, and the scale of micros()
+extern "C" uint32_t set_arm_clock(uint32_t frequency);
+
+static inline void setArmClock(uint32_t hz)
+{
+    set_arm_clock(hz);
+}
+
+static inline float readDieCelsius()
+{
+    return tempmonGetTemp();
+}
+
+#else
+
+static inline void setArmClock(uint32_t)
+{
+}
+
+static inline float readDieCelsius()
+{
+    return hostDieCelsius;
+}
+
+#endif
+
+#if ENABLE_CLOCK_SCALING
+
+static uint32_t boostUntilMs;               // millis() the last boost ends at
+static uint32_t nextTempMs;                 // millis() the die temperature is read next
+static uint32_t clockSinceMs;               // millis() the time at the current clock counts from
+
+// Add the time since the last call to the current clock
+static void accountClockTime()
+{
+    uint32_t nowMs = millis();
+
+    if (clockStats.hz == CLOCK_HIGH_HZ)
+        clockStats.high_ms += nowMs - clockSinceMs;
+    else
+        clockStats.low_ms += nowMs - clockSinceMs;
+    clockSinceMs = nowMs;
+}
+
+static void setClock(uint32_t hz)
+{
+    uint32_t startUs;
+
+    if (hz == clockStats.hz)
+        return;
+    accountClockTime();
+    startUs = micros();
+    setArmClock(hz);
+    clockStats.switch_max_us = max(clockStats.switch_max_us, (uint32_t)(micros() - startUs));
+    clockStats.switches++;
+    clockStats.hz = hz;
+}
+
+// Read the die temperature, and throttle or stop throttling
+static void readDieTemperature()
+{
+    clockStats.die_celsius = readDieCelsius();
+    if (clockStats.die_celsius > clockStats.die_max_celsius)
+        clockStats.die_max_celsius = clockStats.die_celsius;
+
+    if (!clockStats.throttled && clockStats.die_celsius >= CLOCK_THROTTLE_CELSIUS) {
+        clockStats.throttled = true;
+        clockStats.throttles++;
+    } else if (clockStats.throttled && clockStats.die_celsius <= CLOCK_RESUME_CELSIUS) {
+        clockStats.throttled = false;
+    }
+}
+
+void initClockScaling()
+{
+    clockSinceMs = millis();
+    nextTempMs = clockSinceMs + CLOCK_TEMP_PERIOD_MS;
+    boostUntilMs = clockSinceMs;
+    readDieTemperature();
+    setClock(CLOCK_LOW_HZ);
+}
+
+void requestClockBoost(uint32_t durationMs)
+{
+    uint32_t untilMs = millis() + durationMs;
+
+    clockStats.boosts++;
+    if ((int32_t)(untilMs - boostUntilMs) > 0)
+        boostUntilMs = untilMs;
+    if (clockStats.throttled)
+        clockStats.refused++;
+    else
+        setClock(CLOCK_HIGH_HZ);
+}
+
+void serviceClockScaling()
+{
+    uint32_t nowMs = millis();
+
+    if ((int32_t)(nowMs - nextTempMs) >= 0) {
+        nextTempMs = nowMs + CLOCK_TEMP_PERIOD_MS;
+        readDieTemperature();
+    }
+
+    if (clockStats.throttled || (int32_t)(nowMs - boostUntilMs) >= 0)
+        setClock(CLOCK_LOW_HZ);
+}
+
+void getClockStats(ClockStats &stats)
+{
+    uint32_t totalMs;
+
+    accountClockTime();
+    memcpy(&stats, &clockStats, sizeof(ClockStats));
+    totalMs = stats.high_ms + stats.low_ms;
+    stats.average_ma = totalMs ? ((float)stats.high_ms * CLOCK_HIGH_MA + (float)stats.low_ms * CLOCK_LOW_MA) / totalMs
+        : (stats.hz == CLOCK_HIGH_HZ ? CLOCK_HIGH_MA : CLOCK_LOW_MA);
+}
+
+#else
+
+void initClockScaling()
+{
+}
+
+void requestClockBoost(uint32_t)
+{
+}
+
+void serviceClockScaling()
+{
+}
+
+void getClockStats(ClockStats &stats)
+{
+    memcpy(&stats, &clockStats, sizeof(ClockStats));
+    stats.die_celsius = stats.die_max_celsius = readDieCelsius();
+    stats.high_ms = millis();
+    stats.average_ma = CLOCK_HIGH_MA;
+}
+
+#endif
@@ -0,0 +1,80 @@
+/*
+ * CPU clock scaling for the RX-8 Ashtray Gauges project.
+ * The loop does a few hundred microseconds of work per frame at 600 MHz and waits for the rest
+ * of it, in a hot and closed housing. The ARM clock is kept at CLOCK_LOW_HZ (which also lowers
+ * the core voltage) and only raised to CLOCK_HIGH_HZ for a while when something asks for it
+ * (requestClockBoost()): the serial diagnostics, the black box dump. The lid being closed
+ * changes nothing, the clock is already low.
+ *
+ * The die temperature is read every CLOCK_TEMP_PERIOD_MS: from CLOCK_THROTTLE_CELSIUS, the clock
+ * stays low whatever is asked for, until the die is back to CLOCK_RESUME_CELSIUS. The Teensy core
+ * shuts the chip down on its own at 90°C, the throttling comes well before.
+ *
+ * Both clocks are multiples of 150 MHz, so the peripheral bus (IPG) stays at 150 MHz: the tach
+ * timer, the ADC and the interval timers run the same at both. What changes is the time the
+ * interrupts take, four times longer at 150 MHz: the alert timer interrupt goes from a few to a
+ * few tens of microseconds, against its 1ms period. The "clock" serial command reports it, with
+ * the die temperature, the time spent at each clock and the current it should have drawn.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#ifndef CLOCK_SCALING_H
+#define CLOCK_SCALING_H
+
+#include <stdint.h>
+
+// Set this to 0 to run at 600 MHz all the time
+#define ENABLE_CLOCK_SCALING 1
+
+// The ARM clocks, in Hz: multiples of 150 MHz, see above
+#define CLOCK_HIGH_HZ 600000000
+#define CLOCK_LOW_HZ 150000000
+
+// Time a boost keeps the clock high, in milliseconds, for the callers that have no better idea
+#define CLOCK_BOOST_MS 2000
+
+// Time between two readings of the die temperature, in milliseconds
+#define CLOCK_TEMP_PERIOD_MS 1000
+
+// Die temperature the clock is held low from, and the one it may go high again below, in °C
+#define CLOCK_THROTTLE_CELSIUS 80
+#define CLOCK_RESUME_CELSIUS 70
+
+// Current drawn by the Teensy at each clock, in mA, for the estimate of the average: PJRC's
+// figure at 600 MHz, and about half of it at 150 MHz with the lower core voltage. Measure your
+// own board to refine them.
+#define CLOCK_HIGH_MA 100
+#define CLOCK_LOW_MA 50
+
+// Clock scaling statistics
+typedef struct {
+    uint32_t hz;                // ARM clock now
+    float die_celsius;          // Last die temperature read
+    float die_max_celsius;      // Highest one since power up
+    bool throttled;             // The die is too hot, the clock is held low
+    uint32_t throttles;         // Times the die got too hot
+    uint32_t boosts;            // Boosts asked for
+    uint32_t refused;           // Boosts asked for while throttled
+    uint32_t switches;          // Clock changes
+    uint32_t switch_max_us;     // Longest clock change
+    uint32_t high_ms;           // Time spent at CLOCK_HIGH_HZ and CLOCK_LOW_HZ
+    uint32_t low_ms;
+    float average_ma;           // Estimated average current, from the time at each clock
+} ClockStats;
+
+// Lower the clock to CLOCK_LOW_HZ, at the end of the power up
+void initClockScaling();
+
+// Raise the clock to CLOCK_HIGH_HZ now, unless the die is too hot, and keep it there for a while.
+// Call this from the loop.
+// durationMs: The time to keep it high for, from now
+void requestClockBoost(uint32_t durationMs);
+
+// Read the die temperature when it's due, and lower the clock once the boosts are over or the
+// die is too hot. Call this from the loop.
+void serviceClockScaling();
+
+// Get the clock scaling statistics
+void getClockStats(ClockStats &stats);
+
+#endif
@@ -11,6 +11,32 @@
 #include <Adafruit_SSD1306.h>
 #include "coolant_monitor.h"
 #include "FreeSans18pt7bNum.h"
+#include "can_bus.h"
+#include "sensor_health.h"
+#include "trend_graph.h"
+#include "display_bus.h"
+#include "display_manager.h"
+#include "alert.h"
+#include "adc_compare.h"
+#include "gauge_channel.h"
+#include "adc_pair.h"
+#include "tach.h"
+#include "black_box.h"
+#include "ripple.h"
+#include "sensor_snapshot.h"
+#include "thermal_lag.h"
+#include "record_codec.h"
+#include "placement.h"
+#include "clock_scaling.h"
+#include "power_state.h"
+#include "warm_start.h"
+
+#if DUAL_ADC_SAMPLING && ADC_COMPARE_ALARMS
+#error "DUAL_ADC_SAMPLING and ADC_COMPARE_ALARMS both need the second ADC"
+#endif
+#if ENABLE_RIPPLE_ANALYSIS && (DUAL_ADC_SAMPLING || ADC_COMPARE_ALARMS)
+#error "ENABLE_RIPPLE_ANALYSIS needs the second ADC, it can't be used with DUAL_ADC_SAMPLING or ADC_COMPARE_ALARMS"
+#endif
 
 #define OLED_RESET 4 // Reset for Adafruit SSD1306
 
@@ -18,27 +44,116 @@
 Adafruit_SSD1306 display_1(128, 64, &Wire, OLED_RESET);
 Adafruit_SSD1306 display_2(128, 64, &Wire1, OLED_RESET);
 
-// This timer is used to run the buzzer for a user defined number of seconds.
-// Called on entering fault or warning state.
-IntervalTimer buzzerTimer;
-
-// Values to cache the current reading in memory
-float current_oil_temp;
-float current_oil_psi;
+// What each panel shows: a temperature gauge on its top half, and the oil pressure or
+// the supply voltage on its bottom half
+typedef struct {
+    Adafruit_SSD1306 *display;
+    TwoWire *wire;
+    uint8_t address;
+    uint8_t scl_pin;
+    uint8_t sda_pin;
+    uint8_t top;        // Index in gauge_channels of a gauge drawn on the top half
+    uint8_t bottom;     // Index in gauge_channels of a gauge drawn on the bottom half
+} GaugePanelLayout;
+
+// To add a panel, construct its display above and add it here. A second panel on a bus
+// takes DISPLAY_ADDRESS_SECONDARY (SA0 jumper of the module moved).
+const GaugePanelLayout gauge_panel_layouts[] = {
+    {&display_1, &Wire, DISPLAY_ADDRESS_PRIMARY, SCL0_PIN, SDA0_PIN, GAUGE_CHANNEL_OIL_TEMP, GAUGE_CHANNEL_OIL_PSI},
+    {&display_2, &Wire1, DISPLAY_ADDRESS_PRIMARY, SCL1_PIN, SDA1_PIN, GAUGE_CHANNEL_COOLANT_TEMP, GAUGE_CHANNEL_SUPPLY_VOLTAGE},
+};
+#define GAUGE_PANEL_COUNT (sizeof(gauge_panel_layouts) / sizeof(GaugePanelLayout))
+
+// Every transfer to the displays goes through the manager and their bus state: only the changed
+// pages are sent, within a bus time budget per frame, and a display that stops answering is left
+// alone until it's recovered instead of stalling the loop. Panels in gauge_panel_layouts order.
+DisplayManager display_manager;
+
+// Thermistor reference of each input
 bool oil_thermistor_reference_mode_high = true;
-float current_coolant_temp;
-//float current_coolant_psi;
-float current_supply_voltage;
 bool cool_thermistor_reference_mode_high = true;
 
+// Reference switching state of a thermistor input
+typedef struct {
+    uint32_t switched_us;   // micros() when the reference was last switched
+    bool settling;          // True until the input has been read after the switch
+} ThermistorReference;
+ThermistorReference oil_thermistor_reference;
+ThermistorReference cool_thermistor_reference;
+
+// The gauge channels and their last readings, see the table below displayIntro(). Only the loop
+// uses the states, everything else reads the snapshot it publishes (see sensor_snapshot.h).
+extern const GaugeChannel gauge_channels[];
+extern const uint8_t gauge_channel_count;
+GaugeChannelState gauge_channel_states[GAUGE_CHANNEL_MAX];
+
+#if DUAL_ADC_SAMPLING
+// Two gauge channels sampled together, the first on ADC1 and the second on ADC2
+typedef struct {
+    uint8_t first;
+    uint8_t second;
+} GaugeChannelPair;
+
+// The channels sampled in pairs, by index in gauge_channels. Each pair is read back to back, the
+// channels left out are read on their own. Temperatures go with the pressure or voltage shown
+// on the same panel.
+const GaugeChannelPair gauge_channel_pairs[] = {
+    {GAUGE_CHANNEL_OIL_TEMP, GAUGE_CHANNEL_OIL_PSI},
+    {GAUGE_CHANNEL_COOLANT_TEMP, GAUGE_CHANNEL_SUPPLY_VOLTAGE},
+};
+#define GAUGE_CHANNEL_PAIR_COUNT (sizeof(gauge_channel_pairs) / sizeof(GaugeChannelPair))
+
+// Mean of the samples of a paired acquisition, waiting for the read of the channel
+typedef struct {
+    float raw;
+    bool ready;
+} PairedSample;
+PairedSample paired_samples[GAUGE_CHANNEL_MAX];
+#endif
+
+#if ADC_COMPARE_ALARMS
+// Hardware compare window of a channel, in ADC counts, see adc_compare.h
+typedef struct {
+    uint16_t low;
+    uint16_t high;
+} CompareWindow;
+
+// Windows of the gauge channels with the low [0] and the high [1] thermistor reference.
+// Only the thermistor windows depend on the reference. Filled by initCompareWindows().
+CompareWindow compare_windows[GAUGE_CHANNEL_COUNT][2];
+
+// Watch a channel with the window of the current thermistor reference
+// channel: The GAUGE_CHANNEL_* channel
+// referenceHigh: The thermistor reference, ignored by the other channels
+void armCompareAlarm(uint8_t channel, bool referenceHigh)
+{
+    const CompareWindow &window = compare_windows[channel][referenceHigh ? 1 : 0];
+
+    setAdcCompareWindow(channel, gauge_channels[channel].pin, window.low, window.high);
+}
+#endif
+
+// Current low oil pressure warning threshold, following the engine speed, see updateOilPsiLowLimit()
+float oil_psi_low_limit = OIL_PSI_WARNING_LOW;
+
 // General booleans we can check to see what's going on
 bool temperatureUnitIsFahrenheit = false;
 bool pressureUnitIsBar = false;
 bool currentDaylight = true;
 bool lidClosed = false;
+bool engineOff = false;     // The displays are off while the engine is off, see power_state.h
 
-bool in_alert = false; 
-bool buzzer_currently_playing = false;
+// Ignition power state, from the supply voltage, and the passes since the cranking started
+PowerState power_state;
+uint32_t capture_passes = 0;
+
+// Time between two reads of an analogue sample, shorter while cranking
+uint32_t analog_delay_ms = ANALOG_DELAY_BETWEEN_ACQUISITIONS;
+
+// State saved for a warm restart, and restored from at power up if this one is, see warm_start.h
+WarmState warm_state;
+bool warm_start = false;
+uint32_t setup_ms;          // millis() at the start of setup()
 
 bool coolant_temp_warn_happened = false;
 //bool coolant_psi_warn_happened = false;
@@ -46,29 +161,184 @@ bool oil_temp_warn_happened = false;
 bool oil_psi_warn_happened = false;
 bool voltage_warn_happened = false;
 
+// Streaming health of the analogue inputs, fed with every raw sample taken
+SensorHealth oil_temp_health;
+SensorHealth oil_psi_health;
+SensorHealth coolant_temp_health;
+SensorHealth voltage_health;
+
+#if TREND_GRAPH_MODE
+// History of the readings, for the trend graphs
+TrendGraph oil_temp_trend;
+TrendGraph oil_psi_trend;
+TrendGraph coolant_temp_trend;
+TrendGraph voltage_trend;
+#define GAUGE_TREND(graph) (&(graph))
+#else
+#define GAUGE_TREND(graph) NULL
+#endif
+
+// Get the health state tracking the specified analogue pin
+// pin: The analogue pin
+// Return: A pointer to the health state, or NULL if the pin isn't tracked
+SensorHealth *getSensorHealth(uint8_t pin)
+{
+    for (uint8_t i = 0; i < gauge_channel_count; i++) {
+        if (gauge_channels[i].pin == pin)
+            return gauge_channels[i].health;
+    }
+    return NULL;
+}
+
+// Get the health code of the specified analogue pin, if the reading is still usable
+// pin: The analogue pin
+// Return: ENOERR, or a ESENSOR* code if the sensor is degraded or failed
+uint8_t getSensorHealthCode(uint8_t pin)
+{
+    SensorHealth *health = getSensorHealth(pin);
+    return health ? health->fault : ENOERR;
+}
+
 // Read the specified analogue input pin many times and return the mean
 // pin: The pin on which the analogue read will occur
+// health: The health state to feed with the samples, NULL to not analyse them
+// discard: The number of reads to throw away before the samples, at least 1 to warm up the ADC
+// delayMs: The time to wait between two reads, in milliseconds
 // Return: A float between 0 and 1023 representing the analogue value on the specified pin
-float readAnalogInputRaw(uint8_t pin)
+float sampleAnalogInput(uint8_t pin, SensorHealth *health, uint8_t discard, uint32_t delayMs)
 {
     uint16_t cumulative_value = 0;
     int single_value;
 
-    // The first read is a dummy read only to warm up the ADC, so we Loop from zero to
-    // ANALOG_SAMPLES_COUNT inclusively, in fact ANALOG_SAMPLES_COUNT + 1 times.
-    for (size_t i = 0; i <= ANALOG_SAMPLES_COUNT; i++)
+    // The first reads are dummy reads only to warm up the ADC (or let the input settle),
+    // so we Loop ANALOG_SAMPLES_COUNT + discard times.
+    for (size_t i = 0; i < (size_t)ANALOG_SAMPLES_COUNT + discard; i++)
     {
         single_value = analogRead(pin);
 
-        // If it's the first read, force the value to zero, it it will not be taken into account
-        cumulative_value += i > 0 ? single_value : 0;
-        delay(ANALOG_DELAY_BETWEEN_ACQUISITIONS);
+        // If it's a dummy read, force the value to zero, it it will not be taken into account
+        cumulative_value += i >= discard ? single_value : 0;
+
+        // Every real sample goes through the sensor health analysis
+        if (i >= discard && health)
+            updateSensorHealth(*health, (uint16_t)single_value);
+        if (delayMs)
+            delay(delayMs);
     }
 
     // Return the arithmetic mean
     return (float)cumulative_value / (float)ANALOG_SAMPLES_COUNT;
 }
 
+// Take care of a thermistor reference switch made since the last read of an input: wait for
+// what's left of the settle time
+// pin: The analogue pin, nothing is done if it isn't a thermistor input
+// Return: The number of reads to throw away before the samples
+uint8_t settleThermistorReference(uint8_t pin)
+{
+    ThermistorReference *reference = NULL;
+    uint32_t elapsedUs;
+
+    if (pin == OIL_ANALOG_INPUT_PIN)
+        reference = &oil_thermistor_reference;
+    else if (pin == COOLANT_ANALOG_INPUT_PIN)
+        reference = &cool_thermistor_reference;
+    if (!reference || !reference->settling)
+        return 1;
+
+    elapsedUs = micros() - reference->switched_us;
+    if (elapsedUs < THERMISTOR_REFERENCE_SETTLE_US)
+        delayMicroseconds(THERMISTOR_REFERENCE_SETTLE_US - elapsedUs);
+    reference->settling = false;
+    // The transition samples go as well
+    return 1 + THERMISTOR_REFERENCE_DISCARD_SAMPLES;
+}
+
+#if DUAL_ADC_SAMPLING
+// Read two analogue input pins at the same time, one on each ADC, many times and return the means
+// pinA, pinB: The pins, converted by ADC1 and ADC2
+// healthA, healthB: The health states to feed with the samples, NULL to not analyse them
+// discard: The number of reads to throw away before the samples, at least 1 to warm up the ADCs
+// delayMs: The time to wait between two reads, in milliseconds
+// meanA, meanB: Receive a float between 0 and 1023 representing the analogue value on each pin
+void sampleAnalogPair(uint8_t pinA, SensorHealth *healthA, uint8_t pinB, SensorHealth *healthB,
+    uint8_t discard, uint32_t delayMs, float &meanA, float &meanB)
+{
+    uint16_t cumulativeA = 0, cumulativeB = 0;
+    uint16_t a, b;
+
+    for (size_t i = 0; i < (size_t)ANALOG_SAMPLES_COUNT + discard; i++)
+    {
+        analogReadPair(pinA, pinB, a, b);
+        if (i >= discard) {
+            cumulativeA += a;
+            cumulativeB += b;
+            if (healthA)
+                updateSensorHealth(*healthA, a);
+            if (healthB)
+                updateSensorHealth(*healthB, b);
+        }
+        if (delayMs)
+            delay(delayMs);
+    }
+
+    meanA = (float)cumulativeA / (float)ANALOG_SAMPLES_COUNT;
+    meanB = (float)cumulativeB / (float)ANALOG_SAMPLES_COUNT;
+}
+#endif
+
+// Take the mean of a paired acquisition of a pin, if one is waiting
+// pin: The analogue pin
+// raw: Receives the mean
+// Return: False if there is none, the pin must be sampled
+bool takePairedSample(uint8_t pin, float &raw)
+{
+    #if DUAL_ADC_SAMPLING
+    for (uint8_t i = 0; i < gauge_channel_count; i++) {
+        if (gauge_channels[i].pin == pin && paired_samples[i].ready) {
+            paired_samples[i].ready = false;
+            raw = paired_samples[i].raw;
+            return true;
+        }
+    }
+    #endif
+    return false;
+}
+
+// Read the specified analogue input pin many times and return the mean, or the mean of its
+// paired acquisition if it was just taken
+// pin: The pin on which the analogue read will occur
+// Return: A float between 0 and 1023 representing the analogue value on the specified pin
+float readAnalogInputRaw(uint8_t pin)
+{
+    float raw;
+
+    if (takePairedSample(pin, raw))
+        return raw;
+    return sampleAnalogInput(pin, getSensorHealth(pin), 1, analog_delay_ms);
+}
+
+// Read a thermistor input, taking care of a reference switch made since the last read:
+// wait for what's left of the settle time and throw away the transition samples.
+// The mean of a paired acquisition just taken is used instead, if there is one.
+// pin: The thermistor analogue pin
+// blendRead: True for the extra read with the other reference, taken back to back and
+//            kept out of the sensor health analysis (that tracks the main reference)
+// Return: A float between 0 and 1023 representing the analogue value on the specified pin
+float readThermistorRaw(uint8_t pin, bool blendRead)
+{
+    uint8_t discard;
+    float raw;
+
+    if (!blendRead && takePairedSample(pin, raw))
+        return raw;
+
+    discard = settleThermistorReference(pin);
+    if (blendRead)
+        return sampleAnalogInput(pin, NULL, discard, 0);
+    return sampleAnalogInput(pin, getSensorHealth(pin), discard, analog_delay_ms);
+}
+
 // Returns the voltage on the specified pin
 // pin: The pin on which the analogue read will occur
 // Return: A float representing the voltage read at the specified pin
@@ -79,13 +349,11 @@ float readVoltage(uint8_t pin)
     return (MAX_ANALOGUE_VOLTAGE / 1023) * value;
 }
 
-// Invalidate the display value so the next reading will force the display to be redrawn
+// Forget what the displays show, so the next frame sends them whole
 void forceDisplayRefresh()
 {
-    current_oil_psi = __FLT_MIN__;
-    current_oil_temp = __FLT_MIN__;
-    current_coolant_temp = __FLT_MIN__;
-    current_supply_voltage = __FLT_MIN__;
+    for (uint8_t i = 0; i < display_manager.count; i++)
+        invalidateDisplayPanel(display_manager.panels[i]);
 }
 
 // Draw an icon using specified display object
@@ -103,25 +371,46 @@ void drawIcon(Adafruit_SSD1306 &display, const Icon icon, const uint8_t xpos, co
         1);
 }
 
+// Draw a unit sign after a value using the specified display object.
+// In trend graph mode the graph takes that room, so there is no sign.
+// display: An instance reference of the Adafruit_SSD1306 class
+// icon: The unit sign to draw, emum value
+// xpos, ypos: The top left corner to start the drawing
+void drawUnitSign(Adafruit_SSD1306 &display, const Icon icon, const uint8_t xpos, const uint8_t ypos)
+{
+    #if !TREND_GRAPH_MODE
+    drawIcon(display, icon, xpos, ypos);
+    #endif
+}
+
+// Draw the trend graph of a value at the right of the specified display half
+// display: An instance reference of the Adafruit_SSD1306 class, the display to write to
+// graph: The history of the value
+// half: True to draw on the top half of display, False to draw on the bottom half of display
+// warning: True if the value is in warning, the graph is then drawn inverted
+void drawTrend(Adafruit_SSD1306 &display, const TrendGraph &graph, bool half, bool warning)
+{
+    drawTrendGraph(graph, display.getBuffer(), display.width(), half ? 0 : DISPLAY_HALF_TWO / 8, warning);
+}
+
 // Draw the warning icon using the the specified display object
-// We also turn on the warning LED to notify the user of warning state
+// The warning LED is driven by the alert timer, see alert.h
 // display: An instance reference of the Adafruit_SSD1306 class, the display to write to
 // half: True to print on the top half of display, False to print on the bottom half of display
 void drawWarning(Adafruit_SSD1306 &display, bool half)
 {
+    // In trend graph mode, the inverted graph is the warning sign
+    #if !TREND_GRAPH_MODE
     if (half) {
         drawIcon(display, Icon::warning_icon, 95, 0);
     } else {
         drawIcon(display, Icon::warning_icon, 95, 0 + DISPLAY_HALF_TWO);
     }
-    #if ENABLE_WARNING_LEDS
-    digitalWrite(WARNING_LED_OUTPUT_PIN, HIGH);
-    in_alert = true;
     #endif
 }
 
 // Display a fault message using the the specified display object
-// We also turn on the warning LED to notify the user of fault state
+// The warning LED is driven by the alert timer, see alert.h
 // display: An instance reference of the Adafruit_SSD1306 class, the display to write to
 // half: True to print on the top half of display, False to print on the bottom half of display
 void displayFault(Adafruit_SSD1306 &display, bool half)
@@ -131,14 +420,6 @@ void displayFault(Adafruit_SSD1306 &display, bool half)
     } else {
         drawIcon(display, Icon::fault_message, 11, 3 + DISPLAY_HALF_TWO);
     }
-
-    #if ENABLE_WARNING_LEDS
-    digitalWrite(WARNING_LED_OUTPUT_PIN, HIGH);
-    in_alert = true;
-    #endif
-
-    // Ensure if we go out of fault, the display will refresh the actual value
-    forceDisplayRefresh();
 }
 
 // Sets the reference resistor (pull down) for the oil thermistor
@@ -148,6 +429,11 @@ void setThermistorHighReferenceOil(const bool value)
     // The logic is inverted here by the FDN337N on the PCB
     digitalWrite(OIL_THERMISTOR_REFERENCE_SELECT_OUTPUT_PIN, value ? LOW : HIGH);
     oil_thermistor_reference_mode_high = value;
+    oil_thermistor_reference.switched_us = micros();
+    oil_thermistor_reference.settling = true;
+    #if ADC_COMPARE_ALARMS
+    armCompareAlarm(GAUGE_CHANNEL_OIL_TEMP, value);
+    #endif
 }
 
 // Sets the reference resistor (pull down) for the coolant thermistor
@@ -157,6 +443,23 @@ void setThermistorHighReferenceCoolant(const bool value)
     // The logic is inverted here by the FDN337N on the PCB
     digitalWrite(COOLANT_THERMISTOR_REFERENCE_SELECT_OUTPUT_PIN, value ? LOW : HIGH);
     cool_thermistor_reference_mode_high = value;
+    cool_thermistor_reference.switched_us = micros();
+    cool_thermistor_reference.settling = true;
+    #if ADC_COMPARE_ALARMS
+    armCompareAlarm(GAUGE_CHANNEL_COOLANT_TEMP, value);
+    #endif
+}
+
+// Sets the reference resistor (pull down) of the specified thermistor
+// pin: The thermistor analogue pin
+// value: True to set the high resistor value, False to select the low resistor value.
+void setThermistorHighReference(uint8_t pin, const bool value)
+{
+    if (pin == OIL_ANALOG_INPUT_PIN) {
+        setThermistorHighReferenceOil(value);
+    } else {
+        setThermistorHighReferenceCoolant(value);
+    }
 }
 
 // Convert the provided temperature from Celsius to Fahrenheit
@@ -175,19 +478,16 @@ float convertToBar(float pressure)
     return (pressure / 14.5038);
 }
 
-// Read the coolant/oil thermistor resistor value and convert it to temperature in Celsius
-// using the Steinhart-Hart equation.
+// Convert a thermistor reading to temperature in Celsius using the Steinhart-Hart equation.
 // TC: The variable that will hold the returned temperature value
-// pinRead: The pin we are reading our analogue voltage from
+// analogueValue: The mean ADC reading of the thermistor input, 0 to 1023
+// t_res_ref: The value of the pull-down reference resistor the reading was taken with
 // Return: ENOERR if the conversion succeeded and the value has been placed in the TC parameter, otherwise the error code
-// Note: The function also manages the pull-down resistor set related to the sensor
-int getFluidTempCelsius(float &TC, uint8_t pinRead)
+int convertThermistorCelsius(float &TC, float analogueValue, float t_res_ref)
 {
     float tResValue;
     float logTResValue;
     float TK;
-    float analogueValue;
-    float t_res_ref;
 
     // The constant values for the AEM-30-2012 have been calculated with this online calculator:
     // https://www.thinksrs.com/downloads/programs/therm%20calc/ntccalibrator/ntccalculator.html
@@ -198,9 +498,6 @@ int getFluidTempCelsius(float &TC, uint8_t pinRead)
     float c2 = 2.302830665e-4;   // 50C, 3911 OHMs
     float c3 = 0.8052469400e-7;  // 150C, 189.3 OHMs
 
-    // Get the analogue value on the input pin
-    analogueValue = readAnalogInputRaw(pinRead);
-
     // (2.878/5)*1023 = 588.8
     // LOW: 981 HIGH: 15090
     // 981 * (1023/588.8-1) = 721
@@ -217,13 +514,6 @@ int getFluidTempCelsius(float &TC, uint8_t pinRead)
         return ERANGE;
     }
 
-    // Use the correct pull down resistor reference value according to the actual configured value
-    if (pinRead == OIL_ANALOG_INPUT_PIN) {
-        t_res_ref = oil_thermistor_reference_mode_high ? OIL_THERMISTOR_RESISTOR_REFERENCE_HIGH : OIL_THERMISTOR_RESISTOR_REFERENCE_LOW;
-    } else {
-        t_res_ref = cool_thermistor_reference_mode_high ? COOL_THERMISTOR_RESISTOR_REFERENCE_HIGH : COOL_THERMISTOR_RESISTOR_REFERENCE_LOW;
-    }
-
     // Compute the thermistor resistor value, using the equation R2 = R1 * (Vin / Vout - 1)
     tResValue = (t_res_ref * (1023.0 / ((float)analogueValue) - 1.0));
 
@@ -238,45 +528,92 @@ int getFluidTempCelsius(float &TC, uint8_t pinRead)
 
     // Convert the temperature from Kelvin to Celsius
     TC = TK - 273.15;
-    
-    if (pinRead == OIL_ANALOG_INPUT_PIN) {
-        // Manage the oil pull-down resistor reference for the next run
-        if (oil_thermistor_reference_mode_high && TC > THERMISTOR_RESISTOR_REFERENCE_LOW_THRESHOLD)
-            setThermistorHighReferenceOil(false);
+    return ENOERR;
+}
 
-        if (! oil_thermistor_reference_mode_high && TC < THERMISTOR_RESISTOR_REFERENCE_HIGH_THRESHOLD)
-            setThermistorHighReferenceOil(true);
-    } else {
-        // Manage the coolant pull-down resistor reference for the next run
-        if (cool_thermistor_reference_mode_high && TC > THERMISTOR_RESISTOR_REFERENCE_LOW_THRESHOLD)
-            setThermistorHighReferenceCoolant(false);
+// Get the pull-down reference resistor value of the specified thermistor
+// pin: The thermistor analogue pin
+// high: True for the high resistor value, False for the low resistor value
+float getThermistorReferenceResistor(uint8_t pin, bool high)
+{
+    if (pin == OIL_ANALOG_INPUT_PIN) {
+        return high ? OIL_THERMISTOR_RESISTOR_REFERENCE_HIGH : OIL_THERMISTOR_RESISTOR_REFERENCE_LOW;
+    }
+    return high ? COOL_THERMISTOR_RESISTOR_REFERENCE_HIGH : COOL_THERMISTOR_RESISTOR_REFERENCE_LOW;
+}
+
+// Read the coolant/oil thermistor resistor value and convert it to temperature in Celsius
+// using the Steinhart-Hart equation.
+// TC: The variable that will hold the returned temperature value
+// pinRead: The pin we are reading our analogue voltage from
+// Return: ENOERR if the conversion succeeded and the value has been placed in the TC parameter, otherwise the error code
+// Note: The function also manages the pull-down resistor set related to the sensor
+int getFluidTempCelsius(float &TC, uint8_t pinRead)
+{
+    float analogueValue;
+    bool referenceHigh = pinRead == OIL_ANALOG_INPUT_PIN ? oil_thermistor_reference_mode_high : cool_thermistor_reference_mode_high;
+    int err;
+    #if THERMISTOR_DUAL_RANGE_BLEND
+    float otherTC;
+    float highTC, lowTC;
+    float weight;
+    #endif
+
+    // Get the analogue value on the input pin
+    analogueValue = readThermistorRaw(pinRead, false);
+
+    // An open or shorted sensor gives a number, but not a temperature
+    if (isHardSensorFault(getSensorHealthCode(pinRead))) {
+        return getSensorHealthCode(pinRead);
+    }
+
+    // Use the correct pull down resistor reference value according to the actual configured value
+    err = convertThermistorCelsius(TC, analogueValue, getThermistorReferenceResistor(pinRead, referenceHigh));
+    if (err != ENOERR)
+        return err;
+
+    #if THERMISTOR_DUAL_RANGE_BLEND
+    // Between the thresholds, read with the other reference too and blend the two temperatures,
+    // then put the reference back so the main reading (and its health analysis) stays on one range
+    if (TC >= THERMISTOR_RESISTOR_REFERENCE_HIGH_THRESHOLD && TC <= THERMISTOR_RESISTOR_REFERENCE_LOW_THRESHOLD) {
+        setThermistorHighReference(pinRead, !referenceHigh);
+        analogueValue = readThermistorRaw(pinRead, true);
+        setThermistorHighReference(pinRead, referenceHigh);
+
+        if (convertThermistorCelsius(otherTC, analogueValue, getThermistorReferenceResistor(pinRead, !referenceHigh)) == ENOERR) {
+            highTC = referenceHigh ? TC : otherTC;
+            lowTC = referenceHigh ? otherTC : TC;
+            weight = ((highTC + lowTC) / 2.0 - THERMISTOR_RESISTOR_REFERENCE_HIGH_THRESHOLD) /
+                (float)(THERMISTOR_RESISTOR_REFERENCE_LOW_THRESHOLD - THERMISTOR_RESISTOR_REFERENCE_HIGH_THRESHOLD);
+            if (weight < 0)
+                weight = 0;
+            if (weight > 1)
+                weight = 1;
+            TC = highTC + weight * (lowTC - highTC);
+        }
+    }
+    #endif
 
-        if (! cool_thermistor_reference_mode_high && TC < THERMISTOR_RESISTOR_REFERENCE_HIGH_THRESHOLD)
-            setThermistorHighReferenceCoolant(true);
+    // Manage the pull-down resistor reference for the next run.
+    // The next read settles and throws away the transition samples, the health statistics
+    // restart from the new range.
+    if ((referenceHigh && TC > THERMISTOR_RESISTOR_REFERENCE_LOW_THRESHOLD) ||
+        (!referenceHigh && TC < THERMISTOR_RESISTOR_REFERENCE_HIGH_THRESHOLD)) {
+        setThermistorHighReference(pinRead, !referenceHigh);
+        rebaseSensorHealth(*getSensorHealth(pinRead));
     }
     
     return ENOERR;
 }
 
-// Get the Coolant/Oil pressure in PSIG.
-// PSIG is PSI above ambient pressure.
+// Convert a pressure sensor output to PSIG.
 // psi: The variable that will hold the returned PSI value
 // sensorType: The type of pressure sensor used for the fluid
-// pinRead: The pin we are reading our analogue voltage from
+// volts: The sensor output, 0 to 5V
 // Return: ENOERR if the conversion succeeded and the value has been placed in the psi
 //         parameter, otherwise the error code
-int getFluidPsi(float &psi, int sensorType, uint8_t pinRead)
+int convertPsi(float &psi, int sensorType, float volts)
 {
-    float volts_32bit, volts;
-    #if DEBUG_VALUES
-    volts_32bit = 1.5;
-    #else
-    volts_32bit = readVoltage(pinRead);
-    #endif
-
-    // Because the Teensy 4.0's ADC has a max of 3.3V we need to convert the 0-3.3V range back to 0-5V
-    volts = (volts_32bit / MAX_ANALOGUE_VOLTAGE) * 5;
-
     // Ensure the voltage is between the sensor range, otherwise return an error
     // Our range is 0.5 to 4.5, however, most sensors can run a little bit out of their rating
     // so we allow a slightly lower and higher min and max voltage here.
@@ -329,6 +666,30 @@ int getFluidPsi(float &psi, int sensorType, uint8_t pinRead)
     return ENOERR;
 }
 
+// Get the Coolant/Oil pressure in PSIG.
+// PSIG is PSI above ambient pressure.
+// psi: The variable that will hold the returned PSI value
+// sensorType: The type of pressure sensor used for the fluid
+// pinRead: The pin we are reading our analogue voltage from
+// Return: ENOERR if the conversion succeeded and the value has been placed in the psi
+//         parameter, otherwise the error code
+int getFluidPsi(float &psi, int sensorType, uint8_t pinRead)
+{
+    float volts_32bit;
+    #if DEBUG_VALUES
+    volts_32bit = 1.5;
+    #else
+    volts_32bit = readVoltage(pinRead);
+    #endif
+
+    if (isHardSensorFault(getSensorHealthCode(pinRead))) {
+        return getSensorHealthCode(pinRead);
+    }
+
+    // Because the Teensy 4.0's ADC has a max of 3.3V we need to convert the 0-3.3V range back to 0-5V
+    return convertPsi(psi, sensorType, (volts_32bit / MAX_ANALOGUE_VOLTAGE) * 5);
+}
+
 // Read the supply voltage before the DC-DC converter
 // It should be between 11.5 and 14.5
 // voltage: The variable that will hold the returned voltage value
@@ -343,6 +704,10 @@ int getSupplyVoltage(float &voltage)
     volts = readVoltage(VOLTAGE_ANALOG_INPUT_PIN);
     #endif
 
+    if (isHardSensorFault(getSensorHealthCode(VOLTAGE_ANALOG_INPUT_PIN))) {
+        return getSensorHealthCode(VOLTAGE_ANALOG_INPUT_PIN);
+    }
+
     // Convert pin voltage to actual voltage based on the onboard tension divider
     supply_voltage = volts / (VOLTAGE_DIVIDER_R2 / (VOLTAGE_DIVIDER_R1 + VOLTAGE_DIVIDER_R2));
 
@@ -354,6 +719,70 @@ int getSupplyVoltage(float &voltage)
     return ENOERR;
 }
 
+#if ADC_COMPARE_ALARMS
+// Convert a conversion result of a gauge channel the same way its readings are
+// value: The variable that will hold the value
+// channel: The GAUGE_CHANNEL_* channel
+// counts: The conversion result, 0 to 1023
+// referenceHigh: The thermistor reference, ignored by the other channels
+// Return: ENOERR if the conversion succeeded, otherwise the error code
+int convertChannelCounts(float &value, uint8_t channel, uint16_t counts, bool referenceHigh)
+{
+    float volts = (MAX_ANALOGUE_VOLTAGE / 1023) * counts;
+
+    switch (channel) {
+        case GAUGE_CHANNEL_OIL_TEMP:
+        case GAUGE_CHANNEL_COOLANT_TEMP:
+            return convertThermistorCelsius(value, counts,
+                getThermistorReferenceResistor(gauge_channels[channel].pin, referenceHigh));
+        case GAUGE_CHANNEL_OIL_PSI:
+            return convertPsi(value, gauge_channels[channel].sensor_type, (volts / MAX_ANALOGUE_VOLTAGE) * 5);
+        case GAUGE_CHANNEL_SUPPLY_VOLTAGE:
+            value = volts / (VOLTAGE_DIVIDER_R2 / (VOLTAGE_DIVIDER_R1 + VOLTAGE_DIVIDER_R2));
+            return ENOERR;
+        default:
+            return EINVALID;
+    }
+}
+
+// Find the compare window of a channel from its alert thresholds: the highest result that reads at
+// or below the low threshold and the lowest that reads at or above the high one. Every channel
+// reads higher with more counts. Results that don't convert are left to the software readings.
+// channel: The GAUGE_CHANNEL_* channel
+// referenceHigh: The thermistor reference, ignored by the other channels
+// Return: The window
+CompareWindow findCompareWindow(uint8_t channel, bool referenceHigh)
+{
+    CompareWindow window = {ADC_COMPARE_NO_LIMIT, ADC_COMPARE_NO_LIMIT};
+    float value;
+
+    for (uint16_t counts = 0; counts <= 1023; counts++) {
+        if (convertChannelCounts(value, channel, counts, referenceHigh) != ENOERR)
+            continue;
+        if (value <= gauge_channels[channel].low)
+            window.low = counts;
+        if (value >= gauge_channels[channel].high && window.high == ADC_COMPARE_NO_LIMIT)
+            window.high = counts;
+    }
+    return window;
+}
+
+// Compute the compare windows of every channel, once: it takes a couple of thousand conversions
+FLASHMEM void initCompareWindows()
+{
+    for (uint8_t channel = 0; channel < GAUGE_CHANNEL_COUNT; channel++) {
+        compare_windows[channel][0] = findCompareWindow(channel, false);
+        compare_windows[channel][1] = findCompareWindow(channel, true);
+    }
+}
+#endif
+
+// Return true if the displays are off: the lid is closed, or the engine is off
+bool areDisplaysOff()
+{
+    return lidClosed || engineOff;
+}
+
 // Return true if the illumination (parking lights) are turned off, otherwise false
 // Valid voltage are between 0V and 15V. Anything below 1.7v is considered day lignt
 // Note: There a voltage divisor on the board that divides by roughly 4.830
@@ -371,18 +800,18 @@ bool isDayLight()
 // If dayLight is true, set all displays to their maximum luminosity, dim them otherwise
 void setDayLight(bool dayLight)
 {
+    const uint8_t contrast[] = {SSD1306_SETCONTRAST, (uint8_t)(dayLight ? 0xFF : MINIMUM_BRIGHTNESS)};
+
     currentDaylight = dayLight;
-    display_1.ssd1306_command(SSD1306_SETCONTRAST);
-    display_1.ssd1306_command(dayLight ? 0xFF : MINIMUM_BRIGHTNESS);
-    display_2.ssd1306_command(SSD1306_SETCONTRAST);
-    display_2.ssd1306_command(dayLight ? 0xFF : MINIMUM_BRIGHTNESS);
+    for (uint8_t i = 0; i < display_manager.count; i++)
+        sendDisplayCommands(display_manager.panels[i].bus, contrast, sizeof(contrast));
 }
 
 // Ensure the display intensity is set according to the current daylight status
 void processDayLight()
 {
-    // Don't need to bother dimming the displays if the lid is closed.
-    if (lidClosed)
+    // Don't need to bother dimming the displays if they are off.
+    if (areDisplaysOff())
         return;
     bool dayLight = isDayLight();
     if (dayLight != currentDaylight) {
@@ -398,18 +827,44 @@ bool isLidClosed()
     return digitalRead(HALL_EFFECT_SENSOR_INPUT_PIN);
 }
 
+// Turn all displays off or back on, after a change of the lid or the power state
+// wasOff: True if they were off before the change
+void updateDisplaysPower(bool wasOff)
+{
+    const bool off = areDisplaysOff();
+    const uint8_t command = off ? SSD1306_DISPLAYOFF : SSD1306_DISPLAYON;
+
+    if (off == wasOff)
+        return;
+    if (!off)
+        forceDisplayRefresh();
+    for (uint8_t i = 0; i < display_manager.count; i++)
+        sendDisplayCommands(display_manager.panels[i].bus, &command, 1);
+}
+
 // If lidStatus is true, turn off all displays, otherwise turn them back on
 void toggleDisplays(bool lidStatus) 
 {
+    const bool wasOff = areDisplaysOff();
+
     lidClosed = lidStatus;
-    if (lidStatus) {
-        display_1.ssd1306_command(SSD1306_DISPLAYOFF);
-        display_2.ssd1306_command(SSD1306_DISPLAYOFF);
-    } else {
-        forceDisplayRefresh();
-        display_1.ssd1306_command(SSD1306_DISPLAYON);
-        display_2.ssd1306_command(SSD1306_DISPLAYON);
-    }
+    updateDisplaysPower(wasOff);
+}
+
+// Attempt to recover the display if its bus is down, and bring it back to the current
+// brightness, on/off state and values once it answers again
+// panel: The display panel
+void serviceDisplay(DisplayPanel &panel)
+{
+    if (!serviceDisplayBus(panel.bus))
+        return;
+
+    const uint8_t commands[] = {
+        SSD1306_SETCONTRAST, (uint8_t)(currentDaylight ? 0xFF : MINIMUM_BRIGHTNESS),
+        (uint8_t)(areDisplaysOff() ? SSD1306_DISPLAYOFF : SSD1306_DISPLAYON)
+    };
+    sendDisplayCommands(panel.bus, commands, sizeof(commands));
+    invalidateDisplayPanel(panel);
 }
 
 // Ensure the state of the displays is set according to the current lid status
@@ -421,13 +876,6 @@ void processLidStatus()
     }
 }
 
-// Here a fault or warning state has been entered, so we activate and then deactivate the buzzer.
-void handleBuzzer() 
-{
-    digitalWrite(ALERT_BUZZER_OUTPUT_PIN, buzzer_currently_playing);
-    buzzer_currently_playing = false;
-}
-
 // Update the oil temperature on the specified display with the specified temperature.
 // If the Fahrenheit selector jumper has been present during boot time, display the
 // temperature in Fahrenheit, display in Celsius otherwise.
@@ -437,10 +885,6 @@ void handleBuzzer()
 // On display's first half
 void updateOilTemp(Adafruit_SSD1306 &display, float temperature)
 {
-    // To prevent LED flickering we only want to clear our alert if we're updating a display
-    in_alert = false;
-    current_oil_temp = temperature;
-
     // Print the coolant value and the icon according to the desired units
     display.setCursor(TEXT_POS_X, TEXT_POS_Y + 24);
     if (!temperatureUnitIsFahrenheit) {
@@ -461,7 +905,10 @@ void updateOilTemp(Adafruit_SSD1306 &display, float temperature)
     // Print a warning if oil temperature exceeds user set value
     if (temperature >= OIL_TEMP_WARNING_CELSIUS)
         drawWarning(display, TOP_HALF);
-        
+
+    #if TREND_GRAPH_MODE
+    drawTrend(display, oil_temp_trend, TOP_HALF, temperature >= OIL_TEMP_WARNING_CELSIUS);
+    #endif
 }
 
 // Update the Oil pressure on the specified display with the provided value
@@ -473,33 +920,29 @@ void updateOilTemp(Adafruit_SSD1306 &display, float temperature)
 // On display's second half
 void updateOilPsi(Adafruit_SSD1306 &display, float psi)
 {
-    // To prevent LED flickering we only want to clear our alert if we're updating a display
-    in_alert = false;
-    current_oil_psi = psi;
-
     drawIcon(display, Icon::oil_pressure_icon, 0, 7 + DISPLAY_HALF_TWO);
 
     if (pressureUnitIsBar) {
         // Print the bar value
         // Move slightly the displayed value to the left if we are in warning state to give room for the warning sign
-        if (psi <= OIL_PSI_WARNING_LOW || psi >= OIL_PSI_WARNING_HIGH) {
+        if (psi <= oil_psi_low_limit || psi >= OIL_PSI_WARNING_HIGH) {
             display.setCursor(TEXT_POS_X - 4, TEXT_POS_Y + DISPLAY_HALF_TWO + 24);
             display.print(convertToBar(psi), 2);
         } else {
             display.setCursor(TEXT_POS_X, TEXT_POS_Y + DISPLAY_HALF_TWO + 24);
             display.print(convertToBar(psi), 2);
             // Print the bar sign
-            drawIcon(display, Icon::bar_sign, display.getCursorX() + 1, TEXT_POS_Y + DISPLAY_HALF_TWO);
+            drawUnitSign(display, Icon::bar_sign, display.getCursorX() + 1, TEXT_POS_Y + DISPLAY_HALF_TWO);
         }  
     } else {
         // Print the PSI value
         // Move slightly the displayed value to the left if we are in warning state to give room for the warning sign
-        if (psi <= OIL_PSI_WARNING_LOW || psi >= OIL_PSI_WARNING_HIGH) {  
+        if (psi <= oil_psi_low_limit || psi >= OIL_PSI_WARNING_HIGH) {  
             if (psi < 10) {
                 display.setCursor(TEXT_POS_X, TEXT_POS_Y + DISPLAY_HALF_TWO + 24);
                 display.print(psi, 1);
                 // Print the PSI sign
-                drawIcon(display, Icon::psi_sign, display.getCursorX() + 1, TEXT_POS_Y + DISPLAY_HALF_TWO);
+                drawUnitSign(display, Icon::psi_sign, display.getCursorX() + 1, TEXT_POS_Y + DISPLAY_HALF_TWO);
             } else if (psi >= 100) {
                 display.setCursor(TEXT_POS_X - 4, TEXT_POS_Y + DISPLAY_HALF_TWO + 24);
                 display.print(psi, 0);
@@ -515,13 +958,17 @@ void updateOilPsi(Adafruit_SSD1306 &display, float psi)
                 display.print(psi, 1);
             }
             // Print the PSI sign
-            drawIcon(display, Icon::psi_sign, display.getCursorX() + 1, TEXT_POS_Y + DISPLAY_HALF_TWO);
+            drawUnitSign(display, Icon::psi_sign, display.getCursorX() + 1, TEXT_POS_Y + DISPLAY_HALF_TWO);
         }
     }
     
     // Print a warning if oil psi is too low or too high
-    if (psi >= OIL_PSI_WARNING_HIGH || psi <= OIL_PSI_WARNING_LOW)
+    if (psi >= OIL_PSI_WARNING_HIGH || psi <= oil_psi_low_limit)
         drawWarning(display, BOTTOM_HALF);
+
+    #if TREND_GRAPH_MODE
+    drawTrend(display, oil_psi_trend, BOTTOM_HALF, psi >= OIL_PSI_WARNING_HIGH || psi <= oil_psi_low_limit);
+    #endif
 }
 
 // Update the coolant temperature on the specified display with the specified temperature.
@@ -533,10 +980,6 @@ void updateOilPsi(Adafruit_SSD1306 &display, float psi)
 // On display's first half
 void updateCoolantTemp(Adafruit_SSD1306 &display, float temperature)
 {
-    // To prevent LED flickering we only want to clear our alert if we're updating a display
-    in_alert = false;
-    current_coolant_temp = temperature;
-
     // Print the coolant value and the icon according to the desired units
     display.setCursor(TEXT_POS_X, TEXT_POS_Y + 24);
     if (!temperatureUnitIsFahrenheit) {
@@ -557,6 +1000,10 @@ void updateCoolantTemp(Adafruit_SSD1306 &display, float temperature)
     // Print a warning if coolant temperature exceeds user set value
     if (temperature >= COOLANT_TEMP_WARNING_CELSIUS)
         drawWarning(display, TOP_HALF);      
+
+    #if TREND_GRAPH_MODE
+    drawTrend(display, coolant_temp_trend, TOP_HALF, temperature >= COOLANT_TEMP_WARNING_CELSIUS);
+    #endif
 }
 
 /*
@@ -591,33 +1038,26 @@ void updateCoolantPsi(Adafruit_SSD1306 &display, float psi)
 // On display's second half
 void updateSupplyVoltage(Adafruit_SSD1306 &display, float voltage)
 {
-    // To prevent LED flickering we only want to clear our alert if we're updating a display
-    in_alert = false;
-    current_supply_voltage = voltage;
-
     drawIcon(display, Icon::voltage_icon, 6, 3 + DISPLAY_HALF_TWO);
 
     display.setCursor(TEXT_POS_X - (voltage < 10.0 ? 0 : 8), TEXT_POS_Y + DISPLAY_HALF_TWO + 24);
     display.print(voltage, 1);
      
     // Print the voltage sign
-    drawIcon(display, Icon::voltage_sign, display.getCursorX() + 1, TEXT_POS_Y + DISPLAY_HALF_TWO);
+    drawUnitSign(display, Icon::voltage_sign, display.getCursorX() + 1, TEXT_POS_Y + DISPLAY_HALF_TWO);
 
     // Print a warning if voltage is too low or too high
-    if (voltage < BATTERY_VOLTAGE_LOW_WARNING || voltage > BATTERY_VOLTAGE_HIGH_WARNING) {
+    if (voltage < BATTERY_VOLTAGE_LOW_WARNING || voltage > BATTERY_VOLTAGE_HIGH_WARNING)
         drawWarning(display, BOTTOM_HALF);
-        /*if (!voltage_warn_happened) {
-            voltage_warn_happened = true;
-            buzzer_currently_playing = true;
-            buzzerTimer.begin(handleBuzzer, 2000000);
-        }*/
-    }
-          
+
+    #if TREND_GRAPH_MODE
+    drawTrend(display, voltage_trend, BOTTOM_HALF, voltage < BATTERY_VOLTAGE_LOW_WARNING || voltage > BATTERY_VOLTAGE_HIGH_WARNING);
+    #endif
 }
 
 // Display a small animation at start up
 // The logo width must be a multiple of 8. Typically, 8 bits in an unsigned char
-void displayIntro()
+FLASHMEM void displayIntro()
 {
     // The icon to use for the animation
     const Icon icon = Icon::rx8_logo;
@@ -634,17 +1074,17 @@ void displayIntro()
 
     for (size_t x = u_char_bits_size - 1; x < width; x = x + u_char_bits_size)
     {
-        display_1.clearDisplay();
-        display_2.clearDisplay();
-
-        for (size_t y = 0; y < height; y++)
+        for (uint8_t i = 0; i < display_manager.count; i++)
         {
-            display_1.drawBitmap(0, y + (display_1.height() - height) / 2, logo_ptr + y * width / u_char_bits_size  + (width - x - 1) / u_char_bits_size, x + 1, 1 ,1);
-            display_2.drawBitmap(0, y + (display_2.height() - height) / 2, logo_ptr + y * width / u_char_bits_size  + (width - x - 1) / u_char_bits_size, x + 1, 1 ,1);
-        }
+            Adafruit_SSD1306 &display = *display_manager.panels[i].bus.display;
 
-        display_1.display();
-        display_2.display();
+            display.clearDisplay();
+            for (size_t y = 0; y < height; y++)
+            {
+                display.drawBitmap(0, y + (display.height() - height) / 2, logo_ptr + y * width / u_char_bits_size  + (width - x - 1) / u_char_bits_size, x + 1, 1 ,1);
+            }
+            flushDisplayPanel(display_manager.panels[i]);
+        }
 
         // Adjust the delay to have a smooth animation.
         // As more parts of the image is drawn, the more time it take to transfer it with i2c.
@@ -655,20 +1095,347 @@ void displayIntro()
     delay(3000);
 }
 
+// Sensor policy of the thermistor channels, see getFluidTempCelsius()
+int readThermistorChannel(float &value, const GaugeChannel &channel)
+{
+    return getFluidTempCelsius(value, channel.pin);
+}
+
+// Sensor policy of the pressure channels, see getFluidPsi()
+int readPressureChannel(float &value, const GaugeChannel &channel)
+{
+    return getFluidPsi(value, channel.sensor_type, channel.pin);
+}
+
+// Sensor policy of the supply voltage channel, see getSupplyVoltage()
+int readSupplyVoltageChannel(float &value, const GaugeChannel &channel)
+{
+    return getSupplyVoltage(value);
+}
+
+#if ENABLE_RIPPLE_ANALYSIS
+// Sensor policy of the ripple channel: the ripple RMS of the last burst of the supply voltage,
+// 0 until the first one is analysed (see ripple.h)
+int readRippleChannel(float &value, const GaugeChannel &channel)
+{
+    RippleAnalysis analysis;
+
+    serviceRipple(analysis);
+    value = analysis.rms;
+    return ENOERR;
+}
+#endif
+
+// The thermistors are lag compensated, if enabled
+#if THERMISTOR_LAG_COMPENSATION
+#define OIL_THERMISTOR_LAG OIL_THERMISTOR_TIME_CONSTANT
+#define COOLANT_THERMISTOR_LAG COOLANT_THERMISTOR_TIME_CONSTANT
+#else
+#define OIL_THERMISTOR_LAG 0
+#define COOLANT_THERMISTOR_LAG 0
+#endif
+
+// The gauge channels, read in this order every loop. The first GAUGE_CHANNEL_COUNT are the ones sent
+// on the CAN bus and must stay in GAUGE_CHANNEL_* order. To add a sensor, add its entry at the end
+// (up to GAUGE_CHANNEL_MAX) and, to show it, its index to a panel of gauge_panel_layouts.
+// Rail faults:
+//  - Thermistors: a disconnected sensor leaves the pull-down alone (0V), a shorted one pulls up to 3.3V
+//  - Pressure: the sensor output never goes below 0.5V, the divider pulls a disconnected one to 0V.
+//    Above 4.5V at the sensor (3.0V at the pin) means the signal is shorted to the 5V supply.
+//  - Supply voltage: we can't be running with 0V here, but 18V is a real (if worrying) reading
+const GaugeChannel gauge_channels[] = {
+    {"oil_temp", OIL_ANALOG_INPUT_PIN, readThermistorChannel, 0,
+        &oil_temp_health, ESENSOROPEN, ESENSORSHORT, GAUGE_NO_SMOOTHING, OIL_THERMISTOR_LAG,
+        -__FLT_MAX__, OIL_TEMP_WARNING_CELSIUS, updateOilTemp, TOP_HALF,
+        GAUGE_TREND(oil_temp_trend), TREND_GRAPH_OIL_TEMP_MIN, TREND_GRAPH_OIL_TEMP_MAX},
+    {"oil_psi", OIL_PSI_ANALOG_INPUT_PIN, readPressureChannel, PRESSURE_SENSOR_200_PSI,
+        &oil_psi_health, ESENSOROPEN, ESENSORSHORT, GAUGE_NO_SMOOTHING, 0,
+        OIL_PSI_WARNING_LOW, OIL_PSI_WARNING_HIGH, updateOilPsi, BOTTOM_HALF,
+        GAUGE_TREND(oil_psi_trend), TREND_GRAPH_OIL_PSI_MIN, TREND_GRAPH_OIL_PSI_MAX},
+    {"coolant_temp", COOLANT_ANALOG_INPUT_PIN, readThermistorChannel, 0,
+        &coolant_temp_health, ESENSOROPEN, ESENSORSHORT, GAUGE_NO_SMOOTHING, COOLANT_THERMISTOR_LAG,
+        -__FLT_MAX__, COOLANT_TEMP_WARNING_CELSIUS, updateCoolantTemp, TOP_HALF,
+        GAUGE_TREND(coolant_temp_trend), TREND_GRAPH_COOLANT_TEMP_MIN, TREND_GRAPH_COOLANT_TEMP_MAX},
+    {"supply_voltage", VOLTAGE_ANALOG_INPUT_PIN, readSupplyVoltageChannel, 0,
+        &voltage_health, ESENSOROPEN, ENOERR, GAUGE_NO_SMOOTHING, 0,
+        BATTERY_VOLTAGE_LOW_WARNING, BATTERY_VOLTAGE_HIGH_WARNING, updateSupplyVoltage, BOTTOM_HALF,
+        GAUGE_TREND(voltage_trend), TREND_GRAPH_VOLTAGE_MIN, TREND_GRAPH_VOLTAGE_MAX},
+    #if ENABLE_RIPPLE_ANALYSIS
+    // Not on a panel: its alert shows on the warning LED and the buzzer
+    {"ripple", VOLTAGE_ANALOG_INPUT_PIN, readRippleChannel, 0,
+        NULL, ENOERR, ENOERR, GAUGE_NO_SMOOTHING, 0,
+        -__FLT_MAX__, RIPPLE_WARNING_VOLTS, NULL, BOTTOM_HALF, NULL, 0, 0},
+    #endif
+    // A coolant pressure sensor on the spare input would be:
+    //{"coolant_psi", SPARE_1_INPUT_PIN, readPressureChannel, PRESSURE_SENSOR_2131_15G,
+    //    &coolant_psi_health, ESENSOROPEN, ESENSORSHORT, GAUGE_NO_SMOOTHING, 0,
+    //    -__FLT_MAX__, COOLANT_PSI_WARNING, updateCoolantPsi, BOTTOM_HALF, NULL, 0, 0},
+};
+const uint8_t gauge_channel_count = sizeof(gauge_channels) / sizeof(GaugeChannel);
+static_assert(sizeof(gauge_channels) / sizeof(GaugeChannel) >= GAUGE_CHANNEL_COUNT, "The CAN bus channels are missing");
+static_assert(sizeof(gauge_channels) / sizeof(GaugeChannel) <= GAUGE_CHANNEL_MAX, "Too many gauge channels");
+static_assert(SENSOR_SNAPSHOT_CHANNELS == GAUGE_CHANNEL_MAX, "The snapshot must hold every gauge channel");
+
+#if DUAL_ADC_SAMPLING
+// Sample the two channels of a pair at the same time, for their next read. Both readings get the
+// time stamp of the acquisition and half of its time.
+// pair: The pair
+void acquireChannelPair(const GaugeChannelPair &pair)
+{
+    const GaugeChannel &first = gauge_channels[pair.first];
+    const GaugeChannel &second = gauge_channels[pair.second];
+    uint32_t startUs = micros();
+    uint32_t sampledUs;
+    uint8_t discard;
+
+    // Both inputs settle, the longest wait covers the other one
+    discard = settleThermistorReference(first.pin);
+    discard = max(discard, settleThermistorReference(second.pin));
+
+    sampleAnalogPair(first.pin, first.health, second.pin, second.health, discard, analog_delay_ms,
+        paired_samples[pair.first].raw, paired_samples[pair.second].raw);
+    paired_samples[pair.first].ready = true;
+    paired_samples[pair.second].ready = true;
+
+    sampledUs = micros();
+    stampGaugeChannel(gauge_channel_states[pair.first], sampledUs, (sampledUs - startUs) / 2);
+    stampGaugeChannel(gauge_channel_states[pair.second], sampledUs, (sampledUs - startUs) / 2);
+}
+#endif
+
+// Read the gauge channels. Each reading goes to the alert timer as soon as it's acquired, the
+// display can't delay an alert, and to the trend history.
+// channels: Bit per channel to read, in gauge_channels order
+void readGaugeChannels(uint8_t channels)
+{
+    #if DUAL_ADC_SAMPLING
+    bool done[GAUGE_CHANNEL_MAX] = {false};
+
+    // A pair is read straight after its acquisition, so its alerts aren't held up by the next pair
+    for (uint8_t i = 0; i < GAUGE_CHANNEL_PAIR_COUNT; i++) {
+        const GaugeChannelPair &pair = gauge_channel_pairs[i];
+
+        if (!(channels & ((1 << pair.first) | (1 << pair.second))))
+            continue;
+        acquireChannelPair(pair);
+        readGaugeChannel(pair.first, gauge_channels[pair.first], gauge_channel_states[pair.first]);
+        readGaugeChannel(pair.second, gauge_channels[pair.second], gauge_channel_states[pair.second]);
+        done[pair.first] = true;
+        done[pair.second] = true;
+    }
+    for (uint8_t i = 0; i < gauge_channel_count; i++) {
+        if (!done[i] && (channels & (1 << i)))
+            readGaugeChannel(i, gauge_channels[i], gauge_channel_states[i]);
+    }
+    #else
+    for (uint8_t i = 0; i < gauge_channel_count; i++) {
+        if (channels & (1 << i))
+            readGaugeChannel(i, gauge_channels[i], gauge_channel_states[i]);
+    }
+    #endif
+}
+
+// Publish the last reading of every gauge channel in a new snapshot, with its alert state
+void publishGaugeSnapshot()
+{
+    SensorSnapshot &snapshot = beginSensorSnapshot();
+
+    snapshot.count = gauge_channel_count;
+    snapshot.alerting = 0;
+    memset(snapshot.channels, 0, sizeof(snapshot.channels));
+    for (uint8_t i = 0; i < gauge_channel_count; i++) {
+        const GaugeChannelState &state = gauge_channel_states[i];
+        SnapshotChannel &channel = snapshot.channels[i];
+
+        channel.value = state.value;
+        channel.low = state.low;
+        channel.high = state.high;
+        channel.sampled_us = state.sampled_us;
+        channel.error = state.error;
+        channel.health = gauge_channels[i].health ? gauge_channels[i].health->fault : ENOERR;
+        channel.reason = getAlertChannelReason(i);
+        channel.valid = state.error == ENOERR;
+        if (channel.reason != ALERT_NONE)
+            snapshot.alerting |= 1 << i;
+    }
+    publishSensorSnapshot();
+}
+
+// Get the engine speed: from the tach input if it's enabled, otherwise from the ECU frames
+// rpm: The variable that will hold the engine speed
+// Return: False if the engine speed isn't known
+bool getEngineRpm(float &rpm)
+{
+    #if ENABLE_CAN_BUS
+    EcuReadings ecu;
+    #endif
+
+    if (getTachRpm(rpm))
+        return true;
+
+    #if ENABLE_CAN_BUS
+    getEcuReadings(ecu);
+    if (isEcuReadingFresh(ecu.pcm_status_ms, millis())) {
+        rpm = ecu.rpm;
+        return true;
+    }
+    #endif
+    return false;
+}
+
+// Set the low oil pressure warning threshold for the current engine speed. Without the engine
+// speed, or with the engine stopped, it's OIL_PSI_WARNING_LOW.
+void updateOilPsiLowLimit()
+{
+    float rpm;
+    float limit = OIL_PSI_WARNING_LOW;
+
+    if (getEngineRpm(rpm)) {
+        limit = rpm * OIL_PSI_WARNING_LOW_PER_1000_RPM / 1000.0;
+        if (limit < OIL_PSI_WARNING_LOW)
+            limit = OIL_PSI_WARNING_LOW;
+        if (limit > OIL_PSI_WARNING_LOW_MAX)
+            limit = OIL_PSI_WARNING_LOW_MAX;
+    }
+
+    oil_psi_low_limit = limit;
+    setGaugeChannelThresholds(GAUGE_CHANNEL_OIL_PSI, gauge_channel_states[GAUGE_CHANNEL_OIL_PSI], limit, OIL_PSI_WARNING_HIGH);
+}
+
+// Set the pace of the loop and the displays for the power state, after a change
+// wasOff: True if the displays were off before the change
+void applyPowerState(bool wasOff)
+{
+    capture_passes = 0;
+    analog_delay_ms = power_state.state == POWER_STATE_CRANKING ? POWER_CAPTURE_ANALOG_DELAY_MS
+        : ANALOG_DELAY_BETWEEN_ACQUISITIONS;
+    engineOff = power_state.state == POWER_STATE_OFF;
+    updateDisplaysPower(wasOff);
+}
+
+// Follow the ignition power state with the readings of this pass: sample faster while cranking,
+// turn the displays off while the engine is off
+// snapshot: The readings of this pass
+void updatePowerMode(const SensorSnapshot &snapshot)
+{
+    #if ENABLE_POWER_STATES
+    const SnapshotChannel &supply = snapshot.channels[GAUGE_CHANNEL_SUPPLY_VOLTAGE];
+    const SnapshotChannel &oil = snapshot.channels[GAUGE_CHANNEL_OIL_PSI];
+    const bool wasOff = areDisplaysOff();
+    float rpm;
+    bool running;
+    bool alerting;
+
+    // The oil pressure alert is expected with the engine off, only the others keep the displays up
+    running = (oil.valid && oil.value >= POWER_RUNNING_OIL_PSI) || (getEngineRpm(rpm) && rpm >= POWER_RUNNING_RPM);
+    alerting = (snapshot.alerting & ~(1 << GAUGE_CHANNEL_OIL_PSI)) != 0;
+    if (updatePowerState(power_state, supply.value, supply.valid, running, alerting, millis()))
+        applyPowerState(wasOff);
+    #endif
+}
+
+// Get the loop period of the power state, in milliseconds
+int32_t getLoopPeriodMs()
+{
+    switch (power_state.state) {
+    case POWER_STATE_CRANKING:
+        return POWER_CAPTURE_PERIOD_MS;
+    case POWER_STATE_OFF:
+        return POWER_OFF_PERIOD_MS;
+    default:
+        return (int32_t)((1.0 / (float)DISPLAY_REFRESH_RATE_HZ) * 1000.0);
+    }
+}
+
+// Wait for the next loop pass. With the engine off, the supply is watched meanwhile with single
+// reads, and the wait ends as soon as the starter pulls it down, to capture the whole crank.
+// waitMs: The time to wait, in milliseconds
+void waitNextPass(int32_t waitMs)
+{
+    #if ENABLE_POWER_STATES
+    const float dipVolts = power_state.rest_volts - POWER_CRANKING_DROP_VOLTS;
+    const uint32_t startMs = millis();
+    float volts;
+
+    if (power_state.state == POWER_STATE_OFF && power_state.seeded) {
+        while ((int32_t)(millis() - startMs) < waitMs) {
+            delay(min(waitMs - (int32_t)(millis() - startMs), (int32_t)POWER_OFF_WATCH_MS));
+            volts = analogRead(VOLTAGE_ANALOG_INPUT_PIN) * (MAX_ANALOGUE_VOLTAGE / 1023)
+                / (VOLTAGE_DIVIDER_R2 / (VOLTAGE_DIVIDER_R1 + VOLTAGE_DIVIDER_R2));
+            if (volts <= dipVolts)
+                return;
+        }
+        return;
+    }
+    #endif
+    delay(waitMs);
+}
+
+// Save what a warm restart needs to carry on from this pass, see warm_start.h
+void saveRestartState()
+{
+    warm_state.saved_ms = millis() - setup_ms;
+    warm_state.warm = warm_start;
+    for (uint8_t i = 0; i < gauge_channel_count; i++) {
+        memcpy(&warm_state.channels[i], &gauge_channel_states[i], sizeof(GaugeChannelState));
+        if (gauge_channels[i].health)
+            memcpy(&warm_state.health[i], gauge_channels[i].health, sizeof(SensorHealth));
+    }
+    warm_state.oil_reference_high = oil_thermistor_reference_mode_high;
+    warm_state.coolant_reference_high = cool_thermistor_reference_mode_high;
+    memcpy(&warm_state.power, &power_state, sizeof(PowerState));
+    getAlertLatches(warm_state.alerts);
+    saveWarmState(warm_state);
+}
+
+// Compute the alert bits sent on the CAN bus from the snapshot of this pass: a valid reading
+// beyond a threshold of its channel, as the displays and the alert timer see it
+// snapshot: The readings of this pass
+// Return: The GAUGE_ALERT_* bits
+uint8_t getGaugeAlerts(const SensorSnapshot &snapshot)
+{
+    // The low and high alert bits of each channel, 0 for none
+    static const uint8_t channelAlerts[GAUGE_CHANNEL_COUNT][2] = {
+        {0, GAUGE_ALERT_OIL_TEMP_HIGH},
+        {GAUGE_ALERT_OIL_PSI_LOW, GAUGE_ALERT_OIL_PSI_HIGH},
+        {0, GAUGE_ALERT_COOLANT_TEMP_HIGH},
+        {GAUGE_ALERT_VOLTAGE_LOW, GAUGE_ALERT_VOLTAGE_HIGH},
+    };
+    uint8_t alerts = 0;
+
+    for (uint8_t i = 0; i < GAUGE_CHANNEL_COUNT; i++) {
+        const SnapshotChannel &channel = snapshot.channels[i];
+
+        if (!channel.valid)
+            continue;
+        if (channel.value <= channel.low)
+            alerts |= channelAlerts[i][0];
+        if (channel.value >= channel.high)
+            alerts |= channelAlerts[i][1];
+    }
+    return alerts;
+}
+
 // Configures the Teensy IO pins
 // All unused pins are put in three state with pull-ups
-void configureIOs()
+FLASHMEM void configureIOs()
 {
     // Unused pins
+    // Pins 0 and 1 are taken by the CAN transceiver when the CAN bus is enabled
+    #if !ENABLE_CAN_BUS
     pinMode(UNUSED_PIN_0, INPUT_PULLUP);
     pinMode(UNUSED_PIN_1, INPUT_PULLUP);
+    #endif
     //pinMode(UNUSED_PIN_2, INPUT_PULLUP);
     //pinMode(UNUSED_PIN_3, INPUT_PULLUP);
     //pinMode(UNUSED_PIN_5, INPUT_PULLUP);
     //pinMode(UNUSED_PIN_6, INPUT_PULLUP);
     //pinMode(UNUSED_PIN_7, INPUT_PULLUP);
     //pinMode(UNUSED_PIN_8, INPUT_PULLUP);
+    // Pin 9 is taken by the tach input when it's enabled
+    #if !ENABLE_TACH_INPUT
     pinMode(UNUSED_PIN_9, INPUT_PULLUP);
+    #endif
     //pinMode(UNUSED_PIN_10, INPUT_PULLUP);
     pinMode(UNUSED_PIN_11, INPUT_PULLUP);
     pinMode(UNUSED_PIN_12, INPUT_PULLUP);
@@ -703,29 +1470,254 @@ void configureIOs()
     pinMode(ILLUMINATION_ANALOG_INPUT_PIN, INPUT);
 }
 
-// Initialise the specified display, set font, size and colour
-// display: An instance of the Adafruit_SSD1306 class representing the display
-//          to be initialised
-void initDisplay(Adafruit_SSD1306 &display)
+// Initialise the specified display, clear it, set font, size and colour
+// panel: The panel of the display to be initialised, see addDisplayPanel()
+FLASHMEM void initDisplay(DisplayPanel &panel)
 {
-    display.begin(SSD1306_SWITCHCAPVCC, 0x3C, false);
+    Adafruit_SSD1306 &display = *panel.bus.display;
+
+    // A display that doesn't answer is retried from loop()
+    beginDisplayPanel(panel);
     display.setTextSize(1);
     display.setTextColor(WHITE);
     display.setFont(&FreeSans18pt7bNum);
+}
+
+// Set up and initialise the panels of gauge_panel_layouts
+FLASHMEM void initDisplays()
+{
+    DisplayPanel *panel;
+
+    initDisplayManager(display_manager, DISPLAY_FRAME_BUDGET_US);
+    for (uint8_t i = 0; i < GAUGE_PANEL_COUNT; i++) {
+        const GaugePanelLayout &layout = gauge_panel_layouts[i];
+
+        panel = addDisplayPanel(display_manager, *layout.display, *layout.wire, layout.address, layout.scl_pin, layout.sda_pin);
+        if (panel)
+            initDisplay(*panel);
+    }
+}
+
+// Draw a gauge on its half of the specified display: its last reading, or the fault message
+// display: An instance of the Adafruit_SSD1306 class representing the display
+// channel: The index of the gauge in gauge_channels
+// snapshot: The readings to show
+void drawGauge(Adafruit_SSD1306 &display, uint8_t channel, const SensorSnapshot &snapshot)
+{
+    if (!snapshot.channels[channel].valid) {
+        displayFault(display, gauge_channels[channel].half);
+        return;
+    }
+    gauge_channels[channel].draw(display, snapshot.channels[channel].value);
+}
+
+// Draw the gauges of a panel into its buffer, and give the panel the flush priority of an alert
+// if one of them shows one
+// panel: The panel
+// layout: What the panel shows
+// snapshot: The readings to show
+void drawPanel(DisplayPanel &panel, const GaugePanelLayout &layout, const SensorSnapshot &snapshot)
+{
+    Adafruit_SSD1306 &display = *panel.bus.display;
+
     display.clearDisplay();
-    display.display();
-    forceDisplayRefresh();
+    drawGauge(display, layout.top, snapshot);
+    drawGauge(display, layout.bottom, snapshot);
+
+    if (isSnapshotChannelAlerting(snapshot.channels[layout.top]) ||
+        isSnapshotChannelAlerting(snapshot.channels[layout.bottom])) {
+        panel.priority = DISPLAY_PRIORITY_ALERT;
+    } else {
+        panel.priority = DISPLAY_PRIORITY_NORMAL;
+    }
+}
+
+#if ENABLE_MEMORY_REPORT
+// Scratch state the hot functions of the memory report run on, the live state isn't touched
+static ThermalLag report_lag;
+static RecordBlock report_block;
+static uint8_t report_page[BLACK_BOX_PAGE_SIZE];
+static uint16_t report_samples[64];
+static SensorSnapshot report_snapshot;
+
+static void runThermistorConversion()
+{
+    float value;
+    convertThermistorCelsius(value, 600, getThermistorReferenceResistor(OIL_ANALOG_INPUT_PIN, true));
+}
+
+static void runPressureConversion()
+{
+    float value;
+    convertPsi(value, PRESSURE_SENSOR_200_PSI, 2.5);
+}
+
+static void runThermalLag()
+{
+    compensateThermalLag(report_lag, 90, micros());
+}
+
+static void runRecordEncoding()
+{
+    BlackBoxRecord record = {micros(), 0, ENOERR, ALERT_NONE, 0, 90};
+
+    startRecordEncoding(report_block, report_page, sizeof(report_page));
+    encodeRecord(report_block, record);
+}
+
+static void runRippleAnalysis()
+{
+    RippleAnalysis analysis;
+    analyseRipple(report_samples, sizeof(report_samples) / sizeof(uint16_t), RIPPLE_SAMPLE_HZ, 0.01, analysis);
+}
+
+static void runSnapshotRead()
+{
+    readSensorSnapshot(report_snapshot);
+}
+
+// The display is drawn again from the snapshot on the next pass
+static void runOilTempBlit()
+{
+    updateOilTemp(display_1, 90);
+}
+
+// Print the memory report: where the hot code and data are, and their cycle counts
+void printMemory()
+{
+    const HotSymbol symbols[] = {
+        {"recordBlackBox", (const void *)recordBlackBox, 0, NULL},
+        {"triggerBlackBox", (const void *)triggerBlackBox, 0, NULL},
+        {"raiseCompareAlert", (const void *)raiseCompareAlert, 0, NULL},
+        {"decodeEcuFrame", (const void *)decodeEcuFrame, 0, NULL},
+        {"pollTachometer", (const void *)pollTachometer, 0, NULL},
+        {"convertThermistorCelsius", (const void *)convertThermistorCelsius, 0, runThermistorConversion},
+        {"convertPsi", (const void *)convertPsi, 0, runPressureConversion},
+        {"compensateThermalLag", (const void *)compensateThermalLag, 0, runThermalLag},
+        {"encodeRecord", (const void *)encodeRecord, 0, runRecordEncoding},
+        {"analyseRipple", (const void *)analyseRipple, 0, runRippleAnalysis},
+        {"readSensorSnapshot", (const void *)readSensorSnapshot, 0, runSnapshotRead},
+        {"updateOilTemp", (const void *)updateOilTemp, 0, runOilTempBlit},
+        {"gauge_channel_states", gauge_channel_states, sizeof(gauge_channel_states), NULL},
+        {"framebuffer", display_1.getBuffer(), 128 * 64 / 8, NULL},
+        {"oil_icon_c", epd_bitmap_oil_icon_c, sizeof(epd_bitmap_oil_icon_c), NULL},
+        {"gauge_font", FreeSans18pt7bBitmapsNum, sizeof(FreeSans18pt7bBitmapsNum), NULL},
+        {"rx8_logo", epd_bitmap_rx8_logo, sizeof(epd_bitmap_rx8_logo), NULL},
+    };
+    AlertStats stats;
+
+    // The report runs at full speed, the cycle counts are those of the interrupts at that clock
+    requestClockBoost(CLOCK_BOOST_MS);
+    initThermalLag(report_lag, OIL_THERMISTOR_TIME_CONSTANT);
+    printMemoryReport(symbols, sizeof(symbols) / sizeof(HotSymbol));
+    getAlertStats(stats);
+    if (stats.ticks) {
+        Serial.printf("alert timer: %u cycles at most, %u on average\r\n", (unsigned)stats.cycles_max,
+            (unsigned)(stats.cycles_total / stats.ticks));
+    }
+}
+#endif
+
+// Print the clock scaling report: the clock, the die temperature, the time and the estimated
+// current at each clock, and what the low clock does to the alert timer interrupt
+void printClock()
+{
+    ClockStats clock;
+    AlertStats alerts;
+
+    getClockStats(clock);
+    getAlertStats(alerts);
+    Serial.printf("clock %u MHz%s, die %.1f C (max %.1f), %u throttles, %u boosts (%u refused)\r\n",
+        (unsigned)(clock.hz / 1000000), clock.throttled ? " (throttled)" : "", clock.die_celsius, clock.die_max_celsius,
+        (unsigned)clock.throttles, (unsigned)clock.boosts, (unsigned)clock.refused);
+    Serial.printf("%u s at %u MHz, %u s at %u MHz, %u switches (longest %u us), about %.0f mA on average\r\n",
+        (unsigned)(clock.high_ms / 1000), CLOCK_HIGH_HZ / 1000000, (unsigned)(clock.low_ms / 1000), CLOCK_LOW_HZ / 1000000,
+        (unsigned)clock.switches, (unsigned)clock.switch_max_us, clock.average_ma);
+    if (alerts.ticks) {
+        Serial.printf("alert timer: %.1f us at most at %u MHz, %.1f us at %u MHz\r\n",
+            alerts.cycles_max * 1e6f / CLOCK_HIGH_HZ, CLOCK_HIGH_HZ / 1000000,
+            alerts.cycles_max * 1e6f / CLOCK_LOW_HZ, CLOCK_LOW_HZ / 1000000);
+    }
+}
+
+// Print the power state report: the state, the time in each one and the last start
+void printPower()
+{
+    const PowerState &power = power_state;
+
+    Serial.printf("power %s for %u s, supply resting at %.2f V%s\r\n", getPowerStateName(power.state),
+        (unsigned)((millis() - power.since_ms) / 1000), power.rest_volts, power.charging ? ", charging" : "");
+    for (uint8_t state = 0; state < POWER_STATE_COUNT; state++) {
+        Serial.printf("%s: %u times, %u s\r\n", getPowerStateName(state), (unsigned)power.entered[state],
+            (unsigned)(power.state_ms[state] / 1000));
+    }
+    if (power.cranks) {
+        Serial.printf("last start: %u ms cranking, supply down to %.2f V, engine running after %u ms\r\n",
+            (unsigned)power.crank_ms, power.crank_min_volts, (unsigned)power.run_after_ms);
+    }
+}
+
+// Print the cause of the last reset, the warm restarts and the crash report of the Teensy core
+FLASHMEM void printCrash()
+{
+    Serial.printf("last reset: %s, %s start, %u warm restarts since the last cold start\r\n",
+        getResetCauseName(getResetCause()), warm_start ? "warm" : "cold", (unsigned)warm_state.restarts);
+    printCrashReport();
 }
 
-void setup()
+// Answer the serial commands the black box doesn't know
+// command: The command line
+// Return: False if it isn't known here either
+bool runSerialCommand(const char *command)
 {
+    #if ENABLE_MEMORY_REPORT
+    if (strcmp(command, "memory") == 0) {
+        printMemory();
+        return true;
+    }
+    #endif
+    if (strcmp(command, "clock") == 0) {
+        printClock();
+        return true;
+    }
+    if (strcmp(command, "power") == 0) {
+        printPower();
+        return true;
+    }
+    if (strcmp(command, "crash") == 0) {
+        printCrash();
+        return true;
+    }
+    return false;
+}
+
+FLASHMEM void setup()
+{
+    setup_ms = millis();
     configureIOs();
-    initDisplay(display_1);
-    initDisplay(display_2);
 
-    // Start with the high reference pull-down value
-    setThermistorHighReferenceOil(true);
-    setThermistorHighReferenceCoolant(true);
+    // After a watchdog or software reset, carry on from the state saved by the last loop pass
+    warm_start = loadWarmState(warm_state);
+
+    // The alert timer gets the thresholds of every channel here, it only alerts on a channel once
+    // it gets its first reading
+    for (uint8_t i = 0; i < gauge_channel_count; i++) {
+        initGaugeChannel(i, gauge_channels[i], gauge_channel_states[i], TREND_GRAPH_HISTORY_SECONDS);
+        if (warm_start) {
+            restoreGaugeChannel(i, gauge_channels[i], gauge_channel_states[i], warm_state.channels[i],
+                warm_state.health[i]);
+        }
+    }
+    initDisplays();
+
+    #if ADC_COMPARE_ALARMS
+    // Before the thermistor references are set, that arms their windows
+    initCompareWindows();
+    #endif
+
+    // Start with the high reference pull-down value, or the one in use before a warm restart
+    setThermistorHighReferenceOil(warm_start ? warm_state.oil_reference_high : true);
+    setThermistorHighReferenceCoolant(warm_start ? warm_state.coolant_reference_high : true);
     
     // Read the onboard jumper (J2).
     // Jupmer absent = Celsius
@@ -739,17 +1731,61 @@ void setup()
 
     //pressureUnitIsBar = true;
 
-    displayIntro();
+    // Find the saved events and get a flash slot ready for the next, before any timer starts:
+    // the erases hold the interrupts
+    initBlackBox();
+    setBlackBoxCommandHandler(runSerialCommand,
+        ENABLE_MEMORY_REPORT ? "memory, clock, power, crash" : "clock, power, crash");
+
+    // Start listening to the ECU frames and measuring the engine speed, if enabled
+    initCanBus();
+    initTach();
+
+    // Sample the supply voltage in bursts on the second ADC, if enabled
+    initRipple(VOLTAGE_ANALOG_INPUT_PIN,
+        (MAX_ANALOGUE_VOLTAGE / RIPPLE_ADC_MAX) / (VOLTAGE_DIVIDER_R2 / (VOLTAGE_DIVIDER_R1 + VOLTAGE_DIVIDER_R2)));
+
+    // Start the alert timer, it drives the warning LED and the buzzer from now on. After a warm
+    // restart, the alerts that were on are on again at its first interrupt.
+    if (warm_start)
+        restoreAlertLatches(warm_state.alerts);
+    initAlerts(ENABLE_WARNING_LEDS ? WARNING_LED_OUTPUT_PIN : ALERT_NO_PIN,
+        ENABLE_ALERT_BUZZER ? ALERT_BUZZER_OUTPUT_PIN : ALERT_NO_PIN);
+
+    #if ADC_COMPARE_ALARMS
+    // Watch the thresholds in hardware as well, between the readings. The alarm interrupts have the
+    // alert timer priority, they set the warning LED straight away.
+    armCompareAlarm(GAUGE_CHANNEL_OIL_PSI, true);
+    armCompareAlarm(GAUGE_CHANNEL_SUPPLY_VOLTAGE, true);
+    initAdcCompare(raiseCompareAlert, ALERT_TIMER_PRIORITY);
+    #endif
+
+    if (!warm_start)
+        displayIntro();
+
+    // Everything is up, the clock goes down to what the loop needs. The gauges show until the
+    // supply says the engine is off.
+    initClockScaling();
+    if (warm_start) {
+        restorePowerState(power_state, warm_state.power, millis());
+        applyPowerState(false);
+        warm_state.restarts++;
+    } else {
+        initPowerState(power_state, millis());
+        warm_state.restarts = 0;
+    }
+
+    // From now on, the loop must feed the watchdog
+    initWatchdog();
 }
 
 void loop()
 {
-    float oil_temp;
-    float oil_psi;
-    float coolant_temp;
-    float supply_voltage;
-    int err;
-    int err2;
+    // The readings of this pass, and those sent on the CAN bus
+    SensorSnapshot snapshot;
+    const SnapshotChannel *channels = snapshot.channels;
+    GaugeReadings readings;
+    bool fullPass;
 
     // The following value are used to compute and enforce the refresh rate
     uint64_t startMs;
@@ -759,114 +1795,65 @@ void loop()
     // Sample the current timer counter
     startMs = millis();
 
-    // Get oil pressure and temp and display
-    // Also handle any faults that we've caught and display the appropriate message
-    // in the appropriate place
-    err = getFluidTempCelsius(oil_temp, OIL_ANALOG_INPUT_PIN);
-    err2 = getFluidPsi(oil_psi, PRESSURE_SENSOR_200_PSI, OIL_PSI_ANALOG_INPUT_PIN);
-    // We still want to process data when the lid is closed, but we don't want to display this on the screen.
-    if (lidClosed) {
-        if (err != ENOERR || err2 != ENOERR) {
-            digitalWrite(WARNING_LED_OUTPUT_PIN, HIGH);
-            in_alert = true;
-        } else {
-            if (oil_temp >= OIL_TEMP_WARNING_CELSIUS) {
-                digitalWrite(WARNING_LED_OUTPUT_PIN, HIGH);
-                in_alert = true;
-            } else if (oil_psi >= OIL_PSI_WARNING_HIGH || oil_psi <= OIL_PSI_WARNING_LOW) {
-                digitalWrite(WARNING_LED_OUTPUT_PIN, HIGH);
-                in_alert = true;
-            }
-        }
-    } else {
-        if (err == ENOERR && err2 == ENOERR) {
-            if (oil_psi != current_oil_psi || oil_temp != current_oil_temp) {
-                display_1.clearDisplay();
-                updateOilTemp(display_1, oil_temp);
-                updateOilPsi(display_1, oil_psi);
-                display_1.display();
-            }
-        } else if (err != ENOERR) {
-            display_1.clearDisplay();
-            displayFault(display_1, TOP_HALF);
-            if (err2 != ENOERR) {
-                displayFault(display_1, BOTTOM_HALF);
-            } else {
-                updateOilPsi(display_1, oil_psi);
-            }
-            display_1.display();
-        } else {
-            display_1.clearDisplay();
-            updateOilTemp(display_1, oil_temp);
-            displayFault(display_1, BOTTOM_HALF);
-            display_1.display();
-        }
+    // A display whose bus is down costs nothing until its next recovery attempt
+    for (uint8_t i = 0; i < display_manager.count; i++)
+        serviceDisplay(display_manager.panels[i]);
+
+    // Read every gauge channel, against the oil pressure threshold of the current engine speed.
+    // While cranking, only the supply and the oil pressure are read on most passes, the rest and
+    // the displays once every POWER_CAPTURE_SLOW_PASSES. The trend history goes on while the
+    // displays are off.
+    fullPass = power_state.state != POWER_STATE_CRANKING || capture_passes++ % POWER_CAPTURE_SLOW_PASSES == 0;
+    updateOilPsiLowLimit();
+    readGaugeChannels(fullPass ? 0xFF : (1 << GAUGE_CHANNEL_SUPPLY_VOLTAGE) | (1 << GAUGE_CHANNEL_OIL_PSI));
+
+    // Everything that follows works from the snapshot of this pass, as any other reader would
+    publishGaugeSnapshot();
+    readSensorSnapshot(snapshot);
+    updatePowerMode(snapshot);
+
+    readings.oil_temp_celsius = channels[GAUGE_CHANNEL_OIL_TEMP].valid ? channels[GAUGE_CHANNEL_OIL_TEMP].value : 0;
+    readings.oil_psi = channels[GAUGE_CHANNEL_OIL_PSI].valid ? channels[GAUGE_CHANNEL_OIL_PSI].value : 0;
+    readings.coolant_temp_celsius = channels[GAUGE_CHANNEL_COOLANT_TEMP].valid ? channels[GAUGE_CHANNEL_COOLANT_TEMP].value : 0;
+    readings.supply_voltage = channels[GAUGE_CHANNEL_SUPPLY_VOLTAGE].valid ? channels[GAUGE_CHANNEL_SUPPLY_VOLTAGE].value : 0;
+    // A valid reading from a noisy or glitching sensor still reports the sensor health code
+    for (uint8_t channel = 0; channel < GAUGE_CHANNEL_COUNT; channel++) {
+        readings.errors[channel] = channels[channel].valid ? channels[channel].health : channels[channel].error;
     }
-    
 
-    // Get coolant temp and supply voltage and display
-    // Also handle any faults that we've caught and display the appropriate message
-    // in the appropriate place
-    err = getFluidTempCelsius(coolant_temp, COOLANT_ANALOG_INPUT_PIN);
-    err2 = getSupplyVoltage(supply_voltage);
-    // We still want to process data when the lid is closed, but we don't want to display this on the screen.
-    if (lidClosed) {
-        // Save some processing if we are already in an alert state
-        if (!in_alert) {
-            if (err != ENOERR || err2 != ENOERR) {
-                digitalWrite(WARNING_LED_OUTPUT_PIN, HIGH);
-                in_alert = true;
-            } else {
-                if (coolant_temp >= COOLANT_TEMP_WARNING_CELSIUS) {
-                    digitalWrite(WARNING_LED_OUTPUT_PIN, HIGH);
-                    in_alert = true;
-                } else if (supply_voltage >= BATTERY_VOLTAGE_HIGH_WARNING || supply_voltage <= BATTERY_VOLTAGE_LOW_WARNING) {
-                    digitalWrite(WARNING_LED_OUTPUT_PIN, HIGH);
-                    in_alert = true;
-                }
-            }
-        }
-    } else {
-        if (err == ENOERR && err2 == ENOERR) {
-            if (coolant_temp != current_coolant_temp) {
-                display_2.clearDisplay();
-                updateCoolantTemp(display_2, coolant_temp);
-                updateSupplyVoltage(display_2, supply_voltage);
-                display_2.display();
-            }
-        } else if (err != ENOERR) {
-            display_2.clearDisplay();
-            displayFault(display_2, TOP_HALF);
-            if (err2 != ENOERR) {
-                displayFault(display_2, BOTTOM_HALF);
-            } else {
-                updateSupplyVoltage(display_2, supply_voltage);
-            }
-            display_2.display();
-        } else {
-            display_2.clearDisplay();
-            updateCoolantTemp(display_2, coolant_temp);
-            displayFault(display_2, BOTTOM_HALF);
-            display_2.display();
-        }
+    // We still want to process data when the displays are off, but we don't want to display this on the screen.
+    // Every panel is drawn, the display manager only sends what changed, alerts first.
+    if (!areDisplaysOff() && fullPass) {
+        for (uint8_t i = 0; i < display_manager.count; i++)
+            drawPanel(display_manager.panels[i], gauge_panel_layouts[i], snapshot);
+        flushDisplayPanels(display_manager);
     }
-    
+
+    // Hand the readings over to the CAN publisher, it sends them from its own timer
+    readings.alerts = getGaugeAlerts(snapshot);
+    publishGaugeReadings(readings);
+
+    // Save the last event to the flash and answer the serial commands, a little at a time. The
+    // flash is only erased while the engine is off.
+    serviceBlackBox(power_state.state == POWER_STATE_OFF);
+
+    // Lower the clock once the diagnostics are done, or the die gets too hot
+    serviceClockScaling();
+
     // Now we check if the lid is closed, handling it appropriately.
     //processLidStatus();
     // Now we check if the car has switched on/off lights, and handle state changes appropriately.
     processDayLight();
 
-    #if ENABLE_WARNING_LEDS
-    // Fault not detected so we swtich the LEDs off
-    if (!in_alert)
-        digitalWrite(WARNING_LED_OUTPUT_PIN, LOW);
-    #endif
+    // Keep the state for a warm restart, and tell the watchdog the loop still runs
+    saveRestartState();
+    feedWatchdog();
 
-    // Wait the correct amount of time to respect the desired refresh rate
+    // Wait the correct amount of time to respect the refresh rate of the power state
     // Note: There is no needs to take the timer overflow into account here. The timer overflows every
     //       50 days, which is much longer than a car would run continuously
     elapsedMs = (int32_t)(millis() - startMs);
-    waitMs = int32_t((int32_t)((1.0 / (float)DISPLAY_REFRESH_RATE_HZ) * 1000.0) - (int32_t)elapsedMs);
+    waitMs = getLoopPeriodMs() - (int32_t)elapsedMs;
     if (waitMs > 0)
-        delay(waitMs);
+        waitNextPass(waitMs);
 }
@@ -5,19 +5,33 @@
  * BSD tree clause licence (SPDX: BSD-3-Clause)
 */
 
+#ifndef COOLANT_MONITOR_H
+#define COOLANT_MONITOR_H
+
 /* 
  * There are values in here you will need to change.
  * You will need to mesaure the resistance of resistors R3, R4, R8, R9, R10 and R11 and enter the values below.
 */
 
-// Set this to zero if you'd prefer not to have the buzzer
-// #define USE_BUZZER_ALERT 1
+// Set this to one to sound the buzzer for a couple of seconds when a warning or fault starts
+#define ENABLE_ALERT_BUZZER 0
 
 // Set this to zero if you don't want LEDs in a warning state
 #define ENABLE_WARNING_LEDS 1
 
 #define DEBUG_VALUES 0
 
+// Set this to 1 to also watch the warning thresholds with the compare function of the second ADC,
+// between the readings: a violation lights the warning LED within a couple of milliseconds instead
+// of at the next reading. See adc_compare.h.
+#define ADC_COMPARE_ALARMS 0
+
+// Set this to 1 to sample the gauge channels two at a time, one on each ADC, see adc_pair.h and
+// gauge_channel_pairs in coolant_monitor.cpp. The paired readings are taken at the same instant,
+// and a pair takes the sampling time of one channel. Needs the second ADC, so it can't be
+// combined with ADC_COMPARE_ALARMS.
+#define DUAL_ADC_SAMPLING 0
+
 // These values you can change to control when the warning triangle and warning LED is displayed to indicate a fault.
 // Temperatures:
 // The coolant temperature warning threshold, in Celsius
@@ -30,6 +44,11 @@
 // The oil pressure warning threshold, in PSI
 #define OIL_PSI_WARNING_LOW 13
 #define OIL_PSI_WARNING_HIGH 150
+// With the engine speed known (tach input or ECU frames, see tach.h and can_bus.h), the low oil
+// pressure warning rises with it: this many PSI per 1000 RPM, from OIL_PSI_WARNING_LOW at idle
+// up to OIL_PSI_WARNING_LOW_MAX
+#define OIL_PSI_WARNING_LOW_PER_1000_RPM 10
+#define OIL_PSI_WARNING_LOW_MAX 60
 // Voltage:
 // Display a warning sign when the battery voltage is below or above these values
 #define BATTERY_VOLTAGE_LOW_WARNING 11.5
@@ -38,6 +57,21 @@
 // The speed (in Hz) at which the displays refresh the displayed values
 #define DISPLAY_REFRESH_RATE_HZ 5 //4
 
+// Set this to 1 to show a graph of the last few minutes at the right of each value.
+// The graph takes the room of the unit signs and of the warning sign: it is drawn inverted instead.
+#define TREND_GRAPH_MODE 0
+// How far back the graphs go, in seconds. The graphs are 30 pixels wide, so 240 is one pixel every 8 seconds.
+#define TREND_GRAPH_HISTORY_SECONDS 240
+// Values at the bottom and the top of each graph
+#define TREND_GRAPH_OIL_TEMP_MIN 40
+#define TREND_GRAPH_OIL_TEMP_MAX 140
+#define TREND_GRAPH_OIL_PSI_MIN 0
+#define TREND_GRAPH_OIL_PSI_MAX 150
+#define TREND_GRAPH_COOLANT_TEMP_MIN 40
+#define TREND_GRAPH_COOLANT_TEMP_MAX 120
+#define TREND_GRAPH_VOLTAGE_MIN 10
+#define TREND_GRAPH_VOLTAGE_MAX 16
+
 // Position of the displayed value relative to the display half. Do not change this.
 #define TEXT_POS_X 30
 #define TEXT_POS_Y 4
@@ -78,8 +112,8 @@
 
 // Digital pins definitions
 // If it's commentend out, it's in use above
-#define UNUSED_PIN_0 0          // RX1
-#define UNUSED_PIN_1 1          // TX1
+#define UNUSED_PIN_0 0          // RX1 / CRX2 when ENABLE_CAN_BUS is set (see can_bus.h)
+#define UNUSED_PIN_1 1          // TX1 / CTX2 when ENABLE_CAN_BUS is set (see can_bus.h)
 //#define UNUSED_PIN_2 2
 //#define UNUSED_PIN_3 3
 //#define UNUSED_PIN_4 4
@@ -87,7 +121,7 @@
 //#define UNUSED_PIN_6 6
 //#define UNUSED_PIN_7 7      
 //#define UNUSED_PIN_8 8   
-#define UNUSED_PIN_9 9         
+#define UNUSED_PIN_9 9          // Tach input when ENABLE_TACH_INPUT is set (see tach.h)
 //#define UNUSED_PIN_10 10  
 #define UNUSED_PIN_11 11        // MOSI
 #define UNUSED_PIN_12 12        // MISO
@@ -145,6 +179,25 @@
 #define THERMISTOR_RESISTOR_REFERENCE_LOW_THRESHOLD 55
 #define THERMISTOR_RESISTOR_REFERENCE_HIGH_THRESHOLD 50
 
+// Time for the thermistor input to settle after the reference resistor is switched, in microseconds.
+// The FDN337N switches in nanoseconds, this covers the input filter with a good margin.
+// Only the first read after a switch waits, and only for what's left of this time.
+#define THERMISTOR_REFERENCE_SETTLE_US 500
+// Number of ADC samples thrown away after a reference switch, on top of the usual warm up read
+#define THERMISTOR_REFERENCE_DISCARD_SAMPLES 1
+// Set this to 1 to read the thermistor with both references between the two thresholds above,
+// and blend the two temperatures: the weight of the low reference reading goes from 0 at the high
+// reference threshold to 1 at the low reference threshold, so the displayed temperature doesn't
+// jump when the reference is switched. Costs one extra (fast) acquisition per reading in that band.
+#define THERMISTOR_DUAL_RANGE_BLEND 1
+// Set this to 1 to compensate the slow response of the thermistors: the temperature shown is where
+// the sensor is heading, the fluid temperature, rather than where it is (see thermal_lag.h)
+#define THERMISTOR_LAG_COMPENSATION 0
+// Time constants of the thermistors as mounted, in seconds: the time a reading takes to get 63% of
+// the way after a change of the fluid temperature. Measure yours with the thermal-lag host tool.
+#define OIL_THERMISTOR_TIME_CONSTANT 6.0
+#define COOLANT_THERMISTOR_TIME_CONSTANT 8.0
+
 // There is an onboard tension divider that allow the Teensy to read the supply voltage (~12V).
 // The raw voltage is too high for the Teensy, so the voltage is divided with resistors.
 // For the best results, measure the actual values on your specific board and use high precision %1 resistor or better.
@@ -183,11 +236,8 @@
 // The highest tolerable voltage by the ADC
 #define MAX_ANALOGUE_VOLTAGE 3.3
 
-// ERROR Codes, DO NOT CHANGE
-#define ENOERR 0
-#define ERANGE 1
-#define EDIVZERO 2
-#define EINVALID 3
+// ERROR Codes, see error_codes.h
+#include "error_codes.h"
 
 /* Custom icons definitions.
  * Made with Gimp and converted with image2cpp
@@ -198,9 +248,11 @@
  *  rad_pressure_icon, rx8_logo, voltage_icon, voltage_sign, wanring_icon
  * Credit for the following icons to Andrew Wilson:
  *  bar_sign, oil_icon_c, oil_icon_f, oil_pressure_icon
+ * The icons drawn every frame are plain constants, in the DTCM: only the intro logo is left in
+ * the flash (PROGMEM), see placement.h.
  */
 // 'degree_sign', 8x10px
-const unsigned char epd_bitmap_degree_sign [] PROGMEM = {
+const unsigned char epd_bitmap_degree_sign [] = {
     0x3C, 0x66, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0x66, 0x3C, 0xDE, 0x71, 0xB0, 0x78, 0x3C, 0x1E,
     0x0F, 0x07, 0x83, 0xE3, 0x6F, 0x30, 0x18, 0x0C, 0x00, 0x3B, 0x67, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3,
     0xC3, 0x67, 0x3B, 0x03, 0x03, 0x03, 0xDF, 0x31, 0x8C, 0x63, 0x18, 0xC6, 0x00, 0x3E, 0xE3, 0xC0,
@@ -209,7 +261,7 @@ const unsigned char epd_bitmap_degree_sign [] PROGMEM = {
 };
 
 // 'coolant_icon_c', 24x25px
-const unsigned char epd_bitmap_coolant_icon_c [] PROGMEM = {
+const unsigned char epd_bitmap_coolant_icon_c [] = {
     0x00, 0x18, 0x00, 0x00, 0x3c, 0x06, 0x00, 0x3c, 0x08, 0x00, 0x3f, 0x88, 0x00, 0x3f, 0x88, 0x00, 
     0x3c, 0x06, 0x00, 0x3c, 0x00, 0x00, 0x3f, 0x80, 0x00, 0x3f, 0x80, 0x00, 0x3c, 0x00, 0x00, 0x3c, 
     0x00, 0x00, 0x3f, 0x80, 0x00, 0x3f, 0x80, 0x00, 0x3c, 0x00, 0x00, 0x3c, 0x00, 0x00, 0x3c, 0x00, 
@@ -218,7 +270,7 @@ const unsigned char epd_bitmap_coolant_icon_c [] PROGMEM = {
 };
 
 // 'coolant_icon_f', 24x25px
-const unsigned char epd_bitmap_coolant_icon_f [] PROGMEM = {
+const unsigned char epd_bitmap_coolant_icon_f [] = {
     0x00, 0x18, 0x00, 0x00, 0x3c, 0x0e, 0x00, 0x3c, 0x08, 0x00, 0x3f, 0x8c, 0x00, 0x3f, 0x88, 0x00, 
     0x3c, 0x08, 0x00, 0x3c, 0x00, 0x00, 0x3f, 0x80, 0x00, 0x3f, 0x80, 0x00, 0x3c, 0x00, 0x00, 0x3c, 
     0x00, 0x00, 0x3f, 0x80, 0x00, 0x3f, 0x80, 0x00, 0x3c, 0x00, 0x00, 0x3c, 0x00, 0x00, 0x3c, 0x00, 
@@ -227,7 +279,7 @@ const unsigned char epd_bitmap_coolant_icon_f [] PROGMEM = {
 };
 
 // 'oil_icon_c', 24x25px
-const unsigned char epd_bitmap_oil_icon_c [] PROGMEM = {
+const unsigned char epd_bitmap_oil_icon_c [] = {
 	0x00, 0x00, 0x00, 0x00, 0x60, 0x06, 0x00, 0x60, 0x08, 0x00, 0x7c, 0x08, 0x00, 0x7c, 0x08, 0x00, 
 	0x60, 0x06, 0x00, 0x60, 0x00, 0x00, 0x7c, 0x00, 0x00, 0x7c, 0x00, 0x00, 0x60, 0x00, 0x00, 0x60, 
 	0x00, 0x00, 0x7c, 0x00, 0x00, 0x7c, 0x00, 0x70, 0x60, 0x04, 0x88, 0x60, 0x1e, 0x8c, 0xf0, 0xf2, 
@@ -236,7 +288,7 @@ const unsigned char epd_bitmap_oil_icon_c [] PROGMEM = {
 };
 
 // 'oil_icon_f', 24x25px
-const unsigned char epd_bitmap_oil_icon_f [] PROGMEM = {
+const unsigned char epd_bitmap_oil_icon_f [] = {
 	0x00, 0x00, 0x00, 0x00, 0x60, 0x0e, 0x00, 0x60, 0x08, 0x00, 0x7c, 0x0c, 0x00, 0x7c, 0x08, 0x00, 
 	0x60, 0x08, 0x00, 0x60, 0x00, 0x00, 0x7c, 0x00, 0x00, 0x7c, 0x00, 0x00, 0x60, 0x00, 0x00, 0x60, 
 	0x00, 0x00, 0x7c, 0x00, 0x00, 0x7c, 0x00, 0x70, 0x60, 0x04, 0x88, 0x60, 0x1e, 0x8c, 0xf0, 0xf2, 
@@ -245,7 +297,7 @@ const unsigned char epd_bitmap_oil_icon_f [] PROGMEM = {
 };
 
 // 'warning_icon', 31x31px
-const unsigned char epd_bitmap_warning_icon [] PROGMEM = {
+const unsigned char epd_bitmap_warning_icon [] = {
     0x00, 0x01, 0x00, 0x00, 0x00, 0x03, 0x80, 0x00, 0x00, 0x03, 0x80, 0x00, 0x00, 0x07, 0xc0, 0x00,
     0x00, 0x07, 0xc0, 0x00, 0x00, 0x0f, 0xe0, 0x00, 0x00, 0x0e, 0xe0, 0x00, 0x00, 0x1c, 0x70, 0x00,
     0x00, 0x1c, 0x70, 0x00, 0x00, 0x38, 0x38, 0x00, 0x00, 0x38, 0x38, 0x00, 0x00, 0x70, 0x1c, 0x00,
@@ -257,17 +309,17 @@ const unsigned char epd_bitmap_warning_icon [] PROGMEM = {
 };
 
 // 'psi_sign', 15x7px
-const unsigned char epd_bitmap_psi_sign [] PROGMEM = {
+const unsigned char epd_bitmap_psi_sign [] = {
     0xf3, 0xce, 0x92, 0x04, 0x92, 0x04, 0xf3, 0xc4, 0x80, 0x44, 0x80, 0x44, 0x83, 0xce
 };
 
 // 'bar_sign', 15x7px
-const unsigned char epd_bitmap_bar_sign [] PROGMEM = {
+const unsigned char epd_bitmap_bar_sign [] = {
     0xe3, 0x38, 0x94, 0xa4, 0x94, 0xa4, 0xe7, 0xb8, 0x94, 0xa4, 0x94, 0xa4, 0xe4, 0xa4
 };
 
 // 'rad_pressure_icon', 20x28px
-const unsigned char epd_bitmap_rad_psi3_icon [] PROGMEM = {
+const unsigned char epd_bitmap_rad_psi3_icon [] = {
     0x00, 0x07, 0xc0, 0x00, 0x02, 0x80, 0x00, 0x02, 0x80, 0x7f, 0xfe, 0xf0, 0x40, 0x00, 0x10, 0x40,
     0x00, 0x10, 0xc0, 0x00, 0x10, 0x00, 0x00, 0x10, 0xc0, 0x00, 0x10, 0x40, 0x00, 0x10, 0x40, 0x00,
     0x10, 0x48, 0x20, 0x90, 0x5c, 0x71, 0xd0, 0x7e, 0xfb, 0xf0, 0x7f, 0xff, 0xf0, 0x7f, 0xff, 0xf0,
@@ -277,7 +329,7 @@ const unsigned char epd_bitmap_rad_psi3_icon [] PROGMEM = {
 };
 
 // 'oil_pressure_icon', 24x18px
-const unsigned char epd_bitmap_oil_psi_icon [] PROGMEM = {
+const unsigned char epd_bitmap_oil_psi_icon [] = {
     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x71, 0xe0, 0x04, 0x88, 0xc0, 0x1e, 0x8f, 0xf0, 0xf2, 0x78, 
 	0x0f, 0x20, 0x08, 0x00, 0x42, 0x08, 0x00, 0x47, 0x08, 0x00, 0x85, 0x08, 0x01, 0x05, 0x0f, 0xff, 
 	0x07, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xc1, 0x81, 0x83, 0x26, 0x66, 0x64, 
@@ -308,7 +360,7 @@ const unsigned char epd_bitmap_rx8_logo [] PROGMEM = {
 };
 
 // 'fault_message', 102x26px
-const unsigned char epd_bitmap_fault [] PROGMEM = {
+const unsigned char epd_bitmap_fault [] = {
     0x0f, 0xff, 0xe0, 0x0f, 0xc0, 0x0f, 0x80, 0x1f, 0x0f, 0x00, 0x1f, 0xff, 0xfc, 0x0f, 0xff, 0xe0, 
     0x0f, 0xc0, 0x0f, 0x80, 0x1e, 0x0f, 0x00, 0x1f, 0xff, 0xfc, 0x1f, 0xff, 0xe0, 0x1f, 0xc0, 0x0f, 
     0x80, 0x1e, 0x1f, 0x00, 0x3f, 0xff, 0xf8, 0x1f, 0xff, 0xc0, 0x1f, 0xc0, 0x0f, 0x80, 0x1e, 0x1f, 
@@ -334,7 +386,7 @@ const unsigned char epd_bitmap_fault [] PROGMEM = {
 };
 
 // 'voltage_icon', 12x28px
-const unsigned char epd_bitmap_voltage_icon [] PROGMEM = {
+const unsigned char epd_bitmap_voltage_icon [] = {
     0x07, 0xc0, 0x0f, 0x80, 0x0f, 0x80, 0x0f, 0x80, 0x0f, 0x00, 0x1f, 0x00, 0x1f, 0x00, 0x1e, 0x00, 
     0x3e, 0x00, 0x3e, 0x00, 0x3e, 0x00, 0x3c, 0x00, 0x7c, 0x00, 0x7f, 0xf0, 0x7f, 0xe0, 0x7f, 0xe0, 
     0xff, 0xc0, 0x03, 0xc0, 0x03, 0x80, 0x03, 0x80, 0x03, 0x80, 0x03, 0x00, 0x07, 0x00, 0x06, 0x00, 
@@ -342,7 +394,7 @@ const unsigned char epd_bitmap_voltage_icon [] PROGMEM = {
 };
 
 // 'voltage_sign', 7x8px
-const unsigned char epd_bitmap_voltage_sign [] PROGMEM = {
+const unsigned char epd_bitmap_voltage_sign [] = {
     0x82, 0x82, 0x44, 0x44, 0x28, 0x28, 0x10, 0x10
 };
 
@@ -353,7 +405,7 @@ typedef struct {
 } IconSize;
 
 // Icon size table
-const IconSize iconSize[] PROGMEM = {
+const IconSize iconSize[] = {
     {8, 10},    // Degree sign
     {24, 25},   // Coolant icon Celsius
     {24, 25},   // Coolant icon Fahrenheit
@@ -387,7 +439,7 @@ enum class Icon: uint8_t {
     voltage_sign
 };
 
-const unsigned char* epd_bitmap_allArray[sizeof(iconSize) / sizeof(IconSize)] = {
+const unsigned char* const epd_bitmap_allArray[sizeof(iconSize) / sizeof(IconSize)] = {
     epd_bitmap_degree_sign,
     epd_bitmap_coolant_icon_c,
     epd_bitmap_coolant_icon_f,
@@ -403,3 +455,5 @@ const unsigned char* epd_bitmap_allArray[sizeof(iconSize) / sizeof(IconSize)] =
     epd_bitmap_voltage_icon,
     epd_bitmap_voltage_sign
 };
+
+#endif
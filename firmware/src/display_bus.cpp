@@ -0,0 +1,268 @@
+/*
+ * Display bus handling for the RX-8 Ashtray Gauges project, see display_bus.h.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#include <string.h>
+#include <Arduino.h>
+#include "display_bus.h"
+#include "error_codes.h"
+
+// SSD1306 control bytes: the rest of the transfer is commands, or display RAM data
+#define SSD1306_CONTROL_COMMANDS 0x00
+#define SSD1306_CONTROL_DATA 0x40
+
+// SSD1306 no operation command, used to check the display answers
+#define SSD1306_NOP 0xE3
+
+// Half period of the SCL pulses sent by hand during a recovery, in microseconds (100kHz)
+#define DISPLAY_BUS_RECOVERY_HALF_PERIOD_US 5
+
+// Set the time after which the I2C controller aborts a transfer because SCL or SDA is held low.
+// Wire sets it to 15ms on every setClock(), so this must be called after it.
+// wire: The I2C bus
+// us: The timeout, in microseconds
+static void setPinLowTimeout(TwoWire &wire, uint32_t us)
+{
+#if defined(__IMXRT1062__)
+    IMXRT_LPI2C_t *port;
+    uint32_t mcr;
+    uint32_t pinLow;
+
+    if (&wire == &Wire) {
+        port = &IMXRT_LPI2C1;
+    } else if (&wire == &Wire1) {
+        port = &IMXRT_LPI2C3;
+    } else if (&wire == &Wire2) {
+        port = &IMXRT_LPI2C4;
+    } else {
+        return;
+    }
+
+    // The timeout counts in units of 256 cycles of the controller clock (24MHz) after the prescaler
+    pinLow = (uint32_t)((uint64_t)us * (24000000 >> (port->MCFGR1 & 7)) / 256000000) + 1;
+    if (pinLow > 0xFFF)
+        pinLow = 0xFFF;
+
+    // The configuration registers can only be written with the controller disabled
+    mcr = port->MCR;
+    port->MCR = mcr & ~LPI2C_MCR_MEN;
+    port->MCFGR3 = LPI2C_MCFGR3_PINLOW(pinLow);
+    port->MCR = mcr;
+#else
+    wire.setPinLowTimeout(us);
+#endif
+}
+
+// Set the bus clock and timeout, after Wire.begin() or the display initialisation
+static void configureBus(DisplayBus &bus)
+{
+    bus.wire->setClock(DISPLAY_BUS_CLOCK_HZ);
+    setPinLowTimeout(*bus.wire, DISPLAY_BUS_PIN_LOW_TIMEOUT_US);
+}
+
+// Free a bus held low by a device stuck in the middle of a byte: clock SCL by hand until the
+// device releases SDA, then send a STOP. Wire.begin() gives the pins back to the controller.
+static void clearBus(DisplayBus &bus)
+{
+    pinMode(bus.sda_pin, INPUT_PULLUP);
+    pinMode(bus.scl_pin, OUTPUT_OPENDRAIN);
+    digitalWrite(bus.scl_pin, HIGH);
+    delayMicroseconds(DISPLAY_BUS_RECOVERY_HALF_PERIOD_US);
+
+    for (uint8_t i = 0; i < DISPLAY_BUS_RECOVERY_CLOCKS && digitalRead(bus.sda_pin) == LOW; i++) {
+        digitalWrite(bus.scl_pin, LOW);
+        delayMicroseconds(DISPLAY_BUS_RECOVERY_HALF_PERIOD_US);
+        digitalWrite(bus.scl_pin, HIGH);
+        delayMicroseconds(DISPLAY_BUS_RECOVERY_HALF_PERIOD_US);
+    }
+
+    // STOP: SDA rising while SCL is high
+    pinMode(bus.sda_pin, OUTPUT_OPENDRAIN);
+    digitalWrite(bus.scl_pin, LOW);
+    digitalWrite(bus.sda_pin, LOW);
+    delayMicroseconds(DISPLAY_BUS_RECOVERY_HALF_PERIOD_US);
+    digitalWrite(bus.scl_pin, HIGH);
+    delayMicroseconds(DISPLAY_BUS_RECOVERY_HALF_PERIOD_US);
+    digitalWrite(bus.sda_pin, HIGH);
+    delayMicroseconds(DISPLAY_BUS_RECOVERY_HALF_PERIOD_US);
+}
+
+// Mark the bus down, nothing more will be sent until a recovery attempt
+static void takeBusDown(DisplayBus &bus, int err)
+{
+    bus.last_error = err;
+    if (!bus.up)
+        return;
+    bus.up = false;
+    bus.down_since_ms = millis();
+    bus.backoff_ms = DISPLAY_BUS_BACKOFF_MIN_MS;
+    bus.retry_at_ms = bus.down_since_ms + bus.backoff_ms;
+}
+
+// End the current transfer and check its result
+// Return: ENOERR, EBUSNACK or EBUSTIMEOUT
+static int endTransfer(DisplayBus &bus)
+{
+    uint32_t startUs = micros();
+    uint8_t status = bus.wire->endTransmission();
+    uint32_t elapsedUs = micros() - startUs;
+
+    bus.transfers++;
+    if (elapsedUs > bus.transfer_us_max)
+        bus.transfer_us_max = elapsedUs;
+
+    switch (status) {
+        case 0:
+            return ENOERR;
+        case 2:
+        case 3:
+            // Address or data not acknowledged
+            bus.nacks++;
+            return EBUSNACK;
+        default:
+            // Arbitration lost, pin low timeout or Wire's own timeout
+            bus.timeouts++;
+            return EBUSTIMEOUT;
+    }
+}
+
+// Check the display answers, with a command that does nothing
+static int probeDisplay(DisplayBus &bus)
+{
+    bus.wire->beginTransmission(bus.address);
+    bus.wire->write(SSD1306_CONTROL_COMMANDS);
+    bus.wire->write(SSD1306_NOP);
+    return endTransfer(bus);
+}
+
+void initDisplayBus(DisplayBus &bus, Adafruit_SSD1306 &display, TwoWire &wire, uint8_t address, uint8_t sclPin, uint8_t sdaPin)
+{
+    memset(&bus, 0, sizeof(bus));
+    bus.display = &display;
+    bus.wire = &wire;
+    bus.address = address;
+    bus.scl_pin = sclPin;
+    bus.sda_pin = sdaPin;
+    bus.up = true;
+    bus.backoff_ms = DISPLAY_BUS_BACKOFF_MIN_MS;
+}
+
+int beginDisplayBus(DisplayBus &bus)
+{
+    int err;
+
+    // The display may still be in the middle of a transfer if we were reset during one
+    clearBus(bus);
+
+    // This also allocates the display buffer, so it's done even if the display doesn't answer
+    bus.display->begin(SSD1306_SWITCHCAPVCC, bus.address, false, true);
+    configureBus(bus);
+
+    err = probeDisplay(bus);
+    if (err != ENOERR)
+        takeBusDown(bus, err);
+    return err;
+}
+
+int flushDisplay(DisplayBus &bus)
+{
+    return flushDisplayPages(bus, 0, (bus.display->height() + 7) / 8 - 1);
+}
+
+int flushDisplayPages(DisplayBus &bus, uint8_t firstPage, uint8_t lastPage)
+{
+    uint8_t width = bus.display->width();
+    const uint8_t *buffer = bus.display->getBuffer() + firstPage * width;
+    uint16_t length = width * (lastPage - firstPage + 1);
+    const uint8_t window[] = {SSD1306_CONTROL_COMMANDS, SSD1306_PAGEADDR, firstPage, lastPage, SSD1306_COLUMNADDR, 0, (uint8_t)(width - 1)};
+    uint16_t chunk;
+    int err;
+
+    if (!bus.up) {
+        bus.skipped++;
+        return EBUSDOWN;
+    }
+
+    // Set the address window to the pages, in one transfer
+    bus.wire->beginTransmission(bus.address);
+    bus.wire->write(window, sizeof(window));
+    err = endTransfer(bus);
+
+    // Then the display RAM, in chunks as large as the Wire buffer allows
+    while (err == ENOERR && length) {
+        chunk = length < DISPLAY_BUS_CHUNK_SIZE ? length : DISPLAY_BUS_CHUNK_SIZE;
+        bus.wire->beginTransmission(bus.address);
+        bus.wire->write(SSD1306_CONTROL_DATA);
+        bus.wire->write(buffer, chunk);
+        err = endTransfer(bus);
+        buffer += chunk;
+        length -= chunk;
+    }
+
+    if (err != ENOERR)
+        takeBusDown(bus, err);
+    return err;
+}
+
+int sendDisplayCommands(DisplayBus &bus, const uint8_t *commands, uint8_t count)
+{
+    int err;
+
+    if (!bus.up) {
+        bus.skipped++;
+        return EBUSDOWN;
+    }
+
+    bus.wire->beginTransmission(bus.address);
+    bus.wire->write(SSD1306_CONTROL_COMMANDS);
+    bus.wire->write(commands, count);
+    err = endTransfer(bus);
+    if (err != ENOERR)
+        takeBusDown(bus, err);
+    return err;
+}
+
+bool serviceDisplayBus(DisplayBus &bus)
+{
+    uint32_t nowMs = millis();
+    uint32_t startUs;
+    uint32_t elapsedUs;
+    uint32_t downMs;
+    int err;
+
+    if (bus.up || (int32_t)(nowMs - bus.retry_at_ms) < 0)
+        return false;
+
+    bus.recovery_attempts++;
+    startUs = micros();
+
+    clearBus(bus);
+    bus.wire->begin();
+    configureBus(bus);
+    err = probeDisplay(bus);
+    if (err == ENOERR) {
+        // The display may have lost power: initialise it again, Wire was already started
+        bus.display->begin(SSD1306_SWITCHCAPVCC, bus.address, false, false);
+        configureBus(bus);
+    }
+
+    elapsedUs = micros() - startUs;
+    if (elapsedUs > bus.recovery_us_max)
+        bus.recovery_us_max = elapsedUs;
+
+    if (err != ENOERR) {
+        bus.last_error = err;
+        bus.backoff_ms = bus.backoff_ms * 2 < DISPLAY_BUS_BACKOFF_MAX_MS ? bus.backoff_ms * 2 : DISPLAY_BUS_BACKOFF_MAX_MS;
+        bus.retry_at_ms = millis() + bus.backoff_ms;
+        return false;
+    }
+
+    bus.up = true;
+    bus.recoveries++;
+    downMs = millis() - bus.down_since_ms;
+    bus.down_ms_total += downMs;
+    if (downMs > bus.down_ms_max)
+        bus.down_ms_max = downMs;
+    return true;
+}
@@ -0,0 +1,105 @@
+/*
+ * Display bus handling for the RX-8 Ashtray Gauges project.
+ * Every transfer to the displays is checked. A display that stops answering, or a bus held low by
+ * a glitching connector, takes its bus down: nothing more is sent to it until a recovery attempt
+ * (SCL clocked by hand to release SDA, controller restarted, SSD1306 initialised again) brings it
+ * back. Failed attempts are retried with an exponential backoff, so a dead display costs next to
+ * nothing and the other display and the alerts keep running at full rate.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#ifndef DISPLAY_BUS_H
+#define DISPLAY_BUS_H
+
+#include <stdint.h>
+#include <Wire.h>
+#include <Adafruit_SSD1306.h>
+
+// I2C clock of the display buses, in Hz
+#define DISPLAY_BUS_CLOCK_HZ 400000
+
+// The I2C controller aborts a transfer when SCL or SDA stays low for this long, in microseconds.
+// A full chunk takes about 3ms at 400kHz, but neither line stays low for more than a few microseconds.
+#define DISPLAY_BUS_PIN_LOW_TIMEOUT_US 1000
+
+// Number of SCL pulses sent by hand to make a device release SDA. A device stuck in the middle of
+// a byte needs at most 9 (8 bits and the acknowledge).
+#define DISPLAY_BUS_RECOVERY_CLOCKS 9
+
+// Delay before the next recovery attempt after a failed one, in milliseconds.
+// It doubles after each failure, up to the maximum.
+#define DISPLAY_BUS_BACKOFF_MIN_MS 100
+#define DISPLAY_BUS_BACKOFF_MAX_MS 5000
+
+// Largest data chunk per transfer: the Wire transmit buffer less the control byte
+#define DISPLAY_BUS_CHUNK_SIZE (BUFFER_LENGTH - 1)
+
+// State and statistics of one display and its bus
+typedef struct {
+    // Configuration, set by initDisplayBus()
+    Adafruit_SSD1306 *display;
+    TwoWire *wire;
+    uint8_t address;
+    uint8_t scl_pin;
+    uint8_t sda_pin;
+
+    // State
+    bool up;                        // True if the display is answering
+    uint32_t down_since_ms;         // millis() when the bus went down
+    uint32_t retry_at_ms;           // millis() of the next recovery attempt
+    uint32_t backoff_ms;            // Delay after the next failed attempt
+
+    // Counters
+    uint32_t transfers;             // Transfers attempted
+    uint32_t nacks;                 // Transfers not acknowledged
+    uint32_t timeouts;              // Transfers aborted by the controller
+    uint32_t transfer_us_max;       // Longest transfer, in microseconds
+    uint32_t skipped;               // Flushes and commands dropped while the bus was down
+    uint32_t recovery_attempts;     // Recovery attempts, successful or not
+    uint32_t recoveries;            // Successful recoveries
+    uint32_t down_ms_total;         // Time spent down, recovered episodes only, in milliseconds
+    uint32_t down_ms_max;           // Longest recovered episode, in milliseconds
+    uint32_t recovery_us_max;       // Longest single recovery attempt, in microseconds
+    uint8_t last_error;             // Code of the last error, ENOERR if none yet
+} DisplayBus;
+
+// Set up a display bus. Nothing is sent, see beginDisplayBus().
+// bus: The display bus state
+// display: The display
+// wire: The I2C bus the display is on
+// address: The display 7 bits address
+// sclPin, sdaPin: The bus pins, driven by hand during a recovery
+void initDisplayBus(DisplayBus &bus, Adafruit_SSD1306 &display, TwoWire &wire, uint8_t address, uint8_t sclPin, uint8_t sdaPin);
+
+// Initialise the display and check it answers
+// bus: The display bus
+// Return: ENOERR if the display answered, otherwise the error code. The bus is then down and
+//         will be recovered by serviceDisplayBus().
+int beginDisplayBus(DisplayBus &bus);
+
+// Send the display buffer to the display
+// bus: The display bus
+// Return: ENOERR, EBUSDOWN if the bus is down (nothing sent), or the error code of the transfer that failed
+int flushDisplay(DisplayBus &bus);
+
+// Send some pages of the display buffer to the display, the rest of the display RAM is left as is
+// bus: The display bus
+// firstPage, lastPage: The pages to send (8 rows each), lastPage included
+// Return: ENOERR, EBUSDOWN if the bus is down (nothing sent), or the error code of the transfer that failed
+int flushDisplayPages(DisplayBus &bus, uint8_t firstPage, uint8_t lastPage);
+
+// Send commands to the display, in one transfer
+// bus: The display bus
+// commands: The command bytes, with their arguments
+// count: The number of bytes, at most DISPLAY_BUS_CHUNK_SIZE
+// Return: ENOERR, EBUSDOWN if the bus is down (nothing sent), or the error code of the transfer
+int sendDisplayCommands(DisplayBus &bus, const uint8_t *commands, uint8_t count);
+
+// Attempt a recovery if the bus is down and its retry time has come. Call this once per loop.
+// An attempt on a dead display costs about 200us, a successful one about 2ms.
+// bus: The display bus
+// Return: True if the display has just been recovered. It was initialised again, so the caller
+//         must send its settings (contrast, on/off) again and redraw it.
+bool serviceDisplayBus(DisplayBus &bus);
+
+#endif
@@ -0,0 +1,202 @@
+/*
+ * Display scheduling for the RX-8 Ashtray Gauges project, see display_manager.h.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#include <string.h>
+#include <Arduino.h>
+#include "display_manager.h"
+#include "error_codes.h"
+
+// Number of pages of a panel
+static uint8_t getPageCount(const DisplayPanel &panel)
+{
+    return (panel.bus.display->height() + 7) / 8;
+}
+
+// Find the pages of a panel that differ from what its display shows
+// panel: The panel
+// first, last: Receive the first and last changed pages
+// Return: False if no page changed
+static bool findChangedPages(const DisplayPanel &panel, uint8_t &first, uint8_t &last)
+{
+    const uint8_t *buffer = panel.bus.display->getBuffer();
+    uint8_t width = panel.bus.display->width();
+    uint8_t pages = getPageCount(panel);
+
+    if (!panel.sent_valid) {
+        first = 0;
+        last = pages - 1;
+        return true;
+    }
+
+    first = pages;
+    for (uint8_t page = 0; page < pages; page++) {
+        if (memcmp(buffer + page * width, panel.sent + page * width, width) != 0) {
+            if (first == pages)
+                first = page;
+            last = page;
+        }
+    }
+    return first < pages;
+}
+
+// Estimate the bus time of a flush, in microseconds: 9 clocks per byte (8 bits and the acknowledge)
+// for the address window transfer, then the data with the address and control bytes of each chunk
+static uint32_t estimateFlushUs(const DisplayPanel &panel, uint8_t first, uint8_t last)
+{
+    uint32_t length = (uint32_t)panel.bus.display->width() * (last - first + 1);
+    uint32_t chunks = (length + DISPLAY_BUS_CHUNK_SIZE - 1) / DISPLAY_BUS_CHUNK_SIZE;
+    uint32_t bytes = 8 + length + chunks * 2;
+
+    return (uint32_t)((uint64_t)bytes * 9 * 1000000 / DISPLAY_BUS_CLOCK_HZ);
+}
+
+// Priority a panel is flushed with, raised to the alert priority once it waited too long
+static uint8_t getFlushPriority(const DisplayPanel &panel, uint32_t nowMs)
+{
+    if (nowMs - panel.pending_since_ms >= DISPLAY_MAX_DEFER_MS)
+        return DISPLAY_PRIORITY_ALERT;
+    return panel.priority;
+}
+
+// Return true if panel a must be flushed before panel b: higher priority first, then the oldest changes
+static bool flushesBefore(const DisplayPanel &a, const DisplayPanel &b, uint32_t nowMs)
+{
+    uint8_t priorityA = getFlushPriority(a, nowMs);
+    uint8_t priorityB = getFlushPriority(b, nowMs);
+
+    if (priorityA != priorityB)
+        return priorityA > priorityB;
+    return (int32_t)(a.pending_since_ms - b.pending_since_ms) < 0;
+}
+
+void initDisplayManager(DisplayManager &manager, uint32_t budgetUs)
+{
+    memset(&manager, 0, sizeof(manager));
+    manager.budget_us = budgetUs;
+}
+
+DisplayPanel *addDisplayPanel(DisplayManager &manager, Adafruit_SSD1306 &display, TwoWire &wire, uint8_t address, uint8_t sclPin, uint8_t sdaPin)
+{
+    DisplayPanel *panel;
+
+    if (manager.count >= DISPLAY_MANAGER_MAX_PANELS)
+        return NULL;
+    if ((uint32_t)display.width() * ((display.height() + 7) / 8) > DISPLAY_PANEL_BUFFER_SIZE)
+        return NULL;
+
+    panel = &manager.panels[manager.count++];
+    memset(panel, 0, sizeof(DisplayPanel));
+    initDisplayBus(panel->bus, display, wire, address, sclPin, sdaPin);
+    panel->priority = DISPLAY_PRIORITY_NORMAL;
+    return panel;
+}
+
+int beginDisplayPanel(DisplayPanel &panel)
+{
+    int err = beginDisplayBus(panel.bus);
+
+    panel.bus.display->clearDisplay();
+    invalidateDisplayPanel(panel);
+    if (err == ENOERR)
+        err = flushDisplayPanel(panel);
+    return err;
+}
+
+void invalidateDisplayPanel(DisplayPanel &panel)
+{
+    panel.sent_valid = false;
+}
+
+int flushDisplayPanel(DisplayPanel &panel)
+{
+    uint8_t width = panel.bus.display->width();
+    uint8_t pages = getPageCount(panel);
+    uint8_t first, last;
+    uint32_t waitMs;
+    int err;
+
+    if (!findChangedPages(panel, first, last)) {
+        panel.pending = false;
+        return ENOERR;
+    }
+
+    err = flushDisplayPages(panel.bus, first, last);
+    if (err != ENOERR) {
+        // Whatever reached the display, it'll be initialised again when the bus is recovered
+        panel.sent_valid = false;
+        return err;
+    }
+
+    memcpy(panel.sent + first * width, panel.bus.display->getBuffer() + first * width, width * (last - first + 1));
+    panel.sent_valid = true;
+    panel.flushes++;
+    panel.pages_sent += last - first + 1;
+    panel.pages_unchanged += pages - (last - first + 1);
+    if (panel.pending) {
+        waitMs = millis() - panel.pending_since_ms;
+        if (waitMs > panel.wait_ms_max)
+            panel.wait_ms_max = waitMs;
+        panel.pending = false;
+    }
+    return ENOERR;
+}
+
+uint8_t flushDisplayPanels(DisplayManager &manager)
+{
+    uint8_t order[DISPLAY_MANAGER_MAX_PANELS];
+    uint8_t count = 0;
+    uint8_t flushed = 0;
+    uint8_t first, last;
+    uint32_t nowMs = millis();
+    uint32_t spentUs = 0;
+    uint32_t startUs;
+    bool sentAny = false;
+
+    manager.frames++;
+
+    // The panels with changes, in flush order. A panel on a bus that's down has nothing to wait
+    // for: it's sent whole once recovered.
+    for (uint8_t i = 0; i < manager.count; i++) {
+        DisplayPanel &panel = manager.panels[i];
+        uint8_t position = count;
+
+        if (!panel.bus.up || !findChangedPages(panel, first, last)) {
+            panel.pending = false;
+            continue;
+        }
+        if (!panel.pending) {
+            panel.pending = true;
+            panel.pending_since_ms = nowMs;
+        }
+        while (position > 0 && flushesBefore(panel, manager.panels[order[position - 1]], nowMs)) {
+            order[position] = order[position - 1];
+            position--;
+        }
+        order[position] = i;
+        count++;
+    }
+
+    for (uint8_t i = 0; i < count; i++) {
+        DisplayPanel &panel = manager.panels[order[i]];
+
+        findChangedPages(panel, first, last);
+        if (sentAny && spentUs + estimateFlushUs(panel, first, last) > manager.budget_us) {
+            panel.deferrals++;
+            continue;
+        }
+
+        startUs = micros();
+        if (flushDisplayPanel(panel) == ENOERR)
+            flushed++;
+        spentUs += micros() - startUs;
+        sentAny = true;
+    }
+
+    if (spentUs > manager.frame_us_max)
+        manager.frame_us_max = spentUs;
+    if (spentUs > manager.budget_us)
+        manager.frames_over_budget++;
+    return flushed;
+}
@@ -0,0 +1,106 @@
+/*
+ * Display scheduling for the RX-8 Ashtray Gauges project.
+ * Drives any number of SSD1306 panels (up to DISPLAY_MANAGER_MAX_PANELS), two per I2C bus with
+ * the 0x3C and 0x3D addresses. The loop draws every panel into its buffer, then hands them all
+ * over to flushDisplayPanels(), which decides what goes on the buses this frame:
+ *  - Only the pages (8 rows) that differ from what the display already shows are sent, so a
+ *    gauge whose value didn't change costs nothing and one that did costs its half of the panel.
+ *  - The panels showing an alert go first, then the ones that have waited the longest.
+ *  - The flushes stop once the frame budget of bus time is spent. The panels left over keep
+ *    their changes for the next frame, and one left waiting for DISPLAY_MAX_DEFER_MS goes first.
+ * Adding a panel therefore adds to the bus time of a frame only what changed on it, up to the budget.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#ifndef DISPLAY_MANAGER_H
+#define DISPLAY_MANAGER_H
+
+#include <stdint.h>
+#include "display_bus.h"
+
+// Most panels driven: two on each of the three Teensy 4.0 I2C buses
+#define DISPLAY_MANAGER_MAX_PANELS 6
+
+// SSD1306 addresses, selected by the SA0 (D/C) pin of the module
+#define DISPLAY_ADDRESS_PRIMARY 0x3C
+#define DISPLAY_ADDRESS_SECONDARY 0x3D
+
+// Largest panel buffer: 128x64 pixels, one bit each
+#define DISPLAY_PANEL_BUFFER_SIZE (128 * 64 / 8)
+
+// Bus time the flushes of one frame may take, in microseconds. A whole 128x64 panel takes about
+// 24ms at 400kHz, half of one about 12ms. The first panel of a frame is always flushed.
+#define DISPLAY_FRAME_BUDGET_US 40000
+
+// A panel whose changes have waited this long goes first, in milliseconds
+#define DISPLAY_MAX_DEFER_MS 1000
+
+// Flush priorities
+#define DISPLAY_PRIORITY_NORMAL 0
+#define DISPLAY_PRIORITY_ALERT 1
+
+// One panel
+typedef struct {
+    DisplayBus bus;
+
+    // What the display RAM holds, as last sent
+    uint8_t sent[DISPLAY_PANEL_BUFFER_SIZE];
+    bool sent_valid;                // False when the display RAM is unknown: the next flush sends every page
+    uint8_t priority;               // DISPLAY_PRIORITY_*
+    bool pending;                   // True if the buffer has changes not sent yet
+    uint32_t pending_since_ms;      // millis() when they were first seen
+
+    // Counters
+    uint32_t flushes;               // Flushes sent, whole or partial
+    uint32_t pages_sent;            // Pages sent
+    uint32_t pages_unchanged;       // Pages not sent because the display already showed them
+    uint32_t deferrals;             // Frames the panel waited for lack of budget
+    uint32_t wait_ms_max;           // Longest time from a change to its flush, in milliseconds
+} DisplayPanel;
+
+// The panels and the frame statistics
+typedef struct {
+    DisplayPanel panels[DISPLAY_MANAGER_MAX_PANELS];
+    uint8_t count;
+    uint32_t budget_us;
+
+    // Counters
+    uint32_t frames;                // Calls to flushDisplayPanels()
+    uint32_t frame_us_max;          // Longest bus time of a frame, in microseconds
+    uint32_t frames_over_budget;    // Frames whose first flush alone went over the budget
+} DisplayManager;
+
+// Reset the manager, without any panel
+// manager: The manager
+// budgetUs: The bus time budget of a frame, in microseconds
+void initDisplayManager(DisplayManager &manager, uint32_t budgetUs);
+
+// Add a panel. Nothing is sent, see beginDisplayPanel().
+// manager: The manager
+// display: The display
+// wire: The I2C bus the display is on
+// address: DISPLAY_ADDRESS_PRIMARY or DISPLAY_ADDRESS_SECONDARY
+// sclPin, sdaPin: The bus pins
+// Return: The panel, NULL if there are already DISPLAY_MANAGER_MAX_PANELS panels or the display is too large
+DisplayPanel *addDisplayPanel(DisplayManager &manager, Adafruit_SSD1306 &display, TwoWire &wire, uint8_t address, uint8_t sclPin, uint8_t sdaPin);
+
+// Initialise the display of a panel and clear it
+// panel: The panel
+// Return: ENOERR if the display answered, otherwise the error code (it will be recovered by serviceDisplayBus())
+int beginDisplayPanel(DisplayPanel &panel);
+
+// Forget what the display shows, so the next flush sends every page: after the display lost its RAM
+// panel: The panel
+void invalidateDisplayPanel(DisplayPanel &panel);
+
+// Send the changed pages of a panel now, whatever the budget
+// panel: The panel
+// Return: ENOERR (also when nothing changed), EBUSDOWN if the bus is down, or the error code of the transfer
+int flushDisplayPanel(DisplayPanel &panel);
+
+// Send the changes of the panels that fit in the frame budget, highest priority first
+// manager: The manager
+// Return: The number of panels flushed
+uint8_t flushDisplayPanels(DisplayManager &manager);
+
+#endif
@@ -0,0 +1,30 @@
+/*
+ * Error codes shared by the RX-8 Ashtray Gauges source files.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#ifndef ERROR_CODES_H
+#define ERROR_CODES_H
+
+// ERROR Codes, DO NOT CHANGE
+// They are sent on the CAN bus in 4 bits, keep them below 16.
+#define ENOERR 0
+#define ERANGE 1
+#define EDIVZERO 2
+#define EINVALID 3
+
+// Sensor health codes, see sensor_health.h
+// The reading can't be trusted, it is not displayed:
+#define ESENSOROPEN 4       // Input sits at the rail a disconnected sensor pulls it to
+#define ESENSORSHORT 5      // Input sits at the rail a shorted sensor pulls it to
+// The reading is still displayed, but the wiring or sensor needs attention:
+#define ESENSORSTUCK 6      // Input hasn't moved by a single count for far too long
+#define ESENSORNOISY 7      // Input noise well above the ADC noise floor
+#define ESENSORGLITCH 8     // Too many isolated jumps, typically an intermittent connector
+
+// Display bus codes, see display_bus.h
+#define EBUSNACK 9          // The display didn't acknowledge its address or a byte
+#define EBUSTIMEOUT 10      // The transfer was aborted: bus held low, arbitration lost or timeout
+#define EBUSDOWN 11         // The bus is waiting for its next recovery attempt, nothing was sent
+
+#endif
@@ -0,0 +1,97 @@
+/*
+ * Gauge channel registry for the RX-8 Ashtray Gauges project, see gauge_channel.h.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#include <string.h>
+#include <Arduino.h>
+#include "gauge_channel.h"
+#include "alert.h"
+#include "error_codes.h"
+
+static_assert(GAUGE_CHANNEL_MAX <= ALERT_CHANNEL_COUNT, "Every gauge channel needs its alert channel");
+
+void initGaugeChannel(uint8_t index, const GaugeChannel &channel, GaugeChannelState &state, uint32_t historySeconds)
+{
+    memset(&state, 0, sizeof(GaugeChannelState));
+    state.error = ENOERR;
+    state.low = channel.low;
+    state.high = channel.high;
+    setAlertThresholds(index, channel.low, channel.high);
+    initThermalLag(state.lag, channel.lag_time_constant);
+    if (channel.health)
+        initSensorHealth(*channel.health, channel.low_rail_fault, channel.high_rail_fault);
+    if (channel.trend)
+        initTrendGraph(*channel.trend, channel.trend_min, channel.trend_max, historySeconds);
+}
+
+void restoreGaugeChannel(uint8_t index, const GaugeChannel &channel, GaugeChannelState &state,
+    const GaugeChannelState &saved, const SensorHealth &savedHealth)
+{
+    memcpy(&state, &saved, sizeof(GaugeChannelState));
+    setAlertThresholds(index, state.low, state.high);
+    if (channel.health)
+        memcpy(channel.health, &savedHealth, sizeof(SensorHealth));
+
+    // The time stamps were taken before the reset: the next reading counts from now
+    state.stamped = false;
+    state.sampled_us = micros();
+    state.lag.last_us = state.sampled_us;
+}
+
+int readGaugeChannel(uint8_t index, const GaugeChannel &channel, GaugeChannelState &state)
+{
+    uint32_t startUs = micros();
+    float value;
+    int err;
+
+    err = channel.read(value, channel);
+
+    if (state.stamped) {
+        state.read_us = micros() - startUs + state.acquire_us;
+        state.stamped = false;
+    } else {
+        state.sampled_us = micros();
+        state.read_us = state.sampled_us - startUs;
+    }
+    state.read_us_total += state.read_us;
+    if (state.read_us > state.read_us_max)
+        state.read_us_max = state.read_us;
+    state.reads++;
+
+    state.error = err;
+    if (err == ENOERR) {
+        value = compensateThermalLag(state.lag, value, state.sampled_us);
+        if (state.seeded && channel.smoothing < GAUGE_NO_SMOOTHING)
+            value = state.value + channel.smoothing * (value - state.value);
+        state.value = value;
+        state.seeded = true;
+    } else {
+        // The filters start again from the next valid reading
+        state.seeded = false;
+        resetThermalLag(state.lag);
+    }
+
+    // Straight to the alert timer, whatever the loop does next can't delay an alert
+    publishAlertSample(index, state.value, err, state.sampled_us);
+
+    if (err == ENOERR && channel.trend)
+        addTrendSample(*channel.trend, state.value, millis());
+    return err;
+}
+
+void stampGaugeChannel(GaugeChannelState &state, uint32_t sampledUs, uint32_t acquireUs)
+{
+    state.stamped = true;
+    state.sampled_us = sampledUs;
+    state.acquire_us = acquireUs;
+}
+
+void setGaugeChannelThresholds(uint8_t index, GaugeChannelState &state, float low, float high)
+{
+    if (low == state.low && high == state.high)
+        return;
+    state.low = low;
+    state.high = high;
+    setAlertThresholds(index, low, high);
+}
@@ -0,0 +1,126 @@
+/*
+ * Gauge channel registry for the RX-8 Ashtray Gauges project.
+ * Every gauge is one entry of a table: its input pin, how it's read and converted (the sensor
+ * policy), its filtering, its warning thresholds, how it's drawn and its trend history. The loop
+ * runs the same pipeline on each entry (read, smooth, hand over to the alert timer, add to the
+ * history, draw), so a new sensor is a new table entry and costs only its own sampling time.
+ * The time each channel takes to read is recorded, see GaugeChannelState.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#ifndef GAUGE_CHANNEL_H
+#define GAUGE_CHANNEL_H
+
+#include <stdint.h>
+#include <Adafruit_SSD1306.h>
+#include "sensor_health.h"
+#include "trend_graph.h"
+#include "thermal_lag.h"
+
+// Most gauge channels, within the alert channels (see ALERT_CHANNEL_COUNT)
+#define GAUGE_CHANNEL_MAX 8
+
+// Smoothing weight of a channel read as is
+#define GAUGE_NO_SMOOTHING 1.0
+
+// Configuration of one gauge channel
+typedef struct GaugeChannel {
+    const char *name;           // Short name, for the logs and the host tools
+    uint8_t pin;                // Analogue input pin
+
+    // Sensor policy
+    // Read the channel and convert it: sample the pin, check its health and convert the samples
+    // value: Receives the reading
+    // channel: This channel
+    // Return: ENOERR if the value was read, otherwise the error code
+    int (*read)(float &value, const struct GaugeChannel &channel);
+    uint8_t sensor_type;        // Passed on to read(), e.g. the PRESSURE_SENSOR_* type
+    SensorHealth *health;       // Health state fed with every raw sample, NULL for none
+    uint8_t low_rail_fault;     // See initSensorHealth()
+    uint8_t high_rail_fault;
+
+    // Filter: weight of each new reading in the value shown, GAUGE_NO_SMOOTHING to show it as is
+    float smoothing;
+    // Time constant of the sensor response to compensate, in seconds, 0 for none (see thermal_lag.h)
+    float lag_time_constant;
+
+    // Warning thresholds: in alert at or below low, at or above high (-__FLT_MAX__ / __FLT_MAX__ for none)
+    float low;
+    float high;
+
+    // Display slot
+    // Draw the reading on its half of a display, NULL for a channel on no panel
+    // display: The display
+    // value: The reading, valid
+    void (*draw)(Adafruit_SSD1306 &display, float value);
+    bool half;                  // TOP_HALF or BOTTOM_HALF, for the fault message
+
+    // Trend history, NULL for none, and the values at the bottom and the top of its graph
+    TrendGraph *trend;
+    float trend_min;
+    float trend_max;
+} GaugeChannel;
+
+// Last reading, current thresholds and read time statistics of one gauge channel
+typedef struct {
+    // Warning thresholds, from the channel table until changed by setGaugeChannelThresholds()
+    float low;
+    float high;
+
+    float value;                // Last reading, lag compensated and smoothed
+    int error;                  // ENOERR or the error code of the last read
+    bool seeded;                // True once value holds a valid reading
+    uint32_t sampled_us;        // micros() at the end of the acquisition of the last reading
+
+    // Samples taken ahead of the read, see stampGaugeChannel()
+    bool stamped;
+    uint32_t acquire_us;        // Share of the acquisition time charged to the channel
+
+    ThermalLag lag;             // Lag compensation state
+
+    // Profile of read(), acquisition included, in microseconds
+    uint32_t reads;
+    uint32_t read_us;           // Last read
+    uint32_t read_us_max;
+    uint64_t read_us_total;
+} GaugeChannelState;
+
+// Reset the state of a channel, its health and trend history, and give its thresholds to the alert timer
+// index: The channel number, its alert channel
+// channel: The channel
+// state: Its state
+// historySeconds: The time covered by the trend graph, if the channel has one
+void initGaugeChannel(uint8_t index, const GaugeChannel &channel, GaugeChannelState &state, uint32_t historySeconds);
+
+// Put back the state of a channel, and of its health, from before a warm restart (see warm_start.h),
+// after initGaugeChannel(). The filters go on from the saved reading, the trend history starts again.
+// index: The channel number, its alert channel
+// channel: The channel
+// state: Its state
+// saved: The saved state
+// savedHealth: The saved health state, ignored if the channel has none
+void restoreGaugeChannel(uint8_t index, const GaugeChannel &channel, GaugeChannelState &state,
+    const GaugeChannelState &saved, const SensorHealth &savedHealth);
+
+// Change the warning thresholds of a channel, for the display and the alert timer
+// index: The channel number, its alert channel
+// state: Its state
+// low, high: The new thresholds, see GaugeChannel
+void setGaugeChannelThresholds(uint8_t index, GaugeChannelState &state, float low, float high);
+
+// Read a channel and hand the reading over: compensate the sensor lag, smooth it, publish it to the
+// alert timer and add it to the trend history
+// index: The channel number, its alert channel
+// channel: The channel
+// state: Its state, receives the reading
+// Return: ENOERR if the value was read, otherwise the error code
+int readGaugeChannel(uint8_t index, const GaugeChannel &channel, GaugeChannelState &state);
+
+// Record that the samples of a channel were acquired ahead of its next read, along with those of
+// other channels (see adc_pair.h): the reading gets the time stamp of the acquisition
+// state: The state of the channel
+// sampledUs: micros() at the end of the acquisition
+// acquireUs: The share of the acquisition time charged to the channel, in microseconds
+void stampGaugeChannel(GaugeChannelState &state, uint32_t sampledUs, uint32_t acquireUs);
+
+#endif
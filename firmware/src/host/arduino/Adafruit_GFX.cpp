@@ -0,0 +1,216 @@
+/*
+ * Host version of the part of the Adafruit GFX library used by the RX-8 Ashtray Gauges.
+ * The algorithms follow Adafruit_GFX.cpp (BSD licence, Adafruit Industries).
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#include "Adafruit_GFX.h"
+
+Adafruit_GFX::Adafruit_GFX(int16_t w, int16_t h) : WIDTH(w), HEIGHT(h), _width(w), _height(h)
+{
+}
+
+void Adafruit_GFX::drawFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color)
+{
+    for (int16_t i = 0; i < h; i++)
+        drawPixel(x, y + i, color);
+}
+
+void Adafruit_GFX::drawFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color)
+{
+    for (int16_t i = 0; i < w; i++)
+        drawPixel(x + i, y, color);
+}
+
+void Adafruit_GFX::fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color)
+{
+    for (int16_t i = x; i < x + w; i++)
+        drawFastVLine(i, y, h, color);
+}
+
+void Adafruit_GFX::fillScreen(uint16_t color)
+{
+    fillRect(0, 0, _width, _height, color);
+}
+
+void Adafruit_GFX::drawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color)
+{
+    int16_t steep = abs(y1 - y0) > abs(x1 - x0);
+    int16_t t;
+
+    if (steep) {
+        t = x0; x0 = y0; y0 = t;
+        t = x1; x1 = y1; y1 = t;
+    }
+    if (x0 > x1) {
+        t = x0; x0 = x1; x1 = t;
+        t = y0; y0 = y1; y1 = t;
+    }
+
+    int16_t dx = x1 - x0;
+    int16_t dy = abs(y1 - y0);
+    int16_t err = dx / 2;
+    int16_t ystep = y0 < y1 ? 1 : -1;
+
+    for (; x0 <= x1; x0++) {
+        if (steep) {
+            drawPixel(y0, x0, color);
+        } else {
+            drawPixel(x0, y0, color);
+        }
+        err -= dy;
+        if (err < 0) {
+            y0 += ystep;
+            err += dx;
+        }
+    }
+}
+
+void Adafruit_GFX::drawRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color)
+{
+    drawFastHLine(x, y, w, color);
+    drawFastHLine(x, y + h - 1, w, color);
+    drawFastVLine(x, y, h, color);
+    drawFastVLine(x + w - 1, y, h, color);
+}
+
+void Adafruit_GFX::drawBitmap(int16_t x, int16_t y, const uint8_t bitmap[], int16_t w, int16_t h, uint16_t color)
+{
+    int16_t byteWidth = (w + 7) / 8;
+    uint8_t b = 0;
+
+    for (int16_t j = 0; j < h; j++, y++) {
+        for (int16_t i = 0; i < w; i++) {
+            if (i & 7)
+                b <<= 1;
+            else
+                b = pgm_read_byte(&bitmap[j * byteWidth + i / 8]);
+            if (b & 0x80)
+                drawPixel(x + i, y, color);
+        }
+    }
+}
+
+void Adafruit_GFX::setFont(const GFXfont *f)
+{
+    if (f) {
+        // Switching from classic to new font behavior, move the cursor down to the baseline
+        if (!gfxFont)
+            cursor_y += 6;
+    } else if (gfxFont) {
+        cursor_y -= 6;
+    }
+    gfxFont = (GFXfont *)f;
+}
+
+void Adafruit_GFX::drawChar(int16_t x, int16_t y, unsigned char c, uint16_t color, uint8_t size_x, uint8_t size_y)
+{
+    c -= (uint8_t)pgm_read_byte(&gfxFont->first);
+    GFXglyph *glyph = gfxFont->glyph + c;
+    uint8_t *bitmap = gfxFont->bitmap;
+
+    uint16_t bo = glyph->bitmapOffset;
+    uint8_t w = glyph->width, h = glyph->height;
+    int8_t xo = glyph->xOffset, yo = glyph->yOffset;
+    uint8_t xx, yy, bits = 0, bit = 0;
+    int16_t xo16 = 0, yo16 = 0;
+
+    if (size_x > 1 || size_y > 1) {
+        xo16 = xo;
+        yo16 = yo;
+    }
+
+    for (yy = 0; yy < h; yy++) {
+        for (xx = 0; xx < w; xx++) {
+            if (!(bit++ & 7))
+                bits = bitmap[bo++];
+            if (bits & 0x80) {
+                if (size_x == 1 && size_y == 1) {
+                    drawPixel(x + xo + xx, y + yo + yy, color);
+                } else {
+                    fillRect(x + (xo16 + xx) * size_x, y + (yo16 + yy) * size_y, size_x, size_y, color);
+                }
+            }
+            bits <<= 1;
+        }
+    }
+}
+
+size_t Adafruit_GFX::write(uint8_t c)
+{
+    // The classic built-in font isn't available on the host
+    if (!gfxFont)
+        return 1;
+
+    if (c == '\n') {
+        cursor_x = 0;
+        cursor_y += (int16_t)textsize_y * gfxFont->yAdvance;
+    } else if (c != '\r') {
+        uint8_t first = gfxFont->first;
+        if (c >= first && c <= (uint8_t)gfxFont->last) {
+            GFXglyph *glyph = gfxFont->glyph + (c - first);
+            uint8_t w = glyph->width, h = glyph->height;
+            if (w > 0 && h > 0) {
+                int16_t xo = glyph->xOffset;
+                if (wrap && (cursor_x + textsize_x * (xo + w)) > _width) {
+                    cursor_x = 0;
+                    cursor_y += (int16_t)textsize_y * gfxFont->yAdvance;
+                }
+                drawChar(cursor_x, cursor_y, c, textcolor, textsize_x, textsize_y);
+            }
+            cursor_x += glyph->xAdvance * (int16_t)textsize_x;
+        }
+    }
+    return 1;
+}
+
+void Adafruit_GFX::charBounds(unsigned char c, int16_t *x, int16_t *y, int16_t *minx, int16_t *miny, int16_t *maxx, int16_t *maxy)
+{
+    if (!gfxFont)
+        return;
+
+    if (c == '\n') {
+        *x = 0;
+        *y += textsize_y * gfxFont->yAdvance;
+    } else if (c != '\r') {
+        uint8_t first = gfxFont->first, last = gfxFont->last;
+        if (c >= first && c <= last) {
+            GFXglyph *glyph = gfxFont->glyph + (c - first);
+            uint8_t gw = glyph->width, gh = glyph->height, xa = glyph->xAdvance;
+            int8_t xo = glyph->xOffset, yo = glyph->yOffset;
+            if (wrap && (*x + ((xo + gw) * textsize_x)) > _width) {
+                *x = 0;
+                *y += textsize_y * gfxFont->yAdvance;
+            }
+            int16_t x1 = *x + xo * textsize_x, y1 = *y + yo * textsize_y;
+            int16_t x2 = x1 + gw * textsize_x - 1, y2 = y1 + gh * textsize_y - 1;
+            if (x1 < *minx) *minx = x1;
+            if (y1 < *miny) *miny = y1;
+            if (x2 > *maxx) *maxx = x2;
+            if (y2 > *maxy) *maxy = y2;
+            *x += xa * textsize_x;
+        }
+    }
+}
+
+void Adafruit_GFX::getTextBounds(const char *str, int16_t x, int16_t y, int16_t *x1, int16_t *y1, uint16_t *w, uint16_t *h)
+{
+    uint8_t c;
+    int16_t minx = _width, miny = _height, maxx = -1, maxy = -1;
+
+    *x1 = x;
+    *y1 = y;
+    *w = *h = 0;
+
+    while ((c = *str++))
+        charBounds(c, &x, &y, &minx, &miny, &maxx, &maxy);
+
+    if (maxx >= minx) {
+        *x1 = minx;
+        *w = maxx - minx + 1;
+    }
+    if (maxy >= miny) {
+        *y1 = miny;
+        *h = maxy - miny + 1;
+    }
+}
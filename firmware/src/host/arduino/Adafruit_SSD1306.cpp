@@ -0,0 +1,177 @@
+/*
+ * Host version of the Adafruit SSD1306 library (I2C only), see Adafruit_SSD1306.h.
+ * The transfers follow Adafruit_SSD1306.cpp 2.5.x (BSD licence, Adafruit Industries).
+ * The splash screen isn't drawn on begin(), the firmware clears it anyway.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#include "Adafruit_SSD1306.h"
+
+// Largest transfer the Wire library accepts in one go
+#define WIRE_MAX min(256, BUFFER_LENGTH)
+
+Adafruit_SSD1306::Adafruit_SSD1306(uint8_t w, uint8_t h, TwoWire *twi, int8_t rst_pin, uint32_t clkDuring, uint32_t clkAfter)
+    : Adafruit_GFX(w, h), wire(twi ? twi : &Wire), rstPin(rst_pin), wireClk(clkDuring), restoreClk(clkAfter)
+{
+}
+
+Adafruit_SSD1306::~Adafruit_SSD1306()
+{
+    free(buffer);
+}
+
+void Adafruit_SSD1306::ssd1306_command1(uint8_t c)
+{
+    wire->beginTransmission(i2caddr);
+    wire->write((uint8_t)0x00); // Co = 0, D/C = 0
+    wire->write(c);
+    wire->endTransmission();
+}
+
+void Adafruit_SSD1306::ssd1306_commandList(const uint8_t *c, uint8_t n)
+{
+    uint16_t bytesOut = 1;
+
+    wire->beginTransmission(i2caddr);
+    wire->write((uint8_t)0x00); // Co = 0, D/C = 0
+    while (n--) {
+        if (bytesOut >= WIRE_MAX) {
+            wire->endTransmission();
+            wire->beginTransmission(i2caddr);
+            wire->write((uint8_t)0x00);
+            bytesOut = 1;
+        }
+        wire->write(pgm_read_byte(c++));
+        bytesOut++;
+    }
+    wire->endTransmission();
+}
+
+void Adafruit_SSD1306::ssd1306_command(uint8_t c)
+{
+    wire->setClock(wireClk);
+    ssd1306_command1(c);
+    wire->setClock(restoreClk);
+}
+
+bool Adafruit_SSD1306::begin(uint8_t vcs, uint8_t addr, bool reset, bool periphBegin)
+{
+    if (!buffer && !(buffer = (uint8_t *)malloc(WIDTH * ((HEIGHT + 7) / 8))))
+        return false;
+
+    clearDisplay();
+    vccstate = vcs;
+    i2caddr = addr ? addr : ((HEIGHT == 32) ? 0x3C : 0x3D);
+    if (periphBegin)
+        wire->begin();
+
+    if (reset && rstPin >= 0) {
+        pinMode(rstPin, OUTPUT);
+        digitalWrite(rstPin, HIGH);
+        delay(1);
+        digitalWrite(rstPin, LOW);
+        delay(10);
+        digitalWrite(rstPin, HIGH);
+    }
+
+    wire->setClock(wireClk);
+
+    static const uint8_t init1[] = {SSD1306_DISPLAYOFF, SSD1306_SETDISPLAYCLOCKDIV, 0x80, SSD1306_SETMULTIPLEX};
+    ssd1306_commandList(init1, sizeof(init1));
+    ssd1306_command1(HEIGHT - 1);
+
+    static const uint8_t init2[] = {SSD1306_SETDISPLAYOFFSET, 0x0, SSD1306_SETSTARTLINE | 0x0, SSD1306_CHARGEPUMP};
+    ssd1306_commandList(init2, sizeof(init2));
+    ssd1306_command1((vccstate == SSD1306_EXTERNALVCC) ? 0x10 : 0x14);
+
+    static const uint8_t init3[] = {SSD1306_MEMORYMODE, 0x00, SSD1306_SEGREMAP | 0x1, SSD1306_COMSCANDEC};
+    ssd1306_commandList(init3, sizeof(init3));
+
+    uint8_t comPins = 0x02;
+    contrast = 0x8F;
+    if (WIDTH == 128 && HEIGHT == 64) {
+        comPins = 0x12;
+        contrast = (vccstate == SSD1306_EXTERNALVCC) ? 0x9F : 0xCF;
+    }
+    ssd1306_command1(SSD1306_SETCOMPINS);
+    ssd1306_command1(comPins);
+    ssd1306_command1(SSD1306_SETCONTRAST);
+    ssd1306_command1(contrast);
+
+    ssd1306_command1(SSD1306_SETPRECHARGE);
+    ssd1306_command1((vccstate == SSD1306_EXTERNALVCC) ? 0x22 : 0xF1);
+    static const uint8_t init5[] = {SSD1306_SETVCOMDETECT, 0x40, SSD1306_DISPLAYALLON_RESUME,
+                                    SSD1306_NORMALDISPLAY, SSD1306_DEACTIVATE_SCROLL, SSD1306_DISPLAYON};
+    ssd1306_commandList(init5, sizeof(init5));
+
+    wire->setClock(restoreClk);
+    return true;
+}
+
+void Adafruit_SSD1306::drawPixel(int16_t x, int16_t y, uint16_t color)
+{
+    if (x < 0 || x >= width() || y < 0 || y >= height())
+        return;
+
+    switch (color) {
+        case SSD1306_WHITE:
+            buffer[x + (y / 8) * WIDTH] |= (1 << (y & 7));
+            break;
+        case SSD1306_BLACK:
+            buffer[x + (y / 8) * WIDTH] &= ~(1 << (y & 7));
+            break;
+        case SSD1306_INVERSE:
+            buffer[x + (y / 8) * WIDTH] ^= (1 << (y & 7));
+            break;
+    }
+}
+
+bool Adafruit_SSD1306::getPixel(int16_t x, int16_t y)
+{
+    if (x < 0 || x >= width() || y < 0 || y >= height())
+        return false;
+    return buffer[x + (y / 8) * WIDTH] & (1 << (y & 7));
+}
+
+void Adafruit_SSD1306::clearDisplay()
+{
+    memset(buffer, 0, WIDTH * ((HEIGHT + 7) / 8));
+}
+
+void Adafruit_SSD1306::display()
+{
+    static const uint8_t dlist1[] = {SSD1306_PAGEADDR, 0, 0xFF, SSD1306_COLUMNADDR, 0};
+    uint16_t count = WIDTH * ((HEIGHT + 7) / 8);
+    uint8_t *ptr = buffer;
+    uint16_t bytesOut = 1;
+
+    wire->setClock(wireClk);
+    ssd1306_commandList(dlist1, sizeof(dlist1));
+    ssd1306_command1(WIDTH - 1);
+
+    wire->beginTransmission(i2caddr);
+    wire->write((uint8_t)0x40);
+    while (count--) {
+        if (bytesOut >= WIRE_MAX) {
+            wire->endTransmission();
+            wire->beginTransmission(i2caddr);
+            wire->write((uint8_t)0x40);
+            bytesOut = 1;
+        }
+        wire->write(*ptr++);
+        bytesOut++;
+    }
+    wire->endTransmission();
+    wire->setClock(restoreClk);
+}
+
+void Adafruit_SSD1306::invertDisplay(bool i)
+{
+    ssd1306_command(i ? SSD1306_INVERTDISPLAY : SSD1306_NORMALDISPLAY);
+}
+
+void Adafruit_SSD1306::dim(bool dim)
+{
+    ssd1306_command(SSD1306_SETCONTRAST);
+    ssd1306_command(dim ? 0 : contrast);
+}
@@ -0,0 +1,294 @@
+/*
+ * Host stand-in for the Teensy Arduino core, see Arduino.h and host_sim.h.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string>
+#include "Arduino.h"
+#include "host_sim.h"
+
+HostSerial Serial;
+
+// Virtual clock, in microseconds
+static uint64_t simMicros = 0;
+
+static HostIoHooks ioHooks;
+static uint8_t pinStates[HOST_PIN_COUNT];
+
+// Active IntervalTimer callbacks
+#define HOST_TIMER_COUNT 8
+typedef struct {
+    void (*callback)();
+    uint32_t period_us;
+    uint64_t next_us;
+} HostTimer;
+static HostTimer timers[HOST_TIMER_COUNT];
+
+static std::string serialInput;
+
+void hostSetIoHooks(const HostIoHooks &hooks)
+{
+    ioHooks = hooks;
+}
+
+uint64_t hostMicros64()
+{
+    return simMicros;
+}
+
+void hostAdvanceTime(uint64_t us)
+{
+    uint64_t target = simMicros + us;
+    int due;
+
+    while (true) {
+        // Find the first timer falling due before the target
+        due = -1;
+        for (int i = 0; i < HOST_TIMER_COUNT; i++) {
+            if (timers[i].callback && timers[i].next_us <= target && (due < 0 || timers[i].next_us < timers[due].next_us))
+                due = i;
+        }
+        if (due < 0)
+            break;
+
+        if (timers[due].next_us > simMicros)
+            simMicros = timers[due].next_us;
+        timers[due].next_us += timers[due].period_us;
+        timers[due].callback();
+    }
+
+    simMicros = target;
+}
+
+uint8_t hostPinState(uint8_t pin)
+{
+    return pin < HOST_PIN_COUNT ? pinStates[pin] : LOW;
+}
+
+void hostSerialInput(const char *text)
+{
+    serialInput += text;
+}
+
+uint32_t millis()
+{
+    return (uint32_t)(simMicros / 1000);
+}
+
+uint32_t micros()
+{
+    return (uint32_t)simMicros;
+}
+
+void delay(uint32_t ms)
+{
+    hostAdvanceTime((uint64_t)ms * 1000);
+}
+
+void delayMicroseconds(uint32_t us)
+{
+    hostAdvanceTime(us);
+}
+
+void pinMode(uint8_t, uint8_t)
+{
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+    if (pin >= HOST_PIN_COUNT)
+        return;
+
+    value = value ? HIGH : LOW;
+    if (pinStates[pin] != value && ioHooks.digitalWrite)
+        ioHooks.digitalWrite(pin, value, simMicros);
+    pinStates[pin] = value;
+}
+
+int digitalRead(uint8_t pin)
+{
+    return ioHooks.digitalRead ? ioHooks.digitalRead(pin, simMicros) : HIGH;
+}
+
+int analogRead(uint8_t pin)
+{
+    int value = ioHooks.analogRead ? ioHooks.analogRead(pin, simMicros) : 0;
+    hostAdvanceTime(HOST_ANALOG_READ_US);
+    return value;
+}
+
+int hostAnalogSample(uint8_t pin)
+{
+    return ioHooks.analogRead ? ioHooks.analogRead(pin, simMicros) : 0;
+}
+
+void analogReadResolution(unsigned int)
+{
+}
+
+void tone(uint8_t pin, uint32_t)
+{
+    digitalWrite(pin, HIGH);
+}
+
+void noTone(uint8_t pin)
+{
+    digitalWrite(pin, LOW);
+}
+
+IntervalTimer::~IntervalTimer()
+{
+    end();
+}
+
+bool IntervalTimer::beginMicros(void (*funct)(), uint32_t microseconds)
+{
+    end();
+    for (int i = 0; i < HOST_TIMER_COUNT; i++) {
+        if (!timers[i].callback) {
+            timers[i].callback = funct;
+            timers[i].period_us = microseconds > 0 ? microseconds : 1;
+            timers[i].next_us = simMicros + timers[i].period_us;
+            slot = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+void IntervalTimer::end()
+{
+    if (slot >= 0) {
+        timers[slot].callback = NULL;
+        slot = -1;
+    }
+}
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+    size_t count = 0;
+    while (size--)
+        count += write(*buffer++);
+    return count;
+}
+
+size_t Print::print(long n)
+{
+    if (n < 0)
+        return printNumber((unsigned long)-n, 10, 1);
+    return printNumber((unsigned long)n, 10, 0);
+}
+
+size_t Print::printf(const char *format, ...)
+{
+    char buf[256];
+    va_list args;
+    int len;
+
+    va_start(args, format);
+    len = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    if (len < 0)
+        return 0;
+    return write((const uint8_t *)buf, (size_t)len < sizeof(buf) ? (size_t)len : sizeof(buf) - 1);
+}
+
+// Same algorithm as the Teensy core, so the displayed numbers match the device
+size_t Print::printNumber(unsigned long n, uint8_t base, uint8_t sign)
+{
+    uint8_t buf[34];
+    uint8_t digit, i;
+
+    if (n == 0) {
+        buf[sizeof(buf) - 1] = '0';
+        i = sizeof(buf) - 1;
+    } else {
+        i = sizeof(buf) - 1;
+        while (1) {
+            digit = n % base;
+            buf[i] = ((digit < 10) ? '0' + digit : 'A' + digit - 10);
+            n /= base;
+            if (n == 0)
+                break;
+            i--;
+        }
+    }
+    if (sign) {
+        i--;
+        buf[i] = '-';
+    }
+    return write(buf + i, sizeof(buf) - i);
+}
+
+// Same algorithm as the Teensy core, so the displayed numbers match the device
+size_t Print::printFloat(double number, uint8_t digits)
+{
+    uint8_t sign = 0;
+    size_t count = 0;
+
+    if (isnan(number))
+        return print("nan");
+    if (isinf(number))
+        return print("inf");
+    if (number > 4294967040.0f || number < -4294967040.0f)
+        return print("ovf");
+
+    if (number < 0.0) {
+        sign = 1;
+        number = -number;
+    }
+
+    // Round correctly so that print(1.999, 2) prints as "2.00"
+    double rounding = 0.5;
+    for (uint8_t i = 0; i < digits; ++i)
+        rounding *= 0.1;
+    number += rounding;
+
+    unsigned long int_part = (unsigned long)number;
+    double remainder = number - (double)int_part;
+    count += printNumber(int_part, 10, sign);
+
+    if (digits > 0) {
+        uint8_t n, buf[16], len = 1;
+        buf[0] = '.';
+        if (digits > sizeof(buf) - 1)
+            digits = sizeof(buf) - 1;
+        while (digits-- > 0) {
+            remainder *= 10.0;
+            n = (uint8_t)remainder;
+            buf[len++] = '0' + n;
+            remainder -= n;
+        }
+        count += write(buf, len);
+    }
+    return count;
+}
+
+size_t HostSerial::write(uint8_t c)
+{
+    fputc(c, stderr);
+    return 1;
+}
+
+size_t HostSerial::write(const uint8_t *buffer, size_t size)
+{
+    return fwrite(buffer, 1, size, stderr);
+}
+
+int HostSerial::available()
+{
+    return (int)serialInput.size();
+}
+
+int HostSerial::read()
+{
+    int c;
+
+    if (serialInput.empty())
+        return -1;
+    c = (uint8_t)serialInput[0];
+    serialInput.erase(0, 1);
+    return c;
+}
@@ -0,0 +1,135 @@
+/*
+ * Host stand-in for the Teensy Arduino core, used by the RX-8 Ashtray Gauges host tools.
+ * Only what the firmware uses is provided. Time is virtual: it only moves forward when the
+ * firmware waits (delay, delayMicroseconds) or when a peripheral would have taken time
+ * (analogRead, I2C transfers), see host_sim.h.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <type_traits>
+
+#define ARDUINO 10819
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define INPUT_PULLDOWN 3
+#define OUTPUT_OPENDRAIN 4
+
+// Teensy 4.0 analogue pins
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define A4 18
+#define A5 19
+#define A6 20
+#define A7 21
+#define A8 22
+#define A9 23
+
+// Memory placement attributes mean nothing on the host
+#define PROGMEM
+#define FASTRUN
+#define DMAMEM
+#define FLASHMEM
+#define EXTMEM
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define pgm_read_word(addr) (*(const uint16_t *)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t *)(addr))
+#define pgm_read_ptr(addr) (*(void * const *)(addr))
+
+// Return by value: the conditional on two lvalues of the same type is itself an lvalue
+template <class A, class B>
+constexpr typename std::common_type<A, B>::type min(A a, B b) { return a < b ? a : b; }
+template <class A, class B>
+constexpr typename std::common_type<A, B>::type max(A a, B b) { return a > b ? a : b; }
+template <class T, class L, class H>
+constexpr T constrain(T x, L low, H high) { return x < low ? low : (x > high ? high : x); }
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+void analogReadResolution(unsigned int bits);
+void tone(uint8_t pin, uint32_t frequency);
+void noTone(uint8_t pin);
+
+static inline void noInterrupts() {}
+static inline void interrupts() {}
+
+// Periodic callbacks, run by the virtual clock as it moves past their due time
+class IntervalTimer {
+public:
+    ~IntervalTimer();
+    template <typename period_t>
+    bool begin(void (*funct)(), period_t microseconds)
+    {
+        return beginMicros(funct, (uint32_t)microseconds);
+    }
+    void end();
+    void priority(uint8_t) {}
+private:
+    bool beginMicros(void (*funct)(), uint32_t microseconds);
+    int slot = -1;
+};
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size);
+    size_t write(const char *str) { return write((const uint8_t *)str, strlen(str)); }
+
+    size_t print(const char *str) { return write(str); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(int n) { return print((long)n); }
+    size_t print(unsigned int n) { return print((unsigned long)n); }
+    size_t print(long n);
+    size_t print(unsigned long n) { return printNumber(n, 10, 0); }
+    size_t print(double n, int digits = 2) { return printFloat(n, digits); }
+    size_t println() { return write((const uint8_t *)"\r\n", 2); }
+    template <typename T>
+    size_t println(T value) { return print(value) + println(); }
+    size_t println(double n, int digits) { return print(n, digits) + println(); }
+    size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+private:
+    size_t printNumber(unsigned long n, uint8_t base, uint8_t sign);
+    size_t printFloat(double number, uint8_t digits);
+};
+
+class Stream : public Print {
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+};
+
+// USB serial: output goes to stderr, input comes from hostSerialInput() (see host_sim.h)
+class HostSerial : public Stream {
+public:
+    void begin(uint32_t) {}
+    operator bool() { return true; }
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+    int available() override;
+    int read() override;
+};
+extern HostSerial Serial;
+
+#endif
@@ -0,0 +1,2 @@
+// Pre 1.0 Arduino header name, some libraries still look for it
+#include "Arduino.h"
@@ -0,0 +1,89 @@
+/*
+ * Host stand-in for the Teensy Wire library, see Wire.h.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#include "Wire.h"
+#include "host_sim.h"
+
+TwoWire Wire(0);
+TwoWire Wire1(1);
+TwoWire Wire2(2);
+
+void TwoWire::beginTransmission(uint8_t addr)
+{
+    address = addr;
+    length = 0;
+    transmitting = true;
+}
+
+size_t TwoWire::write(uint8_t data)
+{
+    if (!transmitting || length >= BUFFER_LENGTH)
+        return 0;
+    buffer[length++] = data;
+    return 1;
+}
+
+size_t TwoWire::write(const uint8_t *data, size_t quantity)
+{
+    size_t count = 0;
+    while (quantity--)
+        count += write(*data++);
+    return count;
+}
+
+bool TwoWire::attach(uint8_t addr, HostI2cDevice *device)
+{
+    if (device_count >= HOST_WIRE_MAX_DEVICES)
+        return false;
+    device_addresses[device_count] = addr;
+    devices[device_count] = device;
+    device_count++;
+    return true;
+}
+
+uint8_t TwoWire::endTransmission(uint8_t)
+{
+    HostI2cDevice *device = NULL;
+    uint8_t result;
+    size_t sent;
+    uint64_t us;
+
+    if (!transmitting)
+        return 4;
+    transmitting = false;
+
+    for (uint8_t i = 0; i < device_count; i++) {
+        if (device_addresses[i] == address)
+            device = devices[i];
+    }
+
+    result = device ? device->respond() : 2;
+
+    // Without an acknowledge on the address, the transfer stops there
+    sent = result == 0 ? length + 1 : 1;
+
+    // 9 clocks per byte (8 bits and the acknowledge) for the address and the data,
+    // plus about 2 clocks for the start and stop conditions
+    us = ((uint64_t)sent * 9 + 2) * 1000000 / clock_hz;
+    // A bus held low is only released by the controller timeout
+    if (result == 4)
+        us += pin_low_timeout_us;
+    transactions++;
+    bytes += sent;
+    busy_us += us;
+    hostAdvanceTime(us);
+
+    if (result == 2) {
+        nacks++;
+        return 2;
+    }
+    if (result != 0) {
+        timeouts++;
+        return 4;
+    }
+
+    device->onWrite(buffer, length);
+    return 0;
+}
@@ -0,0 +1,79 @@
+/*
+ * Host stand-in for the Teensy Wire library, used by the RX-8 Ashtray Gauges host tools.
+ * Transfers take the virtual time they'd take on the bus at the configured clock.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#ifndef HOST_WIRE_H
+#define HOST_WIRE_H
+
+#include "Arduino.h"
+
+// Same transmit buffer size as the Teensy 4 Wire library
+#define BUFFER_LENGTH 136
+
+// Number of devices that can be attached to one host bus
+#define HOST_WIRE_MAX_DEVICES 4
+
+// A device on a host bus, e.g. the display emulator.
+// It receives the payload of every write transaction addressed to it.
+class HostI2cDevice {
+public:
+    virtual ~HostI2cDevice() {}
+    virtual void onWrite(const uint8_t *data, size_t length) = 0;
+
+    // How the device answers a transaction addressed to it, to simulate faults:
+    // 0 acknowledged, 2 address not acknowledged, 4 bus held low until the controller gives up
+    virtual uint8_t respond() { return 0; }
+};
+
+class TwoWire : public Stream {
+public:
+    TwoWire(uint8_t bus) : bus_number(bus) {}
+    void begin() {}
+    void end() {}
+    void setClock(uint32_t frequency) { clock_hz = frequency; }
+    void beginTransmission(uint8_t address);
+    uint8_t endTransmission(uint8_t sendStop = 1);
+    size_t write(uint8_t data) override;
+    size_t write(const uint8_t *data, size_t quantity) override;
+    uint8_t requestFrom(uint8_t, uint8_t) { return 0; }
+    int available() override { return 0; }
+    int read() override { return -1; }
+
+    // Host only: the time after which a transfer on a bus held low is aborted (endTransmission() returns 4).
+    // On the Teensy this is the controller pin low timeout, see display_bus.cpp.
+    void setPinLowTimeout(uint32_t us) { pin_low_timeout_us = us; }
+
+    // Host only: put a device on the bus at the specified 7 bits address.
+    // A transaction to an address without a device isn't acknowledged: endTransmission()
+    // returns 2 after the address byte, as on the real bus.
+    // Return: False if the bus already has HOST_WIRE_MAX_DEVICES devices
+    bool attach(uint8_t address, HostI2cDevice *device);
+
+    // Statistics, for the host tools
+    uint8_t busNumber() const { return bus_number; }
+    uint32_t transactions = 0;      // Completed transactions
+    uint32_t nacks = 0;             // Transactions not acknowledged
+    uint32_t timeouts = 0;          // Transactions aborted on a bus held low
+    uint64_t bytes = 0;             // Bytes sent, address bytes included
+    uint64_t busy_us = 0;           // Virtual time spent transferring
+
+private:
+    uint8_t bus_number;
+    uint32_t clock_hz = 100000;
+    uint32_t pin_low_timeout_us = 15000;
+    uint8_t address = 0;
+    uint8_t buffer[BUFFER_LENGTH];
+    size_t length = 0;
+    bool transmitting = false;
+    uint8_t device_addresses[HOST_WIRE_MAX_DEVICES];
+    HostI2cDevice *devices[HOST_WIRE_MAX_DEVICES];
+    uint8_t device_count = 0;
+};
+
+extern TwoWire Wire;
+extern TwoWire Wire1;
+extern TwoWire Wire2;
+
+#endif
@@ -0,0 +1,47 @@
+/*
+ * Control of the host stand-in for the Teensy Arduino core.
+ * The host tools drive the firmware with these: they move the virtual clock, feed the
+ * analogue and digital inputs and watch the outputs.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#ifndef HOST_SIM_H
+#define HOST_SIM_H
+
+#include <stdint.h>
+
+// Virtual cost of one analogRead() on the Teensy 4.0 at the default settings, in microseconds
+#define HOST_ANALOG_READ_US 17
+
+// Number of pins of the Teensy 4.0
+#define HOST_PIN_COUNT 40
+
+// Callbacks giving the firmware its inputs and reporting its outputs.
+// Any of them can be NULL: analogue reads then return 0, digital reads return HIGH (pull-ups).
+typedef struct {
+    int (*analogRead)(uint8_t pin, uint64_t nowUs);
+    int (*digitalRead)(uint8_t pin, uint64_t nowUs);
+    void (*digitalWrite)(uint8_t pin, uint8_t value, uint64_t nowUs);
+} HostIoHooks;
+
+// Install the input/output callbacks
+void hostSetIoHooks(const HostIoHooks &hooks);
+
+// Virtual time since start, in microseconds
+uint64_t hostMicros64();
+
+// Read an analogue input the way a second converter working in the background would:
+// through the analogRead hook, but without taking any virtual time from the firmware
+int hostAnalogSample(uint8_t pin);
+
+// Move the virtual clock forward, running the IntervalTimer callbacks that fall due on the way
+// us: The number of microseconds to move forward
+void hostAdvanceTime(uint64_t us);
+
+// Last value written to a digital pin
+uint8_t hostPinState(uint8_t pin);
+
+// Queue bytes to be read by the firmware from Serial
+void hostSerialInput(const char *text);
+
+#endif
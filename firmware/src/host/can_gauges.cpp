@@ -0,0 +1,128 @@
+/*
+ * Gauge frames host tools for the RX-8 Ashtray Gauges project.
+ * can-publish sends synthetic readings with the firmware's encoder at CAN_PUBLISH_RATE_HZ.
+ * can-listen decodes the gauge frames from the bus, as a data logger or dash would.
+ * Run both against the same vcan interface to check the frame layout end to end,
+ * or can-listen alone against a can0 interface with the gauges on the bus.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#include <linux/can.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "host_tools.h"
+#include "../can_bus.h"
+
+static const uint32_t gaugeFrameIds[] = {
+    CAN_ID_GAUGE_VALUES,
+    CAN_ID_GAUGE_STATUS
+};
+
+// Send one encoded frame to the socket
+// Return: True if the whole frame was written
+static bool sendFrame(int sock, const CanFrame &frame)
+{
+    struct can_frame out;
+
+    memset(&out, 0, sizeof(out));
+    out.can_id = frame.id;
+    out.can_dlc = frame.len;
+    memcpy(out.data, frame.buf, frame.len);
+    return write(sock, &out, sizeof(out)) == (ssize_t)sizeof(out);
+}
+
+int runCanPublish(int argc, char **argv)
+{
+    const char *ifname = argc > 0 ? argv[0] : "vcan0";
+    GaugeReadings readings;
+    CanFrame values;
+    CanFrame status;
+    uint8_t counter = 0;
+    uint32_t sent = 0;
+    int sock;
+
+    sock = openCanSocket(ifname, NULL, 0);
+    if (sock < 0)
+        return 1;
+
+    installStopHandler();
+    memset(&readings, 0, sizeof(readings));
+
+    while (!hostStopRequested()) {
+        // Slow ramps that go through every alert threshold
+        float t = hostMillis() / 1000.0;
+        readings.oil_temp_celsius = 90.0 + 40.0 * sin(t / 20.0);
+        readings.oil_psi = 75.0 + 70.0 * sin(t / 7.0);
+        readings.coolant_temp_celsius = 95.0 + 20.0 * sin(t / 30.0);
+        readings.supply_voltage = 13.2 + 2.0 * sin(t / 11.0);
+        readings.alerts = 0;
+        if (readings.oil_temp_celsius >= 120)
+            readings.alerts |= GAUGE_ALERT_OIL_TEMP_HIGH;
+        if (readings.oil_psi <= 13)
+            readings.alerts |= GAUGE_ALERT_OIL_PSI_LOW;
+        if (readings.coolant_temp_celsius >= 110)
+            readings.alerts |= GAUGE_ALERT_COOLANT_TEMP_HIGH;
+
+        encodeGaugeFrames(readings, counter++, values, status);
+        if (sendFrame(sock, values) && sendFrame(sock, status))
+            sent++;
+
+        usleep(1000000 / CAN_PUBLISH_RATE_HZ);
+    }
+
+    close(sock);
+    fprintf(stderr, "sent: %u frame pairs\n", sent);
+    return 0;
+}
+
+int runCanListen(int argc, char **argv)
+{
+    const char *ifname = argc > 0 ? argv[0] : "vcan0";
+    GaugeReadings readings;
+    struct can_frame frame;
+    uint8_t counter = 0;
+    uint8_t expected = 0;
+    bool first = true;
+    uint32_t received = 0;
+    uint32_t missed = 0;
+    int sock;
+
+    sock = openCanSocket(ifname, gaugeFrameIds, sizeof(gaugeFrameIds) / sizeof(gaugeFrameIds[0]));
+    if (sock < 0)
+        return 1;
+
+    installStopHandler();
+    memset(&readings, 0, sizeof(readings));
+    printf("ms,counter,oil_temp_c,oil_psi,coolant_temp_c,voltage,alerts,errors\n");
+
+    while (!hostStopRequested()) {
+        if (read(sock, &frame, sizeof(frame)) != (ssize_t)sizeof(frame))
+            continue;
+        if (!decodeGaugeFrame(frame.can_id & CAN_SFF_MASK, frame.data, frame.can_dlc, readings, counter))
+            continue;
+
+        // The status frame is sent after the values frame, print the pair when it arrives
+        if ((frame.can_id & CAN_SFF_MASK) != CAN_ID_GAUGE_STATUS)
+            continue;
+
+        received++;
+        if (!first && counter != expected)
+            missed += (uint8_t)(counter - expected);
+        first = false;
+        expected = counter + 1;
+
+        printf("%u,%u,%.1f,%.1f,%.1f,%.2f,0x%02X,%u%u%u%u\n",
+            hostMillis(), counter,
+            readings.oil_temp_celsius, readings.oil_psi,
+            readings.coolant_temp_celsius, readings.supply_voltage,
+            readings.alerts,
+            readings.errors[GAUGE_CHANNEL_OIL_TEMP], readings.errors[GAUGE_CHANNEL_OIL_PSI],
+            readings.errors[GAUGE_CHANNEL_COOLANT_TEMP], readings.errors[GAUGE_CHANNEL_SUPPLY_VOLTAGE]);
+    }
+
+    close(sock);
+    fprintf(stderr, "received: %u missed: %u\n", received, missed);
+    return missed == 0 ? 0 : 1;
+}
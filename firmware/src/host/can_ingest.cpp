@@ -0,0 +1,59 @@
+/*
+ * CAN ingest host tool for the RX-8 Ashtray Gauges project.
+ * Runs the firmware's frame filter and decoder against a Linux SocketCAN interface.
+ * The kernel filters are set to the same identifiers as the Teensy's mailbox filters.
+ *
+ * To replay a drive recorded with candump:
+ *   sudo ip link add dev vcan0 type vcan && sudo ip link set up vcan0
+ *   ./program can-ingest vcan0
+ *   canplayer -I drive.log vcan0=can0
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#include <linux/can.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "host_tools.h"
+#include "../can_bus.h"
+
+int runCanIngest(int argc, char **argv)
+{
+    const char *ifname = argc > 0 ? argv[0] : "vcan0";
+    EcuReadings readings;
+    struct can_frame frame;
+    uint32_t frames_read = 0;
+    int sock;
+
+    memset(&readings, 0, sizeof(readings));
+    sock = openCanSocket(ifname, canFilterIds, canFilterCount);
+    if (sock < 0)
+        return 1;
+
+    installStopHandler();
+    printf("ms,id,rpm,speed_kph,throttle_pct,coolant_c\n");
+
+    while (!hostStopRequested()) {
+        if (read(sock, &frame, sizeof(frame)) != (ssize_t)sizeof(frame))
+            continue;
+        frames_read++;
+
+        // Decode straight from the socket buffer, as the firmware does from the mailbox
+        if (decodeEcuFrame(frame.can_id & CAN_SFF_MASK, frame.data, frame.can_dlc, hostMillis(), readings)) {
+            printf("%u,0x%03X,%u,%.2f,%.1f,%d\n",
+                hostMillis(),
+                frame.can_id & CAN_SFF_MASK,
+                readings.rpm,
+                readings.speed_kph_x100 / 100.0,
+                readings.throttle_pct_x2 / 2.0,
+                readings.coolant_temp_celsius);
+        }
+    }
+
+    close(sock);
+    fprintf(stderr, "read: %u decoded: %u ignored: %u short: %u\n",
+        frames_read, readings.frames_decoded, readings.frames_ignored, readings.frames_short);
+
+    // Anything the filters let through that we couldn't decode is a filter or decoder bug
+    return readings.frames_ignored == 0 ? 0 : 1;
+}
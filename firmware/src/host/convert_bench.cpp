@@ -0,0 +1,247 @@
+/*
+ * Conversion benchmark host tool for the RX-8 Ashtray Gauges project.
+ * convert-bench times the conversion of the four CAN bus channels (oil temperature, oil pressure,
+ * coolant temperature, supply voltage) three ways, in samples per second of host CPU time:
+ *  - The existing path: getFluidPsi() and getSupplyVoltage(), ANALOG_SAMPLES_COUNT samples per
+ *    call from the analogue input hook. The virtual ADC and wait times aren't counted.
+ *  - Each sample converted by the scalar conversion of its channel, picked by its pin.
+ *  - Blocks of frames of the four channels through convertBlock() (batch_convert.h), with and
+ *    without converting each sample as well.
+ * It also checks the table conversion of every mean result, in steps of 1/20 of a count, against
+ * the scalar conversion: same error codes, and values within CONVERT_BENCH_TOLERANCE.
+ * The host numbers only compare the paths; on the Teensy the batch kernel uses the DSP instructions.
+ * Usage: convert-bench [frames]
+ *   frames: Frames per block, default 256
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <vector>
+#include <Arduino.h>
+#include "host_tools.h"
+#include "host_sim.h"
+#include "../coolant_monitor.h"
+#include "../batch_convert.h"
+#include "../error_codes.h"
+
+// Firmware conversions, see coolant_monitor.cpp
+int convertThermistorCelsius(float &TC, float analogueValue, float t_res_ref);
+float getThermistorReferenceResistor(uint8_t pin, bool high);
+int convertPsi(float &psi, int sensorType, float volts);
+int getFluidPsi(float &psi, int sensorType, uint8_t pinRead);
+int getSupplyVoltage(float &voltage);
+
+// Host CPU time each path is timed for, in seconds
+#define CONVERT_BENCH_SECONDS 0.3
+
+// Largest difference allowed between the table and the scalar conversions, in the channel units
+#define CONVERT_BENCH_TOLERANCE 0.1
+
+// Number of channels converted
+#define CONVERT_BENCH_CHANNELS 4
+
+// Scalar conversion of each channel, from a mean result
+typedef struct {
+    uint8_t pin;
+    bool high;                  // Thermistor reference
+} ThermistorContext;
+
+static int convertThermistorCounts(float &value, float counts, const void *context)
+{
+    const ThermistorContext *thermistor = (const ThermistorContext *)context;
+
+    return convertThermistorCelsius(value, counts, getThermistorReferenceResistor(thermistor->pin, thermistor->high));
+}
+
+static int convertPsiCounts(float &value, float counts, const void *context)
+{
+    return convertPsi(value, PRESSURE_SENSOR_200_PSI, ((MAX_ANALOGUE_VOLTAGE / 1023) * counts / MAX_ANALOGUE_VOLTAGE) * 5);
+}
+
+static int convertSupplyCounts(float &value, float counts, const void *context)
+{
+    value = (MAX_ANALOGUE_VOLTAGE / 1023) * counts / (VOLTAGE_DIVIDER_R2 / (VOLTAGE_DIVIDER_R1 + VOLTAGE_DIVIDER_R2));
+    return value < 7 ? ERANGE : ENOERR;
+}
+
+static const ThermistorContext oilThermistor = {OIL_ANALOG_INPUT_PIN, true};
+static const ThermistorContext coolantThermistor = {COOLANT_ANALOG_INPUT_PIN, true};
+
+typedef struct {
+    const char *name;
+    uint8_t pin;
+    ConversionFunction convert;
+    const void *context;
+} BenchChannel;
+
+static const BenchChannel benchChannels[CONVERT_BENCH_CHANNELS] = {
+    {"oil_temp", OIL_ANALOG_INPUT_PIN, convertThermistorCounts, &oilThermistor},
+    {"oil_psi", OIL_PSI_ANALOG_INPUT_PIN, convertPsiCounts, NULL},
+    {"coolant_temp", COOLANT_ANALOG_INPUT_PIN, convertThermistorCounts, &coolantThermistor},
+    {"supply_voltage", VOLTAGE_ANALOG_INPUT_PIN, convertSupplyCounts, NULL},
+};
+
+// Samples fed to the existing path through the analogue input hook
+static const std::vector<uint16_t> *hookSamples;
+static size_t hookNext;
+
+static int readHookSample(uint8_t pin, uint64_t nowUs)
+{
+    uint16_t sample = (*hookSamples)[hookNext];
+
+    hookNext = (hookNext + 1) % hookSamples->size();
+    return sample;
+}
+
+// Scalar conversion of one sample, the channel picked by its pin like the existing conversions
+static int convertSample(float &value, uint8_t pin, uint16_t counts)
+{
+    if (pin == OIL_ANALOG_INPUT_PIN)
+        return convertThermistorCounts(value, counts, &oilThermistor);
+    else if (pin == COOLANT_ANALOG_INPUT_PIN)
+        return convertThermistorCounts(value, counts, &coolantThermistor);
+    else if (pin == OIL_PSI_ANALOG_INPUT_PIN)
+        return convertPsiCounts(value, counts, NULL);
+    return convertSupplyCounts(value, counts, NULL);
+}
+
+// Seconds since a start
+static double elapsedSeconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int runConvertBench(int argc, char **argv)
+{
+    uint16_t frames = argc > 0 ? atoi(argv[0]) : 256;
+    ConversionTable *tables = new ConversionTable[CONVERT_BENCH_CHANNELS];
+    const ConversionTable *tablePointers[CONVERT_BENCH_CHANNELS];
+    std::vector<uint16_t> samples, psiSamples, voltageSamples;
+    std::vector<int16_t> converted;
+    float values[CONVERT_BENCH_CHANNELS], scalar;
+    int errors[CONVERT_BENCH_CHANNELS];
+    volatile float sink = 0;
+    uint32_t failures = 0;
+    uint64_t count;
+    double seconds, scalarRate, blockRate;
+
+    if (frames == 0) {
+        fprintf(stderr, "Usage: convert-bench [frames]\n");
+        delete[] tables;
+        return 2;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint8_t c = 0; c < CONVERT_BENCH_CHANNELS; c++) {
+        initConversionTable(tables[c], benchChannels[c].convert, benchChannels[c].context);
+        tablePointers[c] = &tables[c];
+    }
+    printf("%d tables built in %.0f us, %zu bytes each\n", CONVERT_BENCH_CHANNELS, elapsedSeconds(start) * 1e6,
+        sizeof(ConversionTable));
+
+    // Every mean, table against scalar
+    for (uint8_t c = 0; c < CONVERT_BENCH_CHANNELS; c++) {
+        double worst = 0;
+        uint32_t mismatches = 0;
+        float value;
+
+        for (uint32_t step = 0; step <= (CONVERSION_COUNTS - 1) * 20; step++) {
+            float counts = step / 20.0f;
+            int tableError = convertMeanCounts(tables[c], counts, value);
+            int scalarError = benchChannels[c].convert(scalar, counts, benchChannels[c].context);
+
+            if (tableError != scalarError)
+                mismatches++;
+            else if (tableError == ENOERR)
+                worst = max(worst, fabs((double)value - scalar));
+        }
+        printf("%-15s table within %.3f of the scalar conversion, %u error code mismatch(es)\n",
+            benchChannels[c].name, worst, mismatches);
+        if (worst > CONVERT_BENCH_TOLERANCE || mismatches)
+            failures++;
+    }
+
+    // A block around a typical reading of each channel, with some noise
+    srand(1);
+    for (uint16_t i = 0; i < frames; i++) {
+        static const uint16_t typical[CONVERT_BENCH_CHANNELS] = {700, 400, 650, 784};
+
+        for (uint8_t c = 0; c < CONVERT_BENCH_CHANNELS; c++)
+            samples.push_back(typical[c] + rand() % 17 - 8);
+        psiSamples.push_back(samples[i * CONVERT_BENCH_CHANNELS + 1]);
+        voltageSamples.push_back(samples[i * CONVERT_BENCH_CHANNELS + 3]);
+    }
+    converted.resize(samples.size());
+
+    // The block means against the scalar conversion of the same means
+    convertBlock(samples.data(), frames, CONVERT_BENCH_CHANNELS, tablePointers, values, errors, NULL);
+    for (uint8_t c = 0; c < CONVERT_BENCH_CHANNELS; c++) {
+        uint32_t sum = 0;
+
+        for (uint16_t i = 0; i < frames; i++)
+            sum += samples[i * CONVERT_BENCH_CHANNELS + c];
+        benchChannels[c].convert(scalar, (float)sum / frames, benchChannels[c].context);
+        printf("%-15s block mean %.2f, scalar %.2f\n", benchChannels[c].name, values[c], scalar);
+        if (errors[c] != ENOERR || fabs(values[c] - scalar) > CONVERT_BENCH_TOLERANCE)
+            failures++;
+    }
+
+    // Existing path: the pressure and the supply voltage, sampled from the hook
+    {
+        HostIoHooks hooks = {readHookSample, NULL, NULL};
+        float psi, voltage;
+
+        hostSetIoHooks(hooks);
+        count = 0;
+        start = std::chrono::steady_clock::now();
+        do {
+            for (int i = 0; i < 64; i++) {
+                hookSamples = &psiSamples;
+                getFluidPsi(psi, PRESSURE_SENSOR_200_PSI, OIL_PSI_ANALOG_INPUT_PIN);
+                hookSamples = &voltageSamples;
+                getSupplyVoltage(voltage);
+                sink = sink + psi + voltage;
+            }
+            count += 2 * 64 * ANALOG_SAMPLES_COUNT;
+        } while ((seconds = elapsedSeconds(start)) < CONVERT_BENCH_SECONDS);
+        hostSetIoHooks(HostIoHooks{NULL, NULL, NULL});
+        printf("getFluidPsi/getSupplyVoltage %12.0f samples/s\n", count / seconds);
+    }
+
+    // Each sample through its scalar conversion
+    count = 0;
+    start = std::chrono::steady_clock::now();
+    do {
+        for (uint16_t i = 0; i < frames; i++) {
+            for (uint8_t c = 0; c < CONVERT_BENCH_CHANNELS; c++) {
+                convertSample(scalar, benchChannels[c].pin, samples[i * CONVERT_BENCH_CHANNELS + c]);
+                sink = sink + scalar;
+            }
+        }
+        count += samples.size();
+    } while ((seconds = elapsedSeconds(start)) < CONVERT_BENCH_SECONDS);
+    scalarRate = count / seconds;
+    printf("scalar conversion per sample  %12.0f samples/s\n", scalarRate);
+
+    // Blocks, means only then every sample too
+    for (int perSample = 0; perSample < 2; perSample++) {
+        count = 0;
+        start = std::chrono::steady_clock::now();
+        do {
+            convertBlock(samples.data(), frames, CONVERT_BENCH_CHANNELS, tablePointers, values, errors,
+                perSample ? converted.data() : NULL);
+            sink = sink + values[0];
+            count += samples.size();
+        } while ((seconds = elapsedSeconds(start)) < CONVERT_BENCH_SECONDS);
+        blockRate = count / seconds;
+        printf("convertBlock, %-15s %12.0f samples/s, %.0fx the scalar conversion\n",
+            perSample ? "every sample" : "means", blockRate, blockRate / scalarRate);
+    }
+
+    delete[] tables;
+    printf("%u failure(s)\n", failures);
+    return failures ? 1 : 0;
+}
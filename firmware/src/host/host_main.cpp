@@ -0,0 +1,82 @@
+/*
+ * Entry point of the host side tools for the RX-8 Ashtray Gauges project.
+ * Usage: program <tool> [arguments...]
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "host_tools.h"
+
+// Host tools table
+typedef struct {
+    const char *name;
+    int (*run)(int argc, char **argv);
+    const char *usage;
+} HostTool;
+
+static const HostTool hostTools[] = {
+    {"can-ingest", runCanIngest, "can-ingest [interface]   Decode RX-8 ECU frames from a SocketCAN interface (default vcan0)"},
+    {"can-publish", runCanPublish, "can-publish [interface]  Send synthetic gauge frames with the firmware encoder"},
+    {"can-listen", runCanListen, "can-listen [interface]   Decode gauge frames, as a logger or dash on the bus would"},
+    {"replay", runReplay, "replay <trace.csv> [...]  Run the firmware against a recorded trace, see host/replay.cpp"},
+    {"render", runRender, "render <dir> [--update]   Check the firmware screens against golden images in <dir>"},
+    {"tach-sim", runTachSim, "tach-sim [pulses_per_rev] Check the engine speed measurement against synthetic tach signals"},
+    {"thermal-lag", runThermalLagSim, "thermal-lag [tau_s] [...] Check the thermistor lag compensation on synthetic steps, see host/thermal_lag_sim.cpp"},
+    {"ripple-sim", runRippleSim, "ripple-sim [alternator_hz] Check the charging ripple analysis on synthetic rectifier faults"},
+    {"convert-bench", runConvertBench, "convert-bench [frames]   Time the batch conversion kernel against the scalar conversions"},
+    {"log-codec", runLogCodec, "log-codec <file.csv> [...] Compress recorded readings with the black box codec and check them back"},
+    {"log-query", runLogQuery, "log-query <command> <log> Query a drive log through a sidecar index, see host/log_query.cpp"}
+};
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void onStopSignal(int)
+{
+    stopRequested = 1;
+}
+
+void installStopHandler()
+{
+    struct sigaction action;
+
+    // No SA_RESTART, so a blocked read() returns when we're asked to stop
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = onStopSignal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+}
+
+bool hostStopRequested()
+{
+    return stopRequested != 0;
+}
+
+uint32_t hostMillis()
+{
+    static struct timespec start;
+    struct timespec now;
+
+    if (start.tv_sec == 0 && start.tv_nsec == 0)
+        clock_gettime(CLOCK_MONOTONIC, &start);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint32_t)((now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc >= 2) {
+        for (size_t i = 0; i < sizeof(hostTools) / sizeof(HostTool); i++) {
+            if (strcmp(argv[1], hostTools[i].name) == 0)
+                return hostTools[i].run(argc - 2, argv + 2);
+        }
+    }
+
+    fprintf(stderr, "Usage: %s <tool> [arguments...]\n", argv[0]);
+    for (size_t i = 0; i < sizeof(hostTools) / sizeof(HostTool); i++)
+        fprintf(stderr, "  %s\n", hostTools[i].usage);
+    return 2;
+}
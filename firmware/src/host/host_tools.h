@@ -0,0 +1,43 @@
+/*
+ * Host side tools for the RX-8 Ashtray Gauges project.
+ * These are built by the 'native' PlatformIO environment and run on a Linux machine.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#ifndef HOST_TOOLS_H
+#define HOST_TOOLS_H
+
+#include <stdint.h>
+
+// Milliseconds elapsed since the first call, from the host monotonic clock
+uint32_t hostMillis();
+
+// Catch SIGINT and SIGTERM so a tool can stop cleanly and print its summary
+// Blocking reads are interrupted rather than restarted when a signal arrives.
+void installStopHandler();
+
+// Return true once SIGINT or SIGTERM has been received
+bool hostStopRequested();
+
+// Open a raw SocketCAN socket bound to the specified interface
+// ifname: The interface name, e.g. vcan0
+// ids: The standard identifiers to let through the kernel filters, mirroring the controller mailbox filters
+// count: The number of identifiers, zero to receive everything
+// Return: The socket, or -1 on error
+int openCanSocket(const char *ifname, const uint32_t *ids, uint8_t count);
+
+// Each tool takes the arguments following its name on the command line
+// Return: The process exit code
+int runCanIngest(int argc, char **argv);
+int runCanPublish(int argc, char **argv);
+int runCanListen(int argc, char **argv);
+int runReplay(int argc, char **argv);
+int runRender(int argc, char **argv);
+int runTachSim(int argc, char **argv);
+int runThermalLagSim(int argc, char **argv);
+int runRippleSim(int argc, char **argv);
+int runConvertBench(int argc, char **argv);
+int runLogCodec(int argc, char **argv);
+int runLogQuery(int argc, char **argv);
+
+#endif
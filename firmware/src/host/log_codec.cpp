@@ -0,0 +1,180 @@
+/*
+ * Record compression host tool for the RX-8 Ashtray Gauges project.
+ * log-codec compresses recorded readings with the black box codec (record_codec.h) the way the
+ * firmware saves an event, in blocks of one flash page, then decodes them back. It reports the
+ * compression against the 12 byte records of the RAM ring, the time it takes to encode and
+ * decode a record on the host, and fails if a decoded record doesn't match: the times, channels,
+ * errors and reasons must be exact, the values within half a hundredth.
+ * The readings come from a black box dump (record lines) or a replay timeline (display lines,
+ * the channels numbered in order of appearance).
+ * Usage: log-codec <file.csv> [block_bytes]
+ *   block_bytes: Size of a block, default BLACK_BOX_PAGE_SIZE
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <Arduino.h>
+#include "host_tools.h"
+#include "../black_box.h"
+#include "../record_codec.h"
+
+// Host CPU time the encoding and the decoding are timed for, in seconds
+#define LOG_CODEC_SECONDS 0.3
+
+// Read the records of a black box dump or a replay timeline
+// Return: False if the file can't be read
+static bool readRecords(const char *path, std::vector<BlackBoxRecord> &records)
+{
+    char line[256];
+    char *fields[8];
+    int count;
+    std::vector<std::string> names;
+    BlackBoxRecord record;
+    FILE *file = fopen(path, "r");
+
+    if (!file) {
+        perror(path);
+        return false;
+    }
+    memset(&record, 0, sizeof(record));
+    while (fgets(line, sizeof(line), file)) {
+        count = 0;
+        for (char *field = strtok(line, ",\r\n"); field && count < 8; field = strtok(NULL, ",\r\n"))
+            fields[count++] = field;
+
+        // record,<event>,<ms>,<channel>,<value>,<error>,<reason> or <ms>,display,<channel>,<value>
+        if (count >= 7 && strcmp(fields[0], "record") == 0) {
+            record.time_us = (uint32_t)(int32_t)lround(atof(fields[2]) * 1000);
+            record.channel = atoi(fields[3]);
+            record.value = atof(fields[4]);
+            record.error = atoi(fields[5]);
+            record.reason = atoi(fields[6]);
+        } else if (count >= 4 && strcmp(fields[1], "display") == 0) {
+            size_t channel = 0;
+
+            while (channel < names.size() && names[channel] != fields[2])
+                channel++;
+            if (channel == names.size())
+                names.push_back(fields[2]);
+            record.time_us = (uint32_t)lround(atof(fields[0]) * 1000);
+            record.channel = channel;
+            record.value = atof(fields[3]);
+            record.error = 0;
+            record.reason = 0;
+        } else {
+            continue;
+        }
+        if (record.channel < RECORD_CODEC_CHANNELS)
+            records.push_back(record);
+    }
+    fclose(file);
+    return true;
+}
+
+// Encode records in blocks, as saveEvent() does
+// Return: The number of blocks
+static size_t encodeBlocks(const std::vector<BlackBoxRecord> &records, uint16_t blockBytes, std::vector<uint8_t> &data, size_t &used)
+{
+    RecordBlock block;
+    size_t blocks = 0;
+
+    data.assign(records.size() * RECORD_CODEC_MAX_BYTES + blockBytes, 0xFF);
+    used = 0;
+    for (size_t next = 0; next < records.size(); blocks++) {
+        startRecordEncoding(block, data.data() + blocks * blockBytes, blockBytes);
+        while (next < records.size() && encodeRecord(block, records[next]))
+            next++;
+        used += block.position;
+    }
+    return blocks;
+}
+
+// Decode the blocks
+// Return: The number of records
+static size_t decodeBlocks(const std::vector<uint8_t> &data, size_t blocks, uint16_t blockBytes, std::vector<BlackBoxRecord> &records)
+{
+    RecordBlock block;
+    BlackBoxRecord record;
+
+    records.clear();
+    for (size_t i = 0; i < blocks; i++) {
+        startRecordDecoding(block, data.data() + i * blockBytes, blockBytes);
+        while (decodeRecord(block, record))
+            records.push_back(record);
+    }
+    return records.size();
+}
+
+static double elapsedSeconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int runLogCodec(int argc, char **argv)
+{
+    uint16_t blockBytes = argc > 1 ? atoi(argv[1]) : BLACK_BOX_PAGE_SIZE;
+    std::vector<BlackBoxRecord> records, decoded;
+    std::vector<uint8_t> data;
+    size_t blocks = 0, used = 0, rawBlocks;
+    uint32_t failures = 0, runs;
+    double seconds;
+
+    if (argc < 1 || blockBytes < RECORD_CODEC_MAX_BYTES) {
+        fprintf(stderr, "Usage: log-codec <file.csv> [block_bytes]\n");
+        return 2;
+    }
+    if (!readRecords(argv[0], records))
+        return 1;
+    if (records.empty()) {
+        fprintf(stderr, "%s: no records\n", argv[0]);
+        return 1;
+    }
+
+    // Encoding speed, then the compression of the last run
+    runs = 0;
+    auto start = std::chrono::steady_clock::now();
+    do {
+        blocks = encodeBlocks(records, blockBytes, data, used);
+        runs++;
+    } while ((seconds = elapsedSeconds(start)) < LOG_CODEC_SECONDS);
+    rawBlocks = (records.size() + blockBytes / sizeof(BlackBoxRecord) - 1) / (blockBytes / sizeof(BlackBoxRecord));
+    printf("%zu records: %zu bytes compressed, %.2f per record, %.1fx smaller than the %zu byte records\n",
+        records.size(), used, (double)used / records.size(), (double)sizeof(BlackBoxRecord) * records.size() / used,
+        sizeof(BlackBoxRecord));
+    printf("%zu blocks of %u bytes instead of %zu (%.0f%% of the flash writes)\n", blocks, blockBytes, rawBlocks,
+        100.0 * blocks / rawBlocks);
+    printf("encode: %.1f ns per record on the host\n", seconds * 1e9 / runs / records.size());
+
+    runs = 0;
+    start = std::chrono::steady_clock::now();
+    do {
+        decodeBlocks(data, blocks, blockBytes, decoded);
+        runs++;
+    } while ((seconds = elapsedSeconds(start)) < LOG_CODEC_SECONDS);
+    printf("decode: %.1f ns per record on the host\n", seconds * 1e9 / runs / records.size());
+
+    // Round trip
+    if (decoded.size() != records.size()) {
+        printf("%zu records decoded instead of %zu\n", decoded.size(), records.size());
+        failures++;
+    }
+    for (size_t i = 0; i < min(decoded.size(), records.size()); i++) {
+        const BlackBoxRecord &a = records[i], &b = decoded[i];
+
+        if (a.time_us != b.time_us || a.channel != b.channel || a.error != b.error || a.reason != b.reason ||
+            fabs(a.value - b.value) > 0.5 / RECORD_CODEC_SCALE + 1e-6 * fabs(a.value)) {
+            if (failures++ < 10)
+                printf("record %zu: %u,%u,%.4f,%u,%u decoded as %u,%u,%.4f,%u,%u\n", i, a.time_us, a.channel, a.value,
+                    a.error, a.reason, b.time_us, b.channel, b.value, b.error, b.reason);
+        }
+    }
+
+    printf("%u failure(s)\n", failures);
+    return failures ? 1 : 0;
+}
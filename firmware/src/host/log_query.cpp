@@ -0,0 +1,910 @@
+/*
+ * Drive log query host tool for the RX-8 Ashtray Gauges project.
+ * log-query answers questions about a drive log (replay --log, or a logger reading the black
+ * box ring the same way) without decoding all of it: the log is consecutive blocks of
+ * BLACK_BOX_PAGE_SIZE bytes compressed with the black box codec (record_codec.h), in time order.
+ * The log is memory mapped and the blocks are decoded where they lie, so a log larger than the
+ * RAM only has the pages a query touches read in.
+ * The first query builds a sidecar index, <log>.idx, with an entry per group of
+ * LOG_INDEX_GROUP_BLOCKS blocks: its time span, the time of its first record to decode it on its
+ * own (each block is a keyframe), a summary of each channel (readings, minimum, maximum, sum,
+ * last reading) and which channels are in alert at its start or change alert state in it. The
+ * index is rebuilt when the log changes. A range query binary searches the groups by time, uses
+ * the summaries of the groups inside the range and only decodes the groups on its edges, and
+ * the groups where the answer can't come from the summary.
+ * The times are in seconds of micros() from the power up, counting its wraps. Only the readings
+ * without an error count in the statistics. A reading holds until the next one of its channel
+ * for the time over a threshold; a reading with an error isn't over it.
+ * Usage: log-query <command> <log> [arguments]
+ *   info <log>: The log, and the summary of each channel
+ *   stats <log> [from_s to_s]: Readings, minimum, maximum and average of each channel
+ *   alerts <log> [from_s to_s]: Alert windows overlapping the range
+ *   over <log> <channel> <threshold> [from_s to_s]: Time a channel is at or above a threshold
+ *   check <log>: Compare the indexed queries on ranges across the log with decoding all of it
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include <Arduino.h>
+#include "host_tools.h"
+#include "../alert.h"
+#include "../gauge_channel.h"
+#include "../black_box.h"
+#include "../record_codec.h"
+
+extern const GaugeChannel gauge_channels[];
+extern const uint8_t gauge_channel_count;
+
+// Blocks per index entry: 32 blocks of 256 bytes take about 90 s of driving
+#define LOG_INDEX_GROUP_BLOCKS 32
+
+#define LOG_INDEX_MAGIC 0x4938584C
+#define LOG_INDEX_VERSION 1
+
+// Ranges compared by the check command
+#define LOG_QUERY_CHECK_RANGES 40
+
+// Start of the index file
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t block_size;
+    uint32_t group_blocks;
+    uint32_t reserved;
+    uint64_t log_size;          // The log the index was built from
+    int64_t log_mtime_ns;
+    uint64_t blocks;
+    uint64_t groups;
+    uint64_t records;
+    uint64_t start_us;          // First and last record of the log
+    uint64_t end_us;
+} LogIndexHeader;
+
+// Summary of a channel in a group of blocks, or in a range
+typedef struct {
+    uint64_t first_us;          // First and last reading, error or not
+    uint64_t last_us;
+    uint64_t alert_since_us;    // Start of the alert going on at the start of the group
+    double sum;
+    uint32_t count;             // Readings without an error
+    uint32_t errors;            // Readings with one
+    float min;
+    float max;
+    float last;                 // Last reading, and its error
+    uint8_t last_error;
+    uint8_t alert_reason;       // Reason of the alert going on at the start of the group
+    uint8_t reserved[2];
+} ChannelSummary;
+
+// Index entry of a group of blocks
+typedef struct {
+    uint64_t start_us;          // First and last record
+    uint64_t end_us;
+    uint32_t start_raw;         // micros() of the first record, to decode the group on its own
+    uint32_t records;
+    uint8_t present;            // Bit per channel with a reading in the group
+    uint8_t alert_before;       // Bit per channel in alert at the start of the group
+    uint8_t alert_change;       // Bit per channel going in or out of alert in the group
+    uint8_t reserved[5];
+    ChannelSummary channels[RECORD_CODEC_CHANNELS];
+} LogIndexGroup;
+
+// A mapped log and its index
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+    uint64_t blocks;
+    const uint8_t *index;
+    size_t index_size;
+    const LogIndexHeader *header;
+    const LogIndexGroup *groups;
+} LogFile;
+
+// Decoding of consecutive blocks, the micros() times unwrapped as they go
+typedef struct {
+    const LogFile *log;
+    uint64_t block;             // Next block to decode, and the end
+    uint64_t end;
+    RecordBlock decoder;
+    bool open;                  // A block is being decoded
+    bool started;               // A record was decoded, raw and time_us are set
+    uint32_t raw;
+    uint64_t time_us;
+} LogCursor;
+
+// An alert window
+typedef struct {
+    uint8_t channel;
+    uint8_t reason;             // Reason at the start of the window
+    bool ongoing;               // The log ends before the window
+    uint64_t start_us;
+    uint64_t end_us;
+} AlertWindow;
+
+// Blocks decoded by the queries
+static uint64_t blocksDecoded = 0;
+
+static const char *const alertReasonNames[] = {"none", "low", "high", "fault", "stale", "compare"};
+
+static const char *channelName(uint8_t channel)
+{
+    static char number[16];
+
+    if (channel < gauge_channel_count)
+        return gauge_channels[channel].name;
+    snprintf(number, sizeof(number), "channel%u", channel);
+    return number;
+}
+
+static const char *reasonName(uint8_t reason)
+{
+    return reason < sizeof(alertReasonNames) / sizeof(alertReasonNames[0]) ? alertReasonNames[reason] : "?";
+}
+
+static double elapsedSeconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Start decoding blocks
+// firstBlock, endBlock: The blocks
+// started: The time of the record before the first block is known
+// raw, timeUs: Its micros() and unwrapped times
+static void startCursor(LogCursor &cursor, const LogFile &log, uint64_t firstBlock, uint64_t endBlock, bool started,
+    uint32_t raw, uint64_t timeUs)
+{
+    cursor.log = &log;
+    cursor.block = firstBlock;
+    cursor.end = min(endBlock, log.blocks);
+    cursor.open = false;
+    cursor.started = started;
+    cursor.raw = raw;
+    cursor.time_us = timeUs;
+}
+
+// Start decoding a group of blocks
+static void startGroupCursor(LogCursor &cursor, const LogFile &log, uint64_t group)
+{
+    const LogIndexGroup &entry = log.groups[group];
+
+    startCursor(cursor, log, group * LOG_INDEX_GROUP_BLOCKS, (group + 1) * LOG_INDEX_GROUP_BLOCKS, true,
+        entry.start_raw, entry.start_us);
+}
+
+// Decode the next record
+// record: Receives the record
+// timeUs: Receives its unwrapped time
+// Return: False after the last block
+static bool nextRecord(LogCursor &cursor, BlackBoxRecord &record, uint64_t &timeUs)
+{
+    while (!cursor.open || !decodeRecord(cursor.decoder, record)) {
+        if (cursor.block >= cursor.end)
+            return false;
+        // The block is decoded where it's mapped
+        startRecordDecoding(cursor.decoder, cursor.log->data + cursor.block * BLACK_BOX_PAGE_SIZE, BLACK_BOX_PAGE_SIZE);
+        cursor.block++;
+        cursor.open = true;
+        blocksDecoded++;
+    }
+
+    // The times within a group are close enough for the difference to fit in 32 bits
+    if (cursor.started)
+        cursor.time_us += (int32_t)(record.time_us - cursor.raw);
+    else
+        cursor.time_us = record.time_us;
+    cursor.raw = record.time_us;
+    cursor.started = true;
+    timeUs = cursor.time_us;
+    return true;
+}
+
+static void resetSummary(ChannelSummary &summary)
+{
+    memset(&summary, 0, sizeof(summary));
+    summary.min = INFINITY;
+    summary.max = -INFINITY;
+}
+
+static void addReading(ChannelSummary &summary, const BlackBoxRecord &record, uint64_t timeUs)
+{
+    if (summary.count + summary.errors == 0)
+        summary.first_us = timeUs;
+    summary.last_us = timeUs;
+    summary.last = record.value;
+    summary.last_error = record.error;
+    if (record.error) {
+        summary.errors++;
+        return;
+    }
+    summary.count++;
+    summary.sum += record.value;
+    summary.min = min(summary.min, record.value);
+    summary.max = max(summary.max, record.value);
+}
+
+// Add the statistics of a group summary to a range summary
+static void mergeSummary(ChannelSummary &summary, const ChannelSummary &group)
+{
+    if (group.count + group.errors == 0)
+        return;
+    if (summary.count + summary.errors == 0)
+        summary.first_us = group.first_us;
+    summary.last_us = group.last_us;
+    summary.last = group.last;
+    summary.last_error = group.last_error;
+    summary.count += group.count;
+    summary.errors += group.errors;
+    summary.sum += group.sum;
+    summary.min = min(summary.min, group.min);
+    summary.max = max(summary.max, group.max);
+}
+
+// Map a file read only
+// Return: The mapping, NULL on error
+static const uint8_t *mapFile(int fd, size_t size)
+{
+    void *map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+
+    return map == MAP_FAILED ? NULL : (const uint8_t *)map;
+}
+
+// Build the index of a log
+// Return: False if it can't be written
+static bool buildIndex(const LogFile &log, const char *path, const struct stat &status)
+{
+    char temporary[PATH_MAX + 8];
+    FILE *file;
+    LogIndexHeader header;
+    LogIndexGroup group;
+    LogCursor cursor;
+    BlackBoxRecord record;
+    uint64_t timeUs, lastUs = 0;
+    uint32_t lastRaw = 0;
+    uint8_t alerts = 0, alertReasons[RECORD_CODEC_CHANNELS];
+    uint64_t alertSince[RECORD_CODEC_CHANNELS];
+
+    snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+    file = fopen(temporary, "wb");
+    if (!file) {
+        perror(temporary);
+        return false;
+    }
+    memset(&header, 0, sizeof(header));
+    header.magic = LOG_INDEX_MAGIC;
+    header.version = LOG_INDEX_VERSION;
+    header.block_size = BLACK_BOX_PAGE_SIZE;
+    header.group_blocks = LOG_INDEX_GROUP_BLOCKS;
+    header.log_size = status.st_size;
+    header.log_mtime_ns = (int64_t)status.st_mtim.tv_sec * 1000000000LL + status.st_mtim.tv_nsec;
+    header.blocks = log.blocks;
+    header.groups = (log.blocks + LOG_INDEX_GROUP_BLOCKS - 1) / LOG_INDEX_GROUP_BLOCKS;
+    fwrite(&header, sizeof(header), 1, file);
+
+    // One pass over the log, in order
+    madvise((void *)log.data, log.size, MADV_SEQUENTIAL);
+    memset(alertReasons, 0, sizeof(alertReasons));
+    memset(alertSince, 0, sizeof(alertSince));
+    startCursor(cursor, log, 0, 0, false, 0, 0);
+    for (uint64_t g = 0; g < header.groups; g++) {
+        memset(&group, 0, sizeof(group));
+        group.start_us = group.end_us = lastUs;
+        group.start_raw = lastRaw;
+        group.alert_before = alerts;
+        for (uint8_t c = 0; c < RECORD_CODEC_CHANNELS; c++) {
+            resetSummary(group.channels[c]);
+            group.channels[c].alert_since_us = alertSince[c];
+            group.channels[c].alert_reason = alertReasons[c];
+        }
+
+        cursor.end = min((g + 1) * LOG_INDEX_GROUP_BLOCKS, log.blocks);
+        while (nextRecord(cursor, record, timeUs)) {
+            uint8_t bit = 1 << record.channel;
+
+            if (group.records++ == 0) {
+                group.start_us = timeUs;
+                group.start_raw = record.time_us;
+            }
+            group.end_us = timeUs;
+            group.present |= bit;
+            addReading(group.channels[record.channel], record, timeUs);
+
+            if (record.reason && !(alerts & bit)) {
+                alerts |= bit;
+                alertSince[record.channel] = timeUs;
+                alertReasons[record.channel] = record.reason;
+                group.alert_change |= bit;
+            } else if (!record.reason && (alerts & bit)) {
+                alerts &= ~bit;
+                group.alert_change |= bit;
+            }
+        }
+        if (group.records) {
+            if (header.records == 0)
+                header.start_us = group.start_us;
+            header.end_us = group.end_us;
+        }
+        header.records += group.records;
+        lastUs = group.end_us;
+        lastRaw = cursor.raw;
+        fwrite(&group, sizeof(group), 1, file);
+    }
+
+    fseek(file, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, file);
+    if (ferror(file) | fclose(file) || rename(temporary, path) != 0) {
+        perror(path);
+        unlink(temporary);
+        return false;
+    }
+    return true;
+}
+
+// Map the index of a log
+// Return: False if it's missing or out of date
+static bool mapIndex(LogFile &log, const char *path, const struct stat &logStatus)
+{
+    struct stat status;
+    const LogIndexHeader *header;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0)
+        return false;
+    if (fstat(fd, &status) != 0 || (size_t)status.st_size < sizeof(LogIndexHeader)) {
+        close(fd);
+        return false;
+    }
+    log.index_size = status.st_size;
+    log.index = mapFile(fd, log.index_size);
+    close(fd);
+    if (!log.index)
+        return false;
+
+    header = (const LogIndexHeader *)log.index;
+    if (header->magic != LOG_INDEX_MAGIC || header->version != LOG_INDEX_VERSION ||
+        header->block_size != BLACK_BOX_PAGE_SIZE || header->group_blocks != LOG_INDEX_GROUP_BLOCKS ||
+        header->log_size != (uint64_t)logStatus.st_size ||
+        header->log_mtime_ns != (int64_t)logStatus.st_mtim.tv_sec * 1000000000LL + logStatus.st_mtim.tv_nsec ||
+        header->blocks != log.blocks ||
+        log.index_size != sizeof(LogIndexHeader) + header->groups * sizeof(LogIndexGroup)) {
+        munmap((void *)log.index, log.index_size);
+        log.index = NULL;
+        return false;
+    }
+    log.header = header;
+    log.groups = (const LogIndexGroup *)(log.index + sizeof(LogIndexHeader));
+    return true;
+}
+
+// Map a log and its index, building the index if needed
+// Return: False on error
+static bool openLog(LogFile &log, const char *path)
+{
+    char indexPath[PATH_MAX];
+    struct stat status;
+    int fd = open(path, O_RDONLY);
+
+    memset(&log, 0, sizeof(log));
+    snprintf(indexPath, sizeof(indexPath), "%s.idx", path);
+    if (fd < 0 || fstat(fd, &status) != 0) {
+        perror(path);
+        if (fd >= 0)
+            close(fd);
+        return false;
+    }
+    log.size = status.st_size;
+    log.blocks = log.size / BLACK_BOX_PAGE_SIZE;
+    if (log.blocks == 0) {
+        fprintf(stderr, "%s: no blocks\n", path);
+        close(fd);
+        return false;
+    }
+    if (log.size % BLACK_BOX_PAGE_SIZE)
+        fprintf(stderr, "%s: %zu bytes after the last block left out\n", path, log.size % BLACK_BOX_PAGE_SIZE);
+    log.data = mapFile(fd, log.size);
+    close(fd);
+    if (!log.data) {
+        perror(path);
+        return false;
+    }
+
+    if (!mapIndex(log, indexPath, status)) {
+        auto start = std::chrono::steady_clock::now();
+
+        if (!buildIndex(log, indexPath, status) || !mapIndex(log, indexPath, status)) {
+            fprintf(stderr, "%s: can't index\n", path);
+            return false;
+        }
+        fprintf(stderr, "index built in %.3f s: %llu groups, %zu bytes\n", elapsedSeconds(start),
+            (unsigned long long)log.header->groups, log.index_size);
+    }
+    // The queries jump to the groups they need
+    madvise((void *)log.data, log.size, MADV_RANDOM);
+    blocksDecoded = 0;
+    return true;
+}
+
+static void closeLog(LogFile &log)
+{
+    munmap((void *)log.data, log.size);
+    munmap((void *)log.index, log.index_size);
+}
+
+// First group ending at or after a time
+static uint64_t firstGroupFrom(const LogFile &log, uint64_t fromUs)
+{
+    const LogIndexGroup *end = log.groups + log.header->groups;
+
+    return std::partition_point(log.groups, end,
+        [fromUs](const LogIndexGroup &group) { return group.end_us < fromUs; }) - log.groups;
+}
+
+// First group starting after a time
+static uint64_t endGroupTo(const LogFile &log, uint64_t toUs)
+{
+    const LogIndexGroup *end = log.groups + log.header->groups;
+
+    return std::partition_point(log.groups, end,
+        [toUs](const LogIndexGroup &group) { return group.start_us <= toUs; }) - log.groups;
+}
+
+static bool groupWithin(const LogIndexGroup &group, uint64_t fromUs, uint64_t toUs)
+{
+    return group.records && group.start_us >= fromUs && group.end_us <= toUs;
+}
+
+// Statistics of the readings of each channel between two times
+// totals: Receive the statistics of each channel
+static void queryStats(const LogFile &log, uint64_t fromUs, uint64_t toUs, ChannelSummary *totals)
+{
+    uint64_t last = endGroupTo(log, toUs);
+    LogCursor cursor;
+    BlackBoxRecord record;
+    uint64_t timeUs;
+
+    for (uint8_t c = 0; c < RECORD_CODEC_CHANNELS; c++)
+        resetSummary(totals[c]);
+    for (uint64_t g = firstGroupFrom(log, fromUs); g < last; g++) {
+        const LogIndexGroup &group = log.groups[g];
+
+        if (groupWithin(group, fromUs, toUs)) {
+            for (uint8_t c = 0; c < RECORD_CODEC_CHANNELS; c++)
+                mergeSummary(totals[c], group.channels[c]);
+            continue;
+        }
+        startGroupCursor(cursor, log, g);
+        while (nextRecord(cursor, record, timeUs)) {
+            if (timeUs >= fromUs && timeUs <= toUs)
+                addReading(totals[record.channel], record, timeUs);
+        }
+    }
+}
+
+// Reading held by the time over a threshold
+typedef struct {
+    bool held;                  // There's a reading
+    bool over;                  // It's at or above the threshold
+    uint64_t since_us;
+} HeldReading;
+
+// Time the held reading is over the threshold, from its time to another within the range
+static uint64_t heldOver(const HeldReading &held, uint64_t timeUs, uint64_t fromUs, uint64_t toUs)
+{
+    uint64_t start = max(held.since_us, fromUs), end = min(timeUs, toUs);
+
+    return held.held && held.over && end > start ? end - start : 0;
+}
+
+static void holdReading(HeldReading &held, bool over, uint64_t timeUs)
+{
+    held.held = true;
+    held.over = over;
+    held.since_us = timeUs;
+}
+
+// Time a channel is at or above a threshold between two times, in microseconds
+static uint64_t queryOver(const LogFile &log, uint8_t channel, float threshold, uint64_t fromUs, uint64_t toUs)
+{
+    uint64_t first = firstGroupFrom(log, fromUs), last = endGroupTo(log, toUs);
+    uint8_t bit = 1 << channel;
+    HeldReading held = {false, false, 0};
+    LogCursor cursor;
+    BlackBoxRecord record;
+    uint64_t timeUs, total = 0;
+
+    // The last reading before the range, from the summaries
+    for (uint64_t g = first; g > 0; g--) {
+        const ChannelSummary &summary = log.groups[g - 1].channels[channel];
+
+        if (log.groups[g - 1].present & bit) {
+            holdReading(held, summary.last_error == 0 && summary.last >= threshold, summary.last_us);
+            break;
+        }
+    }
+
+    for (uint64_t g = first; g < last; g++) {
+        const LogIndexGroup &group = log.groups[g];
+        const ChannelSummary &summary = group.channels[channel];
+
+        if (!(group.present & bit))
+            continue;
+        // Inside the range, a group that's all over or all under adds up from its summary
+        if (groupWithin(group, fromUs, toUs) && summary.errors == 0 && summary.min >= threshold) {
+            total += heldOver(held, summary.first_us, fromUs, toUs) + summary.last_us - summary.first_us;
+            holdReading(held, true, summary.last_us);
+            continue;
+        }
+        if (groupWithin(group, fromUs, toUs) && (summary.count == 0 || summary.max < threshold)) {
+            total += heldOver(held, summary.first_us, fromUs, toUs);
+            holdReading(held, summary.last_error == 0 && summary.last >= threshold, summary.last_us);
+            continue;
+        }
+        startGroupCursor(cursor, log, g);
+        while (nextRecord(cursor, record, timeUs)) {
+            if (record.channel != channel)
+                continue;
+            total += heldOver(held, timeUs, fromUs, toUs);
+            holdReading(held, record.error == 0 && record.value >= threshold, timeUs);
+        }
+    }
+    // The last reading holds to the end of the range, or of the log
+    return total + heldOver(held, min(toUs, log.header->end_us), fromUs, toUs);
+}
+
+// Alert windows being followed
+typedef struct {
+    uint8_t open;               // Bit per channel in alert
+    uint8_t reasons[RECORD_CODEC_CHANNELS];
+    uint64_t since_us[RECORD_CODEC_CHANNELS];
+} AlertState;
+
+// Follow the alert state of a record
+// opening: A window can start at the record
+static void followAlert(AlertState &state, const BlackBoxRecord &record, uint64_t timeUs, bool opening,
+    uint64_t fromUs, uint64_t toUs, std::vector<AlertWindow> &windows)
+{
+    uint8_t bit = 1 << record.channel;
+
+    if (record.reason && !(state.open & bit) && opening) {
+        state.open |= bit;
+        state.reasons[record.channel] = record.reason;
+        state.since_us[record.channel] = timeUs;
+    } else if (!record.reason && (state.open & bit)) {
+        state.open &= ~bit;
+        if (timeUs >= fromUs && state.since_us[record.channel] <= toUs)
+            windows.push_back(AlertWindow{record.channel, state.reasons[record.channel], false,
+                state.since_us[record.channel], timeUs});
+    }
+}
+
+// Alert windows overlapping a range, in the order they end
+static void queryAlerts(const LogFile &log, uint64_t fromUs, uint64_t toUs, std::vector<AlertWindow> &windows)
+{
+    uint64_t first = firstGroupFrom(log, fromUs), last = endGroupTo(log, toUs);
+    AlertState state;
+    LogCursor cursor;
+    BlackBoxRecord record;
+    uint64_t timeUs;
+
+    windows.clear();
+    if (first >= log.header->groups)
+        return;
+
+    // The alerts going on at the start of the first group, from the index
+    state.open = log.groups[first].alert_before;
+    for (uint8_t c = 0; c < RECORD_CODEC_CHANNELS; c++) {
+        state.reasons[c] = log.groups[first].channels[c].alert_reason;
+        state.since_us[c] = log.groups[first].channels[c].alert_since_us;
+    }
+
+    // A group where no channel goes in or out of alert leaves the state as it is
+    for (uint64_t g = first; g < last; g++) {
+        if (g != first && g != last - 1 && !log.groups[g].alert_change)
+            continue;
+        startGroupCursor(cursor, log, g);
+        while (nextRecord(cursor, record, timeUs))
+            followAlert(state, record, timeUs, timeUs <= toUs, fromUs, toUs, windows);
+    }
+
+    // Then the ends of the windows still open, after the range
+    for (uint64_t g = max(first, last); state.open && g < log.header->groups; g++) {
+        if (!(log.groups[g].alert_change & state.open))
+            continue;
+        startGroupCursor(cursor, log, g);
+        while (nextRecord(cursor, record, timeUs))
+            followAlert(state, record, timeUs, false, fromUs, toUs, windows);
+    }
+    for (uint8_t c = 0; c < RECORD_CODEC_CHANNELS; c++) {
+        if ((state.open & (1 << c)) && log.header->end_us >= fromUs && state.since_us[c] <= toUs)
+            windows.push_back(AlertWindow{c, state.reasons[c], true, state.since_us[c], log.header->end_us});
+    }
+}
+
+// The same queries decoding the whole log, for the check command
+static void decodeStats(const LogFile &log, uint64_t fromUs, uint64_t toUs, ChannelSummary *totals)
+{
+    LogCursor cursor;
+    BlackBoxRecord record;
+    uint64_t timeUs;
+
+    for (uint8_t c = 0; c < RECORD_CODEC_CHANNELS; c++)
+        resetSummary(totals[c]);
+    startCursor(cursor, log, 0, log.blocks, false, 0, 0);
+    while (nextRecord(cursor, record, timeUs)) {
+        if (timeUs >= fromUs && timeUs <= toUs)
+            addReading(totals[record.channel], record, timeUs);
+    }
+}
+
+static uint64_t decodeOver(const LogFile &log, uint8_t channel, float threshold, uint64_t fromUs, uint64_t toUs)
+{
+    HeldReading held = {false, false, 0};
+    LogCursor cursor;
+    BlackBoxRecord record;
+    uint64_t timeUs, total = 0;
+
+    startCursor(cursor, log, 0, log.blocks, false, 0, 0);
+    while (nextRecord(cursor, record, timeUs)) {
+        if (record.channel != channel)
+            continue;
+        total += heldOver(held, timeUs, fromUs, toUs);
+        holdReading(held, record.error == 0 && record.value >= threshold, timeUs);
+    }
+    return total + heldOver(held, min(toUs, log.header->end_us), fromUs, toUs);
+}
+
+static void decodeAlerts(const LogFile &log, uint64_t fromUs, uint64_t toUs, std::vector<AlertWindow> &windows)
+{
+    AlertState state;
+    LogCursor cursor;
+    BlackBoxRecord record;
+    uint64_t timeUs;
+
+    windows.clear();
+    memset(&state, 0, sizeof(state));
+    startCursor(cursor, log, 0, log.blocks, false, 0, 0);
+    while (nextRecord(cursor, record, timeUs))
+        followAlert(state, record, timeUs, true, fromUs, toUs, windows);
+    for (uint8_t c = 0; c < RECORD_CODEC_CHANNELS; c++) {
+        if ((state.open & (1 << c)) && log.header->end_us >= fromUs && state.since_us[c] <= toUs)
+            windows.push_back(AlertWindow{c, state.reasons[c], true, state.since_us[c], log.header->end_us});
+    }
+}
+
+static bool sameSummary(const ChannelSummary &a, const ChannelSummary &b)
+{
+    return a.count == b.count && a.errors == b.errors && (a.count == 0 || (a.min == b.min && a.max == b.max &&
+        fabs(a.sum - b.sum) <= 1e-9 * max(1.0, fabs(a.sum))));
+}
+
+static bool sameWindows(std::vector<AlertWindow> a, std::vector<AlertWindow> b)
+{
+    auto before = [](const AlertWindow &x, const AlertWindow &y) {
+        return x.start_us != y.start_us ? x.start_us < y.start_us : x.channel < y.channel;
+    };
+
+    if (a.size() != b.size())
+        return false;
+    std::sort(a.begin(), a.end(), before);
+    std::sort(b.begin(), b.end(), before);
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].channel != b[i].channel || a[i].reason != b[i].reason || a[i].ongoing != b[i].ongoing ||
+            a[i].start_us != b[i].start_us || a[i].end_us != b[i].end_us)
+            return false;
+    }
+    return true;
+}
+
+// Compare the indexed queries with decoding the whole log, on ranges across the log
+// Return: The number of failures
+static uint32_t checkQueries(const LogFile &log)
+{
+    const LogIndexHeader &header = *log.header;
+    ChannelSummary indexed[RECORD_CODEC_CHANNELS], decoded[RECORD_CODEC_CHANNELS];
+    std::vector<AlertWindow> indexedWindows, decodedWindows;
+    uint64_t statsBlocks = 0, overBlocks = 0, alertBlocks = 0, span = header.end_us - header.start_us;
+    uint32_t failures = 0;
+
+    srand(1);
+    for (uint32_t i = 0; i < LOG_QUERY_CHECK_RANGES; i++) {
+        // The whole log, then ranges of all lengths, some past its ends
+        uint64_t fromUs = header.start_us, toUs = header.end_us;
+        uint8_t channel = i % gauge_channel_count;
+        float threshold;
+
+        if (i > 0) {
+            fromUs = (uint64_t)max(0.0, header.start_us + ((double)rand() / RAND_MAX * 1.1 - 0.05) * span);
+            toUs = fromUs + (uint64_t)((double)rand() / RAND_MAX * span / (1 + i % 8));
+        }
+        queryStats(log, fromUs, toUs, indexed);
+        threshold = indexed[channel].count ? (indexed[channel].min + indexed[channel].max) / 2 : 0;
+
+        blocksDecoded = 0;
+        queryStats(log, fromUs, toUs, indexed);
+        statsBlocks += blocksDecoded;
+        blocksDecoded = 0;
+        uint64_t indexedOver = queryOver(log, channel, threshold, fromUs, toUs);
+        overBlocks += blocksDecoded;
+        blocksDecoded = 0;
+        queryAlerts(log, fromUs, toUs, indexedWindows);
+        alertBlocks += blocksDecoded;
+
+        decodeStats(log, fromUs, toUs, decoded);
+        uint64_t decodedOver = decodeOver(log, channel, threshold, fromUs, toUs);
+        decodeAlerts(log, fromUs, toUs, decodedWindows);
+
+        for (uint8_t c = 0; c < RECORD_CODEC_CHANNELS; c++) {
+            if (!sameSummary(indexed[c], decoded[c])) {
+                printf("stats %.3f-%.3f s, %s: %u readings, %.2f to %.2f indexed, %u, %.2f to %.2f decoded\n",
+                    fromUs / 1e6, toUs / 1e6, channelName(c), indexed[c].count, indexed[c].min, indexed[c].max,
+                    decoded[c].count, decoded[c].min, decoded[c].max);
+                failures++;
+            }
+        }
+        if (indexedOver != decodedOver) {
+            printf("over %.3f-%.3f s, %s at %.2f: %.6f s indexed, %.6f s decoded\n", fromUs / 1e6, toUs / 1e6,
+                channelName(channel), threshold, indexedOver / 1e6, decodedOver / 1e6);
+            failures++;
+        }
+        if (!sameWindows(indexedWindows, decodedWindows)) {
+            printf("alerts %.3f-%.3f s: %zu windows indexed, %zu decoded\n", fromUs / 1e6, toUs / 1e6,
+                indexedWindows.size(), decodedWindows.size());
+            failures++;
+        }
+    }
+    printf("%d ranges, blocks decoded per query with the index: stats %.1f, over %.1f, alerts %.1f, %llu without\n",
+        LOG_QUERY_CHECK_RANGES, (double)statsBlocks / LOG_QUERY_CHECK_RANGES, (double)overBlocks / LOG_QUERY_CHECK_RANGES,
+        (double)alertBlocks / LOG_QUERY_CHECK_RANGES, (unsigned long long)log.blocks);
+    return failures;
+}
+
+static void printSummaries(const ChannelSummary *totals)
+{
+    printf("channel,readings,errors,min,max,avg\n");
+    for (uint8_t c = 0; c < RECORD_CODEC_CHANNELS; c++) {
+        const ChannelSummary &summary = totals[c];
+
+        if (summary.count + summary.errors == 0)
+            continue;
+        if (summary.count)
+            printf("%s,%u,%u,%.2f,%.2f,%.3f\n", channelName(c), summary.count, summary.errors, summary.min,
+                summary.max, summary.sum / summary.count);
+        else
+            printf("%s,0,%u,,,\n", channelName(c), summary.errors);
+    }
+}
+
+// Parse the optional range of a command
+// Return: False if it's malformed
+static bool parseRange(const LogFile &log, int argc, char **argv, uint64_t &fromUs, uint64_t &toUs)
+{
+    fromUs = log.header->start_us;
+    toUs = log.header->end_us;
+    if (argc == 0)
+        return true;
+    if (argc != 2 || atof(argv[0]) < 0 || atof(argv[1]) < atof(argv[0]))
+        return false;
+    fromUs = (uint64_t)llround(atof(argv[0]) * 1e6);
+    toUs = (uint64_t)llround(atof(argv[1]) * 1e6);
+    return true;
+}
+
+// Channel number from a name or a number
+// Return: False if there's no such channel
+static bool parseChannel(const char *text, uint8_t &channel)
+{
+    char *end;
+    long number = strtol(text, &end, 10);
+
+    if (*end == '\0' && number >= 0 && number < RECORD_CODEC_CHANNELS) {
+        channel = number;
+        return true;
+    }
+    for (channel = 0; channel < gauge_channel_count && channel < RECORD_CODEC_CHANNELS; channel++) {
+        if (strcmp(gauge_channels[channel].name, text) == 0)
+            return true;
+    }
+    return false;
+}
+
+static int usage()
+{
+    fprintf(stderr, "Usage: log-query info <log>\n"
+        "       log-query stats <log> [from_s to_s]\n"
+        "       log-query alerts <log> [from_s to_s]\n"
+        "       log-query over <log> <channel> <threshold> [from_s to_s]\n"
+        "       log-query check <log>\n");
+    return 2;
+}
+
+int runLogQuery(int argc, char **argv)
+{
+    const char *command = argc > 0 ? argv[0] : "";
+    LogFile log;
+    ChannelSummary totals[RECORD_CODEC_CHANNELS];
+    uint64_t fromUs, toUs;
+    int result = 0;
+
+    if (argc < 2)
+        return usage();
+    if (strcmp(command, "info") && strcmp(command, "stats") && strcmp(command, "alerts") &&
+        strcmp(command, "over") && strcmp(command, "check"))
+        return usage();
+    if (!openLog(log, argv[1]))
+        return 1;
+    argc -= 2;
+    argv += 2;
+    auto start = std::chrono::steady_clock::now();
+
+    if (strcmp(command, "info") == 0) {
+        const LogIndexHeader &header = *log.header;
+
+        printf("%llu records in %llu blocks of %u bytes, %.2f bytes per record\n", (unsigned long long)header.records,
+            (unsigned long long)header.blocks, header.block_size, (double)log.size / max(header.records, (uint64_t)1));
+        printf("%.3f s to %.3f s, %.1f s\n", header.start_us / 1e6, header.end_us / 1e6,
+            (header.end_us - header.start_us) / 1e6);
+        printf("index: %llu groups of %u blocks, %zu bytes\n", (unsigned long long)header.groups, header.group_blocks,
+            log.index_size);
+        for (uint8_t c = 0; c < RECORD_CODEC_CHANNELS; c++)
+            resetSummary(totals[c]);
+        for (uint64_t g = 0; g < header.groups; g++) {
+            for (uint8_t c = 0; c < RECORD_CODEC_CHANNELS; c++)
+                mergeSummary(totals[c], log.groups[g].channels[c]);
+        }
+        printSummaries(totals);
+    } else if (strcmp(command, "stats") == 0) {
+        if (!parseRange(log, argc, argv, fromUs, toUs)) {
+            result = usage();
+        } else {
+            queryStats(log, fromUs, toUs, totals);
+            printSummaries(totals);
+        }
+    } else if (strcmp(command, "alerts") == 0) {
+        std::vector<AlertWindow> windows;
+
+        if (!parseRange(log, argc, argv, fromUs, toUs)) {
+            result = usage();
+        } else {
+            queryAlerts(log, fromUs, toUs, windows);
+            printf("channel,reason,start_s,end_s,duration_s\n");
+            for (const AlertWindow &window : windows)
+                printf("%s,%s,%.3f,%.3f%s,%.3f\n", channelName(window.channel), reasonName(window.reason),
+                    window.start_us / 1e6, window.end_us / 1e6, window.ongoing ? "+" : "",
+                    (window.end_us - window.start_us) / 1e6);
+        }
+    } else if (strcmp(command, "over") == 0) {
+        uint8_t channel;
+        uint64_t over;
+
+        if (argc < 2 || !parseChannel(argv[0], channel) || !parseRange(log, argc - 2, argv + 2, fromUs, toUs)) {
+            result = usage();
+        } else {
+            double span = (min(toUs, log.header->end_us) - min(max(fromUs, log.header->start_us), toUs)) / 1e6;
+
+            over = queryOver(log, channel, atof(argv[1]), fromUs, toUs);
+            printf("%s at or above %s for %.3f s of %.3f s (%.1f%%)\n", channelName(channel), argv[1], over / 1e6,
+                span, span > 0 ? 100 * over / 1e6 / span : 0);
+        }
+    } else {
+        uint32_t failures = checkQueries(log);
+
+        printf("%u failure(s)\n", failures);
+        result = failures ? 1 : 0;
+    }
+
+    if (strcmp(command, "check") != 0 && result == 0)
+        fprintf(stderr, "%llu of %llu blocks decoded in %.3f ms\n", (unsigned long long)blocksDecoded,
+            (unsigned long long)log.blocks, elapsedSeconds(start) * 1e3);
+    closeLog(log);
+    return result;
+}
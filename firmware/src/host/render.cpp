@@ -0,0 +1,199 @@
+/*
+ * Rendering check host tool for the RX-8 Ashtray Gauges project.
+ * Draws a set of screens with the firmware's own drawing functions, sends them to the
+ * SSD1306 emulators over the host Wire buses and compares what the panels show against
+ * golden images (PBM files, one per screen) in the specified directory.
+ * The bus traffic of every screen is printed along with the result, so a rendering change
+ * shows both its visual and its I2C cost.
+ * Usage: render <directory> [--update]
+ *   --update: Write the golden images from the current rendering instead of comparing
+ * A screen without a golden image is written and reported as NEW, a failure until the image
+ * is checked and committed with the others (test/golden).
+ * When a screen differs, the actual rendering is written next to the golden image as
+ * <screen>.actual.pbm and <screen>.actual.png.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <Arduino.h>
+#include <Adafruit_SSD1306.h>
+#include "host_tools.h"
+#include "ssd1306_emulator.h"
+#include "../coolant_monitor.h"
+#include "../display_manager.h"
+
+// Firmware drawing functions and state
+extern DisplayManager display_manager;
+extern bool temperatureUnitIsFahrenheit;
+extern bool pressureUnitIsBar;
+void initDisplays();
+void displayIntro();
+void displayFault(Adafruit_SSD1306 &display, bool half);
+void updateOilTemp(Adafruit_SSD1306 &display, float temperature);
+void updateOilPsi(Adafruit_SSD1306 &display, float psi);
+void updateCoolantTemp(Adafruit_SSD1306 &display, float temperature);
+void updateSupplyVoltage(Adafruit_SSD1306 &display, float voltage);
+
+// Maximum number of intro frames checked
+#define RENDER_MAX_INTRO_FRAMES 32
+
+// One screen to check
+typedef struct {
+    const char *name;
+    uint8_t display;            // 1: oil display, 2: coolant and voltage display
+    bool fahrenheit;
+    bool bar;
+    float top;                  // Oil or coolant temperature, in Celsius. Below -100 for a fault
+    float bottom;               // Oil pressure in PSI, or supply voltage. Below -100 for a fault
+} RenderScreen;
+
+// The screens cover each branch of the value positioning in updateOilPsi() and
+// updateSupplyVoltage(), the warnings and the faults
+static const RenderScreen renderScreens[] = {
+    {"oil_normal",              1, false, false, 95, 45},
+    {"oil_psi_below_10",        1, false, false, 95, 8.5},
+    {"oil_psi_low_warning",     1, false, false, 95, 12.2},
+    {"oil_psi_100",             1, false, false, 95, 120},
+    {"oil_psi_high_warning",    1, false, false, 95, 155},
+    {"oil_temp_warning",        1, false, false, 125, 45},
+    {"oil_fahrenheit_bar",      1, true, true, 95, 45},
+    {"oil_bar_warning",         1, false, true, 95, 12.2},
+    {"oil_temp_fault",          1, false, false, -1000, 45},
+    {"oil_both_faults",         1, false, false, -1000, -1000},
+    {"coolant_normal",          2, false, false, 88, 13.8},
+    {"coolant_warning",         2, false, false, 112, 13.8},
+    {"coolant_fahrenheit",      2, true, false, 88, 13.8},
+    {"voltage_below_10",        2, false, false, 88, 9.6},
+    {"voltage_low_warning",     2, false, false, 88, 11.2},
+    {"voltage_high_warning",    2, false, false, 88, 15.4},
+    {"voltage_fault",           2, false, false, 88, -1000}
+};
+
+static Ssd1306Emulator panel1(128, 64);
+static Ssd1306Emulator panel2(128, 64);
+static const char *goldenDirectory;
+static bool updateGolden = false;
+static int failures = 0;
+
+// Intro animation frames, captured as they are flushed
+static uint8_t introFrames = 0;
+
+// Check the current panel image against its golden image and print the result
+// name: The screen name, also the golden image file name without extension
+// panel: The emulator that shows the screen
+static void checkScreen(const char *name, const Ssd1306Emulator &panel)
+{
+    char path[512];
+    char actual[512];
+    const char *result;
+    struct stat st;
+    long differences = 0;
+
+    snprintf(path, sizeof(path), "%s/%s.pbm", goldenDirectory, name);
+
+    if (updateGolden || stat(path, &st) != 0) {
+        result = "updated";
+        if (!updateGolden) {
+            // Nothing to compare with: the rendering is kept to be checked
+            result = "NEW";
+            failures++;
+        }
+        if (!panel.savePbm(path)) {
+            perror(path);
+            failures++;
+            return;
+        }
+    } else {
+        differences = panel.comparePbm(path);
+        if (differences == 0) {
+            result = "ok";
+        } else {
+            result = differences < 0 ? "UNREADABLE" : "DIFFERS";
+            failures++;
+            snprintf(actual, sizeof(actual), "%s/%s.actual.pbm", goldenDirectory, name);
+            panel.savePbm(actual);
+            snprintf(actual, sizeof(actual), "%s/%s.actual.png", goldenDirectory, name);
+            panel.savePng(actual);
+        }
+    }
+
+    printf("%-24s %5u bytes %3u transactions  %s", name, panel.last_flush.bytes, panel.last_flush.transactions, result);
+    if (differences > 0)
+        printf(" (%ld pixels)", differences);
+    printf("\n");
+}
+
+static void onIntroFlush(Ssd1306Emulator &panel, void *)
+{
+    char name[32];
+
+    if (introFrames >= RENDER_MAX_INTRO_FRAMES)
+        return;
+    snprintf(name, sizeof(name), "intro_%02u", introFrames++);
+    checkScreen(name, panel);
+}
+
+// Draw one screen with the firmware functions, the same way loop() does
+static void drawScreen(const RenderScreen &screen)
+{
+    DisplayPanel &panel = display_manager.panels[screen.display - 1];
+    Adafruit_SSD1306 &display = *panel.bus.display;
+
+    temperatureUnitIsFahrenheit = screen.fahrenheit;
+    pressureUnitIsBar = screen.bar;
+
+    display.clearDisplay();
+    if (screen.top < -100) {
+        displayFault(display, TOP_HALF);
+    } else if (screen.display == 1) {
+        updateOilTemp(display, screen.top);
+    } else {
+        updateCoolantTemp(display, screen.top);
+    }
+    if (screen.bottom < -100) {
+        displayFault(display, BOTTOM_HALF);
+    } else if (screen.display == 1) {
+        updateOilPsi(display, screen.bottom);
+    } else {
+        updateSupplyVoltage(display, screen.bottom);
+    }
+    flushDisplayPanel(panel);
+}
+
+int runRender(int argc, char **argv)
+{
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--update") == 0) {
+            updateGolden = true;
+        } else {
+            goldenDirectory = argv[i];
+        }
+    }
+
+    if (!goldenDirectory) {
+        fprintf(stderr, "Usage: render <directory> [--update]\n");
+        return 2;
+    }
+    mkdir(goldenDirectory, 0755);
+
+    Wire.attach(DISPLAY_ADDRESS_PRIMARY, &panel1);
+    Wire1.attach(DISPLAY_ADDRESS_PRIMARY, &panel2);
+    initDisplays();
+    printf("%-24s %5u bytes %3u transactions\n", "init", panel1.last_flush.bytes, panel1.last_flush.transactions);
+
+    panel1.onFlush(onIntroFlush, NULL);
+    displayIntro();
+    panel1.onFlush(NULL, NULL);
+
+    for (size_t i = 0; i < sizeof(renderScreens) / sizeof(RenderScreen); i++) {
+        drawScreen(renderScreens[i]);
+        checkScreen(renderScreens[i].name, renderScreens[i].display == 1 ? panel1 : panel2);
+    }
+
+    if (panel1.unknown_commands || panel2.unknown_commands)
+        printf("unknown commands: %u, %u\n", panel1.unknown_commands, panel2.unknown_commands);
+    printf("%d failure(s)\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,706 @@
+/*
+ * Trace replay host tool for the RX-8 Ashtray Gauges project.
+ * Runs the real firmware (setup() and loop() from coolant_monitor.cpp) on a virtual clock,
+ * feeding its analogue and digital inputs from a recorded trace of raw ADC counts.
+ * The timeline of alerts and displayed values goes to stdout, the run summary to stderr.
+ * The timeline only depends on the trace and the firmware, so two runs can be diffed to
+ * catch a change in alert timing; the summary also reports the host CPU time per loop.
+ *
+ * Trace format: CSV with a header line naming the columns, in any order:
+ *   ms            Timestamp of the row, in milliseconds from power up
+ *   oil_temp      Raw ADC counts (0-1023) of the oil thermistor input
+ *   coolant_temp  Raw ADC counts of the coolant thermistor input
+ *   oil_psi       Raw ADC counts of the oil pressure input
+ *   voltage       Raw ADC counts of the supply voltage input
+ *   illumination  Raw ADC counts of the illumination input
+ *   hall          Hall effect sensor input, 0 or 1 (1 = lid closed)
+ *   oil_ohms      Oil thermistor resistance, in place of oil_temp
+ *   coolant_ohms  Coolant thermistor resistance, in place of coolant_temp
+ * Missing columns read as 0 (hall as 0, lid open). Each row holds until the next one.
+ * The thermistor counts of a recording depend on the reference resistor the firmware had
+ * selected at the time, so a trace meant to exercise the reference switching gives the
+ * resistances instead: the counts are then computed with the reference currently selected.
+ *
+ * Each alert started by the alert timer is printed on the timeline with its latency, from the
+ * end of the acquisition of the reading that raised it to the warning LED output. With
+ * ADC_COMPARE_ALARMS, a compare alarm runs from the conversion outside its window instead.
+ * Each change of the ignition power state (power_state.h) is printed as well, as a power line.
+ *
+ * The displays are SSD1306 emulators on the host Wire buses, one at each display address of
+ * each bus: displays 1 to 3 are at 0x3C on Wire, Wire1 and Wire2, displays 4 to 6 at 0x3D.
+ * The firmware drives those it has a panel for. With '--frames <directory>', every flush
+ * (partial ones included) of each display is saved as <directory>/d<display>_<ms>.pbm.
+ * '--display-fault <display>,<from_ms>,<to_ms>,<nack|hang>' makes a display stop answering
+ * between two times, as with a bad connector: 'nack' doesn't acknowledge its address, 'hang'
+ * holds the bus low until the controller gives up. The option can be repeated.
+ *
+ * '--black-box <image>' loads the flash of the black box recorder from a file before the run,
+ * if it exists, and saves it after, so the events of one run can be read in the next.
+ * '--serial <command>' sends a command line to the firmware on the USB serial port at power up,
+ * e.g. '--serial dump' to print the recorded events. The firmware's serial output goes to stderr.
+ * '--log <file>' writes every record of the black box ring to a drive log: blocks of
+ * BLACK_BOX_PAGE_SIZE bytes compressed like the saved events (record_codec.h), as a logger
+ * reading the ring would. See the log-query host tool to analyse it.
+ * '--die-temp <celsius>' sets the die temperature the clock scaling reads, e.g. above
+ * CLOCK_THROTTLE_CELSIUS to check that the diagnostics then run at the low clock.
+ * '--hang <ms>' stops running the loop at that time, as if it were stuck, until the watchdog
+ * resets the firmware (see warm_start.h): the timeline gets a hang, a reset and a restart line
+ * (warm or cold), and the summary the time the readings took to come back.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <vector>
+#include <Arduino.h>
+#include <Adafruit_SSD1306.h>
+#include "host_sim.h"
+#include "host_tools.h"
+#include "ssd1306_emulator.h"
+#include "../coolant_monitor.h"
+#include "../display_manager.h"
+#include "../alert.h"
+#include "../adc_compare.h"
+#include "../gauge_channel.h"
+#include "../can_bus.h"
+#include "../black_box.h"
+#include "../record_codec.h"
+#include "../sensor_snapshot.h"
+#include "../clock_scaling.h"
+#include "../power_state.h"
+#include "../warm_start.h"
+
+// Number of display emulators: both display addresses on the three buses
+#define REPLAY_DISPLAY_COUNT 6
+
+// Maximum number of display fault windows
+#define REPLAY_MAX_DISPLAY_FAULTS 16
+
+// Firmware entry points and state
+void setup();
+void loop();
+extern DisplayManager display_manager;
+extern const GaugeChannel gauge_channels[];
+extern const uint8_t gauge_channel_count;
+extern GaugeChannelState gauge_channel_states[];
+extern uint8_t blackBoxFlash[BLACK_BOX_SLOT_COUNT * BLACK_BOX_SLOT_SIZE];
+extern float hostDieCelsius;
+extern PowerState power_state;
+extern bool warm_start;
+extern bool hostWatchdogRunning;
+extern uint32_t hostWatchdogFedMs;
+extern uint8_t hostResetCause;
+
+// Trace columns
+enum TraceColumn {
+    TRACE_OIL_TEMP = 0,
+    TRACE_COOLANT_TEMP,
+    TRACE_OIL_PSI,
+    TRACE_VOLTAGE,
+    TRACE_ILLUMINATION,
+    TRACE_HALL,
+    TRACE_OIL_OHMS,
+    TRACE_COOLANT_OHMS,
+    TRACE_COLUMN_COUNT
+};
+
+static const char *traceColumnNames[TRACE_COLUMN_COUNT] = {
+    "oil_temp", "coolant_temp", "oil_psi", "voltage", "illumination", "hall", "oil_ohms", "coolant_ohms"
+};
+
+typedef struct {
+    uint64_t us;
+    uint32_t values[TRACE_COLUMN_COUNT];
+} TraceRow;
+
+static std::vector<TraceRow> trace;
+static size_t traceCursor = 0;
+static bool fahrenheitJumper = false;
+static bool barJumper = false;
+
+// Replay results
+static FILE *timeline = stdout;
+static uint32_t alertCount = 0;
+static uint64_t alertStartUs = 0;
+static uint64_t alertTotalUs = 0;
+static uint64_t firstAlertUs = 0;
+static uint32_t alertEventSequence = 0;
+
+static const char *alertReasonNames[] = {"none", "low", "high", "fault", "stale", "compare"};
+
+// The displays, and where to save their frames (NULL to not save them)
+static Ssd1306Emulator panels[REPLAY_DISPLAY_COUNT];
+static TwoWire *const displayBuses[3] = {&Wire, &Wire1, &Wire2};
+static const char *framesDirectory = NULL;
+
+// A window of time during which a display doesn't answer
+typedef struct {
+    uint8_t display;            // 1 to REPLAY_DISPLAY_COUNT
+    uint64_t from_us;
+    uint64_t to_us;
+    uint8_t fault;              // As returned by the emulator, see Ssd1306Emulator::fault
+} DisplayFault;
+
+static DisplayFault displayFaults[REPLAY_MAX_DISPLAY_FAULTS];
+static uint8_t displayFaultCount = 0;
+
+// The drive log, NULL for none: the block being filled, and the next record of the ring
+static FILE *driveLog = NULL;
+static uint8_t logPage[BLACK_BOX_PAGE_SIZE];
+static RecordBlock logBlock;
+static uint32_t logNext = 0;
+static uint32_t logRecords = 0;
+static uint32_t logBlocks = 0;
+
+// Load a CSV trace
+// path: The trace file
+// Return: True if at least one row was loaded
+static bool loadTrace(const char *path)
+{
+    char line[512];
+    int columns[16];
+    int columnCount = 0;
+    FILE *file = fopen(path, "r");
+
+    if (!file) {
+        perror(path);
+        return false;
+    }
+
+    // Header: map each CSV column to a trace column, -1 for 'ms', -2 for unknown
+    if (!fgets(line, sizeof(line), file)) {
+        fclose(file);
+        return false;
+    }
+    for (char *name = strtok(line, ",\r\n"); name && columnCount < 16; name = strtok(NULL, ",\r\n")) {
+        columns[columnCount] = -2;
+        if (strcmp(name, "ms") == 0)
+            columns[columnCount] = -1;
+        for (int i = 0; i < TRACE_COLUMN_COUNT; i++) {
+            if (strcmp(name, traceColumnNames[i]) == 0)
+                columns[columnCount] = i;
+        }
+        columnCount++;
+    }
+
+    while (fgets(line, sizeof(line), file)) {
+        TraceRow row;
+        int column = 0;
+
+        memset(&row, 0, sizeof(row));
+        for (char *field = strtok(line, ",\r\n"); field && column < columnCount; field = strtok(NULL, ",\r\n"), column++) {
+            if (columns[column] == -1)
+                row.us = (uint64_t)(strtod(field, NULL) * 1000.0);
+            else if (columns[column] >= 0)
+                row.values[columns[column]] = (uint32_t)atol(field);
+        }
+        trace.push_back(row);
+    }
+
+    fclose(file);
+    return !trace.empty();
+}
+
+// Get the trace row holding at the specified time
+static const TraceRow &traceRowAt(uint64_t us)
+{
+    // Time only moves forward, so a cursor is enough
+    while (traceCursor + 1 < trace.size() && trace[traceCursor + 1].us <= us)
+        traceCursor++;
+    return trace[traceCursor];
+}
+
+// ADC counts of a thermistor input, from the thermistor resistance and the selected reference
+// ohms: The thermistor resistance
+// selectPin: The reference select output (LOW selects the high reference)
+// high, low: The two reference resistor values
+static int thermistorCounts(uint32_t ohms, uint8_t selectPin, float high, float low)
+{
+    float reference = hostPinState(selectPin) == LOW ? high : low;
+
+    return (int)(1023.0 * reference / (reference + ohms) + 0.5);
+}
+
+static int onAnalogRead(uint8_t pin, uint64_t nowUs)
+{
+    const TraceRow &row = traceRowAt(nowUs);
+
+    switch (pin) {
+        case OIL_ANALOG_INPUT_PIN:
+            if (row.values[TRACE_OIL_OHMS])
+                return thermistorCounts(row.values[TRACE_OIL_OHMS], OIL_THERMISTOR_REFERENCE_SELECT_OUTPUT_PIN,
+                    OIL_THERMISTOR_RESISTOR_REFERENCE_HIGH, OIL_THERMISTOR_RESISTOR_REFERENCE_LOW);
+            return row.values[TRACE_OIL_TEMP];
+        case COOLANT_ANALOG_INPUT_PIN:
+            if (row.values[TRACE_COOLANT_OHMS])
+                return thermistorCounts(row.values[TRACE_COOLANT_OHMS], COOLANT_THERMISTOR_REFERENCE_SELECT_OUTPUT_PIN,
+                    COOL_THERMISTOR_RESISTOR_REFERENCE_HIGH, COOL_THERMISTOR_RESISTOR_REFERENCE_LOW);
+            return row.values[TRACE_COOLANT_TEMP];
+        case OIL_PSI_ANALOG_INPUT_PIN:
+            return row.values[TRACE_OIL_PSI];
+        case VOLTAGE_ANALOG_INPUT_PIN:
+            return row.values[TRACE_VOLTAGE];
+        case ILLUMINATION_ANALOG_INPUT_PIN:
+            return row.values[TRACE_ILLUMINATION];
+        default:
+            return 0;
+    }
+}
+
+static int onDigitalRead(uint8_t pin, uint64_t nowUs)
+{
+    switch (pin) {
+        case HALL_EFFECT_SENSOR_INPUT_PIN:
+            return traceRowAt(nowUs).values[TRACE_HALL] ? HIGH : LOW;
+        case TEMPERATURE_UNIT_SELECTOR_INPUT_PIN:
+            // The jumpers pull the inputs low
+            return fahrenheitJumper ? LOW : HIGH;
+        case PRESSURE_UNIT_SELECTOR_INPUT_PIN:
+            return barJumper ? LOW : HIGH;
+        default:
+            return HIGH;
+    }
+}
+
+static void onDigitalWrite(uint8_t pin, uint8_t value, uint64_t nowUs)
+{
+    if (pin == WARNING_LED_OUTPUT_PIN) {
+        fprintf(timeline, "%.3f,alert,led,%u\n", nowUs / 1000.0, value);
+        if (value) {
+            alertCount++;
+            alertStartUs = nowUs;
+            if (firstAlertUs == 0)
+                firstAlertUs = nowUs;
+        } else {
+            alertTotalUs += nowUs - alertStartUs;
+        }
+    } else if (pin == ALERT_BUZZER_OUTPUT_PIN) {
+        fprintf(timeline, "%.3f,alert,buzzer,%u\n", nowUs / 1000.0, value);
+    }
+}
+
+// Print a displayed value change on the timeline
+// The firmware invalidates the cached values (__FLT_MIN__) to force a redraw after a fault
+static void reportDisplayed(const char *name, float value, float &previous)
+{
+    if (value == previous)
+        return;
+    previous = value;
+    if (value == __FLT_MIN__) {
+        fprintf(timeline, "%.3f,display,%s,-\n", hostMicros64() / 1000.0, name);
+    } else {
+        fprintf(timeline, "%.3f,display,%s,%.2f\n", hostMicros64() / 1000.0, name, value);
+    }
+}
+
+// Print the alert events started since the last call on the timeline, with their latency
+static void reportAlertEvents()
+{
+    AlertEvent event;
+
+    for (; alertEventSequence < UINT32_MAX; alertEventSequence++) {
+        if (!getAlertEvent(alertEventSequence, event)) {
+            AlertStats stats;
+            getAlertStats(stats);
+            if (alertEventSequence >= stats.events)
+                break;
+            fprintf(timeline, "%.3f,alert_lost,-,%u\n", hostMicros64() / 1000.0, alertEventSequence);
+            continue;
+        }
+        fprintf(timeline, "%.3f,alert_%s,%s,%u\n", (event.sampled_us + event.latency_us) / 1000.0,
+            alertReasonNames[event.reason], event.channel < gauge_channel_count ? gauge_channels[event.channel].name : "-",
+            event.latency_us);
+    }
+}
+
+// Stop running the loop, as if it were stuck, until the watchdog resets the firmware, then run
+// setup() again as the Teensy would. On the host, the whole RAM survives the reset, not only the
+// state saved for a warm restart: only what setup() initialises starts again.
+// endUs: The end of the trace, the firmware stays stuck until then without the watchdog
+// resetUs: Receives the time of the reset
+// Return: True if the firmware was reset
+static bool hangUntilWatchdog(uint64_t endUs, uint64_t &resetUs)
+{
+    AlertStats stats;
+
+    fprintf(timeline, "%.3f,hang,-,-\n", hostMicros64() / 1000.0);
+    while (hostMicros64() < endUs) {
+        hostAdvanceTime(1000);
+        reportAlertEvents();
+        if (hostWatchdogRunning && millis() - hostWatchdogFedMs >= WATCHDOG_TIMEOUT_MS) {
+            resetUs = hostMicros64();
+            fprintf(timeline, "%.3f,reset,-,watchdog\n", resetUs / 1000.0);
+            hostWatchdogRunning = false;
+            hostResetCause = RESET_CAUSE_WATCHDOG;
+            setup();
+            fprintf(timeline, "%.3f,restart,-,%s\n", hostMicros64() / 1000.0, warm_start ? "warm" : "cold");
+
+            // A warm restart takes the alert events back to the last save
+            getAlertStats(stats);
+            alertEventSequence = stats.events;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Print the read time profile of a gauge channel, in virtual time
+static void reportChannel(const GaugeChannel &channel, const GaugeChannelState &state)
+{
+    fprintf(stderr, "channel %-15s %u reads, %.0f us average, %u us max\n", channel.name, state.reads,
+        state.reads ? (double)state.read_us_total / state.reads : 0.0, state.read_us_max);
+}
+
+// Save a display frame, called by the emulator at the end of each flush
+static void onPanelFlush(Ssd1306Emulator &panel, void *context)
+{
+    char path[512];
+
+    snprintf(path, sizeof(path), "%s/d%d_%010.3f.pbm", framesDirectory, (int)(intptr_t)context, hostMicros64() / 1000.0);
+    if (!panel.savePbm(path))
+        perror(path);
+}
+
+// Parse a --display-fault argument: <display>,<from_ms>,<to_ms>,<nack|hang>
+// Return: False if the argument is invalid or there are too many faults
+static bool parseDisplayFault(const char *argument)
+{
+    DisplayFault &fault = displayFaults[displayFaultCount];
+    unsigned display;
+    double fromMs, toMs;
+    char type[8];
+
+    if (displayFaultCount >= REPLAY_MAX_DISPLAY_FAULTS)
+        return false;
+    if (sscanf(argument, "%u,%lf,%lf,%7s", &display, &fromMs, &toMs, type) != 4 || display < 1 || display > REPLAY_DISPLAY_COUNT)
+        return false;
+    if (strcmp(type, "nack") == 0) {
+        fault.fault = 2;
+    } else if (strcmp(type, "hang") == 0) {
+        fault.fault = 4;
+    } else {
+        return false;
+    }
+    fault.display = display;
+    fault.from_us = (uint64_t)(fromMs * 1000.0);
+    fault.to_us = (uint64_t)(toMs * 1000.0);
+    displayFaultCount++;
+    return true;
+}
+
+// Set the simulated fault of each display for the current time, and report changes on the timeline
+static void applyDisplayFaults()
+{
+    uint64_t now = hostMicros64();
+
+    for (uint8_t display = 1; display <= REPLAY_DISPLAY_COUNT; display++) {
+        Ssd1306Emulator &panel = panels[display - 1];
+        uint8_t fault = 0;
+
+        for (uint8_t i = 0; i < displayFaultCount; i++) {
+            if (displayFaults[i].display == display && now >= displayFaults[i].from_us && now < displayFaults[i].to_us)
+                fault = displayFaults[i].fault;
+        }
+        if (fault != panel.fault) {
+            panel.fault = fault;
+            fprintf(timeline, "%.3f,fault,display_%u,%u\n", now / 1000.0, display, fault);
+        }
+    }
+}
+
+// Print the bus usage, state and scheduling of a firmware display panel
+static void reportPanel(const DisplayPanel &displayPanel)
+{
+    const DisplayBus &bus = displayPanel.bus;
+    uint8_t display = bus.wire->busNumber() + (bus.address == DISPLAY_ADDRESS_SECONDARY ? 3 : 0);
+    const Ssd1306Emulator &panel = panels[display];
+    char name[16];
+
+    snprintf(name, sizeof(name), "display %u", display + 1);
+    fprintf(stderr, "%s:         %u flushes, %.0f bytes and %.1f transactions per flush, contrast %u, %s\n",
+        name, panel.flushes,
+        panel.flushes ? (double)panel.total_bytes / panel.flushes : 0.0,
+        panel.flushes ? (double)panel.total_transactions / panel.flushes : 0.0,
+        panel.contrast(), panel.isOn() ? "on" : "off");
+    fprintf(stderr, "%s bus:     %u transfers (longest %.2f ms), %u nacks, %u timeouts, %u skipped, %s\n",
+        name, bus.transfers, bus.transfer_us_max / 1000.0, bus.nacks, bus.timeouts, bus.skipped, bus.up ? "up" : "down");
+    fprintf(stderr, "%s recovery: %u of %u attempts (longest %.2f ms), %.1f s down (longest %.1f s)\n",
+        name, bus.recoveries, bus.recovery_attempts, bus.recovery_us_max / 1000.0,
+        bus.down_ms_total / 1e3, bus.down_ms_max / 1e3);
+    fprintf(stderr, "%s pages:   %u sent, %u unchanged, %u deferrals, longest wait %u ms\n",
+        name, displayPanel.pages_sent, displayPanel.pages_unchanged, displayPanel.deferrals, displayPanel.wait_ms_max);
+}
+
+// Host CPU time, in nanoseconds
+static uint64_t cpuNanos()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+// Write the block being filled to the drive log, and start the next one
+static void flushDriveLog()
+{
+    if (logBlock.position) {
+        fwrite(logPage, 1, sizeof(logPage), driveLog);
+        logBlocks++;
+    }
+    memset(logPage, 0xFF, sizeof(logPage));
+    startRecordEncoding(logBlock, logPage, sizeof(logPage));
+}
+
+// Add the records written into the ring since the last loop to the drive log
+static void appendDriveLog()
+{
+    BlackBoxRecord records[64];
+    uint32_t count;
+
+    while ((count = readBlackBoxRecords(logNext, records, 64)) > 0) {
+        for (uint32_t i = 0; i < count; i++) {
+            if (!encodeRecord(logBlock, records[i])) {
+                flushDriveLog();
+                encodeRecord(logBlock, records[i]);
+            }
+        }
+        logRecords += count;
+    }
+}
+
+// Load the black box flash from an image file, if it exists. Without one, the flash is blank.
+static void loadBlackBox(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+
+    memset(blackBoxFlash, 0xFF, sizeof(blackBoxFlash));
+    if (!file)
+        return;
+    if (fread(blackBoxFlash, 1, sizeof(blackBoxFlash), file) != sizeof(blackBoxFlash))
+        fprintf(stderr, "%s: short black box image, the rest reads blank\n", path);
+    fclose(file);
+}
+
+// Save the black box flash to an image file
+static bool saveBlackBox(const char *path)
+{
+    FILE *file = fopen(path, "wb");
+    bool saved;
+
+    if (!file) {
+        perror(path);
+        return false;
+    }
+    saved = fwrite(blackBoxFlash, 1, sizeof(blackBoxFlash), file) == sizeof(blackBoxFlash);
+    fclose(file);
+    return saved;
+}
+
+int runReplay(int argc, char **argv)
+{
+    const char *path = NULL;
+    const char *blackBoxPath = NULL;
+    HostIoHooks hooks;
+    float shown[GAUGE_CHANNEL_MAX] = {0};
+    SensorSnapshot snapshot;
+    uint64_t endUs;
+    uint64_t loopStartUs;
+    uint64_t loopMaxUs = 0;
+    uint64_t cpuStart, cpuLoop, cpuTotal = 0, cpuMax = 0;
+    uint32_t loops = 0;
+    time_t wallStart;
+    AlertStats alertStats;
+    BlackBoxStats blackBoxStats;
+    ClockStats clockStats;
+    uint8_t powerState = POWER_STATE_RUNNING;
+    uint64_t hangUs = 0;
+    uint64_t resetUs = 0;
+    uint64_t setupEndUs = 0;
+    uint64_t resumedUs = 0;
+
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--fahrenheit") == 0) {
+            fahrenheitJumper = true;
+        } else if (strcmp(argv[i], "--bar") == 0) {
+            barJumper = true;
+        } else if (strcmp(argv[i], "--display-fault") == 0 && i + 1 < argc) {
+            if (!parseDisplayFault(argv[++i])) {
+                fprintf(stderr, "Invalid display fault: %s\n", argv[i]);
+                return 2;
+            }
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            framesDirectory = argv[++i];
+        } else if (strcmp(argv[i], "--black-box") == 0 && i + 1 < argc) {
+            blackBoxPath = argv[++i];
+        } else if (strcmp(argv[i], "--serial") == 0 && i + 1 < argc) {
+            hostSerialInput(argv[++i]);
+            hostSerialInput("\n");
+        } else if (strcmp(argv[i], "--log") == 0 && i + 1 < argc) {
+            driveLog = fopen(argv[++i], "wb");
+            if (!driveLog) {
+                perror(argv[i]);
+                return 1;
+            }
+            flushDriveLog();
+        } else if (strcmp(argv[i], "--die-temp") == 0 && i + 1 < argc) {
+            hostDieCelsius = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--hang") == 0 && i + 1 < argc) {
+            hangUs = (uint64_t)(atof(argv[++i]) * 1000);
+        } else if (strcmp(argv[i], "--timeline") == 0 && i + 1 < argc) {
+            timeline = fopen(argv[++i], "w");
+            if (!timeline) {
+                perror(argv[i]);
+                return 1;
+            }
+        } else {
+            path = argv[i];
+        }
+    }
+
+    if (!path) {
+        fprintf(stderr, "Usage: replay <trace.csv> [--fahrenheit] [--bar] [--timeline <out.csv>] [--frames <directory>]\n"
+            "              [--display-fault <display>,<from_ms>,<to_ms>,<nack|hang>]...\n"
+            "              [--black-box <image>] [--serial <command>]... [--log <file>] [--die-temp <celsius>]\n"
+            "              [--hang <ms>]\n");
+        return 2;
+    }
+    if (!loadTrace(path))
+        return 1;
+
+    hooks.analogRead = onAnalogRead;
+    hooks.digitalRead = onDigitalRead;
+    hooks.digitalWrite = onDigitalWrite;
+    hostSetIoHooks(hooks);
+
+    if (framesDirectory)
+        mkdir(framesDirectory, 0755);
+    for (uint8_t i = 0; i < REPLAY_DISPLAY_COUNT; i++) {
+        displayBuses[i % 3]->attach(i < 3 ? DISPLAY_ADDRESS_PRIMARY : DISPLAY_ADDRESS_SECONDARY, &panels[i]);
+        if (framesDirectory)
+            panels[i].onFlush(onPanelFlush, (void *)(intptr_t)(i + 1));
+    }
+
+    fprintf(timeline, "ms,event,channel,value\n");
+    wallStart = time(NULL);
+    endUs = trace.back().us;
+
+    if (blackBoxPath)
+        loadBlackBox(blackBoxPath);
+    applyDisplayFaults();
+    setup();
+
+    while (hostMicros64() < endUs) {
+        if (hangUs && hostMicros64() >= hangUs) {
+            hangUs = 0;
+            if (!hangUntilWatchdog(endUs, resetUs))
+                break;
+            setupEndUs = hostMicros64();
+        }
+        applyDisplayFaults();
+        loopStartUs = hostMicros64();
+        cpuStart = cpuNanos();
+        loop();
+        cpuLoop = cpuNanos() - cpuStart;
+
+        loops++;
+        cpuTotal += cpuLoop;
+        if (cpuLoop > cpuMax)
+            cpuMax = cpuLoop;
+        if (hostMicros64() - loopStartUs > loopMaxUs)
+            loopMaxUs = hostMicros64() - loopStartUs;
+
+        // The gauges on a panel show the last valid reading of the snapshot
+        if (readSensorSnapshot(snapshot)) {
+            for (uint8_t i = 0; i < snapshot.count; i++) {
+                if (gauge_channels[i].draw && snapshot.channels[i].valid)
+                    reportDisplayed(gauge_channels[i].name, snapshot.channels[i].value, shown[i]);
+            }
+        }
+        reportAlertEvents();
+        if (power_state.state != powerState) {
+            powerState = power_state.state;
+            fprintf(timeline, "%.3f,power,-,%s\n", hostMicros64() / 1000.0, getPowerStateName(powerState));
+        }
+        if (driveLog)
+            appendDriveLog();
+        // The readings are back with the last acquisition of the first pass after the reset
+        if (resetUs && !resumedUs) {
+            for (uint8_t i = 0; i < gauge_channel_count; i++) {
+                uint64_t sampledUs = resetUs + (uint32_t)(gauge_channel_states[i].sampled_us - (uint32_t)resetUs);
+                resumedUs = max(resumedUs, sampledUs);
+            }
+        }
+    }
+
+    if (hostPinState(WARNING_LED_OUTPUT_PIN))
+        alertTotalUs += hostMicros64() - alertStartUs;
+    if (timeline != stdout)
+        fclose(timeline);
+    if (blackBoxPath && !saveBlackBox(blackBoxPath))
+        return 1;
+    if (driveLog) {
+        flushDriveLog();
+        fclose(driveLog);
+    }
+
+    fprintf(stderr, "virtual time:      %.1f s\n", hostMicros64() / 1e6);
+    fprintf(stderr, "host cpu time:     %.3f s (%.0fx real time, %ld s wall)\n",
+        cpuTotal / 1e9, cpuTotal ? (hostMicros64() * 1000.0) / cpuTotal : 0.0, (long)(time(NULL) - wallStart));
+    fprintf(stderr, "loops:             %u, longest %.1f ms virtual\n", loops, loopMaxUs / 1000.0);
+    fprintf(stderr, "cpu per loop:      %.1f us average, %.1f us max\n",
+        loops ? cpuTotal / 1000.0 / loops : 0.0, cpuMax / 1000.0);
+    fprintf(stderr, "alerts:            %u, first at %.3f s, %.1f s in alert\n",
+        alertCount, firstAlertUs / 1e6, alertTotalUs / 1e6);
+    getAlertStats(alertStats);
+    fprintf(stderr, "alert latency:     %.1f us average, %.1f us max (bound %u us + conversion), %u timer ticks\n",
+        alertStats.events ? (double)alertStats.latency_total_us / alertStats.events : 0.0,
+        (double)alertStats.latency_max_us, ALERT_PERIOD_US, alertStats.ticks);
+    #if ADC_COMPARE_ALARMS
+    AdcCompareStats compareStats;
+    getAdcCompareStats(compareStats);
+    fprintf(stderr, "compare alarms:    %u, %u dwells (%u idle)\n",
+        compareStats.alarms, compareStats.dwells, compareStats.idle_dwells);
+    #endif
+    fprintf(stderr, "i2c bus 0:         %u transactions, %llu bytes, %.1f s busy\n",
+        Wire.transactions, (unsigned long long)Wire.bytes, Wire.busy_us / 1e6);
+    fprintf(stderr, "i2c bus 1:         %u transactions, %llu bytes, %.1f s busy\n",
+        Wire1.transactions, (unsigned long long)Wire1.bytes, Wire1.busy_us / 1e6);
+    fprintf(stderr, "display frames:    %u, longest %.1f ms of bus time (budget %.1f ms), %u over budget\n",
+        display_manager.frames, display_manager.frame_us_max / 1000.0, display_manager.budget_us / 1000.0,
+        display_manager.frames_over_budget);
+    for (uint8_t i = 0; i < display_manager.count; i++)
+        reportPanel(display_manager.panels[i]);
+    getBlackBoxStats(blackBoxStats);
+    fprintf(stderr, "black box:         %u records, %u dropped, %u events (%u missed), %u saved, %u pages written, %u sectors erased\n",
+        blackBoxStats.records, blackBoxStats.dropped, blackBoxStats.triggers, blackBoxStats.missed, blackBoxStats.saved,
+        blackBoxStats.pages, blackBoxStats.sectors);
+    if (blackBoxStats.encoded) {
+        fprintf(stderr, "black box saved:   %u records in %u bytes, %.1f per record (%zu in RAM)\n", blackBoxStats.encoded,
+            blackBoxStats.bytes, (float)blackBoxStats.bytes / blackBoxStats.encoded, sizeof(BlackBoxRecord));
+    }
+    if (driveLog) {
+        fprintf(stderr, "drive log:         %u records in %u blocks of %u bytes\n", logRecords, logBlocks,
+            BLACK_BOX_PAGE_SIZE);
+    }
+    getClockStats(clockStats);
+    fprintf(stderr, "cpu clock:         %.1f s at %u MHz, %.1f s at %u MHz, %u switches, %u boosts (%u refused), ~%.0f mA\n",
+        clockStats.high_ms / 1000.0, CLOCK_HIGH_HZ / 1000000, clockStats.low_ms / 1000.0, CLOCK_LOW_HZ / 1000000,
+        clockStats.switches, clockStats.boosts, clockStats.refused, clockStats.average_ma);
+    fprintf(stderr, "die temperature:   %.1f C max, %u throttles\n", clockStats.die_max_celsius, clockStats.throttles);
+    fprintf(stderr, "power states:      running %.1f s, cranking %.1f s, off %.1f s, %u starts\n",
+        power_state.state_ms[POWER_STATE_RUNNING] / 1000.0, power_state.state_ms[POWER_STATE_CRANKING] / 1000.0,
+        power_state.state_ms[POWER_STATE_OFF] / 1000.0, power_state.cranks);
+    if (power_state.cranks) {
+        fprintf(stderr, "last start:        %u ms cranking, supply down to %.2f V, engine running after %u ms\n",
+            power_state.crank_ms, power_state.crank_min_volts, power_state.run_after_ms);
+    }
+    if (resetUs) {
+        fprintf(stderr, "watchdog reset:    %s restart, setup %.1f ms, readings back %.1f ms after the reset\n",
+            warm_start ? "warm" : "cold", (setupEndUs - resetUs) / 1000.0, (resumedUs - resetUs) / 1000.0);
+    }
+    for (uint8_t i = 0; i < gauge_channel_count; i++)
+        reportChannel(gauge_channels[i], gauge_channel_states[i]);
+
+    return 0;
+}
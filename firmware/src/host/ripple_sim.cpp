@@ -0,0 +1,221 @@
+/*
+ * Charging ripple host tool for the RX-8 Ashtray Gauges project.
+ * ripple-sim runs the ripple analysis of ripple.h on synthetic supply voltages: a three phase
+ * bridge rectifier, healthy or with a failed diode or phase, under the battery (the ripple is
+ * scaled to a typical RMS), with some noise, quantised to the 12 bit counts of the burst through
+ * the supply divider. For each case, it prints the RMS, peak to peak and dominant frequency
+ * found against the real ones, whether it's a warning, and the time the analysis takes on the
+ * host. It fails if the RMS or the frequency is off, or the warning is wrong.
+ * With ENABLE_RIPPLE_ANALYSIS set, one more case goes through the firmware burst sampling.
+ * Usage: ripple-sim [alternator_hz]
+ *   alternator_hz: Electrical frequency of the alternator, default 200Hz (about 1500rpm engine)
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <Arduino.h>
+#include "host_tools.h"
+#include "host_sim.h"
+#include "../coolant_monitor.h"
+#include "../ripple.h"
+
+// Supply voltage of one 12 bit count, through the divider, as in setup()
+#define RIPPLE_SIM_VOLTS_PER_COUNT ((MAX_ANALOGUE_VOLTAGE / RIPPLE_ADC_MAX) / (VOLTAGE_DIVIDER_R2 / (VOLTAGE_DIVIDER_R1 + VOLTAGE_DIVIDER_R2)))
+
+// Average supply voltage, and noise on it (peak to peak), in volts
+#define RIPPLE_SIM_VOLTAGE 14.2
+#define RIPPLE_SIM_NOISE 0.02
+
+// Samples to find the shape of the rectified waveform over one period
+#define RIPPLE_SIM_SHAPE_STEPS 3600
+
+// Rectifier faults
+typedef enum {
+    RECTIFIER_HEALTHY,
+    RECTIFIER_OPEN_DIODE,       // One positive diode open
+    RECTIFIER_OPEN_PHASE,       // One phase winding open
+} RectifierFault;
+
+// One case: a rectifier, the alternator electrical frequency as a multiple of the one given, and
+// the ripple RMS under the battery
+typedef struct {
+    const char *name;
+    RectifierFault fault;
+    double speed;
+    double rms;
+    double frequency;           // Expected dominant frequency, as a multiple of the alternator's
+    bool warning;               // Expected warning
+} RippleCase;
+
+static const RippleCase rippleCases[] = {
+    {"healthy, idle", RECTIFIER_HEALTHY, 0.5, 0.03, 6, false},
+    {"healthy", RECTIFIER_HEALTHY, 1, 0.05, 6, false},
+    {"healthy, high rpm", RECTIFIER_HEALTHY, 2.5, 0.08, 6, false},
+    {"open diode", RECTIFIER_OPEN_DIODE, 1, 0.9, 1, true},
+    {"open phase", RECTIFIER_OPEN_PHASE, 1, 0.7, 2, true},
+};
+
+// Output of the bridge, before the battery, for a phase angle
+// fault: The rectifier fault
+// angle: The phase angle of the first phase, in radians
+static double rectifierOutput(RectifierFault fault, double angle)
+{
+    double phases[3], high = -2, low = 2;
+
+    for (int i = 0; i < 3; i++)
+        phases[i] = sin(angle - i * 2 * M_PI / 3);
+
+    // The output is the highest phase through its positive diode, over the lowest through its
+    // negative one. An open phase takes no part, an open diode only leaves its negative half.
+    for (int i = 0; i < 3; i++) {
+        if (fault == RECTIFIER_OPEN_PHASE && i == 0)
+            continue;
+        if (!(fault == RECTIFIER_OPEN_DIODE && i == 0))
+            high = max(high, phases[i]);
+        low = min(low, phases[i]);
+    }
+    return high - low;
+}
+
+// Supply voltage waveform of a case: the output of the bridge, scaled so its ripple has the
+// RMS of the case
+typedef struct {
+    RectifierFault fault;
+    double frequency;           // Alternator electrical frequency, in Hz
+    double mean;                // Of the bridge output over one period
+    double scale;               // From the bridge output to the ripple
+} RippleWaveform;
+
+static void initWaveform(RippleWaveform &waveform, RectifierFault fault, double frequency, double rms)
+{
+    double sum = 0, squares = 0, value;
+
+    for (int i = 0; i < RIPPLE_SIM_SHAPE_STEPS; i++) {
+        value = rectifierOutput(fault, 2 * M_PI * i / RIPPLE_SIM_SHAPE_STEPS);
+        sum += value;
+        squares += value * value;
+    }
+    waveform.fault = fault;
+    waveform.frequency = frequency;
+    waveform.mean = sum / RIPPLE_SIM_SHAPE_STEPS;
+    waveform.scale = rms / sqrt(squares / RIPPLE_SIM_SHAPE_STEPS - waveform.mean * waveform.mean);
+}
+
+// Supply voltage at a time, without the noise
+static double waveformVolts(const RippleWaveform &waveform, double seconds)
+{
+    return RIPPLE_SIM_VOLTAGE + waveform.scale * (rectifierOutput(waveform.fault, 2 * M_PI * waveform.frequency * seconds) - waveform.mean);
+}
+
+#if ENABLE_RIPPLE_ANALYSIS
+// Waveform read by the firmware burst, through the analogue input hook
+static RippleWaveform hookWaveform;
+
+static int readHookWaveform(uint8_t pin, uint64_t nowUs)
+{
+    double volts = waveformVolts(hookWaveform, nowUs / 1e6) * (VOLTAGE_DIVIDER_R2 / (VOLTAGE_DIVIDER_R1 + VOLTAGE_DIVIDER_R2));
+
+    return min(max((int)lround(volts / MAX_ANALOGUE_VOLTAGE * 1023), 0), 1023);
+}
+#endif
+
+// Compare an analysis with the waveform and the expected outcome
+// Return: The number of failures
+static uint32_t checkAnalysis(const char *name, const RippleAnalysis &analysis, double rms, double frequency, bool warning, double elapsedUs)
+{
+    const double binHz = (double)RIPPLE_SAMPLE_HZ / RIPPLE_SAMPLES;
+    bool warned = analysis.rms >= RIPPLE_WARNING_VOLTS;
+    uint32_t failures = 0;
+
+    printf("%-20s %6.3f V rms (real %6.3f), %5.3f V p-p, %7.1f Hz (real %7.1f) %5.3f V, %s",
+        name, analysis.rms, rms, analysis.peak_to_peak, analysis.frequency, frequency, analysis.amplitude,
+        warned ? "warning" : "ok");
+    if (elapsedUs > 0)
+        printf(", %.0f us", elapsedUs);
+    printf("\n");
+
+    // Within 5%, plus the quantisation and the noise
+    if (fabs(analysis.rms - rms) > 0.05 * rms + 2 * RIPPLE_SIM_VOLTS_PER_COUNT + RIPPLE_SIM_NOISE / 2) {
+        printf("  RMS off\n");
+        failures++;
+    }
+    if (fabs(analysis.frequency - frequency) > binHz) {
+        printf("  frequency off\n");
+        failures++;
+    }
+    if (warned != warning) {
+        printf("  warning wrong\n");
+        failures++;
+    }
+    return failures;
+}
+
+int runRippleSim(int argc, char **argv)
+{
+    double alternatorHz = argc > 0 ? atof(argv[0]) : 200;
+    uint16_t samples[RIPPLE_SAMPLES];
+    RippleAnalysis analysis;
+    uint32_t failures = 0;
+
+    if (alternatorHz <= 0) {
+        fprintf(stderr, "Usage: ripple-sim [alternator_hz]\n");
+        return 2;
+    }
+
+    printf("%d samples at %d Hz, warning at %.2f V rms, %.1f mV per count\n", RIPPLE_SAMPLES, RIPPLE_SAMPLE_HZ,
+        RIPPLE_WARNING_VOLTS, RIPPLE_SIM_VOLTS_PER_COUNT * 1000);
+    srand(1);
+    for (size_t c = 0; c < sizeof(rippleCases) / sizeof(RippleCase); c++) {
+        const RippleCase &rippleCase = rippleCases[c];
+        RippleWaveform waveform;
+        double volts, sum = 0, squares = 0;
+        double frequency;
+
+        initWaveform(waveform, rippleCase.fault, alternatorHz * rippleCase.speed, rippleCase.rms);
+
+        // Quantised samples, the real RMS over the same burst
+        for (int i = 0; i < RIPPLE_SAMPLES; i++) {
+            volts = waveformVolts(waveform, (double)i / RIPPLE_SAMPLE_HZ) + RIPPLE_SIM_NOISE * ((double)rand() / RAND_MAX - 0.5);
+            samples[i] = min(max((int)lround(volts / RIPPLE_SIM_VOLTS_PER_COUNT), 0), RIPPLE_ADC_MAX);
+            sum += volts;
+            squares += volts * volts;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        analyseRipple(samples, RIPPLE_SAMPLES, RIPPLE_SAMPLE_HZ, RIPPLE_SIM_VOLTS_PER_COUNT, analysis);
+        auto end = std::chrono::steady_clock::now();
+
+        // A frequency past the Nyquist frequency folds back
+        frequency = fmod(waveform.frequency * rippleCase.frequency, RIPPLE_SAMPLE_HZ);
+        if (frequency > RIPPLE_SAMPLE_HZ / 2)
+            frequency = RIPPLE_SAMPLE_HZ - frequency;
+        failures += checkAnalysis(rippleCase.name, analysis,
+            sqrt(max(squares / RIPPLE_SAMPLES - (sum / RIPPLE_SAMPLES) * (sum / RIPPLE_SAMPLES), 0.0)), frequency,
+            rippleCase.warning, std::chrono::duration<double, std::micro>(end - start).count());
+    }
+
+    #if ENABLE_RIPPLE_ANALYSIS
+    // The open diode again, sampled by the firmware burst at 10 bits
+    {
+        HostIoHooks hooks = {readHookWaveform, NULL, NULL};
+
+        initWaveform(hookWaveform, RECTIFIER_OPEN_DIODE, alternatorHz, 0.9);
+        hostSetIoHooks(hooks);
+        initRipple(VOLTAGE_ANALOG_INPUT_PIN, RIPPLE_SIM_VOLTS_PER_COUNT);
+        serviceRipple(analysis);
+        hostAdvanceTime(1000000 * (uint64_t)(RIPPLE_SAMPLES + 1) / RIPPLE_SAMPLE_HZ);
+        if (!serviceRipple(analysis)) {
+            printf("firmware burst not complete\n");
+            failures++;
+        } else {
+            failures += checkAnalysis("open diode, burst", analysis, 0.9, alternatorHz, true, 0);
+        }
+    }
+    #endif
+
+    printf("%u failure(s)\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,59 @@
+/*
+ * SocketCAN helpers for the RX-8 Ashtray Gauges host tools.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <net/if.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "host_tools.h"
+
+#define MAX_SOCKET_FILTERS 16
+
+int openCanSocket(const char *ifname, const uint32_t *ids, uint8_t count)
+{
+    struct can_filter filters[MAX_SOCKET_FILTERS];
+    struct sockaddr_can addr;
+    struct ifreq ifr;
+    int sock;
+
+    sock = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+    if (sock < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    if (count > 0) {
+        if (count > MAX_SOCKET_FILTERS)
+            count = MAX_SOCKET_FILTERS;
+        for (uint8_t i = 0; i < count; i++) {
+            filters[i].can_id = ids[i];
+            filters[i].can_mask = CAN_SFF_MASK | CAN_EFF_FLAG | CAN_RTR_FLAG;
+        }
+        setsockopt(sock, SOL_CAN_RAW, CAN_RAW_FILTER, filters, sizeof(struct can_filter) * count);
+    }
+
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+    if (ioctl(sock, SIOCGIFINDEX, &ifr) < 0) {
+        perror(ifname);
+        close(sock);
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.can_family = AF_CAN;
+    addr.can_ifindex = ifr.ifr_ifindex;
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("bind");
+        close(sock);
+        return -1;
+    }
+
+    return sock;
+}
@@ -0,0 +1,441 @@
+/*
+ * SSD1306 emulator for the RX-8 Ashtray Gauges host tools, see ssd1306_emulator.h.
+ * The decoding follows the SSD1306 datasheet (Solomon Systech, rev 1.1), I2C interface.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include "ssd1306_emulator.h"
+
+// I2C control byte: Co (continuation) and D/C# bits
+#define CONTROL_CONTINUATION 0x80
+#define CONTROL_DATA 0x40
+
+Ssd1306Emulator::Ssd1306Emulator(uint8_t width, uint8_t height)
+    : panel_width(width), panel_height(height)
+{
+    memset(ram, 0, sizeof(ram));
+    memset(&last_flush, 0, sizeof(last_flush));
+    memset(&pending_flush, 0, sizeof(pending_flush));
+}
+
+void Ssd1306Emulator::onFlush(void (*callback)(Ssd1306Emulator &emulator, void *context), void *context)
+{
+    flush_callback = callback;
+    flush_context = context;
+}
+
+void Ssd1306Emulator::onWrite(const uint8_t *buf, size_t length)
+{
+    size_t i = 0;
+    uint8_t control;
+
+    total_bytes += length + 1;
+    total_transactions++;
+    pending_flush.bytes += length + 1;
+    pending_flush.transactions++;
+
+    // Each control byte with Co set applies to the next byte only, then comes another control byte.
+    // The first control byte with Co cleared applies to every byte left in the transaction.
+    while (i < length) {
+        control = buf[i++];
+        if (control & CONTROL_CONTINUATION) {
+            if (i < length) {
+                if (control & CONTROL_DATA) {
+                    data(buf[i++]);
+                } else {
+                    command(buf[i++]);
+                }
+            }
+        } else {
+            while (i < length) {
+                if (control & CONTROL_DATA) {
+                    data(buf[i++]);
+                } else {
+                    command(buf[i++]);
+                }
+            }
+        }
+    }
+}
+
+// Number of argument bytes following a command byte
+static uint8_t commandArguments(uint8_t value)
+{
+    switch (value) {
+        case 0x20:      // Memory addressing mode
+        case 0x81:      // Contrast
+        case 0x8D:      // Charge pump
+        case 0xA8:      // Multiplex ratio
+        case 0xD3:      // Display offset
+        case 0xD5:      // Clock divide ratio
+        case 0xD6:      // Zoom in
+        case 0xD9:      // Pre-charge period
+        case 0xDA:      // COM pins configuration
+        case 0xDB:      // VCOMH deselect level
+            return 1;
+        case 0x21:      // Column address
+        case 0x22:      // Page address
+        case 0xA3:      // Vertical scroll area
+            return 2;
+        case 0x29:      // Vertical and horizontal scroll setup
+        case 0x2A:
+            return 5;
+        case 0x26:      // Horizontal scroll setup
+        case 0x27:
+            return 6;
+        default:
+            return 0;
+    }
+}
+
+void Ssd1306Emulator::command(uint8_t value)
+{
+    if (arguments_needed > 0) {
+        arguments[arguments_received++] = value;
+        if (arguments_received == arguments_needed) {
+            arguments_needed = 0;
+            execute();
+        }
+        return;
+    }
+
+    pending_command = value;
+    arguments_received = 0;
+    arguments_needed = commandArguments(value);
+    if (arguments_needed == 0)
+        execute();
+}
+
+void Ssd1306Emulator::execute()
+{
+    uint8_t value = pending_command;
+
+    if (value <= 0x0F) {
+        // Lower column start address, page addressing mode
+        column = (column & 0xF0) | value;
+    } else if (value <= 0x1F) {
+        // Higher column start address, page addressing mode
+        column = ((value & 0x07) << 4) | (column & 0x0F);
+    } else if (value >= 0x40 && value <= 0x7F) {
+        start_line = value & 0x3F;
+    } else if (value >= 0xB0 && value <= 0xB7) {
+        // Page start address, page addressing mode
+        page = value & 0x07;
+    } else {
+        switch (value) {
+            case 0x20:
+                addressing_mode = arguments[0] & 0x03;
+                break;
+            case 0x21:
+                column_start = arguments[0] & 0x7F;
+                column_end = arguments[1] & 0x7F;
+                column = column_start;
+                break;
+            case 0x22:
+                page_start = arguments[0] & 0x07;
+                page_end = arguments[1] & 0x07;
+                page = page_start;
+                break;
+            case 0x81:
+                contrast_level = arguments[0];
+                break;
+            case 0xA0:
+            case 0xA1:
+                segment_remap = value & 0x01;
+                break;
+            case 0xA4:
+            case 0xA5:
+                entire_on = value & 0x01;
+                break;
+            case 0xA6:
+            case 0xA7:
+                inverted = value & 0x01;
+                break;
+            case 0xA8:
+                multiplex = arguments[0] & 0x3F;
+                break;
+            case 0xAE:
+            case 0xAF:
+                display_on = value & 0x01;
+                break;
+            case 0xC0:
+            case 0xC8:
+                com_scan_reversed = value & 0x08;
+                break;
+            case 0xD3:
+                display_offset = arguments[0] & 0x3F;
+                break;
+            case 0x26: case 0x27: case 0x29: case 0x2A: case 0x2E: case 0x2F: case 0xA3:
+            case 0x8D: case 0xD5: case 0xD6: case 0xD9: case 0xDA: case 0xDB: case 0xE3:
+                // Scrolling, power and timing settings: no effect on the image we show
+                break;
+            default:
+                unknown_commands++;
+                break;
+        }
+    }
+}
+
+void Ssd1306Emulator::data(uint8_t value)
+{
+    bool wrapped = false;
+
+    ram[page][column] = value;
+    pending_flush.data_bytes++;
+
+    switch (addressing_mode) {
+        case 0:
+            // Horizontal: along the columns, then to the next page
+            if (column++ >= column_end) {
+                column = column_start;
+                if (page++ >= page_end) {
+                    page = page_start;
+                    wrapped = true;
+                }
+            }
+            break;
+        case 1:
+            // Vertical: along the pages, then to the next column
+            if (page++ >= page_end) {
+                page = page_start;
+                if (column++ >= column_end) {
+                    column = column_start;
+                    wrapped = true;
+                }
+            }
+            break;
+        default:
+            // Page: along the columns of the current page only
+            column = (column + 1) & 0x7F;
+            break;
+    }
+
+    if (wrapped) {
+        flushes++;
+        last_flush = pending_flush;
+        memset(&pending_flush, 0, sizeof(pending_flush));
+        if (flush_callback)
+            flush_callback(*this, flush_context);
+    }
+}
+
+bool Ssd1306Emulator::pixel(uint8_t x, uint8_t y) const
+{
+    uint8_t com;
+    uint8_t row;
+    uint8_t ramColumn;
+    bool lit;
+
+    if (!display_on || x >= panel_width || y >= panel_height)
+        return false;
+
+    // The panel is wired so SEGREMAP 1 and COMSCANDEC show the RAM upright
+    com = com_scan_reversed ? y : panel_height - 1 - y;
+    if (com > multiplex)
+        return false;
+    ramColumn = segment_remap ? x : panel_width - 1 - x;
+    row = (com + start_line + display_offset) & 0x3F;
+
+    lit = entire_on || (ram[row / 8][ramColumn] >> (row & 7)) & 0x01;
+    return lit != inverted;
+}
+
+bool Ssd1306Emulator::savePbm(const char *path) const
+{
+    FILE *file = fopen(path, "wb");
+    uint8_t bits;
+
+    if (!file)
+        return false;
+
+    fprintf(file, "P4\n%u %u\n", panel_width, panel_height);
+    for (uint8_t y = 0; y < panel_height; y++) {
+        bits = 0;
+        for (uint8_t x = 0; x < panel_width; x++) {
+            if (pixel(x, y))
+                bits |= 0x80 >> (x & 7);
+            if ((x & 7) == 7 || x == panel_width - 1) {
+                fputc(bits, file);
+                bits = 0;
+            }
+        }
+    }
+
+    return fclose(file) == 0;
+}
+
+// CRC-32 (ISO 3309), as used by the PNG chunks
+static uint32_t crc32Update(uint32_t crc, const uint8_t *buf, size_t length)
+{
+    static uint32_t table[256];
+
+    if (table[1] == 0) {
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+    }
+
+    crc = ~crc;
+    while (length--)
+        crc = table[(crc ^ *buf++) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void putUint32(uint8_t *buf, uint32_t value)
+{
+    buf[0] = (uint8_t)(value >> 24);
+    buf[1] = (uint8_t)(value >> 16);
+    buf[2] = (uint8_t)(value >> 8);
+    buf[3] = (uint8_t)value;
+}
+
+// Write one PNG chunk: length, type, data and CRC
+static void writePngChunk(FILE *file, const char *type, const uint8_t *buf, uint32_t length)
+{
+    uint8_t header[8];
+    uint8_t trailer[4];
+    uint32_t crc;
+
+    putUint32(header, length);
+    memcpy(&header[4], type, 4);
+    crc = crc32Update(0, &header[4], 4);
+    crc = crc32Update(crc, buf, length);
+    putUint32(trailer, crc);
+
+    fwrite(header, 1, 8, file);
+    fwrite(buf, 1, length, file);
+    fwrite(trailer, 1, 4, file);
+}
+
+bool Ssd1306Emulator::savePng(const char *path) const
+{
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    // Scanlines: a filter type byte (none) and one byte per pixel. Fits in one stored deflate block.
+    uint8_t raw[64 * (1 + 256)];
+    uint8_t idat[2 + 5 + sizeof(raw) + 4];
+    uint8_t ihdr[13];
+    uint32_t rawLength = 0;
+    uint32_t adlerA = 1, adlerB = 0;
+    uint8_t lit = (uint8_t)(64 + contrast_level * 191 / 255);
+    FILE *file;
+
+    if (panel_height > 64)
+        return false;
+
+    for (uint8_t y = 0; y < panel_height; y++) {
+        raw[rawLength++] = 0;
+        for (uint8_t x = 0; x < panel_width; x++)
+            raw[rawLength++] = pixel(x, y) ? lit : 0;
+    }
+    for (uint32_t i = 0; i < rawLength; i++) {
+        adlerA = (adlerA + raw[i]) % 65521;
+        adlerB = (adlerB + adlerA) % 65521;
+    }
+
+    // zlib stream: header, one final stored block, Adler-32
+    idat[0] = 0x78;
+    idat[1] = 0x01;
+    idat[2] = 0x01;
+    idat[3] = (uint8_t)rawLength;
+    idat[4] = (uint8_t)(rawLength >> 8);
+    idat[5] = (uint8_t)~rawLength;
+    idat[6] = (uint8_t)(~rawLength >> 8);
+    memcpy(&idat[7], raw, rawLength);
+    putUint32(&idat[7 + rawLength], (adlerB << 16) | adlerA);
+
+    putUint32(&ihdr[0], panel_width);
+    putUint32(&ihdr[4], panel_height);
+    ihdr[8] = 8;    // Bit depth
+    ihdr[9] = 0;    // Greyscale
+    ihdr[10] = 0;   // Deflate
+    ihdr[11] = 0;   // Adaptive filtering
+    ihdr[12] = 0;   // No interlace
+
+    file = fopen(path, "wb");
+    if (!file)
+        return false;
+    fwrite(signature, 1, sizeof(signature), file);
+    writePngChunk(file, "IHDR", ihdr, sizeof(ihdr));
+    writePngChunk(file, "IDAT", idat, 7 + rawLength + 4);
+    writePngChunk(file, "IEND", NULL, 0);
+
+    return fclose(file) == 0;
+}
+
+// Read the next number of a PBM header, skipping white space and comments
+static int readPbmNumber(FILE *file)
+{
+    int c;
+    int value = 0;
+
+    do {
+        c = fgetc(file);
+        if (c == '#') {
+            while (c != '\n' && c != EOF)
+                c = fgetc(file);
+        }
+    } while (c != EOF && !isdigit(c));
+
+    if (c == EOF)
+        return -1;
+    while (c != EOF && isdigit(c)) {
+        value = value * 10 + (c - '0');
+        c = fgetc(file);
+    }
+    return value;
+}
+
+long Ssd1306Emulator::comparePbm(const char *path) const
+{
+    FILE *file = fopen(path, "rb");
+    char magic[2];
+    int width, height;
+    int c = 0;
+    long differences = 0;
+    bool golden;
+
+    if (!file)
+        return -1;
+
+    if (fread(magic, 1, 2, file) != 2 || magic[0] != 'P' || (magic[1] != '1' && magic[1] != '4')) {
+        fclose(file);
+        return -1;
+    }
+    width = readPbmNumber(file);
+    height = readPbmNumber(file);
+    if (width != panel_width || height != panel_height) {
+        fclose(file);
+        return -1;
+    }
+
+    // readPbmNumber() consumed the single white space after the height
+    for (uint8_t y = 0; y < panel_height; y++) {
+        for (uint8_t x = 0; x < panel_width; x++) {
+            if (magic[1] == '4') {
+                if ((x & 7) == 0)
+                    c = fgetc(file);
+                golden = (c >> (7 - (x & 7))) & 0x01;
+            } else {
+                do {
+                    c = fgetc(file);
+                } while (c != EOF && c != '0' && c != '1');
+                golden = c == '1';
+            }
+            if (c == EOF) {
+                fclose(file);
+                return -1;
+            }
+            if (golden != pixel(x, y))
+                differences++;
+        }
+    }
+
+    fclose(file);
+    return differences;
+}
@@ -0,0 +1,115 @@
+/*
+ * SSD1306 emulator for the RX-8 Ashtray Gauges host tools.
+ * It sits on a host Wire bus in place of the display and decodes the I2C command and data
+ * stream the way the controller does: display RAM, addressing modes, contrast, on/off,
+ * inversion and orientation. What it shows is what the panel in the car would show.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#ifndef SSD1306_EMULATOR_H
+#define SSD1306_EMULATOR_H
+
+#include <stdint.h>
+#include <Wire.h>
+
+// Display RAM size of the controller, whatever the panel
+#define SSD1306_RAM_COLUMNS 128
+#define SSD1306_RAM_PAGES 8
+
+// Bus traffic of one flush, from the end of the previous flush to the last data byte of this one
+typedef struct {
+    uint32_t bytes;             // Bytes on the bus, address bytes included
+    uint32_t transactions;      // I2C transactions
+    uint32_t data_bytes;        // Display RAM bytes written
+} Ssd1306FlushStats;
+
+class Ssd1306Emulator : public HostI2cDevice {
+public:
+    // width, height: The panel size, in pixels
+    Ssd1306Emulator(uint8_t width = 128, uint8_t height = 64);
+
+    // Decode one write transaction (control bytes, commands and data)
+    void onWrite(const uint8_t *data, size_t length) override;
+
+    // Answer with the simulated fault, see below
+    uint8_t respond() override { return fault; }
+
+    // Call the specified function every time a flush completes, i.e. when the data written
+    // wraps around the column and page address window. Partial windows count as flushes too.
+    void onFlush(void (*callback)(Ssd1306Emulator &emulator, void *context), void *context);
+
+    // Return true if the pixel is lit on the panel, with the orientation, inversion,
+    // start line and on/off state applied. (0, 0) is the top left corner when the panel
+    // is mounted for the Adafruit library default orientation (SEGREMAP 1, COMSCANDEC).
+    bool pixel(uint8_t x, uint8_t y) const;
+
+    uint8_t width() const { return panel_width; }
+    uint8_t height() const { return panel_height; }
+    bool isOn() const { return display_on; }
+    bool isInverted() const { return inverted; }
+    uint8_t contrast() const { return contrast_level; }
+
+    // Write the panel image as a binary PBM (P4), lit pixels black
+    // Return: False if the file can't be written
+    bool savePbm(const char *path) const;
+
+    // Write the panel image as an 8 bits greyscale PNG, lit pixels scaled with the contrast
+    // Return: False if the file can't be written
+    bool savePng(const char *path) const;
+
+    // Compare the panel image with a PBM image (P1 or P4) of the same size
+    // path: The golden image
+    // Return: The number of pixels that differ, or -1 if the image can't be read or its size differs
+    long comparePbm(const char *path) const;
+
+    // Statistics
+    uint32_t flushes = 0;               // Completed flushes
+    Ssd1306FlushStats last_flush;       // Traffic of the last completed flush
+    Ssd1306FlushStats pending_flush;    // Traffic since the last completed flush
+    uint64_t total_bytes = 0;           // Bytes on the bus, address bytes included
+    uint32_t total_transactions = 0;    // Transactions addressed to the display
+    uint32_t unknown_commands = 0;      // Command bytes the emulator doesn't know
+
+    // Simulated fault, as returned by respond(): 0 none, 2 not acknowledging, 4 holding the bus low
+    uint8_t fault = 0;
+
+private:
+    void command(uint8_t value);
+    void execute();
+    void data(uint8_t value);
+
+    uint8_t panel_width;
+    uint8_t panel_height;
+    uint8_t ram[SSD1306_RAM_PAGES][SSD1306_RAM_COLUMNS];
+
+    // Command decoding, a command and its arguments can span several transactions
+    uint8_t pending_command = 0;
+    uint8_t arguments[6];
+    uint8_t arguments_needed = 0;
+    uint8_t arguments_received = 0;
+
+    // Addressing
+    uint8_t addressing_mode = 2;        // 0 horizontal, 1 vertical, 2 page (reset value)
+    uint8_t column = 0;
+    uint8_t page = 0;
+    uint8_t column_start = 0;
+    uint8_t column_end = SSD1306_RAM_COLUMNS - 1;
+    uint8_t page_start = 0;
+    uint8_t page_end = SSD1306_RAM_PAGES - 1;
+
+    // Display state, reset values
+    bool display_on = false;
+    bool inverted = false;
+    bool entire_on = false;
+    bool segment_remap = false;
+    bool com_scan_reversed = false;
+    uint8_t contrast_level = 0x7F;
+    uint8_t start_line = 0;
+    uint8_t display_offset = 0;
+    uint8_t multiplex = 63;
+
+    void (*flush_callback)(Ssd1306Emulator &emulator, void *context) = NULL;
+    void *flush_context = NULL;
+};
+
+#endif
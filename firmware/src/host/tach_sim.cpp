@@ -0,0 +1,162 @@
+/*
+ * Tachometer host tool for the RX-8 Ashtray Gauges project.
+ * tach-sim runs the engine speed measurement of tach.h against synthetic tach signals: it plays
+ * the part of the quad timer (edge counter, capture timer and capture flag, all 16 bits) and
+ * feeds the polls to pollTachometer(), then compares the speed it gives with the true one. Some
+ * signals hold the polls for longer than the capture timer takes to wrap, as a flash erase does.
+ * Usage: tach-sim [pulses_per_rev]
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "host_tools.h"
+#include "../tach.h"
+
+// Simulation step, in seconds
+#define TACH_SIM_STEP 0.000002
+
+// A synthetic signal: the engine speed against time, with some period jitter
+typedef struct {
+    const char *name;
+    double seconds;
+    double (*rpm)(double t);
+    double jitter;          // Random variation of each period, as a fraction
+    double settle;          // Time after a change of speed not taken into the error, in seconds
+    double tolerance;       // Largest error once settled, in % (of 100 RPM at a standstill)
+    double hold;            // Time the polls are held from 2s, as by a flash erase, in seconds
+} TachProfile;
+
+static double idleRpm(double)
+{
+    return 800;
+}
+
+static double cruiseRpm(double)
+{
+    return 3000;
+}
+
+static double redlineRpm(double)
+{
+    return 9000;
+}
+
+static double rampRpm(double t)
+{
+    return 800 + (9000 - 800) * t / 5.0;
+}
+
+static double stallRpm(double t)
+{
+    // Running, stalled from 2s to 4s, restarted
+    return t >= 2 && t < 4 ? 0 : 900;
+}
+
+static const TachProfile tachProfiles[] = {
+    {"idle 800", 5, idleRpm, 0, 0.3, 0.5, 0},
+    {"cruise 3000", 5, cruiseRpm, 0, 0.3, 0.5, 0},
+    {"redline 9000", 5, redlineRpm, 0, 0.3, 0.5, 0},
+    {"idle jitter 5%", 5, idleRpm, 0.05, 0.3, 5, 0},
+    // The average lags the true speed by half a window or so
+    {"ramp 800-9000 in 5s", 5, rampRpm, 0, 0.3, 15, 0},
+    {"stall 2s", 6, stallRpm, 0, 1.5, 0.5, 0},
+    // The capture timer wraps while the polls are held
+    {"idle 800 held 100ms", 5, idleRpm, 0, 0.3, 0.5, 0.1},
+    {"redline 9000 held 400ms", 5, redlineRpm, 0, 0.3, 0.5, 0.4},
+};
+
+// Quad timer model
+typedef struct {
+    uint32_t edges;         // Edges counted
+    bool flag;              // Capture flag
+    uint16_t capture;       // Capture register
+} TimerModel;
+
+// Return the capture timer value at a time
+static uint16_t timerTicks(double t)
+{
+    return (uint16_t)(uint64_t)(t * TACH_TIMER_HZ);
+}
+
+// Run one profile
+// Return: True if the error stayed within the tolerance of the profile once settled
+static bool runProfile(const TachProfile &profile, uint8_t pulsesPerRev)
+{
+    Tachometer tach;
+    TimerModel timer = {0, false, 0};
+    double phase = 0;
+    double nextPoll = 0;
+    double period = 0;
+    double lastChange = 0;
+    double lastRpm = profile.rpm(0);
+    double errorMax = 0;
+    double errorTotal = 0;
+    uint32_t checked = 0;
+
+    initTachometer(tach, TACH_TIMER_HZ, pulsesPerRev, TACH_AVERAGE_MS, TACH_TIMEOUT_MS);
+
+    for (double t = 0; t < profile.seconds; t += TACH_SIM_STEP) {
+        double rpm = profile.rpm(t);
+
+        // A new period starts at each edge, with its own jitter
+        if (fabs(rpm - lastRpm) > 100)
+            lastChange = t;
+        lastRpm = rpm;
+        phase += rpm / 60.0 * pulsesPerRev * TACH_SIM_STEP * (1 + period);
+        if (phase >= 1) {
+            phase -= 1;
+            period = profile.jitter * (2.0 * rand() / RAND_MAX - 1);
+            timer.edges++;
+            if (!timer.flag) {
+                timer.flag = true;
+                timer.capture = timerTicks(t);
+            }
+        }
+
+        if (t >= nextPoll && !(t >= 2 && t < 2 + profile.hold)) {
+            bool captured = timer.flag;
+            uint16_t capture = timer.capture;
+            double error;
+
+            timer.flag = false;
+            pollTachometer(tach, (uint16_t)timer.edges, captured, capture, timerTicks(t), (uint32_t)(uint64_t)(t * 1e6));
+            // A late poll doesn't make up for those missed
+            nextPoll += TACH_POLL_US / 1e6;
+            if (nextPoll < t)
+                nextPoll = t + TACH_POLL_US / 1e6;
+
+            if (t - lastChange < profile.settle || t < profile.settle)
+                continue;
+            error = fabs(tach.rpm - rpm) / (rpm > 0 ? rpm : 100) * 100;
+            errorTotal += error;
+            if (error > errorMax)
+                errorMax = error;
+            checked++;
+        }
+    }
+
+    printf("%-22s %6u estimates, error %.2f%% average, %.2f%% max\n", profile.name, tach.estimates,
+        checked ? errorTotal / checked : 0.0, errorMax);
+    return errorMax <= profile.tolerance;
+}
+
+int runTachSim(int argc, char **argv)
+{
+    uint8_t pulsesPerRev = argc > 0 ? atoi(argv[0]) : TACH_PULSES_PER_REV;
+    uint32_t failures = 0;
+
+    if (pulsesPerRev == 0) {
+        fprintf(stderr, "Usage: tach-sim [pulses_per_rev]\n");
+        return 2;
+    }
+
+    srand(1);
+    for (size_t i = 0; i < sizeof(tachProfiles) / sizeof(TachProfile); i++) {
+        if (!runProfile(tachProfiles[i], pulsesPerRev))
+            failures++;
+    }
+    printf("%u failure(s)\n", failures);
+    return failures ? 1 : 0;
+}
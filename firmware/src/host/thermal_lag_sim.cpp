@@ -0,0 +1,294 @@
+/*
+ * Thermistor lag host tool for the RX-8 Ashtray Gauges project.
+ * thermal-lag runs the lag compensation of thermal_lag.h on a synthetic sensor: the fluid
+ * temperature steps and ramps, the sensor follows it as a first order system with some noise and
+ * is read at the display refresh rate. It prints how long the raw and compensated readings take
+ * to settle after each step, their overshoot and noise, and the time constant fitThermalLag()
+ * identifies from the raw readings of the first step.
+ * The compensation uses OIL_THERMISTOR_TIME_CONSTANT: simulating a sensor with another time
+ * constant shows what a wrong setting does (too long overshoots, too short leaves part of the lag),
+ * and fails.
+ * With '--trace <out.csv>', the sensor temperature is also written as a replay trace (oil and
+ * coolant thermistor resistances), to run the whole firmware against it.
+ * With '--fit', the time constant is identified from recorded readings instead: a black box dump
+ * (record lines, channel number) or a replay timeline (display lines, channel name), between two
+ * times in milliseconds, the first at the step.
+ * Usage: thermal-lag [time_constant_s] [--trace <out.csv>]
+ *        thermal-lag --fit <file.csv> <channel> <from_ms> <to_ms>
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <Arduino.h>
+#include "host_tools.h"
+#include "../coolant_monitor.h"
+#include "../thermal_lag.h"
+#include "../error_codes.h"
+
+// Firmware thermistor conversion, see coolant_monitor.cpp
+int convertThermistorCelsius(float &TC, float analogueValue, float t_res_ref);
+
+// Simulation step, and time between two readings, in seconds
+#define THERMAL_LAG_SIM_STEP 0.01
+#define THERMAL_LAG_SIM_READ_PERIOD (1.0 / DISPLAY_REFRESH_RATE_HZ)
+
+// Noise of a reading, peak to peak, in degrees
+#define THERMAL_LAG_SIM_NOISE 0.2
+
+// Time between two rows of the replay trace, in milliseconds
+#define THERMAL_LAG_SIM_TRACE_MS 100
+
+// A part of the fluid temperature profile: from the temperature at its start, a ramp to 'to'
+typedef struct {
+    double seconds;
+    double to;
+    double ramp;                // Time to get there, 0 for a step
+} ThermalSegment;
+
+static const double thermalStart = 80;
+static const ThermalSegment thermalProfile[] = {
+    {20, 80, 0},                // Cruise
+    {60, 110, 0},               // Hard use
+    {60, 90, 0},                // Back to cruise
+    {60, 120, 60},              // Slow climb
+    {30, 120, 0},
+};
+
+// Settling of the readings after a step
+typedef struct {
+    double settle;              // Time to get within 10% of the step for good, in seconds
+    double overshoot;           // Largest excursion past the final temperature, in % of the step
+} StepResponse;
+
+// Return the fluid temperature at a time
+static double fluidTemperature(double t)
+{
+    double from = thermalStart;
+
+    for (size_t i = 0; i < sizeof(thermalProfile) / sizeof(ThermalSegment); i++) {
+        const ThermalSegment &segment = thermalProfile[i];
+
+        if (t < segment.seconds) {
+            if (segment.ramp > 0 && t < segment.ramp)
+                return from + (segment.to - from) * t / segment.ramp;
+            return segment.to;
+        }
+        t -= segment.seconds;
+        from = segment.to;
+    }
+    return from;
+}
+
+// Get the thermistor resistance at a temperature, by bisection through the firmware conversion
+static uint32_t thermistorOhms(double celsius)
+{
+    const float reference = 1000;
+    double low = log(100.0), high = log(500000.0), middle = 0;
+    float tc;
+
+    for (int i = 0; i < 40; i++) {
+        middle = (low + high) / 2;
+        if (convertThermistorCelsius(tc, 1023.0 * reference / (reference + exp(middle)), reference) != ENOERR || tc < celsius)
+            high = middle;
+        else
+            low = middle;
+    }
+    return (uint32_t)(exp(middle) + 0.5);
+}
+
+// Measure the settling of a series of readings after a step
+// times, values: The readings, from the step to the next change of the profile
+// from, to: The fluid temperature before and after the step
+static StepResponse measureStep(const std::vector<double> &times, const std::vector<double> &values, double from, double to)
+{
+    StepResponse response = {0, 0};
+    double step = to - from;
+
+    for (size_t i = 0; i < values.size(); i++) {
+        if (fabs(values[i] - to) > 0.1 * fabs(step))
+            response.settle = times[i] - times[0] + THERMAL_LAG_SIM_READ_PERIOD;
+        if ((values[i] - to) / step * 100 > response.overshoot)
+            response.overshoot = (values[i] - to) / step * 100;
+    }
+    return response;
+}
+
+// Identify the time constant from recorded readings
+static int runFit(const char *path, const char *channel, double fromMs, double toMs)
+{
+    char line[256];
+    char *fields[8];
+    int count;
+    double ms;
+    float timeConstant, deadTime;
+    std::vector<float> seconds, values;
+    FILE *file = fopen(path, "r");
+
+    if (!file) {
+        perror(path);
+        return 1;
+    }
+    while (fgets(line, sizeof(line), file)) {
+        count = 0;
+        for (char *field = strtok(line, ",\r\n"); field && count < 8; field = strtok(NULL, ",\r\n"))
+            fields[count++] = field;
+
+        // record,<event>,<ms>,<channel>,<value>,... or <ms>,display,<channel>,<value>
+        if (count >= 5 && strcmp(fields[0], "record") == 0 && strcmp(fields[3], channel) == 0) {
+            ms = atof(fields[2]);
+            if (ms >= fromMs && ms <= toMs) {
+                seconds.push_back((ms - fromMs) / 1000);
+                values.push_back(atof(fields[4]));
+            }
+        } else if (count >= 4 && strcmp(fields[1], "display") == 0 && strcmp(fields[2], channel) == 0) {
+            ms = atof(fields[0]);
+            if (ms >= fromMs && ms <= toMs) {
+                seconds.push_back((ms - fromMs) / 1000);
+                values.push_back(atof(fields[3]));
+            }
+        }
+    }
+    fclose(file);
+
+    if (fitThermalLag(seconds.data(), values.data(), values.size(), timeConstant, deadTime) != ENOERR) {
+        fprintf(stderr, "No step found in the %zu readings of %s\n", values.size(), channel);
+        return 1;
+    }
+    printf("%zu readings, %.1f to %.1f: time constant %.2f s, dead time %.2f s\n",
+        values.size(), values.front(), values.back(), timeConstant, deadTime);
+    return 0;
+}
+
+int runThermalLagSim(int argc, char **argv)
+{
+    const size_t segments = sizeof(thermalProfile) / sizeof(ThermalSegment);
+    double sensorTimeConstant = OIL_THERMISTOR_TIME_CONSTANT;
+    const char *tracePath = NULL;
+    FILE *trace = NULL;
+    ThermalLag lag;
+    double sensor = thermalStart;
+    double fluid;
+    double nextRead = 0, nextRow = 0;
+    size_t segment = 0;
+    double segmentStart = 0;
+    double segmentFrom = thermalStart;
+    double noiseRaw = 0, noiseCompensated = 0;
+    uint32_t noiseReadings = 0;
+    std::vector<double> times, raw, compensated, fluids;
+    std::vector<float> fitSeconds, fitValues;
+    float fittedTimeConstant = 0, fittedDeadTime = 0;
+    uint32_t failures = 0;
+
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--fit") == 0 && i + 4 < argc)
+            return runFit(argv[i + 1], argv[i + 2], atof(argv[i + 3]), atof(argv[i + 4]));
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+            tracePath = argv[++i];
+        else
+            sensorTimeConstant = atof(argv[i]);
+    }
+    if (sensorTimeConstant <= 0) {
+        fprintf(stderr, "Usage: thermal-lag [time_constant_s] [--trace <out.csv>]\n"
+            "       thermal-lag --fit <file.csv> <channel> <from_ms> <to_ms>\n");
+        return 2;
+    }
+    if (tracePath) {
+        trace = fopen(tracePath, "w");
+        if (!trace) {
+            perror(tracePath);
+            return 1;
+        }
+        fprintf(trace, "ms,oil_ohms,coolant_ohms,oil_psi,voltage,illumination,hall\n");
+    }
+
+    printf("sensor time constant %.1f s, compensated for %.1f s\n", sensorTimeConstant, OIL_THERMISTOR_TIME_CONSTANT);
+    srand(1);
+    initThermalLag(lag, OIL_THERMISTOR_TIME_CONSTANT);
+    for (double t = 0; segment < segments; t += THERMAL_LAG_SIM_STEP) {
+        // At the end of a segment, report how the readings followed it
+        if (t >= segmentStart + thermalProfile[segment].seconds) {
+            const ThermalSegment &ended = thermalProfile[segment];
+
+            if (ended.ramp > 0) {
+                printf("ramp %.0f to %.0f in %.0f s: lagging %.1f C raw, %.1f C compensated at the end\n", segmentFrom,
+                    ended.to, ended.ramp, fluids.back() - raw.back(), fluids.back() - compensated.back());
+            } else if (ended.to != segmentFrom) {
+                StepResponse rawResponse = measureStep(times, raw, segmentFrom, ended.to);
+                StepResponse compensatedResponse = measureStep(times, compensated, segmentFrom, ended.to);
+
+                printf("step %.0f to %.0f: within 10%% after %.1f s raw, %.1f s compensated, overshoot %.1f%%\n",
+                    segmentFrom, ended.to, rawResponse.settle, compensatedResponse.settle, compensatedResponse.overshoot);
+                if (compensatedResponse.settle > rawResponse.settle / 2 || compensatedResponse.overshoot > 10)
+                    failures++;
+                // The time constant is identified from the raw readings of the first step
+                if (fitSeconds.empty()) {
+                    for (size_t i = 0; i < raw.size(); i++) {
+                        fitSeconds.push_back(times[i] - segmentStart);
+                        fitValues.push_back(raw[i]);
+                    }
+                }
+            }
+
+            segmentStart += ended.seconds;
+            segmentFrom = ended.to;
+            segment++;
+            times.clear();
+            raw.clear();
+            compensated.clear();
+            fluids.clear();
+            continue;
+        }
+
+        // The sensor follows the fluid as a first order system
+        fluid = fluidTemperature(t);
+        sensor += (fluid - sensor) * THERMAL_LAG_SIM_STEP / sensorTimeConstant;
+
+        if (t >= nextRead) {
+            double reading = sensor + THERMAL_LAG_SIM_NOISE * ((double)rand() / RAND_MAX - 0.5);
+            double shown = compensateThermalLag(lag, reading, (uint32_t)(t * 1e6));
+
+            nextRead += THERMAL_LAG_SIM_READ_PERIOD;
+            times.push_back(t);
+            raw.push_back(reading);
+            compensated.push_back(shown);
+            fluids.push_back(fluid);
+
+            // Noise, once settled on a constant temperature
+            if (thermalProfile[segment].ramp == 0 && t - segmentStart > 8 * sensorTimeConstant) {
+                noiseRaw += (reading - fluid) * (reading - fluid);
+                noiseCompensated += (shown - fluid) * (shown - fluid);
+                noiseReadings++;
+            }
+        }
+
+        if (trace && t * 1000 >= nextRow) {
+            uint32_t ohms = thermistorOhms(sensor);
+
+            fprintf(trace, "%.0f,%u,%u,300,622,100,0\n", nextRow, ohms, ohms);
+            nextRow += THERMAL_LAG_SIM_TRACE_MS;
+        }
+    }
+    if (trace)
+        fclose(trace);
+
+    if (noiseReadings) {
+        printf("noise once settled: %.2f C rms raw, %.2f C rms compensated\n",
+            sqrt(noiseRaw / noiseReadings), sqrt(noiseCompensated / noiseReadings));
+    }
+
+    if (fitThermalLag(fitSeconds.data(), fitValues.data(), fitValues.size(), fittedTimeConstant, fittedDeadTime) != ENOERR) {
+        printf("time constant not identified\n");
+        failures++;
+    } else {
+        printf("identified from the first step: time constant %.2f s, dead time %.2f s\n", fittedTimeConstant, fittedDeadTime);
+        if (fabs(fittedTimeConstant - sensorTimeConstant) > 0.1 * sensorTimeConstant)
+            failures++;
+    }
+
+    printf("%u failure(s)\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,120 @@
+/*
+ * Memory placement for the RX-8 Ashtray Gauges project, see placement.h.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#include <Arduino.h>
+#include "placement.h"
+
+#if defined(__IMXRT1062__)
+
+// Data cache of the Cortex-M7: 32kB, 4 ways of 256 sets of 32 byte lines
+#define DCACHE_WAYS 4
+#define DCACHE_SETS 256
+
+// Linker symbols: the code copied to the ITCM, the variables in the DTCM, the start of the heap
+extern unsigned long _stext, _etext, _sdata, _ebss, _heap_start;
+
+const char *getMemoryRegion(const void *address)
+{
+    uint32_t a = (uint32_t)address;
+
+    if (a < 0x00080000)
+        return "ITCM";
+    if (a >= 0x20000000 && a < 0x20080000)
+        return "DTCM";
+    if (a >= 0x20200000 && a < 0x20280000)
+        return "OCRAM";
+    if (a >= 0x60000000 && a < 0x70000000)
+        return "flash";
+    return "?";
+}
+
+FLASHMEM void flushCaches()
+{
+    asm volatile("dsb");
+    for (uint32_t way = 0; way < DCACHE_WAYS; way++) {
+        for (uint32_t set = 0; set < DCACHE_SETS; set++)
+            SCB_CACHE_DCCISW = (way << 30) | (set << 5);
+    }
+    asm volatile("dsb");
+    SCB_CACHE_ICIALLU = 0;
+    asm volatile("dsb");
+    asm volatile("isb");
+}
+
+static inline uint32_t readCycles()
+{
+    return ARM_DWT_CYCCNT;
+}
+
+#else
+
+const char *getMemoryRegion(const void *)
+{
+    return "host";
+}
+
+void flushCaches()
+{
+}
+
+static inline uint32_t readCycles()
+{
+    return 0;
+}
+
+#endif
+
+// Data read by the symbols without a run function, kept so the reads aren't optimised out
+static volatile uint32_t memorySink;
+
+// Run a symbol once
+// Return: The cycles it took
+FASTRUN static uint32_t runSymbol(const HotSymbol &symbol, bool cold)
+{
+    const volatile uint8_t *data = (const volatile uint8_t *)symbol.address;
+    uint32_t sum = 0;
+    uint32_t cycles;
+
+    if (cold)
+        flushCaches();
+    cycles = readCycles();
+    if (symbol.run) {
+        symbol.run();
+    } else {
+        for (uint32_t i = 0; i < symbol.size; i += 4)
+            sum += data[i];
+    }
+    cycles = readCycles() - cycles;
+    memorySink = sum;
+    return cycles;
+}
+
+FLASHMEM void printMemoryReport(const HotSymbol *symbols, uint8_t count)
+{
+    uint32_t cold, warm;
+
+    Serial.println("symbol,region,address,cold_cycles,warm_cycles");
+    for (uint8_t i = 0; i < count; i++) {
+        if (!symbols[i].run && !symbols[i].size) {
+            // Only its placement: it can't be run outside its interrupt
+            Serial.printf("%s,%s,0x%08x,,\r\n", symbols[i].name, getMemoryRegion(symbols[i].address),
+                (unsigned)(uintptr_t)symbols[i].address);
+            continue;
+        }
+        cold = warm = UINT32_MAX;
+        for (uint8_t run = 0; run < MEMORY_REPORT_RUNS; run++) {
+            cold = min(cold, runSymbol(symbols[i], true));
+            warm = min(warm, runSymbol(symbols[i], false));
+        }
+        Serial.printf("%s,%s,0x%08x,%u,%u\r\n", symbols[i].name, getMemoryRegion(symbols[i].address),
+            (unsigned)(uintptr_t)symbols[i].address, (unsigned)cold, (unsigned)warm);
+    }
+
+    #if defined(__IMXRT1062__)
+    Serial.printf("ITCM code %u bytes, DTCM data %u bytes, OCRAM static %u bytes\r\n",
+        (unsigned)((uint32_t)&_etext - (uint32_t)&_stext), (unsigned)((uint32_t)&_ebss - (uint32_t)&_sdata),
+        (unsigned)((uint32_t)&_heap_start - 0x20200000));
+    #endif
+}
@@ -0,0 +1,66 @@
+/*
+ * Memory placement for the RX-8 Ashtray Gauges project.
+ * The Teensy 4.0 has three memories the firmware can run from, with very different timings:
+ *  - ITCM (code) and DTCM (data), the tightly coupled RAM: one cycle, never cached, nothing to
+ *    warm up. The program code is copied to the ITCM at power up, unless it's marked FLASHMEM,
+ *    and the variables are in the DTCM, unless they're marked DMAMEM. FASTRUN is the default
+ *    code section, it only makes the placement explicit.
+ *  - OCRAM (DMAMEM and the malloc() heap): behind the data cache, a miss costs tens of cycles.
+ *  - The program flash (FLASHMEM code, PROGMEM data): behind both caches, a miss costs hundreds
+ *    of cycles.
+ * What runs from an interrupt or once per reading is in the TCM, so its worst case is its
+ * typical case whatever the loop did to the caches before:
+ *  - Code: the interrupt handlers and what they call (alerts, black box, ADC compare, tach,
+ *    ripple, CAN) are FASTRUN, but for the CAN frame codec that is also built without the
+ *    Teensy core and is in the ITCM by default. The code that only runs at power up or on a
+ *    serial command is FLASHMEM, to leave the ITCM to the rest (conversions, filters, blits).
+ *  - Data: the alert channels, the black box ring and the sample buffers are in the DTCM. The
+ *    icons and the gauge font are plain constants (DTCM) rather than PROGMEM, the flash is
+ *    only read for the intro logo.
+ *  - The display framebuffers are allocated by the display library on the heap, in the OCRAM:
+ *    only the loop reads them, at the pace of the display bus. Nothing uses DMA, so there's no
+ *    buffer to keep coherent with the cache.
+ *
+ * The serial command "memory" reports where each hot symbol landed and its cycle count, cold
+ * (caches cleaned and invalidated just before) and warm (run again right after), the least of
+ * MEMORY_REPORT_RUNS runs each. A symbol in the TCM has the same count both ways, the gap
+ * between the two is what the caches cost a symbol placed elsewhere.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+#include <stdint.h>
+
+// Set this to 0 to leave out the "memory" serial command
+#define ENABLE_MEMORY_REPORT 1
+
+// Runs of each symbol, cold and warm, the least cycle count is reported
+#define MEMORY_REPORT_RUNS 3
+
+// A symbol of the memory report
+typedef struct {
+    const char *name;
+    const void *address;        // The function or the data
+    uint32_t size;              // Bytes of data read when there's no run function, 0 for code
+    void (*run)();              // Runs the function once, NULL for data, or for code that is only
+                                // placed (an interrupt handler)
+} HotSymbol;
+
+// Get the memory an address is in
+// address: The address
+// Return: "ITCM", "DTCM", "OCRAM", "flash", "?" (or "host" on the host)
+const char *getMemoryRegion(const void *address);
+
+// Clean and invalidate the data cache, and invalidate the instruction cache. Nothing on the host.
+void flushCaches();
+
+// Print the memory report on the serial port: a CSV line per symbol
+// (symbol,region,address,cold_cycles,warm_cycles) and the memory used in each region.
+// Call this from the loop, with the interrupts enabled.
+// symbols: The symbols
+// count: Their number
+void printMemoryReport(const HotSymbol *symbols, uint8_t count);
+
+#endif
@@ -0,0 +1,100 @@
+/*
+ * Ignition power states for the RX-8 Ashtray Gauges project, see power_state.h.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#include <string.h>
+#include "power_state.h"
+
+static const char *powerStateNames[POWER_STATE_COUNT] = {"running", "cranking", "off"};
+
+void initPowerState(PowerState &power, uint32_t nowMs)
+{
+    memset(&power, 0, sizeof(PowerState));
+    power.state = POWER_STATE_RUNNING;
+    power.since_ms = nowMs;
+    power.last_ms = nowMs;
+    power.active_ms = nowMs;
+    power.entered[POWER_STATE_RUNNING] = 1;
+}
+
+void restorePowerState(PowerState &power, const PowerState &saved, uint32_t nowMs)
+{
+    uint32_t shiftMs = nowMs - saved.last_ms;
+
+    memcpy(&power, &saved, sizeof(PowerState));
+    power.since_ms += shiftMs;
+    power.last_ms += shiftMs;
+    power.active_ms += shiftMs;
+}
+
+// Enter a state
+static void enterPowerState(PowerState &power, uint8_t state, uint32_t nowMs)
+{
+    power.state = state;
+    power.since_ms = nowMs;
+    power.entered[state]++;
+}
+
+bool updatePowerState(PowerState &power, float volts, bool voltsValid, bool engineRunning, bool keepAwake, uint32_t nowMs)
+{
+    uint32_t elapsedMs = nowMs - power.last_ms;
+    uint8_t state = power.state;
+    bool dip = false;
+
+    power.state_ms[power.state] += elapsedMs;
+    power.last_ms = nowMs;
+
+    if (voltsValid) {
+        if (!power.seeded) {
+            power.rest_volts = volts;
+            power.seeded = true;
+        }
+        power.charging_ms = volts >= POWER_CHARGING_VOLTS ? power.charging_ms + elapsedMs : 0;
+        power.charging = power.charging_ms >= POWER_CHARGING_HOLD_MS;
+        dip = !power.charging && !engineRunning && volts <= power.rest_volts - POWER_CRANKING_DROP_VOLTS;
+    }
+    if (power.charging || engineRunning || keepAwake)
+        power.active_ms = nowMs;
+
+    switch (power.state) {
+    case POWER_STATE_RUNNING:
+    case POWER_STATE_OFF:
+        if (dip) {
+            enterPowerState(power, POWER_STATE_CRANKING, nowMs);
+            power.cranks++;
+            power.crank_min_volts = volts;
+            power.run_after_ms = 0;
+        } else if (power.state == POWER_STATE_RUNNING && nowMs - power.active_ms >= POWER_OFF_HOLD_MS) {
+            enterPowerState(power, POWER_STATE_OFF, nowMs);
+        } else if (power.state == POWER_STATE_OFF && power.active_ms == nowMs) {
+            enterPowerState(power, POWER_STATE_RUNNING, nowMs);
+        }
+        break;
+
+    case POWER_STATE_CRANKING:
+        if (voltsValid && volts < power.crank_min_volts)
+            power.crank_min_volts = volts;
+        if (engineRunning && !power.run_after_ms)
+            power.run_after_ms = nowMs != power.since_ms ? nowMs - power.since_ms : 1;
+        power.crank_ms = nowMs - power.since_ms;
+        if (power.charging || power.crank_ms >= POWER_CRANKING_MAX_MS) {
+            // A start that didn't take shows the gauges for a while, as at power up
+            enterPowerState(power, POWER_STATE_RUNNING, nowMs);
+            power.active_ms = nowMs;
+        }
+        break;
+    }
+
+    // The resting level leaves the cranking dips out
+    if (voltsValid && power.state != POWER_STATE_CRANKING) {
+        float weight = elapsedMs >= POWER_REST_TIME_CONSTANT_MS ? 1 : (float)elapsedMs / POWER_REST_TIME_CONSTANT_MS;
+        power.rest_volts += (volts - power.rest_volts) * weight;
+    }
+    return power.state != state;
+}
+
+const char *getPowerStateName(uint8_t state)
+{
+    return state < POWER_STATE_COUNT ? powerStateNames[state] : "?";
+}
@@ -0,0 +1,125 @@
+/*
+ * Ignition power states for the RX-8 Ashtray Gauges project.
+ * The gauges are powered whenever the ignition is on, engine running or not. The supply voltage
+ * tells the states apart:
+ *  - Running: the alternator charges, the supply is at POWER_CHARGING_VOLTS or more. An oil
+ *    pressure (or an engine speed, when known) says the same, for an alternator that doesn't
+ *    charge any more, and so does an alert (but the low oil pressure one, that comes with the
+ *    engine off): the gauges stay up while there's something to show.
+ *  - Cranking: the starter pulls the supply POWER_CRANKING_DROP_VOLTS below its resting level
+ *    (its average over the last seconds) while the engine isn't running. It lasts until the
+ *    alternator charges, or POWER_CRANKING_MAX_MS.
+ *  - Engine off: nothing says the engine runs for POWER_OFF_HOLD_MS, e.g. ignition on to listen
+ *    to the radio, or the engine stalled.
+ * The gauges start in the running state at power up, they show for POWER_OFF_HOLD_MS even if the
+ * engine isn't started.
+ *
+ * What each state does is up to the loop (see coolant_monitor.cpp):
+ *  - Running: every channel at the display rate, as ever.
+ *  - Cranking: the supply voltage and the oil pressure as fast as they can be read (the rest and
+ *    the displays every POWER_CAPTURE_SLOW_PASSES passes), to catch the voltage dip and the time
+ *    the oil pressure takes to build up. Both are kept in the statistics of the last start, and
+ *    every reading goes to the black box as usual.
+ *  - Engine off: the displays off and the channels read every POWER_OFF_PERIOD_MS, with a single
+ *    read of the supply every POWER_OFF_WATCH_MS in between to catch the start of a crank. The
+ *    alerts still work, e.g. a coolant heat soak after a hot stop.
+ * The state logic is plain C++, the replay host tool runs it against the traces.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#ifndef POWER_STATE_H
+#define POWER_STATE_H
+
+#include <stdint.h>
+
+// Set this to 0 to stay in the running state all the time
+#define ENABLE_POWER_STATES 1
+
+// Supply voltage from which the alternator charges, and the time it must hold, in milliseconds
+#define POWER_CHARGING_VOLTS 13.5
+#define POWER_CHARGING_HOLD_MS 2000
+
+// Drop of the supply below its resting level that means the starter runs, in volts
+#define POWER_CRANKING_DROP_VOLTS 1.5
+
+// Time constant of the resting level of the supply, in milliseconds
+#define POWER_REST_TIME_CONSTANT_MS 5000
+
+// Longest cranking state, in milliseconds: past it, the loop goes back to the running state
+#define POWER_CRANKING_MAX_MS 5000
+
+// Oil pressure, and engine speed, that say the engine runs
+#define POWER_RUNNING_OIL_PSI 5
+#define POWER_RUNNING_RPM 300
+
+// Time without sign of the engine running before the engine off state, in milliseconds
+#define POWER_OFF_HOLD_MS 30000
+
+// Loop period while cranking and while the engine is off, in milliseconds
+#define POWER_CAPTURE_PERIOD_MS 20
+#define POWER_OFF_PERIOD_MS 500
+
+// While the engine is off, the supply is read this often between the passes, in milliseconds:
+// a dip starts the next pass at once, the start of the crank isn't missed
+#define POWER_OFF_WATCH_MS 10
+
+// While cranking, the other channels and the displays are read and drawn once every this many passes
+#define POWER_CAPTURE_SLOW_PASSES 10
+
+// Time between two reads of one analogue sample while cranking, in milliseconds
+#define POWER_CAPTURE_ANALOG_DELAY_MS 1
+
+// The power states
+#define POWER_STATE_RUNNING 0
+#define POWER_STATE_CRANKING 1
+#define POWER_STATE_OFF 2
+#define POWER_STATE_COUNT 3
+
+// Power state and statistics
+typedef struct {
+    uint8_t state;              // POWER_STATE_*
+    uint32_t since_ms;          // millis() when the state started
+    bool seeded;                // False until the first valid supply reading
+    float rest_volts;           // Resting level of the supply
+    uint32_t last_ms;           // millis() of the last update
+    uint32_t charging_ms;       // Time the supply has been at POWER_CHARGING_VOLTS or more
+    bool charging;              // For POWER_CHARGING_HOLD_MS at least
+    uint32_t active_ms;         // millis() of the last sign of the engine running
+
+    // Statistics
+    uint32_t entered[POWER_STATE_COUNT];    // Times each state was entered
+    uint32_t state_ms[POWER_STATE_COUNT];   // Time spent in each state, up to the last update
+    uint32_t cranks;                        // Starts seen
+    float crank_min_volts;                  // Lowest supply of the last start
+    uint32_t crank_ms;                      // Length of the last cranking state
+    uint32_t run_after_ms;                  // From the start of the last crank to the first sign of the
+                                            // engine running (the oil pressure), 0 if none came
+} PowerState;
+
+// Start in the running state
+// power: The state
+// nowMs: millis() now
+void initPowerState(PowerState &power, uint32_t nowMs);
+
+// Put back the state from before a warm restart (see warm_start.h): the time of the reset doesn't count
+// power: The state
+// saved: The saved state
+// nowMs: millis() now
+void restorePowerState(PowerState &power, const PowerState &saved, uint32_t nowMs);
+
+// Update the state with a reading of the supply voltage. Call this once per loop pass.
+// power: The state
+// volts: The supply voltage
+// voltsValid: False if the reading failed, the voltage is left out
+// engineRunning: True if the oil pressure or the engine speed say the engine runs
+// keepAwake: True to stay out of the engine off state, e.g. while there's an alert
+// nowMs: millis() now
+// Return: True if the state changed
+bool updatePowerState(PowerState &power, float volts, bool voltsValid, bool engineRunning, bool keepAwake, uint32_t nowMs);
+
+// Get the name of a state
+// state: POWER_STATE_*
+// Return: "running", "cranking", "off"
+const char *getPowerStateName(uint8_t state);
+
+#endif
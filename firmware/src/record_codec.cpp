@@ -0,0 +1,188 @@
+/*
+ * Compressed record blocks for the RX-8 Ashtray Gauges project, see record_codec.h.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#include <math.h>
+#include <string.h>
+#include "record_codec.h"
+
+// Tag byte: the channel in the low bits, then the flags. A tag with the top bit set (blank
+// flash) ends the block.
+#define RECORD_TAG_CHANNEL 0x07
+#define RECORD_TAG_STATUS 0x08      // Error and reason bytes follow
+#define RECORD_TAG_ABSOLUTE 0x10    // The value isn't a difference, first of its channel in the block
+#define RECORD_TAG_SAME_VALUE 0x20  // No value, it's the last one of the channel
+#define RECORD_TAG_SAME_TIME 0x40   // No time, it's the last record's
+#define RECORD_TAG_END 0x80
+
+// Largest quantised value: the differences between two of them fit in 32 bits
+#define RECORD_VALUE_LIMIT 0x3FFFFFFF
+
+static inline uint32_t zigzag(int32_t value)
+{
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static inline int32_t unzigzag(uint32_t value)
+{
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+// Append a varint to a record being encoded
+// Return: The number of bytes
+static uint8_t putVarint(uint8_t *out, uint32_t value)
+{
+    uint8_t length = 0;
+
+    while (value >= 0x80) {
+        out[length++] = (uint8_t)value | 0x80;
+        value >>= 7;
+    }
+    out[length++] = (uint8_t)value;
+    return length;
+}
+
+// Read a varint of a block being decoded
+// Return: False if the block ends first
+static bool getVarint(RecordBlock &block, uint32_t &value)
+{
+    uint8_t byte;
+
+    value = 0;
+    for (uint8_t shift = 0; shift < 35; shift += 7) {
+        if (block.position >= block.size)
+            return false;
+        byte = block.input[block.position++];
+        value |= (uint32_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+static int32_t quantise(float value)
+{
+    float scaled = value * RECORD_CODEC_SCALE;
+
+    // NaN goes to 0
+    if (!(scaled > -RECORD_VALUE_LIMIT))
+        return scaled < 0 ? -RECORD_VALUE_LIMIT : 0;
+    if (scaled > RECORD_VALUE_LIMIT)
+        return RECORD_VALUE_LIMIT;
+    return (int32_t)lroundf(scaled);
+}
+
+static void resetBlock(RecordBlock &block, uint16_t size)
+{
+    block.size = size;
+    block.position = 0;
+    block.time_us = 0;
+    block.started = false;
+    block.known = 0;
+}
+
+void startRecordEncoding(RecordBlock &block, uint8_t *data, uint16_t size)
+{
+    block.data = data;
+    block.input = NULL;
+    resetBlock(block, size);
+}
+
+bool encodeRecord(RecordBlock &block, const BlackBoxRecord &record)
+{
+    uint8_t out[RECORD_CODEC_MAX_BYTES];
+    uint8_t length = 1;
+    uint8_t channel = record.channel & RECORD_TAG_CHANNEL;
+    uint8_t bit = 1 << channel;
+    uint8_t tag = channel;
+    int32_t value = quantise(record.value);
+
+    // The first time of a block is absolute, it's the difference from 0
+    if (block.started && record.time_us == block.time_us)
+        tag |= RECORD_TAG_SAME_TIME;
+    else
+        length += putVarint(out + length, zigzag((int32_t)(record.time_us - block.time_us)));
+
+    if (!(block.known & bit))
+        tag |= RECORD_TAG_ABSOLUTE;
+    if ((block.known & bit) && value == block.values[channel])
+        tag |= RECORD_TAG_SAME_VALUE;
+    else
+        length += putVarint(out + length, zigzag((block.known & bit) ? value - block.values[channel] : value));
+
+    if (!(block.known & bit) || record.error != block.errors[channel] || record.reason != block.reasons[channel]) {
+        tag |= RECORD_TAG_STATUS;
+        out[length++] = record.error;
+        out[length++] = record.reason;
+    }
+    out[0] = tag;
+
+    if (block.position + length > block.size)
+        return false;
+    memcpy(block.data + block.position, out, length);
+    block.position += length;
+
+    block.time_us = record.time_us;
+    block.started = true;
+    block.known |= bit;
+    block.values[channel] = value;
+    block.errors[channel] = record.error;
+    block.reasons[channel] = record.reason;
+    return true;
+}
+
+void startRecordDecoding(RecordBlock &block, const uint8_t *data, uint16_t size)
+{
+    block.data = NULL;
+    block.input = data;
+    resetBlock(block, size);
+}
+
+bool decodeRecord(RecordBlock &block, BlackBoxRecord &record)
+{
+    uint8_t tag, channel, bit;
+    uint32_t field;
+
+    if (block.position >= block.size)
+        return false;
+    tag = block.input[block.position];
+    if (tag & RECORD_TAG_END)
+        return false;
+    block.position++;
+    channel = tag & RECORD_TAG_CHANNEL;
+    bit = 1 << channel;
+
+    if (!(tag & RECORD_TAG_SAME_TIME)) {
+        if (!getVarint(block, field))
+            return false;
+        block.time_us += unzigzag(field);
+    }
+
+    // A difference needs a value before it in the block
+    if (!(tag & RECORD_TAG_ABSOLUTE) && !(block.known & bit))
+        return false;
+    if (!(tag & RECORD_TAG_SAME_VALUE)) {
+        if (!getVarint(block, field))
+            return false;
+        block.values[channel] = (tag & RECORD_TAG_ABSOLUTE) ? unzigzag(field) : block.values[channel] + unzigzag(field);
+    }
+
+    if (tag & RECORD_TAG_STATUS) {
+        if (block.position + 2 > block.size)
+            return false;
+        block.errors[channel] = block.input[block.position++];
+        block.reasons[channel] = block.input[block.position++];
+    } else if (!(block.known & bit)) {
+        return false;
+    }
+    block.known |= bit;
+
+    record.time_us = block.time_us;
+    record.channel = channel;
+    record.error = block.errors[channel];
+    record.reason = block.reasons[channel];
+    record.reserved = 0;
+    record.value = (float)block.values[channel] / RECORD_CODEC_SCALE;
+    return true;
+}
@@ -0,0 +1,78 @@
+/*
+ * Compressed record blocks for the RX-8 Ashtray Gauges project.
+ * The black box records are 12 bytes each in RAM, but consecutive records hardly differ: the
+ * time moves by tens of milliseconds and each channel's reading by a few hundredths. They are
+ * saved to the flash in blocks (one flash page each) where each record is stored as its
+ * differences from the previous ones:
+ *  - A tag byte: the channel, and flags for what follows.
+ *  - The time from the previous record of the block, as a zig-zag varint (7 bits per byte, the
+ *    sign in the lowest bit), left out if it's the same.
+ *  - The value quantised to 1/RECORD_CODEC_SCALE, as a zig-zag varint from the previous value
+ *    of the same channel in the block, left out if it's the same.
+ *  - The error and alert reason bytes, only when they change for the channel.
+ * Each block starts afresh (a keyframe): the first time is absolute and the first value of each
+ * channel too, so a block decodes on its own and a lost page only loses its own records.
+ * A record takes 3 to 6 bytes instead of 12. The times are exact, the values are rounded to the
+ * hundredth.
+ *
+ * The encoder and the decoder are the same code on the Teensy and on the host, see the
+ * log-codec host tool for the ratio and the speed on recorded readings.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#ifndef RECORD_CODEC_H
+#define RECORD_CODEC_H
+
+#include <stdint.h>
+#include "black_box.h"
+
+// Quantisation of the values: hundredths of the unit
+#define RECORD_CODEC_SCALE 100
+
+// Channels of the records, the channel number fits in the 3 low bits of the tag
+#define RECORD_CODEC_CHANNELS 8
+
+// Largest encoded record: tag, time and value varints, error and reason
+#define RECORD_CODEC_MAX_BYTES 13
+
+// A block of records being encoded or decoded
+typedef struct {
+    uint8_t *data;              // The block, NULL when decoding
+    const uint8_t *input;       // The block, when decoding
+    uint16_t size;
+    uint16_t position;          // Bytes used, or read
+
+    // Last record of the block, and last value and status of each channel
+    uint32_t time_us;
+    bool started;
+    uint8_t known;              // Bit per channel with a value in the block
+    int32_t values[RECORD_CODEC_CHANNELS];
+    uint8_t errors[RECORD_CODEC_CHANNELS];
+    uint8_t reasons[RECORD_CODEC_CHANNELS];
+} RecordBlock;
+
+// Start encoding a block
+// block: The block state
+// data: The block, filled with 0xFF (blank flash)
+// size: Its size, in bytes
+void startRecordEncoding(RecordBlock &block, uint8_t *data, uint16_t size);
+
+// Encode a record at the end of a block
+// block: The block state
+// record: The record, its channel below RECORD_CODEC_CHANNELS
+// Return: False if the block is full, the record isn't in it
+bool encodeRecord(RecordBlock &block, const BlackBoxRecord &record);
+
+// Start decoding a block
+// block: The block state
+// data: The block
+// size: Its size, in bytes
+void startRecordDecoding(RecordBlock &block, const uint8_t *data, uint16_t size);
+
+// Decode the next record of a block
+// block: The block state
+// record: Receives the record
+// Return: False at the end of the block
+bool decodeRecord(RecordBlock &block, BlackBoxRecord &record);
+
+#endif
@@ -0,0 +1,232 @@
+/*
+ * Charging system ripple analysis for the RX-8 Ashtray Gauges project, see ripple.h.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#include <math.h>
+#include <string.h>
+#include <Arduino.h>
+#include "ripple.h"
+#include "adc_pair.h"
+#if !defined(__IMXRT1062__)
+#include "host_sim.h"
+#endif
+
+// Fixed point scale of the Goertzel coefficient, 2cos(w) in Q14
+#define RIPPLE_COEFF_SHIFT 14
+
+// Samples minus their mean, and the magnitude of each DFT bin
+static int16_t rippleAc[RIPPLE_SAMPLES] __attribute__((aligned(4)));
+static float rippleBins[RIPPLE_SAMPLES / 2];
+
+// Sum of the squares of the samples, two at a time
+// samples: The samples, 4 byte aligned
+// count: Their number, even
+static int64_t sumSquares(const int16_t *samples, uint16_t count)
+{
+    int64_t sum = 0;
+
+    #if defined(__IMXRT1062__)
+    const uint32_t *pairs = (const uint32_t *)samples;
+
+    // SMLALD: sum += low * low + high * high, on both halves of the word
+    for (uint16_t i = 0; i < count / 2; i++)
+        asm("smlald %Q0, %R0, %1, %1" : "+r" (sum) : "r" (pairs[i]));
+    #else
+    for (uint16_t i = 0; i < count; i++)
+        sum += (int32_t)samples[i] * samples[i];
+    #endif
+    return sum;
+}
+
+// Squared magnitude of one DFT bin, by the Goertzel recurrence
+// samples: The samples
+// count: Their number
+// coeff: 2cos(2 pi bin / count), in Q14
+static int64_t goertzelPower(const int16_t *samples, uint16_t count, int32_t coeff)
+{
+    int32_t s0, s1 = 0, s2 = 0;
+
+    // The state stays within the sum of the samples over sin(w): 31 bits for 512 12 bit
+    // samples down to the lowest bin scanned
+    for (uint16_t i = 0; i < count; i++) {
+        s0 = samples[i] + (int32_t)(((int64_t)coeff * s1) >> RIPPLE_COEFF_SHIFT) - s2;
+        s2 = s1;
+        s1 = s0;
+    }
+    return (int64_t)s1 * s1 + (int64_t)s2 * s2 - ((((int64_t)coeff * s1) >> RIPPLE_COEFF_SHIFT) * s2);
+}
+
+void analyseRipple(const uint16_t *samples, uint16_t count, uint32_t sampleHz, float voltsPerCount, RippleAnalysis &analysis)
+{
+    uint32_t sum = 0;
+    int32_t mean;
+    int16_t low = INT16_MAX, high = INT16_MIN;
+    float offset, variance;
+    uint16_t first, peak = 0;
+    float delta = 0;
+
+    memset(&analysis, 0, sizeof(RippleAnalysis));
+    count = min(count, (uint16_t)RIPPLE_SAMPLES) & ~1;
+    if (count == 0)
+        return;
+
+    for (uint16_t i = 0; i < count; i++)
+        sum += samples[i];
+    mean = (sum + count / 2) / count;
+    for (uint16_t i = 0; i < count; i++) {
+        rippleAc[i] = (int16_t)(samples[i] - mean);
+        low = min(low, rippleAc[i]);
+        high = max(high, rippleAc[i]);
+    }
+
+    // The rounding of the mean is taken back out of the variance
+    offset = (float)sum / count - mean;
+    variance = (float)sumSquares(rippleAc, count) / count - offset * offset;
+    analysis.mean = voltsPerCount * sum / count;
+    analysis.rms = voltsPerCount * sqrtf(max(variance, 0.0f));
+    analysis.peak_to_peak = voltsPerCount * (high - low);
+
+    // Magnitude of each bin from RIPPLE_MIN_HZ up to the Nyquist frequency, the largest one is
+    // the dominant frequency
+    first = max((uint32_t)1, ((uint32_t)RIPPLE_MIN_HZ * count + sampleHz - 1) / sampleHz);
+    for (uint16_t bin = first; bin < count / 2; bin++) {
+        int32_t coeff = (int32_t)lroundf(2 * cosf(2 * (float)M_PI * bin / count) * (1 << RIPPLE_COEFF_SHIFT));
+
+        rippleBins[bin] = sqrtf((float)max(goertzelPower(rippleAc, count, coeff), (int64_t)0));
+        if (peak == 0 || rippleBins[bin] > rippleBins[peak])
+            peak = bin;
+    }
+    if (peak == 0 || high == low)
+        return;
+
+    // Between bins, the peak is placed by a parabola through its neighbours
+    if (peak > first && peak + 1 < count / 2) {
+        float before = rippleBins[peak - 1], after = rippleBins[peak + 1];
+        float curve = before - 2 * rippleBins[peak] + after;
+
+        if (curve < 0)
+            delta = 0.5f * (before - after) / curve;
+    }
+    analysis.frequency = (peak + delta) * sampleHz / count;
+    analysis.amplitude = voltsPerCount * 2 * rippleBins[peak] / count;
+}
+
+#if ENABLE_RIPPLE_ANALYSIS
+
+// The burst, written by the timer interrupt until complete, then read by the loop
+static uint16_t rippleSamples[RIPPLE_SAMPLES];
+static volatile uint16_t rippleCount;
+static volatile bool rippleComplete;
+static IntervalTimer rippleTimer;
+
+// Only used by the loop
+static uint8_t ripplePin;
+static float rippleVoltsPerCount;
+static bool rippleRunning;
+static uint32_t rippleStartMs;
+static bool rippleAnalysed;
+static RippleAnalysis rippleAnalysis;
+
+#if defined(__IMXRT1062__)
+
+// ADC input number of the supply voltage pin
+static uint8_t rippleInput;
+
+// Burst timer interrupt: take the conversion started at the last tick and start the next one
+FASTRUN static void sampleRipple()
+{
+    uint16_t count = rippleCount;
+
+    rippleSamples[count++] = ADC2_R0;
+    rippleCount = count;
+    if (count < RIPPLE_SAMPLES) {
+        ADC2_HC0 = ADC_HC_ADCH(rippleInput);
+    } else {
+        rippleTimer.end();
+        rippleComplete = true;
+    }
+}
+
+FLASHMEM void initRipple(uint8_t pin, float voltsPerCount)
+{
+    ripplePin = pin;
+    rippleVoltsPerCount = voltsPerCount;
+    rippleInput = getAdcInput(pin);
+
+    // The core has already clocked and calibrated ADC2 like ADC1: single 12 bit conversions
+    // without averaging, started by software
+    ADC2_CFG = (ADC2_CFG & ~(ADC_CFG_MODE(3) | ADC_CFG_AVGS(3))) | ADC_CFG_MODE(2);
+    ADC2_GC &= ~(ADC_GC_ADCO | ADC_GC_AVGE);
+}
+
+// Start a burst: the first conversion now, the timer takes it one period later
+static void startRippleBurst()
+{
+    rippleCount = 0;
+    rippleComplete = false;
+    ADC2_HC0 = ADC_HC_ADCH(rippleInput);
+    rippleTimer.priority(RIPPLE_TIMER_PRIORITY);
+    rippleTimer.begin(sampleRipple, 1000000 / RIPPLE_SAMPLE_HZ);
+}
+
+#else
+
+// On the host, the samples come from the analogue input hook, scaled to 12 bits
+static void sampleRipple()
+{
+    uint16_t count = rippleCount;
+
+    rippleSamples[count++] = hostAnalogSample(ripplePin) * (RIPPLE_ADC_MAX + 1) / 1024;
+    rippleCount = count;
+    if (count == RIPPLE_SAMPLES) {
+        rippleTimer.end();
+        rippleComplete = true;
+    }
+}
+
+void initRipple(uint8_t pin, float voltsPerCount)
+{
+    ripplePin = pin;
+    rippleVoltsPerCount = voltsPerCount;
+}
+
+static void startRippleBurst()
+{
+    rippleCount = 0;
+    rippleComplete = false;
+    rippleTimer.begin(sampleRipple, 1000000 / RIPPLE_SAMPLE_HZ);
+}
+
+#endif
+
+bool serviceRipple(RippleAnalysis &analysis)
+{
+    if (rippleRunning && rippleComplete) {
+        analyseRipple(rippleSamples, RIPPLE_SAMPLES, RIPPLE_SAMPLE_HZ, rippleVoltsPerCount, rippleAnalysis);
+        rippleAnalysed = true;
+        rippleRunning = false;
+    }
+    if (!rippleRunning && (millis() - rippleStartMs >= RIPPLE_BURST_PERIOD_MS || !rippleAnalysed)) {
+        rippleStartMs = millis();
+        rippleRunning = true;
+        startRippleBurst();
+    }
+
+    analysis = rippleAnalysis;
+    return rippleAnalysed;
+}
+
+#else
+
+void initRipple(uint8_t pin, float voltsPerCount)
+{
+}
+
+bool serviceRipple(RippleAnalysis &analysis)
+{
+    memset(&analysis, 0, sizeof(RippleAnalysis));
+    return false;
+}
+
+#endif
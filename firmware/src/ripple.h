@@ -0,0 +1,77 @@
+/*
+ * Charging system ripple analysis for the RX-8 Ashtray Gauges project.
+ * The alternator output is rectified three phase AC: a healthy one leaves a small ripple on the
+ * supply at six times its electrical frequency, a failed diode or phase winding leaves a much
+ * larger one at a third of that (or lower), and a failing regulator makes it wander at a few
+ * hertz. The supply voltage gauge only sees the average, so once a second the supply input is
+ * sampled in a burst of RIPPLE_SAMPLES at RIPPLE_SAMPLE_HZ by ADC2, paced by a timer interrupt
+ * that only reads the last conversion and starts the next one (the loop isn't held). The loop
+ * then analyses the burst:
+ *  - The ripple RMS, over the samples minus their mean. The sum of squares runs two samples per
+ *    instruction on the Cortex-M7 (SMLALD).
+ *  - Its dominant frequency and amplitude, by a fixed point Goertzel scan of the DFT bins above
+ *    RIPPLE_MIN_HZ. A full scan of 512 samples is under a millisecond, once a second.
+ * The ripple is a gauge channel, "ripple", in volts RMS with RIPPLE_WARNING_VOLTS as its high
+ * threshold: above that, it's an alert like the others (LED, buzzer, black box).
+ *
+ * The burst needs ADC2, so this can't be used with ADC_COMPARE_ALARMS or DUAL_ADC_SAMPLING.
+ * Frequencies above RIPPLE_SAMPLE_HZ / 2 fold back below it, the RMS is right anyway.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#ifndef RIPPLE_H
+#define RIPPLE_H
+
+#include <stdint.h>
+
+// Set this to 1 to analyse the ripple of the supply voltage
+#define ENABLE_RIPPLE_ANALYSIS 0
+
+// Burst sampling rate in Hz, and samples per burst (an even number)
+#define RIPPLE_SAMPLE_HZ 10000
+#define RIPPLE_SAMPLES 512
+
+// Time between two bursts, in milliseconds
+#define RIPPLE_BURST_PERIOD_MS 1000
+
+// Lowest frequency looked for, in Hz: the DFT bins below only hold the slow drift of the supply
+#define RIPPLE_MIN_HZ 50
+
+// Ripple RMS above which the charging system needs looking at, in volts. A healthy alternator
+// stays well under 0.1V, a meter on AC reading 0.5V across the battery points to a failed diode.
+#define RIPPLE_WARNING_VOLTS 0.5
+
+// Priority of the burst timer interrupt: below the alert timer
+#define RIPPLE_TIMER_PRIORITY 48
+
+// Burst resolution: 12 bit conversions, without averaging
+#define RIPPLE_ADC_MAX 4095
+
+// Result of the analysis of one burst
+typedef struct {
+    float mean;                 // Average supply voltage, in volts
+    float rms;                  // Ripple RMS, in volts
+    float peak_to_peak;         // Ripple from its lowest to its highest sample, in volts
+    float frequency;            // Dominant frequency, in Hz, 0 for a flat supply
+    float amplitude;            // Its amplitude (peak), in volts
+} RippleAnalysis;
+
+// Analyse a burst of samples
+// samples: The samples, in counts
+// count: Their number, even, up to RIPPLE_SAMPLES
+// sampleHz: The sampling rate, in Hz
+// voltsPerCount: The supply voltage of one count
+// analysis: Receives the result
+void analyseRipple(const uint16_t *samples, uint16_t count, uint32_t sampleHz, float voltsPerCount, RippleAnalysis &analysis);
+
+// Set up ADC2 for the bursts. The first one starts on the first read.
+// pin: The analogue input of the supply voltage
+// voltsPerCount: The supply voltage of one 12 bit count, through the divider
+void initRipple(uint8_t pin, float voltsPerCount);
+
+// Analyse a completed burst and start the next one when it's due. Call this from the loop.
+// analysis: Receives the analysis of the last burst
+// Return: False until the first burst is analysed
+bool serviceRipple(RippleAnalysis &analysis);
+
+#endif
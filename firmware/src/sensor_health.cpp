@@ -0,0 +1,151 @@
+/*
+ * Sensor health diagnostics for the RX-8 Ashtray Gauges project.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#include <string.h>
+#include "sensor_health.h"
+
+void initSensorHealth(SensorHealth &health, uint8_t lowRailFault, uint8_t highRailFault)
+{
+    memset(&health, 0, sizeof(SensorHealth));
+    health.low_rail_fault = lowRailFault;
+    health.high_rail_fault = highRailFault;
+}
+
+void rebaseSensorHealth(SensorHealth &health)
+{
+    health.seeded = false;
+    health.pending = false;
+    health.variance = 0;
+    health.same_count = 0;
+}
+
+bool isHardSensorFault(uint8_t code)
+{
+    return code == ESENSOROPEN || code == ESENSORSHORT;
+}
+
+// Update the exponentially weighted mean and variance with an accepted sample
+static void acceptSample(SensorHealth &health, uint16_t raw)
+{
+    float delta;
+
+    // Seed the statistics with the first sample
+    if (!health.seeded) {
+        health.mean = raw;
+        health.last_raw = raw;
+        health.seeded = true;
+    }
+
+    delta = (float)raw - health.mean;
+    health.mean += SENSOR_STATS_ALPHA * delta;
+    health.variance = (1.0 - SENSOR_STATS_ALPHA) * (health.variance + SENSOR_STATS_ALPHA * delta * delta);
+
+    if (raw == health.last_raw) {
+        health.same_count++;
+    } else {
+        health.same_count = 0;
+    }
+    health.last_raw = raw;
+}
+
+// Track consecutive samples at the rails and raise or clear the rail fault
+// Return: True if the sample is at a rail that means a fault, so it must not be used in the statistics
+static bool processRails(SensorHealth &health, uint16_t raw)
+{
+    uint8_t railFault = ENOERR;
+
+    if (raw <= SENSOR_RAIL_MARGIN_COUNTS) {
+        railFault = health.low_rail_fault;
+    } else if (raw >= SENSOR_ADC_MAX_COUNTS - SENSOR_RAIL_MARGIN_COUNTS) {
+        railFault = health.high_rail_fault;
+    }
+
+    if (railFault == ENOERR) {
+        health.rail_streak = 0;
+        if (health.off_rail_streak < SENSOR_RAIL_SAMPLES)
+            health.off_rail_streak++;
+        if (health.rail_fault != ENOERR && health.off_rail_streak >= SENSOR_RAIL_SAMPLES)
+            health.rail_fault = ENOERR;
+        return false;
+    }
+
+    health.off_rail_streak = 0;
+    if (health.rail_streak < SENSOR_RAIL_SAMPLES)
+        health.rail_streak++;
+    if (health.rail_streak >= SENSOR_RAIL_SAMPLES && health.rail_fault != railFault) {
+        health.rail_fault = railFault;
+        health.rail_faults++;
+    }
+
+    // An isolated sample at the rail is still a glitch, let it through the glitch detection
+    return health.rail_fault != ENOERR;
+}
+
+// Count a glitch in the current window
+static void countGlitch(SensorHealth &health)
+{
+    health.glitches++;
+    health.window_glitches++;
+}
+
+uint8_t updateSensorHealth(SensorHealth &health, uint16_t raw)
+{
+    float distance;
+    float noiseLimit;
+
+    health.samples++;
+
+    // Glitch rate window
+    if (++health.window_samples >= SENSOR_GLITCH_WINDOW_SAMPLES) {
+        health.glitch_rate = health.window_glitches;
+        health.window_samples = 0;
+        health.window_glitches = 0;
+    }
+
+    if (!processRails(health, raw)) {
+        distance = (float)raw - health.mean;
+        if (distance < 0)
+            distance = -distance;
+
+        if (health.samples <= SENSOR_WARMUP_SAMPLES || distance < SENSOR_GLITCH_DELTA_COUNTS) {
+            // Back near the mean: the pending sample was a glitch
+            if (health.pending) {
+                countGlitch(health);
+                health.pending = false;
+            }
+            acceptSample(health, raw);
+        } else if (!health.pending) {
+            // Far from the mean, wait for the next sample to decide
+            health.pending = true;
+            health.pending_raw = raw;
+        } else {
+            // Two samples in a row far from the mean: that's a real step, restart from there
+            health.pending = false;
+            health.mean = ((float)health.pending_raw + (float)raw) / 2.0;
+            health.same_count = 0;
+            health.last_raw = raw;
+        }
+    }
+
+    // Pick the most severe condition
+    noiseLimit = SENSOR_NOISE_LIMIT_COUNTS * SENSOR_NOISE_LIMIT_COUNTS;
+    // Once noisy, wait for the noise to drop clearly below the limit before clearing
+    if (health.fault == ESENSORNOISY)
+        noiseLimit *= 0.5;
+
+    if (health.rail_fault != ENOERR) {
+        health.fault = health.rail_fault;
+    } else if (SENSOR_STUCK_SAMPLES > 0 && health.same_count >= SENSOR_STUCK_SAMPLES) {
+        health.fault = ESENSORSTUCK;
+    } else if (health.glitch_rate > SENSOR_GLITCH_RATE_LIMIT) {
+        health.fault = ESENSORGLITCH;
+    } else if (health.samples > SENSOR_WARMUP_SAMPLES && health.variance > noiseLimit) {
+        health.fault = ESENSORNOISY;
+    } else {
+        health.fault = ENOERR;
+    }
+
+    return health.fault;
+}
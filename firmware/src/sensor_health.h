@@ -0,0 +1,100 @@
+/*
+ * Sensor health diagnostics for the RX-8 Ashtray Gauges project.
+ * Every raw ADC sample of a channel is fed through a small streaming analysis, so a
+ * disconnected sensor can be told apart from a shorted one, a frozen reading or a
+ * connector that only loses contact now and then.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#ifndef SENSOR_HEALTH_H
+#define SENSOR_HEALTH_H
+
+#include <stdint.h>
+#include "error_codes.h"
+
+// Full scale of the raw ADC samples (10 bits)
+#define SENSOR_ADC_MAX_COUNTS 1023
+
+// A raw sample this close to a rail, in ADC counts, is considered to be at the rail
+#define SENSOR_RAIL_MARGIN_COUNTS 4
+// Number of consecutive samples at a rail before an open/short fault is raised.
+// The fault clears after as many consecutive samples away from the rail.
+#define SENSOR_RAIL_SAMPLES 10
+
+// Weight of each new sample in the running mean and variance
+#define SENSOR_STATS_ALPHA (1.0 / 64.0)
+// Number of samples before the running statistics are trusted
+#define SENSOR_WARMUP_SAMPLES 64
+
+// Running standard deviation above which a channel is noisy, in ADC counts.
+// The Teensy ADC noise floor is one or two counts.
+#define SENSOR_NOISE_LIMIT_COUNTS 12.0
+
+// A single sample this far from the running mean, that comes back on the next sample, is a glitch
+#define SENSOR_GLITCH_DELTA_COUNTS 80
+// Glitches are counted over windows of this many samples
+#define SENSOR_GLITCH_WINDOW_SAMPLES 1000
+// Number of glitches per window above which the channel is flagged
+#define SENSOR_GLITCH_RATE_LIMIT 5
+
+// Number of consecutive identical samples before a channel is considered stuck, 0 to disable.
+// A live analogue input usually moves by a count or two. At 5 samples per reading and
+// 5 readings per second, 1500 samples is one minute. A steady input is also normal (a regulated
+// supply, no oil pressure with the engine off, the ADC averaging its conversions), so stuck is
+// only a warning: the reading stays valid.
+#define SENSOR_STUCK_SAMPLES 1500
+
+// Streaming health state of one analogue channel
+typedef struct {
+    // Configuration, set by initSensorHealth()
+    uint8_t low_rail_fault;     // Code raised when the input sits at the low rail, ENOERR if that's a valid reading
+    uint8_t high_rail_fault;    // Code raised when the input sits at the high rail, ENOERR if that's a valid reading
+
+    // Running statistics
+    float mean;                 // Exponentially weighted mean, in counts
+    float variance;             // Exponentially weighted variance, in counts squared
+    bool seeded;                // True once the mean has been seeded with a first sample
+    uint16_t last_raw;          // Last sample accepted in the statistics
+    uint16_t pending_raw;       // Sample far from the mean, waiting for the next one to tell a glitch from a step
+    bool pending;               // True if pending_raw holds a sample
+
+    // Rail, stuck and glitch tracking
+    uint16_t rail_streak;       // Consecutive samples at the same rail
+    uint16_t off_rail_streak;   // Consecutive samples away from the rails
+    uint8_t rail_fault;         // Current rail fault, ENOERR if none
+    uint32_t same_count;        // Consecutive identical samples
+    uint16_t window_samples;    // Samples in the current glitch window
+    uint16_t window_glitches;   // Glitches in the current glitch window
+    uint16_t glitch_rate;       // Glitches in the last complete window
+
+    // Counters
+    uint32_t samples;           // Total samples analysed
+    uint32_t glitches;          // Total glitches seen
+    uint32_t rail_faults;       // Number of times a rail fault was raised
+
+    uint8_t fault;              // Current health code, ENOERR or one of ESENSOR*
+} SensorHealth;
+
+// Reset the health state of a channel
+// health: The channel health state
+// lowRailFault: The code to raise when the input sits at the low rail (ENOERR if it is a valid reading)
+// highRailFault: The code to raise when the input sits at the high rail (ENOERR if it is a valid reading)
+void initSensorHealth(SensorHealth &health, uint8_t lowRailFault, uint8_t highRailFault);
+
+// Restart the running statistics from the next sample, keeping the rail state and the counters.
+// Use this when the input scaling changes on purpose (e.g. a thermistor reference switch),
+// so the step isn't taken for noise or a stuck sensor.
+// health: The channel health state
+void rebaseSensorHealth(SensorHealth &health);
+
+// Analyse one raw ADC sample. Constant time, meant to be called for every sample taken.
+// health: The channel health state
+// raw: The raw ADC sample, 0 to SENSOR_ADC_MAX_COUNTS
+// Return: The channel health code after this sample, ENOERR or one of ESENSOR*
+uint8_t updateSensorHealth(SensorHealth &health, uint16_t raw);
+
+// Return true if the health code means the reading can't be used at all
+// (open or shorted), false if the reading is good or only degraded (stuck, noisy, glitches)
+bool isHardSensorFault(uint8_t code);
+
+#endif
@@ -0,0 +1,56 @@
+/*
+ * Sensor snapshot for the RX-8 Ashtray Gauges project, see sensor_snapshot.h.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#include <string.h>
+#include <Arduino.h>
+#include "sensor_snapshot.h"
+
+// The two frames: the published one is frames[sequence % 2], the writer fills the other one
+static SensorSnapshot snapshotFrames[2];
+static uint32_t snapshotSequence = 0;
+
+SensorSnapshot &beginSensorSnapshot()
+{
+    // Only the writer changes the sequence, it doesn't need to be read atomically here
+    return snapshotFrames[(snapshotSequence + 1) % 2];
+}
+
+void publishSensorSnapshot()
+{
+    uint32_t sequence = snapshotSequence + 1;
+    SensorSnapshot &frame = snapshotFrames[sequence % 2];
+
+    frame.sequence = sequence;
+    frame.published_us = micros();
+    // The frame is written before the sequence that publishes it (a DMB on the Cortex-M7)
+    __atomic_store_n(&snapshotSequence, sequence, __ATOMIC_RELEASE);
+}
+
+bool readSensorSnapshot(SensorSnapshot &snapshot)
+{
+    uint32_t sequence;
+
+    for (uint8_t attempt = 0; attempt < SENSOR_SNAPSHOT_RETRIES; attempt++) {
+        sequence = __atomic_load_n(&snapshotSequence, __ATOMIC_ACQUIRE);
+        if (sequence == 0)
+            return false;
+        memcpy(&snapshot, &snapshotFrames[sequence % 2], sizeof(SensorSnapshot));
+        // The copy is read before the sequence is checked again
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&snapshotSequence, __ATOMIC_RELAXED) == sequence)
+            return true;
+    }
+    return false;
+}
+
+bool isSnapshotChannelAlerting(const SnapshotChannel &channel)
+{
+    return !channel.valid || channel.value <= channel.low || channel.value >= channel.high;
+}
+
+uint32_t getSensorSnapshotSequence()
+{
+    return __atomic_load_n(&snapshotSequence, __ATOMIC_ACQUIRE);
+}
@@ -0,0 +1,73 @@
+/*
+ * Sensor snapshot for the RX-8 Ashtray Gauges project.
+ * The loop publishes a snapshot of every gauge channel once per pass, after reading them: the
+ * reading, its error and sensor health codes, its thresholds, the alert state and the time it
+ * was acquired. The displays, the CAN publisher and the host tools read the snapshot instead of
+ * the channel states, and any code added later (telemetry, logging), from the loop or from an
+ * interrupt, gets a consistent frame the same way.
+ *
+ * The snapshot is double buffered under a sequence number (a seqlock on two frames):
+ *  - The loop, the only writer, fills the frame that isn't published in place, then publishes
+ *    it by incrementing the sequence. It never waits, and never copies a frame.
+ *  - A reader copies the published frame, then checks that the sequence didn't move. If it
+ *    did, the writer published twice meanwhile and may have been writing the frame being
+ *    copied, the reader starts again. A reader in an interrupt that preempts the writer copies
+ *    the frame the writer isn't touching, so it never has to start again.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#ifndef SENSOR_SNAPSHOT_H
+#define SENSOR_SNAPSHOT_H
+
+#include <stdint.h>
+
+// Channels in a snapshot, GAUGE_CHANNEL_MAX
+#define SENSOR_SNAPSHOT_CHANNELS 8
+
+// Attempts of readSensorSnapshot() before giving up, against a writer publishing continuously
+#define SENSOR_SNAPSHOT_RETRIES 8
+
+// One gauge channel in a snapshot
+typedef struct {
+    float value;                // Last valid reading, lag compensated and smoothed
+    float low;                  // Current warning thresholds, see GaugeChannel
+    float high;
+    uint32_t sampled_us;        // micros() at the end of the acquisition of the last reading
+    uint8_t error;              // ENOERR or the error code of the last reading
+    uint8_t health;             // ENOERR or the ESENSOR* code of the sensor, see sensor_health.h
+    uint8_t reason;             // ALERT_* reason the channel is in alert for, see alert.h
+    bool valid;                 // value holds a reading, the last one didn't fail
+} SnapshotChannel;
+
+// A snapshot of every gauge channel
+typedef struct {
+    uint32_t sequence;          // Number of the snapshot, counting from 1
+    uint32_t published_us;      // micros() when it was published
+    uint8_t count;              // Number of channels, in gauge_channels order
+    uint8_t alerting;           // Bit per channel in alert
+    SnapshotChannel channels[SENSOR_SNAPSHOT_CHANNELS];
+} SensorSnapshot;
+
+// Get the frame to fill for the next snapshot, from the loop only. Every field must be written,
+// the frame holds the snapshot before the last one.
+// Return: The frame
+SensorSnapshot &beginSensorSnapshot();
+
+// Publish the frame filled since beginSensorSnapshot(), from the loop only
+void publishSensorSnapshot();
+
+// Copy the last snapshot published. Any context, the interrupts included.
+// snapshot: Receives the snapshot
+// Return: False if there's none yet, or the writer kept publishing during every attempt
+bool readSensorSnapshot(SensorSnapshot &snapshot);
+
+// Return true if a channel of a snapshot must be shown as an alert: its last reading failed, or
+// it's beyond a threshold
+// channel: The channel
+bool isSnapshotChannelAlerting(const SnapshotChannel &channel);
+
+// Get the number of the last snapshot published, to check for a new one without copying it
+// Return: The number, 0 before the first one
+uint32_t getSensorSnapshotSequence();
+
+#endif
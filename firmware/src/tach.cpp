@@ -0,0 +1,187 @@
+/*
+ * Tachometer input for the RX-8 Ashtray Gauges project, see tach.h.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#include <string.h>
+#include <Arduino.h>
+#include "tach.h"
+
+void initTachometer(Tachometer &tach, uint32_t tickHz, uint8_t pulsesPerRev, uint32_t averageMs, uint32_t timeoutMs)
+{
+    memset(&tach, 0, sizeof(Tachometer));
+    tach.tick_hz = tickHz;
+    tach.pulses_per_rev = pulsesPerRev;
+    tach.average_ticks = (uint32_t)((uint64_t)tickHz * averageMs / 1000);
+    tach.timeout_ticks = (uint32_t)((uint64_t)tickHz * timeoutMs / 1000);
+    // Half the wrap of the 16 bit capture timer: the poll jitter is well within the other half
+    tach.late_us = (uint32_t)(32768ULL * 1000000 / tickHz);
+}
+
+// Take a captured edge into the ring and average the periods since the newest capture at least
+// the averaging time before it
+// tach: The tachometer
+// edge: The number of the edge, counting from the first poll
+// ticks: Its time
+static void addTachEdge(Tachometer &tach, uint32_t edge, uint32_t ticks)
+{
+    uint8_t index;
+    uint32_t windowTicks;
+
+    tach.capture_edges[tach.head] = edge;
+    tach.capture_ticks[tach.head] = ticks;
+    tach.edge_ticks = ticks;
+    tach.head = (tach.head + 1) % TACH_CAPTURE_COUNT;
+    if (tach.captures < TACH_CAPTURE_COUNT)
+        tach.captures++;
+
+    // Walk back to the reference edge, or stop at the oldest capture
+    for (uint8_t i = 1; i < tach.captures; i++) {
+        index = (tach.head + TACH_CAPTURE_COUNT - 1 - i) % TACH_CAPTURE_COUNT;
+        windowTicks = ticks - tach.capture_ticks[index];
+        if (windowTicks >= tach.average_ticks || i == tach.captures - 1) {
+            // (edges / pulses per turn) turns in (window / tick rate) seconds
+            tach.rpm = (float)((double)(edge - tach.capture_edges[index]) * 60.0 * tach.tick_hz /
+                ((double)tach.pulses_per_rev * windowTicks));
+            tach.estimates++;
+            return;
+        }
+    }
+}
+
+FASTRUN void pollTachometer(Tachometer &tach, uint16_t count, bool captured, uint16_t capture, uint16_t now, uint32_t nowUs)
+{
+    uint16_t newEdges;
+
+    if (!tach.started) {
+        // The edges before the first poll aren't numbered: a capture pending now is thrown away
+        tach.started = true;
+        tach.last_count = count;
+        tach.last_now = now;
+        tach.last_us = nowUs;
+        return;
+    }
+
+    newEdges = count - tach.last_count;
+
+    if (nowUs - tach.last_us > tach.late_us) {
+        // A late poll: the capture timer may have wrapped, the time comes from micros() and the
+        // captured edge can't be timed. The speed is kept, the next captures start the averaging
+        // again: a few edges over the late time would give a rough one at idle.
+        tach.now_ticks += (uint32_t)((uint64_t)(nowUs - tach.last_us) * tach.tick_hz / 1000000);
+        tach.captures = 0;
+        if (newEdges)
+            tach.edge_ticks = tach.now_ticks;
+    } else {
+        tach.now_ticks += (uint16_t)(now - tach.last_now);
+
+        // The captured edge is the first one after the last poll, its time is counted back from now
+        if (captured && newEdges)
+            addTachEdge(tach, tach.edges + 1, tach.now_ticks - (uint16_t)(now - capture));
+    }
+
+    tach.edges += newEdges;
+    tach.last_count = count;
+    tach.last_now = now;
+    tach.last_us = nowUs;
+
+    // Without edges, the engine stopped: the next edge starts the averaging again
+    if ((tach.captures || tach.rpm) && tach.now_ticks - tach.edge_ticks > tach.timeout_ticks) {
+        tach.captures = 0;
+        tach.rpm = 0;
+    }
+}
+
+#if ENABLE_TACH_INPUT
+
+// Only used by the poll timer interrupt, once started
+static Tachometer tachometer;
+static IntervalTimer tachTimer;
+
+#if defined(__IMXRT1062__)
+
+// Poll timer interrupt: read the counters and clear the capture flag
+FASTRUN static void pollTach()
+{
+    bool captured = TMR4_SCTRL3 & TMR_SCTRL_IEF;
+    uint16_t capture = TMR4_CAPT3;
+    uint16_t count;
+
+    // The next capture must be the edge after 'count': if an edge comes between the count read
+    // and the flag clear, it's counted and its capture is cleared, so read and clear again
+    do {
+        count = TMR4_CNTR2;
+        TMR4_SCTRL3 &= ~TMR_SCTRL_IEF;
+    } while (TMR4_CNTR2 != count);
+
+    pollTachometer(tachometer, count, captured, capture, TMR4_CNTR3, micros());
+}
+
+FLASHMEM void initTach()
+{
+    initTachometer(tachometer, TACH_TIMER_HZ, TACH_PULSES_PER_REV, TACH_AVERAGE_MS, TACH_TIMEOUT_MS);
+
+    CCM_CCGR6 |= CCM_CCGR6_QQTIMER4(CCM_CCGR_ON);
+
+    // Timer 2: count the rising edges of its input pin, free running over 16 bits
+    TMR4_CTRL2 = 0;
+    TMR4_SCTRL2 = 0;
+    TMR4_CSCTRL2 = 0;
+    TMR4_LOAD2 = 0;
+    TMR4_CNTR2 = 0;
+    TMR4_CTRL2 = TMR_CTRL_CM(1) | TMR_CTRL_PCS(2);
+
+    // Timer 3: count the bus clock / 128, capture on the rising edges of the timer 2 input pin
+    TMR4_CTRL3 = 0;
+    TMR4_CSCTRL3 = 0;
+    TMR4_LOAD3 = 0;
+    TMR4_CNTR3 = 0;
+    TMR4_SCTRL3 = TMR_SCTRL_CAPTURE_MODE(1);
+    TMR4_CTRL3 = TMR_CTRL_CM(1) | TMR_CTRL_PCS(8 + 7) | TMR_CTRL_SCS(2);
+
+    // Pin 9 (GPIO_B0_11) to QTIMER4_TIMER2 (ALT1), with the keeper off: the signal drives it
+    IOMUXC_SW_PAD_CTL_PAD_GPIO_B0_11 = IOMUXC_PAD_HYS | IOMUXC_PAD_DSE(1);
+    IOMUXC_SW_MUX_CTL_PAD_GPIO_B0_11 = 1;
+
+    tachTimer.begin(pollTach, TACH_POLL_US);
+}
+
+#else
+
+// On the host there is no signal: the counters never move and the engine reads stopped
+static void pollTach()
+{
+    uint32_t nowUs = micros();
+
+    pollTachometer(tachometer, 0, false, 0, (uint16_t)((uint64_t)nowUs * TACH_TIMER_HZ / 1000000), nowUs);
+}
+
+void initTach()
+{
+    initTachometer(tachometer, TACH_TIMER_HZ, TACH_PULSES_PER_REV, TACH_AVERAGE_MS, TACH_TIMEOUT_MS);
+    tachTimer.begin(pollTach, TACH_POLL_US);
+}
+
+#endif
+
+bool getTachRpm(float &rpm)
+{
+    noInterrupts();
+    rpm = tachometer.rpm;
+    interrupts();
+    return true;
+}
+
+#else
+
+void initTach()
+{
+}
+
+bool getTachRpm(float &rpm)
+{
+    rpm = 0;
+    return false;
+}
+
+#endif
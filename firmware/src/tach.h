@@ -0,0 +1,108 @@
+/*
+ * Tachometer input for the RX-8 Ashtray Gauges project.
+ * The engine speed is measured from the tach signal on pin 9 by the quad timer QTimer4, without
+ * an interrupt per pulse:
+ *  - Timer 2 counts the rising edges of the signal.
+ *  - Timer 3 runs from the bus clock and captures its count on the first rising edge after its
+ *    capture flag was cleared.
+ * A timer interrupt polls both every TACH_POLL_US and clears the capture flag. The captured
+ * edge is then the one numbered after the edges counted at the last poll, so the time between
+ * two captures covers a known number of whole periods. At each capture, the engine speed is the
+ * average over the periods since the capture TACH_AVERAGE_MS earlier or so. The CPU cost doesn't
+ * depend on the engine speed.
+ *
+ * The 16 bit counters are extended to 32 bits at each poll, the polls come often enough that
+ * they can't wrap in between. That arithmetic and the averaging don't touch the hardware, see
+ * pollTachometer(): the host tools run them on synthetic pulse trains.
+ *
+ * The tach signal of the car swings 0-12V: bring it down to 3.3V (divider and clamp diode, or an
+ * opto-coupler) before it reaches the pin.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#ifndef TACH_H
+#define TACH_H
+
+#include <stdint.h>
+
+// Set this to 1 to measure the engine speed from the tach signal on TACH_INPUT_PIN
+#define ENABLE_TACH_INPUT 0
+
+// Input pin, QTimer4 timer 2 input. Do not change this.
+#define TACH_INPUT_PIN 9
+
+// Pulses of the tach signal per turn of the eccentric shaft. Set this to your signal.
+#define TACH_PULSES_PER_REV 2
+
+// Time between two polls of the counters, in microseconds. Must be well below the time the
+// capture timer takes to wrap (65536 ticks of TACH_TIMER_HZ, 56ms).
+#define TACH_POLL_US 10000
+
+// Shortest time the periods are averaged over, in milliseconds
+#define TACH_AVERAGE_MS 100
+
+// Without an edge for this long, the engine is stopped, in milliseconds
+#define TACH_TIMEOUT_MS 1000
+
+// Number of captured edges kept to average over, at least TACH_AVERAGE_MS / (TACH_POLL_US / 1000) + 2
+#define TACH_CAPTURE_COUNT 16
+
+// Clock of the capture timer: the 150MHz bus clock divided by 128, in Hz
+#define TACH_TIMER_HZ (150000000 / 128)
+
+// Engine speed measurement state
+typedef struct {
+    // Configuration, set by initTachometer()
+    uint32_t tick_hz;           // Capture timer clock, in Hz
+    uint8_t pulses_per_rev;
+    uint32_t average_ticks;     // Shortest averaging window, in ticks
+    uint32_t timeout_ticks;     // Time without edges before the speed drops to 0, in ticks
+    uint32_t late_us;           // Time between two polls past which the capture timer may have wrapped
+
+    // Counters extended to 32 bits
+    bool started;               // False until the first poll
+    uint16_t last_count;        // Edge counter at the last poll
+    uint16_t last_now;          // Capture timer at the last poll
+    uint32_t last_us;           // micros() at the last poll
+    uint32_t edges;             // Edges counted since the first poll
+    uint32_t now_ticks;         // Capture timer ticks since the first poll
+
+    // Ring of the last captured edges, newest at head - 1
+    uint32_t capture_edges[TACH_CAPTURE_COUNT];     // Edge number, counting from the first poll
+    uint32_t capture_ticks[TACH_CAPTURE_COUNT];     // Time of the edge
+    uint8_t head;
+    uint8_t captures;           // Number of captures in the ring, 0 when the engine is stopped
+    uint32_t edge_ticks;        // Time of the newest capture, or of the late poll that counted the newest edges
+
+    float rpm;                  // Engine speed, 0 when stopped
+    uint32_t estimates;         // Number of times the speed was computed
+} Tachometer;
+
+// Reset a tachometer
+// tach: The tachometer
+// tickHz: The clock of the capture timer, in Hz
+// pulsesPerRev: The number of pulses per turn
+// averageMs: The shortest time to average the periods over, in milliseconds
+// timeoutMs: The time without edges after which the engine is stopped, in milliseconds
+void initTachometer(Tachometer &tach, uint32_t tickHz, uint8_t pulsesPerRev, uint32_t averageMs, uint32_t timeoutMs);
+
+// Process one poll of the counters
+// tach: The tachometer
+// count: The free running edge counter
+// captured: True if an edge was captured since the capture flag was last cleared
+// capture: The capture timer value at that edge
+// now: The capture timer value now, the flag having been cleared since count was read
+// nowUs: micros() now. A poll that comes too late to tell how often the capture timer wrapped
+// (the interrupts held, e.g. by a flash erase of the black box) takes its time from it, keeps
+// the speed and starts the averaging again.
+void pollTachometer(Tachometer &tach, uint16_t count, bool captured, uint16_t capture, uint16_t now, uint32_t nowUs);
+
+// Start measuring on TACH_INPUT_PIN. Does nothing unless ENABLE_TACH_INPUT is set.
+void initTach();
+
+// Get the engine speed measured from the tach signal
+// rpm: Receives the engine speed, 0 when the engine is stopped (or nothing is wired)
+// Return: False if ENABLE_TACH_INPUT isn't set
+bool getTachRpm(float &rpm);
+
+#endif
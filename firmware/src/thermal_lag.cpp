@@ -0,0 +1,90 @@
+/*
+ * Sensor lag compensation for the RX-8 Ashtray Gauges project, see thermal_lag.h.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#include <math.h>
+#include <string.h>
+#include "thermal_lag.h"
+#include "error_codes.h"
+
+// Smallest step fitThermalLag() takes as one, in the reading units
+#define THERMAL_LAG_MIN_STEP 1.0
+
+void initThermalLag(ThermalLag &lag, float timeConstant)
+{
+    memset(&lag, 0, sizeof(ThermalLag));
+    lag.time_constant = timeConstant;
+}
+
+float compensateThermalLag(ThermalLag &lag, float value, uint32_t sampledUs)
+{
+    float filterTime = lag.time_constant / THERMAL_LAG_SPEEDUP;
+    float dt;
+
+    if (lag.time_constant <= 0)
+        return value;
+
+    if (!lag.seeded) {
+        lag.filtered = value;
+        lag.last_us = sampledUs;
+        lag.seeded = true;
+        return value;
+    }
+
+    // Low pass (backward Euler, stable at any sample rate), then push the reading ahead by the
+    // filtered derivative: filtered + tau * (value - filtered) / filterTime
+    dt = (sampledUs - lag.last_us) / 1e6f;
+    lag.last_us = sampledUs;
+    lag.filtered += dt / (filterTime + dt) * (value - lag.filtered);
+    return lag.filtered + THERMAL_LAG_SPEEDUP * (value - lag.filtered);
+}
+
+void resetThermalLag(ThermalLag &lag)
+{
+    lag.seeded = false;
+}
+
+int fitThermalLag(const float *seconds, const float *values, uint32_t count, float &timeConstant, float &deadTime)
+{
+    uint32_t tail = count / 10;
+    float initial, final = 0;
+    float step, remaining;
+    double sumT = 0, sumY = 0, sumTT = 0, sumTY = 0;
+    double slope, intercept;
+    uint32_t points = 0;
+
+    if (tail == 0)
+        return EINVALID;
+
+    initial = values[0];
+    for (uint32_t i = count - tail; i < count; i++)
+        final += values[i];
+    final /= tail;
+    step = final - initial;
+    if (fabsf(step) < THERMAL_LAG_MIN_STEP)
+        return EINVALID;
+
+    // ln(remaining) = -(t - deadTime) / tau
+    for (uint32_t i = 0; i < count - tail; i++) {
+        remaining = (final - values[i]) / step;
+        if (remaining > 0.9 || remaining < 0.1)
+            continue;
+        sumT += seconds[i];
+        sumY += log(remaining);
+        sumTT += (double)seconds[i] * seconds[i];
+        sumTY += seconds[i] * log(remaining);
+        points++;
+    }
+    if (points < 3 || points * sumTT - sumT * sumT <= 0)
+        return EINVALID;
+
+    slope = (points * sumTY - sumT * sumY) / (points * sumTT - sumT * sumT);
+    intercept = (sumY - slope * sumT) / points;
+    if (slope >= 0)
+        return EINVALID;
+
+    timeConstant = -1.0 / slope;
+    deadTime = intercept * timeConstant;
+    return ENOERR;
+}
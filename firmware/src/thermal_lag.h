@@ -0,0 +1,64 @@
+/*
+ * Sensor lag compensation for the RX-8 Ashtray Gauges project.
+ * A thermistor in a banjo bolt or a hose adapter follows the fluid like a first order system: its
+ * temperature moves towards the fluid's at a rate proportional to the difference,
+ *   dTsensor/dt = (Tfluid - Tsensor) / tau
+ * so after a change, the reading only gets 63% of the way in one time constant tau (several
+ * seconds), 90% in 2.3 tau. Inverting that model, the fluid temperature is
+ *   Tfluid = Tsensor + tau * dTsensor/dt
+ * The derivative of a sampled reading is noisy, so it goes through a low pass filter whose time
+ * constant is tau / THERMAL_LAG_SPEEDUP: the compensated reading responds like a sensor that many
+ * times faster, and its noise is as many times larger. As a transfer function, that's the lead-lag
+ *   (1 + tau s) / (1 + tau / THERMAL_LAG_SPEEDUP s)
+ * It costs a few multiplications per reading, and copes with an irregular sample rate.
+ *
+ * The time constant depends on the sensor, its mounting and the fluid flow: fitThermalLag()
+ * identifies it from a recorded step response (e.g. a black box dump), see the thermal-lag host tool.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#ifndef THERMAL_LAG_H
+#define THERMAL_LAG_H
+
+#include <stdint.h>
+
+// How many times faster the compensated reading responds than the sensor. Its noise is
+// amplified as much.
+#define THERMAL_LAG_SPEEDUP 4.0
+
+// Compensation state of one sensor
+typedef struct {
+    float time_constant;        // tau, in seconds, 0 to pass the readings through
+    float filtered;             // Reading through the low pass filter
+    uint32_t last_us;           // Time of the last reading
+    bool seeded;                // False until the first reading, and after a failed one
+} ThermalLag;
+
+// Reset the compensation of a sensor
+// lag: The compensation state
+// timeConstant: The time constant of the sensor, in seconds, 0 for none
+void initThermalLag(ThermalLag &lag, float timeConstant);
+
+// Compensate a reading
+// lag: The compensation state
+// value: The sensor reading
+// sampledUs: micros() at the end of its acquisition
+// Return: The estimated fluid temperature (the reading itself for the first one)
+float compensateThermalLag(ThermalLag &lag, float value, uint32_t sampledUs);
+
+// Start again from the next reading, after a failed one
+// lag: The compensation state
+void resetThermalLag(ThermalLag &lag);
+
+// Identify the time constant and dead time of a sensor from its response to a step of the fluid
+// temperature: the log of the remaining error, between 90% and 10% of the step, fitted against time
+// by least squares. The final value is the average of the last tenth of the readings.
+// seconds: The time of each reading, from the step, in seconds
+// values: The readings
+// count: The number of readings, starting at the step and ending once settled
+// timeConstant: Receives tau, in seconds
+// deadTime: Receives the time before the response starts, in seconds
+// Return: ENOERR, or EINVALID if the readings don't show a step
+int fitThermalLag(const float *seconds, const float *values, uint32_t count, float &timeConstant, float &deadTime);
+
+#endif
@@ -0,0 +1,86 @@
+/*
+ * Trend graphs for the RX-8 Ashtray Gauges project.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#include <string.h>
+#include "trend_graph.h"
+
+void initTrendGraph(TrendGraph &graph, float min, float max, uint32_t historySeconds)
+{
+    memset(&graph, 0, sizeof(TrendGraph));
+    graph.min = min;
+    graph.max = max;
+    graph.point_ms = historySeconds * 1000 / TREND_GRAPH_WIDTH;
+    graph.last_row = -1;
+}
+
+// Get the row of a value, 0 at the top
+static int8_t getTrendRow(const TrendGraph &graph, float value)
+{
+    float scaled = (value - graph.min) / (graph.max - graph.min) * (TREND_GRAPH_HEIGHT - 1);
+
+    if (scaled < 0)
+        scaled = 0;
+    if (scaled > TREND_GRAPH_HEIGHT - 1)
+        scaled = TREND_GRAPH_HEIGHT - 1;
+    return (int8_t)(TREND_GRAPH_HEIGHT - 1 - (int8_t)(scaled + 0.5));
+}
+
+// Draw the new point in the next column of the ring, overwriting the oldest one.
+// The column joins the previous point so the trace stays continuous on a fast change.
+static void pushTrendPoint(TrendGraph &graph, float value)
+{
+    int8_t row = getTrendRow(graph, value);
+    int8_t top = row;
+    int8_t bottom = row;
+
+    if (graph.last_row >= 0) {
+        if (graph.last_row < top)
+            top = graph.last_row;
+        if (graph.last_row > bottom)
+            bottom = graph.last_row;
+    }
+
+    // Rows top to bottom, inclusive
+    graph.columns[graph.head] = (uint32_t)(((2ULL << bottom) - 1) & ~((1ULL << top) - 1));
+    graph.head = (graph.head + 1) % TREND_GRAPH_WIDTH;
+    graph.last_row = row;
+}
+
+bool addTrendSample(TrendGraph &graph, float value, uint32_t nowMs)
+{
+    if (graph.samples == 0)
+        graph.point_start_ms = nowMs;
+
+    graph.sum += value;
+    graph.samples++;
+
+    if ((uint32_t)(nowMs - graph.point_start_ms) < graph.point_ms)
+        return false;
+
+    // The point is the mean of the readings over its period
+    pushTrendPoint(graph, graph.sum / graph.samples);
+    graph.sum = 0;
+    graph.samples = 0;
+    return true;
+}
+
+void drawTrendGraph(const TrendGraph &graph, uint8_t *buffer, uint8_t bufferWidth, uint8_t firstPage, bool inverted)
+{
+    uint32_t column;
+    uint8_t *dest;
+    uint8_t index = graph.head;
+
+    // Oldest column on the left, the ring index does the scrolling
+    for (uint8_t x = 0; x < TREND_GRAPH_WIDTH; x++) {
+        column = inverted ? ~graph.columns[index] : graph.columns[index];
+        dest = &buffer[firstPage * bufferWidth + TREND_GRAPH_X + x];
+        for (uint8_t page = 0; page < TREND_GRAPH_PAGES; page++) {
+            *dest = (uint8_t)(column >> (page * 8));
+            dest += bufferWidth;
+        }
+        if (++index >= TREND_GRAPH_WIDTH)
+            index = 0;
+    }
+}
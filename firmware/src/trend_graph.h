@@ -0,0 +1,61 @@
+/*
+ * Trend graphs for the RX-8 Ashtray Gauges project.
+ * Each channel keeps the last few minutes of readings, downsampled to one point per graph column,
+ * in a ring of ready to draw display columns. A new point costs one column of pixel maths, and
+ * drawing the graph is a straight copy of the ring into the display page buffer: nothing is
+ * redrawn through the graphics primitives, however long the history.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#ifndef TREND_GRAPH_H
+#define TREND_GRAPH_H
+
+#include <stdint.h>
+
+// Position of the graph on the display: the right end of each half. Do not change this.
+#define TREND_GRAPH_X 98
+#define TREND_GRAPH_WIDTH (128 - TREND_GRAPH_X)
+// A graph is one display half high: 32 rows, 4 pages of 8 rows
+#define TREND_GRAPH_HEIGHT 32
+#define TREND_GRAPH_PAGES (TREND_GRAPH_HEIGHT / 8)
+
+// History of one channel
+typedef struct {
+    // Configuration, set by initTrendGraph()
+    float min;                  // Value at the bottom row
+    float max;                  // Value at the top row
+    uint32_t point_ms;          // Time covered by one point (one column), in milliseconds
+
+    // Point being accumulated
+    float sum;
+    uint16_t samples;
+    uint32_t point_start_ms;
+
+    // Ring of drawn columns, one bit per row (bit 0 is the top row), oldest at 'head'
+    uint32_t columns[TREND_GRAPH_WIDTH];
+    uint8_t head;
+    int8_t last_row;            // Row of the newest point, -1 if there isn't one yet
+} TrendGraph;
+
+// Reset a graph
+// graph: The graph to reset
+// min, max: The values at the bottom and the top of the graph. Readings outside are clamped.
+// historySeconds: The time covered by the whole graph width, in seconds
+void initTrendGraph(TrendGraph &graph, float min, float max, uint32_t historySeconds);
+
+// Add a reading to the point being accumulated
+// graph: The channel graph
+// value: The reading
+// nowMs: The current time, in milliseconds
+// Return: True if a point was completed and the graph moved by one column, otherwise false
+bool addTrendSample(TrendGraph &graph, float value, uint32_t nowMs);
+
+// Copy the graph into a display page buffer (SSD1306 layout: one byte per column and page)
+// graph: The channel graph
+// buffer: The display page buffer
+// bufferWidth: The display width, in pixels
+// firstPage: The page of the graph top row, 0 for the top half and 4 for the bottom half
+// inverted: True to draw the graph inverted, to show a warning
+void drawTrendGraph(const TrendGraph &graph, uint8_t *buffer, uint8_t bufferWidth, uint8_t firstPage, bool inverted);
+
+#endif
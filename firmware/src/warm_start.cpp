@@ -0,0 +1,163 @@
+/*
+ * Watchdog and warm restart for the RX-8 Ashtray Gauges project, see warm_start.h.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#include <stddef.h>
+#include <string.h>
+#include <Arduino.h>
+#include "warm_start.h"
+
+static_assert(WATCHDOG_TIMEOUT_MS % 500 == 0 && WATCHDOG_TIMEOUT_MS >= 500 && WATCHDOG_TIMEOUT_MS <= 128000,
+    "The watchdog counts half seconds, up to 128 s");
+static_assert(WATCHDOG_TIMEOUT_MS > POWER_OFF_PERIOD_MS, "The longest loop pass must feed the watchdog in time");
+
+// Magic of a saved state
+#define WARM_STATE_MAGIC 0x57524D53
+
+// The state saved by the last loop pass. Not cleared at start up, see warm_start.h.
+DMAMEM static WarmState savedState __attribute__((aligned(32)));
+
+static const char *resetCauseNames[] = {"power on", "watchdog", "software", "other"};
+
+#if defined(__IMXRT1062__)
+
+FLASHMEM void initWatchdog()
+{
+    #if ENABLE_WATCHDOG
+    // No power down counter, no software reset nor WDOG_B output, only the timeout reset
+    WDOG1_WMCR = 0;
+    WDOG1_WCR = WDOG_WCR_WT(WATCHDOG_TIMEOUT_MS / 500 - 1) | WDOG_WCR_SRS | WDOG_WCR_WDA | WDOG_WCR_WDE;
+    #endif
+}
+
+void feedWatchdog()
+{
+    #if ENABLE_WATCHDOG
+    WDOG1_WSR = 0x5555;
+    WDOG1_WSR = 0xAAAA;
+    #endif
+}
+
+static bool resetCauseRead = false;
+static uint8_t resetCause;
+
+// Read the reset cause bits, and clear them for the next reset
+static uint8_t readResetCause()
+{
+    uint32_t srsr = SRC_SRSR;
+
+    SRC_SRSR = srsr;
+    if (srsr & SRC_SRSR_IPP_RESET_B)
+        return RESET_CAUSE_POWER_ON;
+    if (srsr & (SRC_SRSR_WDOG_RST_B | SRC_SRSR_WDOG3_RST_B))
+        return RESET_CAUSE_WATCHDOG;
+    if (srsr & SRC_SRSR_LOCKUP_SYSRESETREQ)
+        return RESET_CAUSE_SOFTWARE;
+    return RESET_CAUSE_OTHER;
+}
+
+uint8_t getResetCause()
+{
+    if (!resetCauseRead) {
+        resetCause = readResetCause();
+        resetCauseRead = true;
+    }
+    return resetCause;
+}
+
+// Make sure the saved state is in the RAM, not only in the data cache
+static inline void writeBackState()
+{
+    arm_dcache_flush(&savedState, sizeof(WarmState));
+}
+
+FLASHMEM void printCrashReport()
+{
+    if (CrashReport)
+        Serial.print(CrashReport);
+    else
+        Serial.println("no crash report");
+}
+
+#else
+
+// On the host, the watchdog the replay tool runs and the reset cause it sets
+bool hostWatchdogRunning = false;
+uint32_t hostWatchdogFedMs;
+uint8_t hostResetCause = RESET_CAUSE_POWER_ON;
+
+void initWatchdog()
+{
+    hostWatchdogRunning = ENABLE_WATCHDOG;
+    hostWatchdogFedMs = millis();
+}
+
+void feedWatchdog()
+{
+    hostWatchdogFedMs = millis();
+}
+
+uint8_t getResetCause()
+{
+    return hostResetCause;
+}
+
+static inline void writeBackState()
+{
+}
+
+void printCrashReport()
+{
+    Serial.println("no crash report on the host");
+}
+
+#endif
+
+const char *getResetCauseName(uint8_t cause)
+{
+    return cause <= RESET_CAUSE_OTHER ? resetCauseNames[cause] : "?";
+}
+
+// FNV-1a hash of the state, seeded with the build time so a new firmware never takes the state
+// of the last one
+static uint32_t hashWarmState(const WarmState &state)
+{
+    const char *build = __DATE__ " " __TIME__;
+    const uint8_t *bytes = (const uint8_t *)&state;
+    uint32_t hash = 2166136261u;
+
+    while (*build)
+        hash = (hash ^ (uint8_t)*build++) * 16777619u;
+    for (size_t i = 0; i < offsetof(WarmState, checksum); i++)
+        hash = (hash ^ bytes[i]) * 16777619u;
+    return hash;
+}
+
+void saveWarmState(WarmState &state)
+{
+    #if ENABLE_WATCHDOG
+    state.magic = WARM_STATE_MAGIC;
+    state.checksum = hashWarmState(state);
+    memcpy(&savedState, &state, sizeof(WarmState));
+    writeBackState();
+    #endif
+}
+
+FLASHMEM bool loadWarmState(WarmState &state)
+{
+    #if ENABLE_WATCHDOG
+    if (getResetCause() == RESET_CAUSE_POWER_ON)
+        return false;
+    if (savedState.magic != WARM_STATE_MAGIC || savedState.checksum != hashWarmState(savedState))
+        return false;
+    // A warm restart that didn't last: the state may be what makes the firmware crash
+    if (savedState.warm && savedState.saved_ms < WARM_START_MIN_RUN_MS)
+        return false;
+
+    memcpy(&state, &savedState, sizeof(WarmState));
+    return true;
+    #else
+    return false;
+    #endif
+}
@@ -0,0 +1,92 @@
+/*
+ * Watchdog and warm restart for the RX-8 Ashtray Gauges project.
+ * The watchdog (WDOG1 of the i.MX RT) resets the Teensy when the loop stops feeding it for
+ * WATCHDOG_TIMEOUT_MS, e.g. stuck on an I2C bus or in a fault handler. It's started at the end
+ * of setup() and fed once per loop pass: the longest pass is the engine off one, POWER_OFF_PERIOD_MS.
+ *
+ * A reset shouldn't cost the intro and the sensors learning again what they knew. Every loop pass
+ * saves a small snapshot of the state (WarmState: the channel filters and health, the thermistor
+ * references, the power state and its statistics, the alert latches) in a RAM the Teensy core
+ * doesn't clear at start up (DMAMEM, written through to the RAM past the data cache). After a
+ * reset that didn't remove the power, setup() finds it, skips the intro, and the first loop pass
+ * has valid readings and the alerts that were on. A snapshot is only used if its checksum holds,
+ * and if the power up it was saved from didn't itself come from a warm restart that lasted less
+ * than WARM_START_MIN_RUN_MS: a state that makes the firmware crash gets a cold start.
+ *
+ * The Teensy core keeps what its fault handler found (CrashReport) in the same kind of RAM. It's
+ * left alone at start up, printing it clears it: the serial command "crash" prints it, with the
+ * cause of the last reset and the warm restarts since the last cold start.
+ * BSD tree clause licence (SPDX: BSD-3-Clause)
+*/
+
+#ifndef WARM_START_H
+#define WARM_START_H
+
+#include <stdint.h>
+#include "alert.h"
+#include "gauge_channel.h"
+#include "power_state.h"
+#include "sensor_health.h"
+
+// Set this to 0 to run without the watchdog, and always start cold
+#define ENABLE_WATCHDOG 1
+
+// Time without feeding before the watchdog resets the Teensy, in milliseconds: a multiple of 500
+// from 500 to 128000
+#define WATCHDOG_TIMEOUT_MS 2000
+
+// A warm restart that runs for less than this before the next reset is followed by a cold start,
+// in milliseconds
+#define WARM_START_MIN_RUN_MS 10000
+
+// Cause of the last reset
+#define RESET_CAUSE_POWER_ON 0  // Power up, or a brownout: the RAM is lost
+#define RESET_CAUSE_WATCHDOG 1
+#define RESET_CAUSE_SOFTWARE 2  // Reset request, e.g. by the fault handler or the bootloader
+#define RESET_CAUSE_OTHER 3     // Reset pin, debugger
+
+// State saved for a warm restart
+typedef struct {
+    uint32_t magic;
+    uint32_t saved_ms;                  // millis() of the save, since the power up that saved it
+    bool warm;                          // That power up was a warm restart
+    uint32_t restarts;                  // Warm restarts since the last cold start
+
+    GaugeChannelState channels[GAUGE_CHANNEL_MAX];
+    SensorHealth health[GAUGE_CHANNEL_MAX];
+    bool oil_reference_high;            // Thermistor references
+    bool coolant_reference_high;
+    PowerState power;
+    AlertLatches alerts;
+
+    uint32_t checksum;
+} WarmState;
+
+// Start the watchdog. It can't be stopped until the next reset.
+void initWatchdog();
+
+// Tell the watchdog the loop still runs. Call this once per loop pass.
+void feedWatchdog();
+
+// Get the cause of the last reset
+// Return: A RESET_CAUSE_* cause
+uint8_t getResetCause();
+
+// Get the name of a reset cause
+// cause: A RESET_CAUSE_* cause
+// Return: "power on", "watchdog", "software", "other"
+const char *getResetCauseName(uint8_t cause);
+
+// Save the state for a warm restart. Call this once per loop pass.
+// state: The state, its magic and checksum are set here
+void saveWarmState(WarmState &state);
+
+// Get the state saved before the last reset, if it's usable
+// state: Receives the state
+// Return: True for a warm restart, false for a cold start (the state is then left as is)
+bool loadWarmState(WarmState &state);
+
+// Print the crash report of the Teensy core on the serial port, and clear it
+void printCrashReport();
+
+#endif